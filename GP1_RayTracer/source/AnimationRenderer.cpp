@@ -0,0 +1,153 @@
+#include "AnimationRenderer.h"
+
+//Standard includes
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+//Project includes
+#include "Benchmark.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include "Timer.h"
+
+namespace dae
+{
+	AnimationRenderer::AnimationRenderer(int width, int height, const AnimationOptions& options) :
+		m_Width{ width },
+		m_Height{ height },
+		m_Options{ options }
+	{
+		if (m_Options.framesPerSecond <= 0.f) m_Options.framesPerSecond = 30.f;
+	}
+
+	bool AnimationRenderer::Render(const std::string& sceneName)
+	{
+		// A count from the options is used as is (up to the number of frames), the measured one stays within the cores, every frame in flight holds a copy of the scene
+		const uint32_t maxFramesInFlight{ std::max(std::min(m_Options.numFramesInFlight > 0 ? m_Options.numFramesInFlight : std::thread::hardware_concurrency(), m_Options.numFrames), 1u) };
+
+		// What a frame in flight renders with, the first scene writes the snapshot, the others only load it
+		struct Slot
+		{
+			std::unique_ptr<Scene> pScene{};
+			std::unique_ptr<Renderer> pRenderer{};
+		};
+		std::vector<Slot> slots{};
+
+		const std::string directory{ m_Options.directory.empty() ? "Resources/Animation/" + std::filesystem::path{ sceneName }.stem().string() : m_Options.directory };
+		std::error_code error{};
+		std::filesystem::create_directories(directory, error);
+
+		std::atomic<uint32_t> nextFrame{ 0 };
+		std::atomic<bool> hasFailed{ false };
+		std::mutex outputMutex{};
+
+		// False when the scene could not be loaded
+		const auto addSlots{ [&](uint32_t numSlots)
+			{
+				while (slots.size() < numSlots)
+				{
+					Slot& slot{ slots.emplace_back() };
+					slot.pScene = Benchmark::LoadScene(sceneName);
+					if (!slot.pScene) return false;
+
+					// Every frame traces every pixel, the previous frame of a renderer is a different number of frames back depending on the frames in flight
+					slot.pRenderer = Benchmark::CreateRenderer(m_Width, m_Height);
+				}
+				return true;
+			} };
+
+		// Frames up to endFrame, one task per frame in flight, each takes the next frame that is not taken yet so a slow frame doesn't hold up the others
+		// Returns the frames per second
+		const auto renderFrames{ [&](uint32_t numFramesInFlight, uint32_t endFrame)
+			{
+				const uint32_t firstFrame{ nextFrame };
+				const float time{ Benchmark::Measure([&]()
+					{
+						std::vector<std::future<void>> tasks{};
+						for (uint32_t slotIndex{ 0 }; slotIndex < numFramesInFlight; ++slotIndex)
+						{
+							tasks.push_back(std::async(std::launch::async, [&, slotIndex]()
+								{
+									Scene* pScene{ slots[slotIndex].pScene.get() };
+									Renderer& renderer{ *slots[slotIndex].pRenderer };
+									Timer timer{};
+
+									for (uint32_t frame{ nextFrame++ }; frame < endFrame; frame = nextFrame++)
+									{
+										const float frameTimeSeconds{ m_Options.startTime + static_cast<float>(frame) / m_Options.framesPerSecond };
+										timer.SetFixedTime(frameTimeSeconds);
+										pScene->Update(&timer);
+
+										const float frameTime{ Benchmark::Measure([&]() { renderer.Render(pScene); }) };
+
+										const std::string path{ GetFramePath(directory, frame) };
+										const bool isWritten{ !renderer.SaveBufferToImage(path) };
+										if (!isWritten) hasFailed = true;
+
+										const std::lock_guard lock{ outputMutex };
+										std::cout << "Frame " << frame << " at " << frameTimeSeconds << "s: " << frameTime << "ms" << (isWritten ? "" : " | could not write " + path) << '\n';
+									}
+								}));
+						}
+
+						for (std::future<void>& task : tasks)
+						{
+							task.get();
+						}
+					}) };
+
+				// Every task took one frame past endFrame before it stopped
+				nextFrame = endFrame;
+				return static_cast<float>(endFrame - firstFrame) * 1000.f / std::max(time, 1e-3f);
+			} };
+
+		const auto start{ std::chrono::steady_clock::now() };
+
+		// Doubles the frames in flight while that gives at least 10% more frames per second, every step renders two frames per frame in flight
+		// The frames rendered while measuring are part of the animation
+		uint32_t numFramesInFlight{ maxFramesInFlight };
+		if (m_Options.numFramesInFlight == 0 && m_Options.numFrames > 0)
+		{
+			numFramesInFlight = 1;
+			if (!addSlots(1)) return false;
+			float framesPerSecond{ renderFrames(1, std::min(2u, m_Options.numFrames)) };
+
+			for (uint32_t tryFramesInFlight{ 2 }; tryFramesInFlight <= maxFramesInFlight && nextFrame + 2 * tryFramesInFlight <= m_Options.numFrames; tryFramesInFlight *= 2)
+			{
+				if (!addSlots(tryFramesInFlight)) return false;
+				const float tryFramesPerSecond{ renderFrames(tryFramesInFlight, nextFrame + 2 * tryFramesInFlight) };
+				if (tryFramesPerSecond < framesPerSecond * 1.1f) break;
+
+				numFramesInFlight = tryFramesInFlight;
+				framesPerSecond = tryFramesPerSecond;
+			}
+			std::cout << "Measured " << numFramesInFlight << " frames in flight at " << framesPerSecond << " frames/s\n";
+		}
+
+		if (!addSlots(numFramesInFlight)) return false;
+		renderFrames(numFramesInFlight, m_Options.numFrames);
+
+		const float totalTime{ std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count() };
+		std::cout << m_Options.numFrames << " frames in " << totalTime << "s with " << numFramesInFlight << " in flight | "
+			<< static_cast<float>(m_Options.numFrames) / totalTime << " frames/s | written to " << directory << '\n';
+
+		return !hasFailed;
+	}
+
+	std::string AnimationRenderer::GetFramePath(const std::string& directory, uint32_t frame) const
+	{
+		std::ostringstream path{};
+		path << directory << "/frame_" << std::setw(4) << std::setfill('0') << frame << ".bmp";
+		return path.str();
+	}
+}
@@ -1,8 +1,103 @@
 #pragma once
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
 #include "Math.h"
 
 namespace dae::BRDF
 {
+#pragma region Math Policies
+	// Reference math, exactly what the BRDFs always used
+	struct PreciseMath
+	{
+		static float Pow(float x, float exponent) { return powf(x, exponent); }
+		static float Pow5(float x) { return powf(x, 5.f); }
+		static float Divide(float a, float b) { return a / b; }
+		static ColorRGB Divide(const ColorRGB& a, float b) { return ColorRGB{ a } / b; }
+		static Vector3 Normalized(const Vector3& v) { return v.Normalized(); }
+	};
+
+	// Approximations for the shading hot path, RayTracer --regression fails when the error they introduce grows (see Renderer::MeasureFastMathError)
+	struct FastMath
+	{
+		// Exponent from the float bits, atanh series on the mantissa folded to [sqrt(.5), sqrt(2)), x > 0
+		static float Log2(float x)
+		{
+			int32_t bits{};
+			std::memcpy(&bits, &x, sizeof(bits));
+
+			float exponent{ static_cast<float>(((bits >> 23) & 0xFF) - 127) };
+			bits = (bits & 0x007FFFFF) | 0x3F800000;
+
+			float mantissa{};
+			std::memcpy(&mantissa, &bits, sizeof(mantissa));
+			if (mantissa > 1.41421356f)
+			{
+				mantissa *= .5f;
+				exponent += 1.f;
+			}
+
+			const float t{ (mantissa - 1.f) / (mantissa + 1.f) };
+			const float t2{ t * t };
+			return exponent + t * (2.88539008f + t2 * (.961796694f + t2 * (.577078016f + t2 * .412198583f)));
+		}
+
+		// Integer part straight into the exponent bits, polynomial for the fraction in [-.5, .5]
+		static float Exp2(float x)
+		{
+			x = std::clamp(x, -126.f, 127.f);
+
+			const int32_t integer{ static_cast<int32_t>(x + (x < 0.f ? -.5f : .5f)) };
+			const float f{ x - static_cast<float>(integer) };
+			const float fraction{ 1.f + f * (.693147181f + f * (.240226507f + f * (.0555041087f + f * (.00961812911f + f * .00133335581f)))) };
+
+			const int32_t bits{ (integer + 127) << 23 };
+			float scale{};
+			std::memcpy(&scale, &bits, sizeof(scale));
+
+			return fraction * scale;
+		}
+
+		// Only defined for x >= 0, anything below returns 0
+		static float Pow(float x, float exponent)
+		{
+			if (x <= 0.f) return 0.f;
+			return Exp2(exponent * Log2(x));
+		}
+
+		static float Pow5(float x)
+		{
+			const float x2{ x * x };
+			return x2 * x2 * x;
+		}
+
+		// Hardware estimate refined with one Newton-Raphson step
+		static float Reciprocal(float x)
+		{
+#ifdef USE_SSE
+			const float y{ _mm_cvtss_f32(_mm_rcp_ss(_mm_set_ss(x))) };
+			return y * (2.f - x * y);
+#else
+			return 1.f / x;
+#endif
+		}
+
+		static float InvSqrt(float x)
+		{
+#ifdef USE_SSE
+			const float y{ _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x))) };
+			return y * (1.5f - .5f * x * y * y);
+#else
+			return 1.f / sqrtf(x);
+#endif
+		}
+
+		static float Divide(float a, float b) { return a * Reciprocal(b); }
+		static ColorRGB Divide(const ColorRGB& a, float b) { return a * Reciprocal(b); }
+		static Vector3 Normalized(const Vector3& v) { return v * InvSqrt(Vector3::Dot(v, v)); }
+	};
+#pragma endregion
+
 	/**
 	 * \param kd Diffuse Reflection Coefficient
 	 * \param cd Diffuse Color
@@ -26,10 +121,11 @@ namespace dae::BRDF
 	 * \param n Normal of the Surface
 	 * \return Phong Specular Color
 	 */
+	template<typename Math = PreciseMath>
 	static ColorRGB Phong(const float& ks, const float& exp, const Vector3& l, const Vector3& v, const Vector3& n)
 	{
 		// Why Vector3::Reflect(n, l) and not Vector3::Reflect(l, n)?
-		const float phong{ ks * powf(Vector3::Dot(Vector3::Reflect(n, l), v), exp) };
+		const float phong{ ks * Math::Pow(Vector3::Dot(Vector3::Reflect(n, l), v), exp) };
 
 		if (phong < 0.f) return {}; // Is this normal?
 
@@ -43,9 +139,23 @@ namespace dae::BRDF
 	 * \param f0 Base reflectivity of a surface based on IOR (Indices Of Refrection), this is different for Dielectrics (Non-Metal) and Conductors (Metal)
 	 * \return
 	 */
+	template<typename Math = PreciseMath>
 	static ColorRGB FresnelFunction_Schlick(const Vector3& h, const Vector3& v, const ColorRGB& f0)
 	{
-		return f0 + (colors::White - f0) * powf(1.f - std::max(Vector3::Dot(h, v), 0.f), 5.f);
+		return f0 + (colors::White - f0) * Math::Pow5(1.f - std::max(Vector3::Dot(h, v), 0.f));
+	}
+
+	/**
+	 * \brief BRDF NormalDistribution >> Trowbridge-Reitz GGX with a precomputed a2
+	 * \param a2 squared(squared(roughness))
+	 */
+	template<typename Math = PreciseMath>
+	static float NormalDistribution_GGX_Precomputed(const Vector3& n, const Vector3& h, float a2)
+	{
+		const float nDotH{ std::max(Vector3::Dot(n, h), 0.f) };
+
+		const float denominator{ (nDotH * nDotH) * (a2 - 1.f) + 1.f };
+		return Math::Divide(a2, static_cast<float>(M_PI) * (denominator * denominator));
 	}
 
 	/**
@@ -58,10 +168,19 @@ namespace dae::BRDF
 	static float NormalDistribution_GGX(const Vector3& n, const Vector3& h, const float& roughness)
 	{
 		const float a2{ (roughness * roughness) * (roughness * roughness) };
-		const float nDotH{ std::max(Vector3::Dot(n, h), 0.f) };
+		return NormalDistribution_GGX_Precomputed(n, h, a2);
+	}
 
-		const float denominator{ (nDotH * nDotH) * (a2 - 1.f) + 1.f };
-		return a2 / (static_cast<float>(M_PI) * (denominator * denominator));
+	/**
+	 * \brief BRDF Geometry Function >> Schlick GGX with a precomputed k
+	 * \param k (squared(roughness) + 1)^2 / 8 for direct lighting
+	 */
+	template<typename Math = PreciseMath>
+	static float GeometryFunction_SchlickGGX_Precomputed(const Vector3& n, const Vector3& v, float k)
+	{
+		const float nDotV{ std::max(Vector3::Dot(n, v), 0.f) };
+
+		return Math::Divide(nDotV, nDotV * (1.f - k) + k);
 	}
 
 	/**
@@ -77,9 +196,7 @@ namespace dae::BRDF
 		const float a{ roughness * roughness };
 		const float k{ (a + 1.f) * (a + 1.f) / 8.f };
 
-		const float nDotV{ std::max(Vector3::Dot(n, v), 0.f) };
-
-		return nDotV / (nDotV * (1.f - k) + k);
+		return GeometryFunction_SchlickGGX_Precomputed(n, v, k);
 	}
 
 	/**
@@ -94,4 +211,175 @@ namespace dae::BRDF
 	{
 		return GeometryFunction_SchlickGGX(n, v, roughness) * GeometryFunction_SchlickGGX(n, l, roughness);
 	}
+
+	/**
+	 * \brief BRDF Geometry Function >> Smith with a precomputed k
+	 */
+	template<typename Math = PreciseMath>
+	static float GeometryFunction_Smith_Precomputed(const Vector3& n, const Vector3& v, const Vector3& l, float k)
+	{
+		return GeometryFunction_SchlickGGX_Precomputed<Math>(n, v, k) * GeometryFunction_SchlickGGX_Precomputed<Math>(n, l, k);
+	}
+
+#ifdef USE_SSE
+#pragma region SIMD
+	// Same BRDFs for 4 shading points at once (structure of arrays), always with the FastMath approximations
+	namespace SIMD
+	{
+		struct Vector3x4
+		{
+			__m128 x{};
+			__m128 y{};
+			__m128 z{};
+		};
+
+		struct ColorRGBx4
+		{
+			__m128 r{};
+			__m128 g{};
+			__m128 b{};
+		};
+
+		inline Vector3x4 Load(const Vector3 (&v)[4])
+		{
+			return
+			{
+				_mm_setr_ps(v[0].x, v[1].x, v[2].x, v[3].x),
+				_mm_setr_ps(v[0].y, v[1].y, v[2].y, v[3].y),
+				_mm_setr_ps(v[0].z, v[1].z, v[2].z, v[3].z)
+			};
+		}
+
+		inline __m128 Dot(const Vector3x4& a, const Vector3x4& b)
+		{
+			return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, b.x), _mm_mul_ps(a.y, b.y)), _mm_mul_ps(a.z, b.z));
+		}
+
+		inline __m128 Dot(const Vector3x4& a, const Vector3& b)
+		{
+			return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.x, _mm_set1_ps(b.x)), _mm_mul_ps(a.y, _mm_set1_ps(b.y))), _mm_mul_ps(a.z, _mm_set1_ps(b.z)));
+		}
+
+		inline __m128 Select(__m128 mask, __m128 a, __m128 b)
+		{
+			return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+		}
+
+		inline __m128 Reciprocal(__m128 x)
+		{
+			const __m128 y{ _mm_rcp_ps(x) };
+			return _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(2.f), _mm_mul_ps(x, y)));
+		}
+
+		inline __m128 Divide(__m128 a, __m128 b)
+		{
+			return _mm_mul_ps(a, Reciprocal(b));
+		}
+
+		inline Vector3x4 Normalized(const Vector3x4& v)
+		{
+			const __m128 sqrMagnitude{ Dot(v, v) };
+			__m128 invMagnitude{ _mm_rsqrt_ps(sqrMagnitude) };
+			invMagnitude = _mm_mul_ps(invMagnitude, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(.5f), sqrMagnitude), _mm_mul_ps(invMagnitude, invMagnitude))));
+
+			return { _mm_mul_ps(v.x, invMagnitude), _mm_mul_ps(v.y, invMagnitude), _mm_mul_ps(v.z, invMagnitude) };
+		}
+
+		// See FastMath::Log2, x > 0
+		inline __m128 Log2(__m128 x)
+		{
+			const __m128i bits{ _mm_castps_si128(x) };
+
+			__m128 exponent{ _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127))) };
+			__m128 mantissa{ _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F800000))) };
+
+			const __m128 fold{ _mm_cmpgt_ps(mantissa, _mm_set1_ps(1.41421356f)) };
+			mantissa = Select(fold, _mm_mul_ps(mantissa, _mm_set1_ps(.5f)), mantissa);
+			exponent = _mm_add_ps(exponent, _mm_and_ps(fold, _mm_set1_ps(1.f)));
+
+			const __m128 one{ _mm_set1_ps(1.f) };
+			const __m128 t{ _mm_div_ps(_mm_sub_ps(mantissa, one), _mm_add_ps(mantissa, one)) };
+			const __m128 t2{ _mm_mul_ps(t, t) };
+
+			__m128 polynomial{ _mm_set1_ps(.412198583f) };
+			polynomial = _mm_add_ps(_mm_mul_ps(polynomial, t2), _mm_set1_ps(.577078016f));
+			polynomial = _mm_add_ps(_mm_mul_ps(polynomial, t2), _mm_set1_ps(.961796694f));
+			polynomial = _mm_add_ps(_mm_mul_ps(polynomial, t2), _mm_set1_ps(2.88539008f));
+
+			return _mm_add_ps(exponent, _mm_mul_ps(t, polynomial));
+		}
+
+		// See FastMath::Exp2
+		inline __m128 Exp2(__m128 x)
+		{
+			x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-126.f)), _mm_set1_ps(127.f));
+
+			const __m128i integer{ _mm_cvtps_epi32(x) }; // Rounds to nearest
+			const __m128 f{ _mm_sub_ps(x, _mm_cvtepi32_ps(integer)) };
+
+			__m128 fraction{ _mm_set1_ps(.00133335581f) };
+			fraction = _mm_add_ps(_mm_mul_ps(fraction, f), _mm_set1_ps(.00961812911f));
+			fraction = _mm_add_ps(_mm_mul_ps(fraction, f), _mm_set1_ps(.0555041087f));
+			fraction = _mm_add_ps(_mm_mul_ps(fraction, f), _mm_set1_ps(.240226507f));
+			fraction = _mm_add_ps(_mm_mul_ps(fraction, f), _mm_set1_ps(.693147181f));
+			fraction = _mm_add_ps(_mm_mul_ps(fraction, f), _mm_set1_ps(1.f));
+
+			const __m128 scale{ _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(integer, _mm_set1_epi32(127)), 23)) };
+			return _mm_mul_ps(fraction, scale);
+		}
+
+		inline __m128 Pow(__m128 x, float exponent)
+		{
+			const __m128 positive{ _mm_cmpgt_ps(x, _mm_setzero_ps()) };
+			const __m128 safeX{ _mm_max_ps(x, _mm_set1_ps(FLT_MIN)) };
+			return _mm_and_ps(positive, Exp2(_mm_mul_ps(_mm_set1_ps(exponent), Log2(safeX))));
+		}
+
+		inline __m128 Pow5(__m128 x)
+		{
+			const __m128 x2{ _mm_mul_ps(x, x) };
+			return _mm_mul_ps(_mm_mul_ps(x2, x2), x);
+		}
+
+		inline __m128 Phong(float ks, float exp, const Vector3x4& l, const Vector3& v, const Vector3& n)
+		{
+			// Reflect(n, l) = n - 2 * dot(n, l) * l
+			const __m128 twoNDotL{ _mm_mul_ps(_mm_set1_ps(2.f), Dot(l, n)) };
+			const Vector3x4 reflected
+			{
+				_mm_sub_ps(_mm_set1_ps(n.x), _mm_mul_ps(twoNDotL, l.x)),
+				_mm_sub_ps(_mm_set1_ps(n.y), _mm_mul_ps(twoNDotL, l.y)),
+				_mm_sub_ps(_mm_set1_ps(n.z), _mm_mul_ps(twoNDotL, l.z))
+			};
+
+			return _mm_mul_ps(_mm_set1_ps(ks), Pow(Dot(reflected, v), exp));
+		}
+
+		inline ColorRGBx4 FresnelFunction_Schlick(const Vector3x4& h, const Vector3& v, const ColorRGB& f0)
+		{
+			const __m128 weight{ Pow5(_mm_sub_ps(_mm_set1_ps(1.f), _mm_max_ps(Dot(h, v), _mm_setzero_ps()))) };
+			return
+			{
+				_mm_add_ps(_mm_set1_ps(f0.r), _mm_mul_ps(_mm_set1_ps(1.f - f0.r), weight)),
+				_mm_add_ps(_mm_set1_ps(f0.g), _mm_mul_ps(_mm_set1_ps(1.f - f0.g), weight)),
+				_mm_add_ps(_mm_set1_ps(f0.b), _mm_mul_ps(_mm_set1_ps(1.f - f0.b), weight))
+			};
+		}
+
+		inline __m128 NormalDistribution_GGX_Precomputed(const Vector3& n, const Vector3x4& h, float a2)
+		{
+			const __m128 nDotH{ _mm_max_ps(Dot(h, n), _mm_setzero_ps()) };
+
+			const __m128 denominator{ _mm_add_ps(_mm_mul_ps(_mm_mul_ps(nDotH, nDotH), _mm_set1_ps(a2 - 1.f)), _mm_set1_ps(1.f)) };
+			return Divide(_mm_set1_ps(a2), _mm_mul_ps(_mm_set1_ps(static_cast<float>(M_PI)), _mm_mul_ps(denominator, denominator)));
+		}
+
+		inline __m128 GeometryFunction_SchlickGGX_Precomputed(__m128 nDotV, float k)
+		{
+			nDotV = _mm_max_ps(nDotV, _mm_setzero_ps());
+			return Divide(nDotV, _mm_add_ps(_mm_mul_ps(nDotV, _mm_set1_ps(1.f - k)), _mm_set1_ps(k)));
+		}
+	}
+#pragma endregion
+#endif
 }
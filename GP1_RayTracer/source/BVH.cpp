@@ -0,0 +1,555 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+
+#include "Parallel.h"
+
+namespace dae
+{
+	namespace
+	{
+		float SurfaceArea(const Vector3& minAABB, const Vector3& maxAABB)
+		{
+			const Vector3 extent{ maxAABB - minAABB };
+			return 2.f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+		}
+
+		float SurfaceArea(const BVHNode& node)
+		{
+			return SurfaceArea(node.minAABB, node.maxAABB);
+		}
+
+		// function(begin, end) for consecutive ranges of chunkSize covering [first, first + count), on all cores when there is more than one
+		template<typename Function>
+		void ForEachChunk(uint32_t first, uint32_t count, uint32_t chunkSize, const Function& function)
+		{
+			const uint32_t numChunks{ (count + chunkSize - 1) / chunkSize };
+			if (numChunks <= 1)
+			{
+				function(first, first + count);
+				return;
+			}
+
+			concurrency::parallel_for(0u, numChunks, [&](uint32_t chunk)
+				{
+					const uint32_t begin{ first + chunk * chunkSize };
+					function(begin, std::min(begin + chunkSize, first + count));
+				});
+		}
+
+		// Conservative 8 bit quantization, the decoded box always contains the original one
+		uint8_t QuantizeMin(float value, float origin, float scale)
+		{
+			if (scale <= 0.f) return 0;
+
+			float q{ std::floor((value - origin) / scale) };
+			q = std::clamp(q, 0.f, 255.f);
+			if (origin + q * scale > value && q > 0.f) --q;
+
+			return static_cast<uint8_t>(q);
+		}
+
+		uint8_t QuantizeMax(float value, float origin, float scale)
+		{
+			if (scale <= 0.f) return 0;
+
+			float q{ std::ceil((value - origin) / scale) };
+			q = std::clamp(q, 0.f, 255.f);
+			if (origin + q * scale < value && q < 255.f) ++q;
+
+			return static_cast<uint8_t>(q);
+		}
+	}
+
+	void BVH::Build(const std::vector<Vector3>& positions, const std::vector<int>& indices, BVHLayout layout)
+	{
+		Clear();
+		if (layout == BVHLayout::None || indices.empty()) return;
+
+		const uint32_t numTriangles{ static_cast<uint32_t>(indices.size() / 3) };
+
+		m_BuildTriangles.resize(numTriangles);
+		ForEachChunk(0, numTriangles, m_ChunkSize, [&](uint32_t begin, uint32_t end)
+			{
+				for (uint32_t i{ begin }; i < end; ++i)
+				{
+					const Vector3& v0{ positions[indices[i * 3]] };
+					const Vector3& v1{ positions[indices[i * 3 + 1]] };
+					const Vector3& v2{ positions[indices[i * 3 + 2]] };
+					m_BuildTriangles[i] = { Vector3::Min(v0, Vector3::Min(v1, v2)), i, Vector3::Max(v0, Vector3::Max(v1, v2)) };
+				}
+			});
+
+		if (numTriangles >= m_ParallelBinningSize) m_PartitionBuffer.resize(numTriangles);
+
+		// A binary tree never has more than 2n - 1 nodes, with the array sized up front threads can fill in children without locking
+		m_Nodes.resize(2 * static_cast<size_t>(numTriangles) - 1);
+
+		const Bin bounds{ GetBounds(0, numTriangles) };
+		m_Nodes[0] = { bounds.minAABB, 0, bounds.maxAABB, numTriangles };
+
+		std::atomic<uint32_t> numNodes{ 1 };
+		Subdivide(0, 0, bounds.centroidMin, bounds.centroidMax, numNodes);
+
+		m_Nodes.resize(numNodes);
+		SortNodes();
+
+		m_TriangleIndices.resize(numTriangles);
+		ForEachChunk(0, numTriangles, m_ChunkSize, [&](uint32_t begin, uint32_t end)
+			{
+				for (uint32_t i{ begin }; i < end; ++i) m_TriangleIndices[i] = m_BuildTriangles[i].index;
+			});
+
+		m_BuildTriangles.clear();
+		m_BuildTriangles.shrink_to_fit();
+		m_PartitionBuffer.clear();
+		m_PartitionBuffer.shrink_to_fit();
+
+		if (!BuildQuantizedNodes() && layout == BVHLayout::Quantized)
+		{
+			std::cout << "BVH: " << numTriangles << " triangles is more than a quantized BVH can hold (" << MaxQuantizedTriangles << "), using the binary layout\n";
+			layout = BVHLayout::Binary;
+		}
+
+		m_BinaryMemoryUsage = m_Nodes.size() * sizeof(BVHNode) + m_TriangleIndices.size() * sizeof(uint32_t);
+		m_QuantizedMemoryUsage = m_QuantizedNodes.empty() ? 0 : m_QuantizedNodes.size() * sizeof(QuantizedBVHNode) + m_TriangleIndices.size() * sizeof(uint32_t);
+
+		// Only keep the layout that will be traversed
+		if (layout == BVHLayout::Quantized)
+		{
+			m_Nodes.clear();
+			m_Nodes.shrink_to_fit();
+		}
+		else
+		{
+			m_QuantizedNodes.clear();
+			m_QuantizedNodes.shrink_to_fit();
+		}
+
+		m_Layout = layout;
+	}
+
+	void BVH::Clear()
+	{
+		m_Layout = BVHLayout::None;
+
+		m_Nodes.clear();
+		m_QuantizedNodes.clear();
+		m_TriangleIndices.clear();
+
+		m_BinaryMemoryUsage = 0;
+		m_QuantizedMemoryUsage = 0;
+	}
+
+	void BVH::Restore(BVHLayout layout, std::vector<BVHNode>&& nodes, std::vector<QuantizedBVHNode>&& quantizedNodes, std::vector<uint32_t>&& triangleIndices,
+		size_t binaryMemoryUsage, size_t quantizedMemoryUsage)
+	{
+		Clear();
+
+		m_Nodes = std::move(nodes);
+		m_QuantizedNodes = std::move(quantizedNodes);
+		m_TriangleIndices = std::move(triangleIndices);
+
+		m_BinaryMemoryUsage = binaryMemoryUsage;
+		m_QuantizedMemoryUsage = quantizedMemoryUsage;
+
+		m_Layout = layout;
+	}
+
+	size_t BVH::GetMemoryUsage() const
+	{
+		return m_Nodes.size() * sizeof(BVHNode) + m_QuantizedNodes.size() * sizeof(QuantizedBVHNode) + m_TriangleIndices.size() * sizeof(uint32_t);
+	}
+
+	void BVH::PrintStatistics() const
+	{
+		constexpr float toKB{ 1.f / 1024.f };
+
+		std::cout << "BVH: " << m_TriangleIndices.size() << " triangles"
+			<< " | binary " << static_cast<float>(m_BinaryMemoryUsage) * toKB << "KB"
+			<< " | quantized " << static_cast<float>(m_QuantizedMemoryUsage) * toKB << "KB"
+			<< " | in use " << static_cast<float>(GetMemoryUsage()) * toKB << "KB\n";
+	}
+
+	Vector3 BVH::GetCentroid(const BuildTriangle& triangle)
+	{
+		return (triangle.minAABB + triangle.maxAABB) * .5f;
+	}
+
+	int BVH::GetBinIndex(float centroid, float centroidMin, float binScale)
+	{
+		// The largest centroid lands exactly on the end of the last bin
+		return std::min(static_cast<int>((centroid - centroidMin) * binScale), m_NumBins - 1);
+	}
+
+	void BVH::AddToBin(Bin& bin, const Bin& other)
+	{
+		bin.minAABB = Vector3::Min(bin.minAABB, other.minAABB);
+		bin.maxAABB = Vector3::Max(bin.maxAABB, other.maxAABB);
+		bin.centroidMin = Vector3::Min(bin.centroidMin, other.centroidMin);
+		bin.centroidMax = Vector3::Max(bin.centroidMax, other.centroidMax);
+		bin.triangleCount += other.triangleCount;
+	}
+
+	BVH::Bin BVH::GetBounds(uint32_t first, uint32_t count) const
+	{
+		std::vector<Bin> chunkBounds((count + m_ChunkSize - 1) / m_ChunkSize);
+		ForEachChunk(first, count, m_ChunkSize, [&](uint32_t begin, uint32_t end)
+			{
+				Bin& bounds{ chunkBounds[(begin - first) / m_ChunkSize] };
+				for (uint32_t i{ begin }; i < end; ++i)
+				{
+					const BuildTriangle& triangle{ m_BuildTriangles[i] };
+					const Vector3 centroid{ GetCentroid(triangle) };
+					bounds.minAABB = Vector3::Min(bounds.minAABB, triangle.minAABB);
+					bounds.maxAABB = Vector3::Max(bounds.maxAABB, triangle.maxAABB);
+					bounds.centroidMin = Vector3::Min(bounds.centroidMin, centroid);
+					bounds.centroidMax = Vector3::Max(bounds.centroidMax, centroid);
+				}
+				bounds.triangleCount = end - begin;
+			});
+
+		Bin bounds{};
+		for (const Bin& chunk : chunkBounds)
+		{
+			AddToBin(bounds, chunk);
+		}
+		return bounds;
+	}
+
+	void BVH::BinTriangles(uint32_t first, uint32_t count, const Vector3& centroidMin, const Vector3& binScale, Bins& bins) const
+	{
+		for (uint32_t i{ first }; i < first + count; ++i)
+		{
+			const BuildTriangle& triangle{ m_BuildTriangles[i] };
+			const Vector3 centroid{ GetCentroid(triangle) };
+
+			for (int axis{ 0 }; axis < 3; ++axis)
+			{
+				if (binScale[axis] <= 0.f) continue;
+
+				Bin& bin{ bins[axis][GetBinIndex(centroid[axis], centroidMin[axis], binScale[axis])] };
+				bin.minAABB = Vector3::Min(bin.minAABB, triangle.minAABB);
+				bin.maxAABB = Vector3::Max(bin.maxAABB, triangle.maxAABB);
+				bin.centroidMin = Vector3::Min(bin.centroidMin, centroid);
+				bin.centroidMax = Vector3::Max(bin.centroidMax, centroid);
+				++bin.triangleCount;
+			}
+		}
+	}
+
+	void BVH::PartitionTriangles(uint32_t first, uint32_t count, uint32_t leftCount, int axis, int split, float centroidMin, float binScale)
+	{
+		const auto isLeft{ [&](const BuildTriangle& triangle) { return GetBinIndex(GetCentroid(triangle)[axis], centroidMin, binScale) < split; } };
+
+		const auto begin{ m_BuildTriangles.begin() + first };
+		if (count < m_ParallelBinningSize)
+		{
+			[[maybe_unused]] const auto middle{ std::partition(begin, begin + count, isLeft) };
+			assert(static_cast<uint32_t>(middle - begin) == leftCount);
+			return;
+		}
+
+		// Every chunk counts its left triangles, then writes both sides to their place in the buffer, keeping the order within each side
+		const uint32_t numChunks{ (count + m_ChunkSize - 1) / m_ChunkSize };
+		std::vector<uint32_t> chunkLeftCounts(numChunks);
+		ForEachChunk(first, count, m_ChunkSize, [&](uint32_t chunkBegin, uint32_t chunkEnd)
+			{
+				chunkLeftCounts[(chunkBegin - first) / m_ChunkSize] = static_cast<uint32_t>(
+					std::count_if(m_BuildTriangles.begin() + chunkBegin, m_BuildTriangles.begin() + chunkEnd, isLeft));
+			});
+
+		std::vector<uint32_t> chunkLeftOffsets(numChunks);
+		std::exclusive_scan(chunkLeftCounts.begin(), chunkLeftCounts.end(), chunkLeftOffsets.begin(), first);
+
+		ForEachChunk(first, count, m_ChunkSize, [&](uint32_t chunkBegin, uint32_t chunkEnd)
+			{
+				const uint32_t chunk{ (chunkBegin - first) / m_ChunkSize };
+				uint32_t left{ chunkLeftOffsets[chunk] };
+				uint32_t right{ first + leftCount + (chunkBegin - first) - (chunkLeftOffsets[chunk] - first) };
+				for (uint32_t i{ chunkBegin }; i < chunkEnd; ++i)
+				{
+					const BuildTriangle& triangle{ m_BuildTriangles[i] };
+					m_PartitionBuffer[isLeft(triangle) ? left++ : right++] = triangle;
+				}
+			});
+
+		ForEachChunk(first, count, m_ChunkSize, [&](uint32_t chunkBegin, uint32_t chunkEnd)
+			{
+				std::copy(m_PartitionBuffer.begin() + chunkBegin, m_PartitionBuffer.begin() + chunkEnd, m_BuildTriangles.begin() + chunkBegin);
+			});
+	}
+
+	BVH::Split BVH::FindSplit(uint32_t first, uint32_t count, const Vector3& centroidMin, const Vector3& binScale) const
+	{
+		Bins bins{};
+		if (count >= m_ParallelBinningSize)
+		{
+			std::vector<Bins> chunkBins((count + m_ChunkSize - 1) / m_ChunkSize);
+			ForEachChunk(first, count, m_ChunkSize, [&](uint32_t begin, uint32_t end)
+				{
+					BinTriangles(begin, end - begin, centroidMin, binScale, chunkBins[(begin - first) / m_ChunkSize]);
+				});
+
+			for (const Bins& chunk : chunkBins)
+			{
+				for (int axis{ 0 }; axis < 3; ++axis)
+				{
+					for (int i{ 0 }; i < m_NumBins; ++i) AddToBin(bins[axis][i], chunk[axis][i]);
+				}
+			}
+		}
+		else
+		{
+			BinTriangles(first, count, centroidMin, binScale, bins);
+		}
+
+		// Split cost is area times triangle count of both sides, the right sides are summed up from the back first
+		float bestCost{ FLT_MAX };
+		int bestAxis{ -1 };
+		int bestSplit{ 0 };
+		for (int axis{ 0 }; axis < 3; ++axis)
+		{
+			if (binScale[axis] <= 0.f) continue;
+
+			// Small nodes leave most bins empty, those don't change the sums
+			float rightCosts[m_NumBins]{};
+			Bin right{};
+			for (int split{ m_NumBins - 1 }; split > 0; --split)
+			{
+				if (bins[axis][split].triangleCount > 0) AddToBin(right, bins[axis][split]);
+				rightCosts[split] = right.triangleCount > 0 ? SurfaceArea(right.minAABB, right.maxAABB) * static_cast<float>(right.triangleCount) : FLT_MAX;
+			}
+
+			Bin left{};
+			for (int split{ 1 }; split < m_NumBins; ++split)
+			{
+				if (bins[axis][split - 1].triangleCount == 0) continue;
+
+				AddToBin(left, bins[axis][split - 1]);
+				if (rightCosts[split] == FLT_MAX) continue;
+
+				const float cost{ SurfaceArea(left.minAABB, left.maxAABB) * static_cast<float>(left.triangleCount) + rightCosts[split] };
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = split;
+				}
+			}
+		}
+
+		Split split{};
+		if (bestAxis < 0) return split;
+
+		split.axis = bestAxis;
+		split.index = bestSplit;
+		for (int i{ 0 }; i < m_NumBins; ++i)
+		{
+			AddToBin(i < bestSplit ? split.left : split.right, bins[bestAxis][i]);
+		}
+		return split;
+	}
+
+	uint32_t BVH::GetMedianSplitDepth(uint32_t count)
+	{
+		uint32_t depth{ 0 };
+		for (; count > MaxLeafSize; count = (count + 1) / 2) ++depth;
+		return depth;
+	}
+
+	BVH::Split BVH::FindMedianSplit(uint32_t first, uint32_t count, const Vector3& centroidMin, const Vector3& centroidMax)
+	{
+		const Vector3 extent{ centroidMax - centroidMin };
+		const int axis{ extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2) };
+
+		// The right half gets the odd triangle, it never needs more levels than GetMedianSplitDepth counted
+		const uint32_t leftCount{ count / 2 };
+		if (extent[axis] > 0.f)
+		{
+			const auto begin{ m_BuildTriangles.begin() + first };
+			std::nth_element(begin, begin + leftCount, begin + count, [axis](const BuildTriangle& a, const BuildTriangle& b)
+				{
+					const float centroidA{ GetCentroid(a)[axis] };
+					const float centroidB{ GetCentroid(b)[axis] };
+					return centroidA < centroidB || (centroidA == centroidB && a.index < b.index);
+				});
+		}
+
+		Split split{};
+		split.axis = axis;
+		split.left = GetBounds(first, leftCount);
+		split.right = GetBounds(first + leftCount, count - leftCount);
+		return split;
+	}
+
+	void BVH::Subdivide(uint32_t nodeIndex, uint32_t depth, const Vector3& centroidMin, const Vector3& centroidMax, std::atomic<uint32_t>& numNodes)
+	{
+		BVHNode& node{ m_Nodes[nodeIndex] };
+		if (node.triangleCount <= MaxLeafSize) return;
+
+		const uint32_t first{ node.leftFirst };
+		const uint32_t count{ node.triangleCount };
+
+		// Bins are spread evenly over the centroid bounds, an axis where all centroids are the same isn't binned
+		const Vector3 extent{ centroidMax - centroidMin };
+		Vector3 binScale{};
+		for (int axis{ 0 }; axis < 3; ++axis)
+		{
+			if (extent[axis] > 0.f) binScale[axis] = static_cast<float>(m_NumBins) / extent[axis];
+		}
+
+		// A heuristic split can leave a child with all but one triangle, close to MaxDepth only median splits are left to reach the leaves in time
+		const bool isHeuristicSplit{ depth + 1 + GetMedianSplitDepth(count) <= MaxDepth && (binScale.x > 0.f || binScale.y > 0.f || binScale.z > 0.f) };
+
+		// Kept out of this frame, the bins would pile up on the stack of a deep tree
+		Split split{};
+		if (isHeuristicSplit) split = FindSplit(first, count, centroidMin, binScale);
+
+		if (split.axis >= 0)
+			PartitionTriangles(first, count, split.left.triangleCount, split.axis, split.index, centroidMin[split.axis], binScale[split.axis]);
+		else
+			split = FindMedianSplit(first, count, centroidMin, centroidMax);
+
+		const Bin& left{ split.left };
+		const Bin& right{ split.right };
+
+		const uint32_t leftChild{ numNodes.fetch_add(2) };
+		m_Nodes[leftChild] = { left.minAABB, first, left.maxAABB, left.triangleCount };
+		m_Nodes[leftChild + 1] = { right.minAABB, first + left.triangleCount, right.maxAABB, right.triangleCount };
+
+		node.leftFirst = leftChild;
+		node.triangleCount = 0;
+
+		const auto subdivideLeft{ [&]() { Subdivide(leftChild, depth + 1, left.centroidMin, left.centroidMax, numNodes); } };
+		const auto subdivideRight{ [&]() { Subdivide(leftChild + 1, depth + 1, right.centroidMin, right.centroidMax, numNodes); } };
+		if (count >= m_ParallelTaskSize)
+		{
+			concurrency::parallel_invoke(subdivideLeft, subdivideRight);
+		}
+		else
+		{
+			subdivideLeft();
+			subdivideRight();
+		}
+	}
+
+	void BVH::SortNodes()
+	{
+		std::vector<BVHNode> nodes{};
+		nodes.reserve(m_Nodes.size());
+		nodes.push_back(m_Nodes[0]);
+
+		// Old and new index of every node still to visit, the left child is on top so it is visited first
+		std::vector<std::pair<uint32_t, uint32_t>> stack{ { 0, 0 } };
+		while (!stack.empty())
+		{
+			const auto [oldIndex, newIndex] { stack.back() };
+			stack.pop_back();
+
+			const BVHNode& node{ m_Nodes[oldIndex] };
+			if (node.triangleCount > 0) continue;
+
+			const uint32_t leftChild{ static_cast<uint32_t>(nodes.size()) };
+			nodes[newIndex].leftFirst = leftChild;
+			nodes.push_back(m_Nodes[node.leftFirst]);
+			nodes.push_back(m_Nodes[node.leftFirst + 1]);
+
+			stack.emplace_back(node.leftFirst + 1, leftChild + 1);
+			stack.emplace_back(node.leftFirst, leftChild);
+		}
+
+		m_Nodes = std::move(nodes);
+	}
+
+	bool BVH::BuildQuantizedNodes()
+	{
+		m_QuantizedNodes.clear();
+
+		// Leaves hold at most MaxLeafSize triangles, only the index of the first one can run out of bits
+		if (m_TriangleIndices.size() > MaxQuantizedTriangles) return false;
+		m_QuantizedNodes.reserve(m_Nodes.size() / 2 + 1);
+
+		// The root is always an interior node in the 4-wide tree, even when the binary root is a leaf
+		const BVHNode& root{ m_Nodes[0] };
+		if (root.triangleCount > 0)
+			CollapseNode(root, { 0 });
+		else
+			CollapseNode(root, { root.leftFirst, root.leftFirst + 1 });
+
+		m_QuantizedNodes.shrink_to_fit();
+		return true;
+	}
+
+	uint32_t BVH::CollapseNode(const BVHNode& parent, std::vector<uint32_t> binaryChildren)
+	{
+		// Pull grandchildren up until there are 4 children, always opening the largest interior child first
+		while (binaryChildren.size() < 4)
+		{
+			int largestChild{ -1 };
+			float largestArea{ -1.f };
+			for (int i{ 0 }; i < static_cast<int>(binaryChildren.size()); ++i)
+			{
+				const BVHNode& child{ m_Nodes[binaryChildren[i]] };
+				if (child.triangleCount == 0 && SurfaceArea(child) > largestArea)
+				{
+					largestArea = SurfaceArea(child);
+					largestChild = i;
+				}
+			}
+
+			if (largestChild < 0) break;
+
+			const uint32_t leftChild{ m_Nodes[binaryChildren[largestChild]].leftFirst };
+			binaryChildren[largestChild] = leftChild;
+			binaryChildren.push_back(leftChild + 1);
+		}
+
+		const uint32_t quantizedIndex{ static_cast<uint32_t>(m_QuantizedNodes.size()) };
+		m_QuantizedNodes.emplace_back();
+
+		// Slightly enlarged scale so origin + 255 * scale never falls short of the parent max
+		QuantizedBVHNode node{};
+		const Vector3 extent{ parent.maxAABB - parent.minAABB };
+		node.origin = parent.minAABB;
+		node.scale = extent * (1.0001f / 255.f);
+
+		for (uint32_t i{ 0 }; i < 4; ++i)
+		{
+			if (i >= binaryChildren.size())
+			{
+				node.children[i] = QuantizedBVHNode::EmptyChild;
+				continue;
+			}
+
+			const BVHNode& child{ m_Nodes[binaryChildren[i]] };
+			node.minX[i] = QuantizeMin(child.minAABB.x, node.origin.x, node.scale.x);
+			node.minY[i] = QuantizeMin(child.minAABB.y, node.origin.y, node.scale.y);
+			node.minZ[i] = QuantizeMin(child.minAABB.z, node.origin.z, node.scale.z);
+			node.maxX[i] = QuantizeMax(child.maxAABB.x, node.origin.x, node.scale.x);
+			node.maxY[i] = QuantizeMax(child.maxAABB.y, node.origin.y, node.scale.y);
+			node.maxZ[i] = QuantizeMax(child.maxAABB.z, node.origin.z, node.scale.z);
+
+			if (child.triangleCount > 0)
+			{
+				assert(child.triangleCount <= QuantizedBVHNode::LeafCountMask && child.leftFirst <= QuantizedBVHNode::LeafFirstMask);
+				node.children[i] = QuantizedBVHNode::LeafFlag
+					| (child.triangleCount << QuantizedBVHNode::LeafCountShift)
+					| child.leftFirst;
+			}
+			else
+			{
+				node.children[i] = CollapseNode(child, { child.leftFirst, child.leftFirst + 1 });
+			}
+		}
+
+		// Assign by index, the recursion above may have reallocated the node array
+		m_QuantizedNodes[quantizedIndex] = node;
+		return quantizedIndex;
+	}
+}
@@ -0,0 +1,164 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+#include "Vector3.h"
+
+namespace dae
+{
+	enum class BVHLayout : uint8_t
+	{
+		None, // Brute force, every triangle is tested
+		Binary, // 32 byte nodes with full precision bounds
+		Quantized // 64 byte 4-wide nodes, child bounds stored as 8 bit offsets in the parent box
+	};
+
+	struct BVHNode
+	{
+		Vector3 minAABB{};
+		uint32_t leftFirst{}; // Index of the left child (right child is leftFirst + 1) or first triangle for leaves
+		Vector3 maxAABB{};
+		uint32_t triangleCount{}; // 0 for interior nodes
+	};
+
+	struct alignas(64) QuantizedBVHNode
+	{
+		// Child bounds are origin + q * scale
+		Vector3 origin{};
+		Vector3 scale{};
+
+		uint8_t minX[4]{};
+		uint8_t minY[4]{};
+		uint8_t minZ[4]{};
+		uint8_t maxX[4]{};
+		uint8_t maxY[4]{};
+		uint8_t maxZ[4]{};
+
+		// Interior child: node index, leaf child: LeafFlag | count << LeafCountShift | first triangle
+		uint32_t children[4]{};
+
+		static constexpr uint32_t EmptyChild{ 0xFFFFFFFF };
+		static constexpr uint32_t LeafFlag{ 0x80000000 };
+		static constexpr uint32_t LeafCountShift{ 24 };
+		static constexpr uint32_t LeafCountMask{ 0x7F };
+		static constexpr uint32_t LeafFirstMask{ 0x00FFFFFF };
+	};
+	static_assert(sizeof(BVHNode) == 32);
+	static_assert(sizeof(QuantizedBVHNode) == 64);
+
+	/**
+	 * \brief Object space bounding volume hierarchy over the triangles of one TriangleMesh
+	 * Built top down with a binned surface area heuristic (Wald 2007), large nodes are binned and partitioned on all cores,
+	 * the two halves of a large node are built at the same time
+	 * The tree doesn't depend on the number of threads
+	 * Triangles the heuristic can't separate (same centroid) and nodes close to MaxDepth are split at the median instead,
+	 * so every leaf holds at most MaxLeafSize triangles and no leaf is deeper than MaxDepth
+	 */
+	class BVH final
+	{
+	public:
+		static constexpr uint32_t MaxLeafSize{ 4 };
+		// Deepest leaf below the root, the traversal stacks are sized for it
+		static constexpr uint32_t MaxDepth{ 64 };
+		// A quantized leaf stores its first triangle in 24 bits, bigger meshes are built with the Binary layout instead
+		static constexpr uint32_t MaxQuantizedTriangles{ QuantizedBVHNode::LeafFirstMask + 1 };
+		static_assert(MaxLeafSize <= QuantizedBVHNode::LeafCountMask, "a quantized leaf stores its triangle count in 7 bits");
+
+		// Quantized falls back to Binary for meshes of more than MaxQuantizedTriangles triangles, GetLayout tells which one is used
+		void Build(const std::vector<Vector3>& positions, const std::vector<int>& indices, BVHLayout layout);
+		void Clear();
+		// Adopts a tree built earlier, used when loading a scene snapshot
+		// Only the nodes of the layout in use are kept, the memory figures of both layouts are those of the original build
+		void Restore(BVHLayout layout, std::vector<BVHNode>&& nodes, std::vector<QuantizedBVHNode>&& quantizedNodes, std::vector<uint32_t>&& triangleIndices,
+			size_t binaryMemoryUsage, size_t quantizedMemoryUsage);
+
+		BVHLayout GetLayout() const { return m_Layout; }
+		bool IsBuilt() const { return m_Layout != BVHLayout::None; }
+
+		size_t GetMemoryUsage() const;
+		// What each layout takes, whichever one is in use, 0 for a layout the mesh can't be stored in
+		size_t GetBinaryMemoryUsage() const { return m_BinaryMemoryUsage; }
+		size_t GetQuantizedMemoryUsage() const { return m_QuantizedMemoryUsage; }
+		void PrintStatistics() const;
+
+		const std::vector<BVHNode>& GetNodes() const { return m_Nodes; }
+		const std::vector<QuantizedBVHNode>& GetQuantizedNodes() const { return m_QuantizedNodes; }
+		// Triangle ids (index into the index buffer / 3) in leaf order
+		const std::vector<uint32_t>& GetTriangleIndices() const { return m_TriangleIndices; }
+
+	private:
+		BVHLayout m_Layout{ BVHLayout::None };
+
+		std::vector<BVHNode> m_Nodes{};
+		std::vector<QuantizedBVHNode> m_QuantizedNodes{};
+		std::vector<uint32_t> m_TriangleIndices{};
+
+		// Bounds stored next to the id and partitioned along with it, every level of the build reads them front to back
+		struct BuildTriangle
+		{
+			Vector3 minAABB{};
+			uint32_t index{};
+			Vector3 maxAABB{};
+		};
+
+		// Triangle and centroid bounds of the triangles whose centroid falls in one bin
+		struct Bin
+		{
+			Vector3 minAABB{ FLT_MAX, FLT_MAX, FLT_MAX };
+			Vector3 maxAABB{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			Vector3 centroidMin{ FLT_MAX, FLT_MAX, FLT_MAX };
+			Vector3 centroidMax{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			uint32_t triangleCount{};
+		};
+
+		static constexpr int m_NumBins{ 16 };
+		using Bins = std::array<std::array<Bin, m_NumBins>, 3>; // Per axis
+
+		// Triangles in bins [0, index) on the axis go left
+		struct Split
+		{
+			int axis{ -1 };
+			int index{};
+			Bin left{};
+			Bin right{};
+		};
+
+		// Nodes with at least this many triangles are binned and partitioned in chunks over all cores
+		static constexpr uint32_t m_ParallelBinningSize{ 1u << 16 };
+		static constexpr uint32_t m_ChunkSize{ 1u << 14 };
+		// Nodes with at least this many triangles build their two halves at the same time
+		static constexpr uint32_t m_ParallelTaskSize{ 1u << 12 };
+
+		size_t m_BinaryMemoryUsage{};
+		size_t m_QuantizedMemoryUsage{};
+
+		// Build only data
+		std::vector<BuildTriangle> m_BuildTriangles{};
+		std::vector<BuildTriangle> m_PartitionBuffer{};
+
+		static Vector3 GetCentroid(const BuildTriangle& triangle);
+		static int GetBinIndex(float centroid, float centroidMin, float binScale);
+		static void AddToBin(Bin& bin, const Bin& other);
+
+		Bin GetBounds(uint32_t first, uint32_t count) const;
+		void BinTriangles(uint32_t first, uint32_t count, const Vector3& centroidMin, const Vector3& binScale, Bins& bins) const;
+		// Cheapest split by the surface area heuristic, axis -1 when the triangles can't be split
+		Split FindSplit(uint32_t first, uint32_t count, const Vector3& centroidMin, const Vector3& binScale) const;
+		void PartitionTriangles(uint32_t first, uint32_t count, uint32_t leftCount, int axis, int split, float centroidMin, float binScale);
+		// Levels of median splits below a node before every leaf fits MaxLeafSize
+		static uint32_t GetMedianSplitDepth(uint32_t count);
+		// Halves the triangles by their order along the widest centroid axis, by index when the centroids all coincide
+		Split FindMedianSplit(uint32_t first, uint32_t count, const Vector3& centroidMin, const Vector3& centroidMax);
+		// Children are allocated from several threads, numNodes is the next free node
+		void Subdivide(uint32_t nodeIndex, uint32_t depth, const Vector3& centroidMin, const Vector3& centroidMax, std::atomic<uint32_t>& numNodes);
+		// Puts every pair of children right after the pairs of the nodes before it in depth first order, like a single thread allocates them
+		void SortNodes();
+
+		// False when the mesh has too many triangles for the quantized leaves
+		bool BuildQuantizedNodes();
+		uint32_t CollapseNode(const BVHNode& parent, std::vector<uint32_t> binaryChildren);
+	};
+}
@@ -0,0 +1,47 @@
+#include "Benchmark.h"
+
+//Standard includes
+#include <algorithm>
+#include <iostream>
+
+//Project includes
+#include "Renderer.h"
+#include "Scene.h"
+
+namespace dae
+{
+	namespace Benchmark
+	{
+		std::unique_ptr<Scene> LoadScene(const std::string& sceneName)
+		{
+			std::unique_ptr<Scene> pScene{ Scene::Create(sceneName) };
+			if (!pScene)
+			{
+				std::cout << "Unknown scene \"" << sceneName << "\", available scenes:";
+				for (const std::string& name : Scene::GetRegisteredNames())
+					std::cout << ' ' << name;
+				std::cout << '\n';
+				return nullptr;
+			}
+
+			pScene->InitializeFromSnapshot();
+			return pScene;
+		}
+
+		std::unique_ptr<Renderer> CreateRenderer(int width, int height)
+		{
+			auto pRenderer{ std::make_unique<Renderer>(width, height) };
+			pRenderer->SetIncrementalRendering(false);
+			return pRenderer;
+		}
+
+		float GetMedian(std::vector<float> values)
+		{
+			if (values.empty()) return 0.f;
+
+			std::ranges::sort(values);
+			const size_t middle{ values.size() / 2 };
+			return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2.f;
+		}
+	}
+}
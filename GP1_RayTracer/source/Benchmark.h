@@ -0,0 +1,47 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dae
+{
+	class Renderer;
+	class Scene;
+
+	// Setup and timing shared by the headless runs: the benchmarks in main.cpp, RegressionSuite, AnimationRenderer and the render workers
+	namespace Benchmark
+	{
+		// Registered scene or .scene file, initialized from its snapshot
+		// nullptr for an unknown scene, after printing the scenes that do exist
+		std::unique_ptr<Scene> LoadScene(const std::string& sceneName);
+		// Without a window, and every frame traces every pixel: an incremental frame only traces what changed since the last one
+		std::unique_ptr<Renderer> CreateRenderer(int width, int height);
+
+		// The middle value, the mean of the two middle values for an even count, 0 without values
+		float GetMedian(std::vector<float> values);
+
+		// Milliseconds the call took
+		template<typename Function>
+		float Measure(const Function& function)
+		{
+			const auto start{ std::chrono::steady_clock::now() };
+			function();
+			return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		// Median milliseconds of numRuns calls, ignores a single call the OS got in the way of
+		template<typename Function>
+		float MeasureMedian(uint32_t numRuns, const Function& function)
+		{
+			std::vector<float> times{};
+			for (uint32_t run{ 0 }; run < numRuns; ++run)
+			{
+				times.push_back(Measure(function));
+			}
+			return GetMedian(std::move(times));
+		}
+	}
+}
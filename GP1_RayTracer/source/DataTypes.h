@@ -1,6 +1,9 @@
 #pragma once
 #include <cassert>
 
+#include "Parallel.h"
+
+#include "BVH.h"
 #include "Math.h"
 #include "vector"
 
@@ -54,6 +57,99 @@ namespace dae
 		unsigned char materialIndex{};
 	};
 
+	inline void TransformAABB(const Matrix& transform, const Vector3& minAABB, const Vector3& maxAABB, Vector3& transformedMinAABB, Vector3& transformedMaxAABB)
+	{
+		Vector3 tMinAABB{ transform.TransformPoint(minAABB) };
+		Vector3 tMaxAABB{ tMinAABB };
+
+		// (xmax, ymin, zmin)
+		Vector3 tAABB{ transform.TransformPoint(maxAABB.x, minAABB.y, minAABB.z) };
+		tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
+		tMinAABB = Vector3::Min(tAABB, tMinAABB);
+
+		// (xmax, ymin, zmax)
+		tAABB = transform.TransformPoint(maxAABB.x, minAABB.y, maxAABB.z);
+		tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
+		tMinAABB = Vector3::Min(tAABB, tMinAABB);
+
+		// (xmin, ymin, zmax)
+		tAABB = transform.TransformPoint(minAABB.x, minAABB.y, maxAABB.z);
+		tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
+		tMinAABB = Vector3::Min(tAABB, tMinAABB);
+
+		// (xmin, ymax, zmin)
+		tAABB = transform.TransformPoint(minAABB.x, maxAABB.y, minAABB.z);
+		tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
+		tMinAABB = Vector3::Min(tAABB, tMinAABB);
+
+		// (xmax, ymax, zmin)
+		tAABB = transform.TransformPoint(maxAABB.x, maxAABB.y, minAABB.z);
+		tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
+		tMinAABB = Vector3::Min(tAABB, tMinAABB);
+
+		// (xmax, ymax, zmax)
+		tAABB = transform.TransformPoint(maxAABB.x, maxAABB.y, maxAABB.z);
+		tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
+		tMinAABB = Vector3::Min(tAABB, tMinAABB);
+
+		// (xmin, ymax, zmax)
+		tAABB = transform.TransformPoint(minAABB.x, maxAABB.y, maxAABB.z);
+		tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
+		tMinAABB = Vector3::Min(tAABB, tMinAABB);
+
+		transformedMaxAABB = tMaxAABB;
+		transformedMinAABB = tMinAABB;
+	}
+
+	// Position stored as 16 bit fractions of the box of its mesh, see TriangleMesh::Compress
+	struct QuantizedPosition
+	{
+		uint16_t x{};
+		uint16_t y{};
+		uint16_t z{};
+	};
+
+	// Unit vector folded onto an octahedron and unfolded onto a square, 16 bits per coordinate
+	struct OctahedralNormal
+	{
+		int16_t x{};
+		int16_t y{};
+
+		static OctahedralNormal Encode(const Vector3& normal)
+		{
+			const float length{ std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z) };
+			if (length == 0.f) return {};
+
+			float x{ normal.x / length };
+			float y{ normal.y / length };
+
+			// The lower half folds over the diagonals
+			if (normal.z < 0.f)
+			{
+				const float foldedX{ (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f) };
+				y = (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f);
+				x = foldedX;
+			}
+
+			return { static_cast<int16_t>(std::round(x * INT16_MAX)), static_cast<int16_t>(std::round(y * INT16_MAX)) };
+		}
+
+		Vector3 Decode() const
+		{
+			Vector3 normal{ static_cast<float>(x) / INT16_MAX, static_cast<float>(y) / INT16_MAX, 0.f };
+			normal.z = 1.f - std::abs(normal.x) - std::abs(normal.y);
+
+			if (normal.z < 0.f)
+			{
+				const float unfoldedX{ (1.f - std::abs(normal.y)) * (normal.x >= 0.f ? 1.f : -1.f) };
+				normal.y = (1.f - std::abs(normal.x)) * (normal.y >= 0.f ? 1.f : -1.f);
+				normal.x = unfoldedX;
+			}
+
+			return normal.Normalized();
+		}
+	};
+
 	struct TriangleMesh
 	{
 		TriangleMesh() = default;
@@ -62,20 +158,17 @@ namespace dae
 		{
 			//Calculate Normals
 			CalculateNormals();
-
-			//Update Transforms
-			UpdateTransforms();
 		}
 
 		TriangleMesh(const std::vector<Vector3>& _positions, const std::vector<int>& _indices, const std::vector<Vector3>& _normals, TriangleCullMode _cullMode) :
 			positions(_positions), normals(_normals), indices(_indices), cullMode(_cullMode)
 		{
-			UpdateTransforms();
 		}
 
 		std::vector<Vector3> positions{};
 		std::vector<Vector3> normals{};
 		std::vector<int> indices{};
+		std::vector<Vector2> uvs{}; // One per position, empty when the mesh has no texture coordinates
 		unsigned char materialIndex{};
 
 		TriangleCullMode cullMode{ TriangleCullMode::BackFaceCulling };
@@ -93,23 +186,49 @@ namespace dae
 		std::vector<Vector3> transformedPositions{};
 		std::vector<Vector3> transformedNormals{};
 
+		// Compressed mode, see Compress: the float positions and normals are gone, every read goes through GetPosition
+		std::vector<QuantizedPosition> quantizedPositions{};
+		std::vector<OctahedralNormal> packedNormals{}; // One per triangle
+		Vector3 quantizationOrigin{};
+		Vector3 quantizationScale{};
+		bool isCompressed{ false };
+
+		// Built over the object space positions, rays are moved into object space to traverse it
+		BVH bvh{};
+		Matrix worldTransform{};
+		Matrix inverseWorldTransform{};
+
+		// Transforms are only recalculated when something changed, see UpdateTransforms
+		bool isTransformDirty{ true };
+		bool areVerticesDirty{ true };
+
 		void Translate(const Vector3& translation)
 		{
-			translationTransform = Matrix::CreateTranslation(translation);
+			SetTransform(translationTransform, Matrix::CreateTranslation(translation));
 		}
 
 		void RotateY(float yaw)
 		{
-			rotationTransform = Matrix::CreateRotationY(yaw);
+			SetTransform(rotationTransform, Matrix::CreateRotationY(yaw));
 		}
 
 		void Scale(const Vector3& scale)
 		{
-			scaleTransform = Matrix::CreateScale(scale);
+			SetTransform(scaleTransform, Matrix::CreateScale(scale));
+		}
+
+		void SetTransform(Matrix& transform, const Matrix& newTransform)
+		{
+			if (transform == newTransform) return;
+
+			transform = newTransform;
+			isTransformDirty = true;
 		}
 
-		void AppendTriangle(const Triangle& triangle, bool ignoreTransformUpdate = false)
+		// Only marks the mesh dirty, the vertices get transformed once on the next UpdateTransforms
+		void AppendTriangle(const Triangle& triangle)
 		{
+			assert(!isCompressed);
 			int startIndex = static_cast<int>(positions.size());
 
 			positions.push_back(triangle.v0);
@@ -122,9 +241,7 @@ namespace dae
 
 			normals.push_back(triangle.normal);
 
-			//Not ideal, but making sure all vertices are updated
-			if (!ignoreTransformUpdate)
-				UpdateTransforms();
+			isTransformDirty = true;
 		}
 
 		void CalculateNormals()
@@ -140,25 +257,154 @@ namespace dae
 			}
 		}
 
-		void UpdateTransforms()
+		void BuildBVH(BVHLayout layout)
 		{
-			const Matrix finalTransform{ scaleTransform * rotationTransform * translationTransform };
+			if (!isCompressed)
+			{
+				bvh.Build(positions, indices, layout);
+				return;
+			}
 
-			//Transform Positions
-			transformedPositions.clear();
+			// Over the decoded positions, those are the triangles the hit tests see
+			std::vector<Vector3> decodedPositions(quantizedPositions.size());
+			TransformRange(decodedPositions.size(), [&](size_t i) { decodedPositions[i] = GetPosition(i); });
+			bvh.Build(decodedPositions, indices, layout);
+		}
+
+		Vector3 GetPosition(size_t index) const
+		{
+			if (!isCompressed) return positions[index];
+
+			const QuantizedPosition& position{ quantizedPositions[index] };
+			return Vector3
+			{
+				quantizationOrigin.x + static_cast<float>(position.x) * quantizationScale.x,
+				quantizationOrigin.y + static_cast<float>(position.y) * quantizationScale.y,
+				quantizationOrigin.z + static_cast<float>(position.z) * quantizationScale.z
+			};
+		}
+
+		size_t GetNumPositions() const { return isCompressed ? quantizedPositions.size() : positions.size(); }
+
+		// Face normal of the float triangle, only decoded once the closest hit is known
+		Vector3 GetTriangleNormal(uint32_t triangleIndex) const { return packedNormals[triangleIndex].Decode(); }
+
+		/**
+		 * \brief Replaces the float positions (12 bytes per vertex) and normals (12 bytes per triangle) by 6 and 4 byte versions
+		 * Positions are quantized against the box of the mesh, each coordinate is off by at most half a step (extent / 65535)
+		 * The BVH is rebuilt over the decoded positions, the normals are taken from the float triangles before they are dropped
+		 * One way, the mesh can't be appended to or streamed afterwards
+		 */
+		void Compress()
+		{
+			if (isCompressed || positions.empty()) return;
+
+			Vector3 minPosition{ positions[0] };
+			Vector3 maxPosition{ positions[0] };
 			for (const Vector3& position : positions)
 			{
-				transformedPositions.emplace_back(finalTransform.TransformPoint(position));
+				minPosition = Vector3::Min(minPosition, position);
+				maxPosition = Vector3::Max(maxPosition, position);
 			}
-			//Update AABB
-			UpdateTransformedAABB(finalTransform);
 
-			//Transform Normals
+			quantizationOrigin = minPosition;
+			quantizationScale = (maxPosition - minPosition) / static_cast<float>(UINT16_MAX);
+
+			// Flat axes have a scale of 0, every position is at the origin there
+			const auto quantize{ [](float value, float origin, float scale)
+				{
+					return scale > 0.f ? static_cast<uint16_t>(std::min(std::round((value - origin) / scale), static_cast<float>(UINT16_MAX))) : uint16_t{};
+				} };
+
+			quantizedPositions.resize(positions.size());
+			TransformRange(positions.size(), [&](size_t i)
+				{
+					const Vector3& position{ positions[i] };
+					quantizedPositions[i] =
+					{
+						quantize(position.x, quantizationOrigin.x, quantizationScale.x),
+						quantize(position.y, quantizationOrigin.y, quantizationScale.y),
+						quantize(position.z, quantizationOrigin.z, quantizationScale.z)
+					};
+				});
+
+			packedNormals.resize(indices.size() / 3);
+			TransformRange(packedNormals.size(), [&](size_t i)
+				{
+					const Vector3& v0{ positions[indices[i * 3]] };
+					const Vector3& v1{ positions[indices[i * 3 + 1]] };
+					const Vector3& v2{ positions[indices[i * 3 + 2]] };
+					packedNormals[i] = OctahedralNormal::Encode(Vector3::Cross(v1 - v0, v2 - v0));
+				});
+
+			positions.clear();
+			positions.shrink_to_fit();
+			normals.clear();
+			normals.shrink_to_fit();
+			transformedPositions.clear();
+			transformedPositions.shrink_to_fit();
 			transformedNormals.clear();
-			for (const Vector3& normal : normals)
+			transformedNormals.shrink_to_fit();
+
+			isCompressed = true;
+			areVerticesDirty = true;
+
+			if (bvh.IsBuilt()) BuildBVH(bvh.GetLayout());
+		}
+
+		// Vertex and index buffers, the BVH reports its own
+		size_t GetGeometryMemoryUsage() const
+		{
+			return (positions.capacity() + normals.capacity() + transformedPositions.capacity() + transformedNormals.capacity()) * sizeof(Vector3)
+				+ quantizedPositions.capacity() * sizeof(QuantizedPosition) + packedNormals.capacity() * sizeof(OctahedralNormal)
+				+ indices.capacity() * sizeof(int) + uvs.capacity() * sizeof(Vector2);
+		}
+
+		void UpdateTransforms()
+		{
+			if (isTransformDirty)
 			{
-				transformedNormals.emplace_back(finalTransform.TransformVector(normal));
+				worldTransform = scaleTransform * rotationTransform * translationTransform;
+				inverseWorldTransform = worldTransform.Inverse();
+
+				//Update AABB
+				UpdateTransformedAABB(worldTransform);
+
+				isTransformDirty = false;
+				areVerticesDirty = true;
 			}
+
+			// Meshes with a BVH are traced in object space and never read the transformed vertices
+			if (!areVerticesDirty || bvh.IsBuilt()) return;
+
+			// Transform in place, the buffers only grow when the mesh itself grew
+			transformedPositions.resize(GetNumPositions());
+			transformedNormals.resize(normals.size());
+
+			TransformRange(transformedPositions.size(), [this](size_t i) { transformedPositions[i] = worldTransform.TransformPoint(GetPosition(i)); });
+			TransformRange(normals.size(), [this](size_t i) { transformedNormals[i] = worldTransform.TransformVector(normals[i]); });
+
+			areVerticesDirty = false;
+		}
+
+		// Large meshes are split in chunks over all cores, small ones are not worth the scheduling
+		template<typename Function>
+		static void TransformRange(size_t count, const Function& function)
+		{
+			constexpr size_t chunkSize{ 4096 };
+
+			if (count <= chunkSize)
+			{
+				for (size_t i{ 0 }; i < count; ++i) function(i);
+				return;
+			}
+
+			const size_t numChunks{ (count + chunkSize - 1) / chunkSize };
+			concurrency::parallel_for(size_t{ 0 }, numChunks, [&](size_t chunk)
+				{
+					const size_t end{ std::min(count, (chunk + 1) * chunkSize) };
+					for (size_t i{ chunk * chunkSize }; i < end; ++i) function(i);
+				});
 		}
 
 		void UpdateAABB()
@@ -174,50 +420,71 @@ namespace dae
 				maxAABB = Vector3::Max(maxAABB, p);
 				minAABB = Vector3::Min(minAABB, p);
 			}
+
+			isTransformDirty = true;
 		}
 
 		void UpdateTransformedAABB(const Matrix& finalTransform)
 		{
-			Vector3 tMinAABB{ finalTransform.TransformPoint(minAABB) };
-			Vector3 tMaxAABB{ tMinAABB };
-
-			// (xmax, ymin, zmin)
-			Vector3 tAABB{ finalTransform.TransformPoint(maxAABB.x, minAABB.y, minAABB.z) };
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-
-			// (xmax, ymin, zmax)
-			tAABB = finalTransform.TransformPoint(maxAABB.x, minAABB.y, maxAABB.z);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-
-			// (xmin, ymin, zmax)
-			tAABB = finalTransform.TransformPoint(minAABB.x, minAABB.y, maxAABB.z);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-
-			// (xmin, ymax, zmin)
-			tAABB = finalTransform.TransformPoint(minAABB.x, maxAABB.y, minAABB.z);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-
-			// (xmax, ymax, zmin)
-			tAABB = finalTransform.TransformPoint(maxAABB.x, maxAABB.y, minAABB.z);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-
-			// (xmax, ymax, zmax)
-			tAABB = finalTransform.TransformPoint(maxAABB.x, maxAABB.y, maxAABB.z);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-
-			// (xmin, ymax, zmax)
-			tAABB = finalTransform.TransformPoint(minAABB.x, maxAABB.y, maxAABB.z);
-			tMaxAABB = Vector3::Max(tAABB, tMaxAABB);
-			tMinAABB = Vector3::Min(tAABB, tMinAABB);
-
-			transformedMaxAABB = tMaxAABB;
-			transformedMinAABB = tMinAABB;
+			TransformAABB(finalTransform, minAABB, maxAABB, transformedMinAABB, transformedMaxAABB);
+		}
+	};
+
+	// Places a shared TriangleMesh in the world without copying its geometry,
+	// the mesh is only referenced by index so memory scales with the unique meshes, not with the instances
+	struct TriangleMeshInstance
+	{
+		uint32_t meshIndex{};
+		unsigned char materialIndex{};
+
+		TriangleCullMode cullMode{ TriangleCullMode::BackFaceCulling };
+
+		Matrix rotationTransform{};
+		Matrix translationTransform{};
+		Matrix scaleTransform{};
+
+		Matrix worldTransform{};
+		Matrix inverseWorldTransform{};
+
+		Vector3 transformedMaxAABB{};
+		Vector3 transformedMinAABB{};
+
+		bool isTransformDirty{ true };
+
+		void Translate(const Vector3& translation)
+		{
+			SetTransform(translationTransform, Matrix::CreateTranslation(translation));
+		}
+
+		void RotateY(float yaw)
+		{
+			SetTransform(rotationTransform, Matrix::CreateRotationY(yaw));
+		}
+
+		void Scale(const Vector3& scale)
+		{
+			SetTransform(scaleTransform, Matrix::CreateScale(scale));
+		}
+
+		void SetTransform(Matrix& transform, const Matrix& newTransform)
+		{
+			if (transform == newTransform) return;
+
+			transform = newTransform;
+			isTransformDirty = true;
+		}
+
+		// The object space AABB comes from the mesh on every update, so the box follows a shared mesh that changed after the instance was made
+		void UpdateTransforms(const Vector3& meshMinAABB, const Vector3& meshMaxAABB)
+		{
+			if (!isTransformDirty) return;
+
+			worldTransform = scaleTransform * rotationTransform * translationTransform;
+			inverseWorldTransform = worldTransform.Inverse();
+
+			TransformAABB(worldTransform, meshMinAABB, meshMaxAABB, transformedMinAABB, transformedMaxAABB);
+
+			isTransformDirty = false;
 		}
 	};
 #pragma endregion
@@ -248,6 +515,20 @@ namespace dae
 		float max{ FLT_MAX };
 	};
 
+	// World space box a mesh covered before and after it moved, see Scene::GetMovedBounds
+	struct MovedBounds
+	{
+		Vector3 minAABB{};
+		Vector3 maxAABB{};
+	};
+
+	// Directions of the rays through the next pixel to the right and below, they start at the same origin as the primary ray
+	struct RayDifferentials
+	{
+		Vector3 directionX{};
+		Vector3 directionY{};
+	};
+
 	struct HitRecord
 	{
 		Vector3 origin{};
@@ -256,6 +537,21 @@ namespace dae
 
 		bool didHit{ false };
 		unsigned char materialIndex{ 0 };
+
+		// Triangle meshes only, enough to interpolate the vertex attributes once the closest hit is known
+		Vector2 barycentrics{}; // Weights of v1 and v2
+		uint32_t triangleIndex{};
+		const TriangleMesh* pMesh{ nullptr };
+		const Matrix* pWorldTransform{ nullptr };
+	};
+
+	// Closest hit of one ray of a batch query, see Scene::GetClosestHits
+	struct RayHit
+	{
+		Vector3 normal{};
+		float t{ FLT_MAX }; // FLT_MAX when nothing was hit
+		uint32_t triangleIndex{}; // Triangle meshes only
+		unsigned char materialIndex{ 0 };
 	};
 #pragma endregion
 }
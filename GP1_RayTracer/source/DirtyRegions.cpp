@@ -0,0 +1,167 @@
+#include "DirtyRegions.h"
+
+//Project includes
+#include "Camera.h"
+#include "Scene.h"
+#include "Utils.h"
+
+//Standard includes
+#include <algorithm>
+#include <cmath>
+
+namespace dae
+{
+	namespace
+	{
+		bool IsSame(const Vector3& a, const Vector3& b)
+		{
+			return a.x == b.x && a.y == b.y && a.z == b.z;
+		}
+
+		bool IsSame(const Light& a, const Light& b)
+		{
+			return IsSame(a.origin, b.origin) && IsSame(a.direction, b.direction) && a.intensity == b.intensity && a.type == b.type
+				&& a.color.r == b.color.r && a.color.g == b.color.g && a.color.b == b.color.b;
+		}
+
+		bool IsSame(const Sphere& a, const Sphere& b)
+		{
+			return IsSame(a.origin, b.origin) && a.radius == b.radius && a.materialIndex == b.materialIndex;
+		}
+
+		bool IsSame(const Plane& a, const Plane& b)
+		{
+			return IsSame(a.origin, b.origin) && IsSame(a.normal, b.normal) && a.materialIndex == b.materialIndex;
+		}
+
+		// Compares and then remembers the current values for the next frame
+		template<typename T>
+		bool IsUnchanged(std::span<const T> current, std::vector<T>& last)
+		{
+			const bool isUnchanged{ std::ranges::equal(current, last, [](const T& a, const T& b) { return IsSame(a, b); }) };
+			if (!isUnchanged) last.assign(current.begin(), current.end());
+			return isUnchanged;
+		}
+	}
+
+	void DirtyRegions::Resize(int width, int height)
+	{
+		m_Width = width;
+		m_Height = height;
+		m_Pixels.assign(static_cast<size_t>(width) * height, CachedPixel{});
+		Invalidate();
+	}
+
+	bool DirtyRegions::BeginFrame(const Scene& scene, const Camera& camera, float fov, float aspectRatio, uint32_t settingsKey)
+	{
+		++m_Frame;
+
+		// Every check runs so the last frame values are all up to date afterwards
+		bool isSceneUnchanged{ m_pLastScene == &scene };
+		isSceneUnchanged = settingsKey == m_LastSettingsKey && isSceneUnchanged;
+		isSceneUnchanged = IsUnchanged(scene.GetLights(), m_LastLights) && isSceneUnchanged;
+		isSceneUnchanged = IsUnchanged(scene.GetSphereGeometries(), m_LastSpheres) && isSceneUnchanged;
+		isSceneUnchanged = IsUnchanged(scene.GetPlaneGeometries(), m_LastPlanes) && isSceneUnchanged;
+		m_IsSceneUnchanged = isSceneUnchanged;
+
+		const bool isIncremental{ isSceneUnchanged && camera.cameraToWorld == m_LastCameraToWorld && fov == m_LastFov };
+
+		m_pLastScene = &scene;
+		m_LastCameraToWorld = camera.cameraToWorld;
+		m_LastFov = fov;
+		m_LastSettingsKey = settingsKey;
+
+		m_MovedBounds = scene.GetMovedBounds();
+		m_Footprints.clear();
+		if (!isIncremental) return false;
+
+		const Matrix worldToCamera{ camera.cameraToWorld.Inverse() };
+		for (const MovedBounds& bounds : m_MovedBounds)
+		{
+			m_Footprints.push_back(Project(bounds, worldToCamera, fov, aspectRatio));
+		}
+
+		return true;
+	}
+
+	bool DirtyRegions::IsDirty(int px, int py) const
+	{
+		for (const Rect& footprint : m_Footprints)
+		{
+			if (px >= footprint.minX && px < footprint.maxX && py >= footprint.minY && py < footprint.maxY) return true;
+		}
+
+		const CachedPixel& pixel{ m_Pixels[px + py * m_Width] };
+		if (!pixel.didHit || m_MovedBounds.empty()) return false;
+
+		// The shadow ray of the pixel, from the hit point (t = 0) to the light (t = 1), can now be blocked or free
+		for (const Light& light : m_LastLights)
+		{
+			const Vector3 toLight{ LightUtils::GetDirectionToLight(light, pixel.hitOrigin) };
+			const Vector3 inverseDirection{ 1.f / toLight.x, 1.f / toLight.y, 1.f / toLight.z };
+
+			for (const MovedBounds& bounds : m_MovedBounds)
+			{
+				if (GeometryUtils::SlabDistance_AABB(bounds.minAABB, bounds.maxAABB, pixel.hitOrigin, inverseDirection, 1.f) != FLT_MAX) return true;
+			}
+		}
+
+		return false;
+	}
+
+	void DirtyRegions::SetPrimaryHit(int px, int py, const HitRecord& hit)
+	{
+		CachedPixel& pixel{ m_Pixels[px + py * m_Width] };
+		pixel.hitOrigin = hit.origin;
+		pixel.didHit = hit.didHit;
+		pixel.tracedFrame = m_Frame;
+	}
+
+	uint32_t DirtyRegions::CountTracedPixels() const
+	{
+		return static_cast<uint32_t>(std::ranges::count_if(m_Pixels, [this](const CachedPixel& pixel) { return pixel.tracedFrame == m_Frame; }));
+	}
+
+	DirtyRegions::Rect DirtyRegions::Project(const MovedBounds& bounds, const Matrix& worldToCamera, float fov, float aspectRatio) const
+	{
+		const Rect screen{ 0, 0, m_Width, m_Height };
+
+		float minX{ FLT_MAX };
+		float minY{ FLT_MAX };
+		float maxX{ -FLT_MAX };
+		float maxY{ -FLT_MAX };
+		for (int corner{ 0 }; corner < 8; ++corner)
+		{
+			const Vector3 point
+			{
+				corner & 1 ? bounds.maxAABB.x : bounds.minAABB.x,
+				corner & 2 ? bounds.maxAABB.y : bounds.minAABB.y,
+				corner & 4 ? bounds.maxAABB.z : bounds.minAABB.z
+			};
+			const Vector3 cameraPoint{ worldToCamera.TransformPoint(point) };
+
+			// A corner behind the camera projects to the wrong side, the box can cover any part of the screen
+			if (cameraPoint.z <= 1e-4f) return screen;
+
+			// Inverse of the mapping in Renderer::TracePrimary
+			const float x{ (cameraPoint.x / (cameraPoint.z * aspectRatio * fov) + 1.f) * .5f * static_cast<float>(m_Width) };
+			const float y{ (1.f - cameraPoint.y / (cameraPoint.z * fov)) * .5f * static_cast<float>(m_Height) };
+			minX = std::min(minX, x);
+			minY = std::min(minY, y);
+			maxX = std::max(maxX, x);
+			maxY = std::max(maxY, y);
+		}
+
+		// One extra pixel on every side, a pixel center right on the edge still counts
+		// Clamped while still a float, corners close to the camera plane project far outside the int range
+		const float width{ static_cast<float>(m_Width) };
+		const float height{ static_cast<float>(m_Height) };
+		return Rect
+		{
+			static_cast<int>(std::clamp(std::floor(minX) - 1.f, 0.f, width)),
+			static_cast<int>(std::clamp(std::floor(minY) - 1.f, 0.f, height)),
+			static_cast<int>(std::clamp(std::ceil(maxX) + 1.f, 0.f, width)),
+			static_cast<int>(std::clamp(std::ceil(maxY) + 1.f, 0.f, height))
+		};
+	}
+}
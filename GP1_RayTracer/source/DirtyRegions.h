@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "DataTypes.h"
+#include "Matrix.h"
+
+namespace dae
+{
+	class Scene;
+	struct Camera;
+
+	/**
+	 * \brief Decides which pixels have to be traced again when only meshes moved since the last frame
+	 * A pixel is dirty when it lies inside the screen footprint of a moved mesh (its box before and after the move) or when
+	 * the shadow ray from its cached primary hit to any light passes through such a box, every other pixel keeps its color
+	 */
+	class DirtyRegions final
+	{
+	public:
+		struct Rect
+		{
+			int minX{};
+			int minY{};
+			int maxX{}; // Exclusive
+			int maxY{}; // Exclusive
+		};
+
+		DirtyRegions() = default;
+		~DirtyRegions() = default;
+
+		DirtyRegions(const DirtyRegions&) = delete;
+		DirtyRegions(DirtyRegions&&) noexcept = delete;
+		DirtyRegions& operator=(const DirtyRegions&) = delete;
+		DirtyRegions& operator=(DirtyRegions&&) noexcept = delete;
+
+		// Drops the cached pixels, the next frame traces every pixel
+		void Resize(int width, int height);
+
+		// Compares the frame with the previous one, false when every pixel has to be traced
+		// (first frame, other scene, camera, lights, spheres, planes or any of the render settings changed)
+		// settingsKey holds everything besides the scene that changes the pixels, packed in one value
+		bool BeginFrame(const Scene& scene, const Camera& camera, float fov, float aspectRatio, uint32_t settingsKey);
+		// Forces the next frame to trace every pixel
+		void Invalidate() { m_pLastScene = nullptr; }
+		// Same scene, lights, spheres, planes and settings as the last frame, only the camera and meshes may have moved
+		bool IsSceneUnchanged() const { return m_IsSceneUnchanged; }
+
+		// Only valid for frames where BeginFrame returned true, thread safe
+		bool IsDirty(int px, int py) const;
+		// Called for every traced pixel, pixels are only ever written by one thread
+		void SetPrimaryHit(int px, int py, const HitRecord& hit);
+
+		// Pixels traced since BeginFrame
+		bool WasTraced(int px, int py) const { return m_Pixels[px + py * m_Width].tracedFrame == m_Frame; }
+		uint32_t CountTracedPixels() const;
+		const std::vector<Rect>& GetFootprints() const { return m_Footprints; }
+
+	private:
+		struct CachedPixel
+		{
+			Vector3 hitOrigin{};
+			uint32_t tracedFrame{};
+			bool didHit{};
+		};
+
+		int m_Width{};
+		int m_Height{};
+
+		std::vector<CachedPixel> m_Pixels{};
+		uint32_t m_Frame{};
+
+		// This frame: the moved boxes and where they land on screen
+		std::vector<MovedBounds> m_MovedBounds{};
+		std::vector<Rect> m_Footprints{};
+
+		// Last frame, everything that is not allowed to change for an incremental frame
+		const Scene* m_pLastScene{ nullptr };
+		Matrix m_LastCameraToWorld{};
+		float m_LastFov{};
+		uint32_t m_LastSettingsKey{};
+		bool m_IsSceneUnchanged{ false };
+		std::vector<Light> m_LastLights{};
+		std::vector<Sphere> m_LastSpheres{};
+		std::vector<Plane> m_LastPlanes{};
+
+		// Screen rectangle covering the box, the whole screen when the box reaches behind the camera
+		Rect Project(const MovedBounds& bounds, const Matrix& worldToCamera, float fov, float aspectRatio) const;
+	};
+}
@@ -0,0 +1,517 @@
+#include "DistributedRenderer.h"
+
+//Project includes
+#include "Benchmark.h"
+#include "Renderer.h"
+#include "Scene.h"
+
+//Standard includes
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char** environ;
+#endif
+
+namespace dae
+{
+#pragma region Protocol
+	namespace
+	{
+		// Both ends run the same build, so messages are plain structs in native byte order
+		constexpr uint32_t ProtocolVersion{ 1 };
+		// Larger than the pixels of a full 4K frame, a bigger size is a corrupt header and not a reason to allocate it
+		constexpr uint32_t MaxPayloadSize{ 1u << 26 };
+
+		enum class MessageType : uint32_t
+		{
+			Hello, // Worker: ProtocolVersion
+			Setup, // Coordinator: SetupMessage followed by the scene name
+			Ready, // Worker: scene is loaded
+			Frame, // Coordinator: FrameMessage, applies to all following tiles
+			Tile, // Coordinator: TileMessage
+			TileResult, // Worker: TileMessage followed by the packed RGB pixels
+			Shutdown // Coordinator
+		};
+
+		struct MessageHeader
+		{
+			MessageType type{};
+			uint32_t size{}; // Payload bytes after the header
+		};
+
+		struct SetupMessage
+		{
+			uint32_t width{};
+			uint32_t height{};
+		};
+
+		struct FrameMessage
+		{
+			uint32_t frameIndex{};
+			Vector3 origin{};
+			Vector3 forward{};
+			float fovAngle{};
+			RenderSettings settings{};
+		};
+
+		struct TileMessage
+		{
+			uint32_t frameIndex{};
+			uint32_t tileIndex{};
+			int x{};
+			int y{};
+			int width{};
+			int height{};
+		};
+
+		bool WriteMessage(const Socket& socket, MessageType type, const void* pPayload = nullptr, uint32_t size = 0, const void* pExtra = nullptr, uint32_t extraSize = 0)
+		{
+			// One buffer, one send
+			std::vector<uint8_t> buffer(sizeof(MessageHeader) + size + extraSize);
+
+			const MessageHeader header{ type, size + extraSize };
+			std::memcpy(buffer.data(), &header, sizeof(header));
+			if (size > 0) std::memcpy(buffer.data() + sizeof(header), pPayload, size);
+			if (extraSize > 0) std::memcpy(buffer.data() + sizeof(header) + size, pExtra, extraSize);
+
+			return socket.SendAll(buffer.data(), buffer.size());
+		}
+
+		bool ReadMessage(const Socket& socket, MessageType& type, std::vector<uint8_t>& payload)
+		{
+			MessageHeader header{};
+			if (!socket.ReceiveAll(&header, sizeof(header))) return false;
+
+			if (header.size > MaxPayloadSize) return false;
+
+			type = header.type;
+			payload.resize(header.size);
+
+			return header.size == 0 || socket.ReceiveAll(payload.data(), header.size);
+		}
+
+		template<typename T>
+		bool ReadPayload(const std::vector<uint8_t>& payload, T& value)
+		{
+			if (payload.size() < sizeof(T)) return false;
+
+			std::memcpy(&value, payload.data(), sizeof(T));
+			return true;
+		}
+	}
+#pragma endregion
+
+#pragma region RenderCoordinator
+	RenderCoordinator::RenderCoordinator(Renderer* pRenderer, uint32_t tileSize) :
+		m_pRenderer{ pRenderer },
+		m_TileSize{ std::max(tileSize, 1u) }
+	{
+		// Row by row, the tile index is what travels over the wire
+		const int tileSizeInt{ static_cast<int>(m_TileSize) };
+		for (int y{ 0 }; y < m_pRenderer->GetHeight(); y += tileSizeInt)
+		{
+			for (int x{ 0 }; x < m_pRenderer->GetWidth(); x += tileSizeInt)
+			{
+				Tile tile{};
+				tile.x = x;
+				tile.y = y;
+				tile.width = std::min(tileSizeInt, m_pRenderer->GetWidth() - x);
+				tile.height = std::min(tileSizeInt, m_pRenderer->GetHeight() - y);
+				m_Tiles.push_back(tile);
+			}
+		}
+	}
+
+	RenderCoordinator::~RenderCoordinator()
+	{
+		Stop();
+	}
+
+	bool RenderCoordinator::Start(const std::string& sceneName, uint32_t numWorkers, uint32_t numLocalWorkers, uint16_t port)
+	{
+		m_Listener = Socket::Listen(port);
+		if (!m_Listener.IsValid()) return false;
+
+		const uint16_t listenPort{ m_Listener.GetPort() };
+		std::cout << "Coordinator listening on port " << listenPort << ", waiting for " << numWorkers << " render workers\n";
+
+		for (uint32_t i{ 0 }; i < std::min(numLocalWorkers, numWorkers); ++i)
+		{
+			if (!SpawnLocalWorker(listenPort))
+				std::cout << "Could not start local render worker " << i << '\n';
+		}
+
+		// Workers load the scene in parallel, the setup is sent as soon as one connects
+		const SetupMessage setup{ static_cast<uint32_t>(m_pRenderer->GetWidth()), static_cast<uint32_t>(m_pRenderer->GetHeight()) };
+		std::vector<bool> readable{};
+		while (m_Workers.size() < numWorkers && Socket::Poll({ &m_Listener }, readable, ConnectTimeoutMs))
+		{
+			Worker worker{};
+			worker.socket = m_Listener.Accept();
+			if (!worker.socket.IsValid()) continue;
+
+			MessageType type{};
+			std::vector<uint8_t> payload{};
+			uint32_t version{};
+			if (!ReadMessage(worker.socket, type, payload) || type != MessageType::Hello || !ReadPayload(payload, version) || version != ProtocolVersion)
+			{
+				std::cout << "Rejected a render worker with a different protocol version\n";
+				continue;
+			}
+
+			if (WriteMessage(worker.socket, MessageType::Setup, &setup, sizeof(setup), sceneName.data(), static_cast<uint32_t>(sceneName.size())))
+				m_Workers.push_back(std::move(worker));
+		}
+
+		for (Worker& worker : m_Workers)
+		{
+			MessageType type{};
+			std::vector<uint8_t> payload{};
+			if (!ReadMessage(worker.socket, type, payload) || type != MessageType::Ready)
+				LoseWorker(worker);
+		}
+
+		const uint32_t numAliveWorkers{ GetNumAliveWorkers() };
+		if (numAliveWorkers == 0)
+		{
+			std::cout << "No render worker connected\n";
+			return false;
+		}
+
+		std::cout << numAliveWorkers << " render workers ready\n";
+		return true;
+	}
+
+	void RenderCoordinator::Stop()
+	{
+		for (Worker& worker : m_Workers)
+		{
+			if (worker.isAlive) WriteMessage(worker.socket, MessageType::Shutdown);
+			worker.socket.Close();
+		}
+		m_Workers.clear();
+		m_Listener.Close();
+
+#if !defined(_WIN32)
+		for (const int process : m_LocalWorkerProcesses)
+		{
+			waitpid(process, nullptr, 0);
+		}
+#endif
+		m_LocalWorkerProcesses.clear();
+	}
+
+	void RenderCoordinator::RenderFrame(Scene* pScene)
+	{
+		++m_FrameIndex;
+
+		const Camera& camera{ pScene->GetCamera() };
+		const FrameMessage frame{ m_FrameIndex, camera.origin, camera.forward, camera.fovAngle, m_pRenderer->GetSettings() };
+		for (Worker& worker : m_Workers)
+		{
+			if (worker.isAlive && !WriteMessage(worker.socket, MessageType::Frame, &frame, sizeof(frame)))
+				LoseWorker(worker);
+		}
+
+		m_PendingTiles.clear();
+		for (uint32_t i{ 0 }; i < static_cast<uint32_t>(m_Tiles.size()); ++i)
+		{
+			m_Tiles[i].isDone = false;
+			m_Tiles[i].numIssues = 0;
+			m_PendingTiles.push_back(i);
+		}
+		m_NumTilesDone = 0;
+
+		std::vector<const Socket*> sockets{};
+		std::vector<Worker*> socketWorkers{};
+		std::vector<bool> readable{};
+		while (m_NumTilesDone < m_Tiles.size())
+		{
+			AssignTiles();
+
+			sockets.clear();
+			socketWorkers.clear();
+			for (Worker& worker : m_Workers)
+			{
+				if (!worker.isAlive) continue;
+				sockets.push_back(&worker.socket);
+				socketWorkers.push_back(&worker);
+			}
+
+			if (sockets.empty())
+			{
+				std::cout << "No render workers left, rendering the remaining tiles locally\n";
+				m_pRenderer->BeginRects(pScene);
+				for (Tile& tile : m_Tiles)
+				{
+					if (tile.isDone) continue;
+					m_pRenderer->RenderRect(pScene, tile.x, tile.y, tile.width, tile.height);
+					tile.isDone = true;
+				}
+				m_NumTilesDone = static_cast<uint32_t>(m_Tiles.size());
+				break;
+			}
+
+			if (Socket::Poll(sockets, readable, 1000))
+			{
+				for (size_t i{ 0 }; i < sockets.size(); ++i)
+				{
+					if (readable[i]) ReceiveTile(*socketWorkers[i]);
+				}
+			}
+
+			DropHungWorkers();
+		}
+
+		m_pRenderer->Present();
+	}
+
+	void RenderCoordinator::PrintStatistics() const
+	{
+		std::cout << "\n**DISTRIBUTED RENDERING**\n";
+		for (size_t i{ 0 }; i < m_Workers.size(); ++i)
+		{
+			std::cout << ">> WORKER " << i << (m_Workers[i].isAlive ? "" : " (lost)") << " = " << m_Workers[i].numTilesRendered << " tiles\n";
+		}
+		std::cout << ">> REISSUED TILES = " << m_NumReissuedTiles << '\n';
+		std::cout << ">> DISCARDED DUPLICATES = " << m_NumDiscardedTiles << '\n';
+		std::cout << ">> TIMED OUT WORKERS = " << m_NumTimedOutWorkers << "\n\n";
+	}
+
+	bool RenderCoordinator::SpawnLocalWorker(uint16_t port)
+	{
+		const std::string address{ "127.0.0.1:" + std::to_string(port) };
+
+#if defined(_WIN32)
+		char executablePath[MAX_PATH]{};
+		GetModuleFileNameA(nullptr, executablePath, MAX_PATH);
+
+		std::string commandLine{ "\"" + std::string{ executablePath } + "\" --worker " + address };
+
+		STARTUPINFOA startupInfo{};
+		startupInfo.cb = sizeof(startupInfo);
+		PROCESS_INFORMATION processInfo{};
+		if (!CreateProcessA(executablePath, commandLine.data(), nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startupInfo, &processInfo))
+			return false;
+
+		// The worker exits on its own once the connection closes
+		CloseHandle(processInfo.hThread);
+		CloseHandle(processInfo.hProcess);
+#else
+		std::string arguments[]{ "RayTracer", "--worker", address };
+		char* argv[]{ arguments[0].data(), arguments[1].data(), arguments[2].data(), nullptr };
+
+		pid_t process{};
+		if (posix_spawn(&process, "/proc/self/exe", nullptr, nullptr, argv, environ) != 0)
+			return false;
+
+		m_LocalWorkerProcesses.push_back(static_cast<int>(process));
+#endif
+
+		return true;
+	}
+
+	void RenderCoordinator::AssignTiles()
+	{
+		for (Worker& worker : m_Workers)
+		{
+			while (worker.isAlive && worker.tilesInFlight.size() < MaxTilesInFlight)
+			{
+				uint32_t tileIndex{};
+				if (!m_PendingTiles.empty())
+				{
+					tileIndex = m_PendingTiles.front();
+					m_PendingTiles.pop_front();
+					if (m_Tiles[tileIndex].isDone) continue;
+				}
+				else if (worker.tilesInFlight.empty())
+				{
+					// Nothing left to hand out, an idle worker takes over the tile another worker has been on the longest
+					const auto straggler{ std::min_element(m_Tiles.begin(), m_Tiles.end(), [](const Tile& a, const Tile& b)
+						{
+							const bool canReissueA{ !a.isDone && a.numIssues > 0 && a.numIssues < MaxIssuesPerTile };
+							const bool canReissueB{ !b.isDone && b.numIssues > 0 && b.numIssues < MaxIssuesPerTile };
+							if (canReissueA != canReissueB) return canReissueA;
+							return a.issueTime < b.issueTime;
+						}) };
+
+					if (straggler->isDone || straggler->numIssues == 0 || straggler->numIssues >= MaxIssuesPerTile) break;
+
+					tileIndex = static_cast<uint32_t>(straggler - m_Tiles.begin());
+					++m_NumReissuedTiles;
+				}
+				else
+				{
+					break;
+				}
+
+				if (!IssueTile(worker, tileIndex)) LoseWorker(worker);
+			}
+		}
+	}
+
+	bool RenderCoordinator::IssueTile(Worker& worker, uint32_t tileIndex)
+	{
+		Tile& tile{ m_Tiles[tileIndex] };
+		const TileMessage message{ m_FrameIndex, tileIndex, tile.x, tile.y, tile.width, tile.height };
+
+		// Recorded before sending, so LoseWorker hands it out again when the send fails
+		++tile.numIssues;
+		tile.issueTime = std::chrono::steady_clock::now();
+		worker.tilesInFlight.push_back({ m_FrameIndex, tileIndex, tile.issueTime });
+
+		return WriteMessage(worker.socket, MessageType::Tile, &message, sizeof(message));
+	}
+
+	void RenderCoordinator::ReceiveTile(Worker& worker)
+	{
+		MessageType type{};
+		std::vector<uint8_t> payload{};
+		TileMessage message{};
+		if (!ReadMessage(worker.socket, type, payload) || type != MessageType::TileResult || !ReadPayload(payload, message) || message.tileIndex >= m_Tiles.size())
+		{
+			LoseWorker(worker);
+			return;
+		}
+
+		std::erase_if(worker.tilesInFlight, [&](const TileInFlight& tileInFlight)
+			{
+				return tileInFlight.frameIndex == message.frameIndex && tileInFlight.tileIndex == message.tileIndex;
+			});
+
+		// Duplicates of a re-issued tile and late tiles of an older frame
+		Tile& tile{ m_Tiles[message.tileIndex] };
+		if (message.frameIndex != m_FrameIndex || tile.isDone)
+		{
+			++m_NumDiscardedTiles;
+			return;
+		}
+
+		const size_t numPixelBytes{ static_cast<size_t>(tile.width) * tile.height * 3 };
+		if (payload.size() != sizeof(message) + numPixelBytes)
+		{
+			LoseWorker(worker);
+			return;
+		}
+
+		m_pRenderer->WriteRect(tile.x, tile.y, tile.width, tile.height, payload.data() + sizeof(message));
+		tile.isDone = true;
+		++m_NumTilesDone;
+		++worker.numTilesRendered;
+	}
+
+	void RenderCoordinator::DropHungWorkers()
+	{
+		const auto deadline{ std::chrono::steady_clock::now() - std::chrono::milliseconds{ TileTimeoutMs } };
+		for (Worker& worker : m_Workers)
+		{
+			const bool isHung{ std::ranges::any_of(worker.tilesInFlight, [&](const TileInFlight& tileInFlight)
+				{
+					return tileInFlight.frameIndex == m_FrameIndex && !m_Tiles[tileInFlight.tileIndex].isDone && tileInFlight.issueTime < deadline;
+				}) };
+			if (!worker.isAlive || !isHung) continue;
+
+			std::cout << "A render worker did not answer within " << TileTimeoutMs << "ms\n";
+			++m_NumTimedOutWorkers;
+			LoseWorker(worker);
+		}
+	}
+
+	void RenderCoordinator::LoseWorker(Worker& worker)
+	{
+		if (!worker.isAlive) return;
+
+		std::cout << "Lost a render worker, its tiles are handed out again\n";
+		worker.isAlive = false;
+		worker.socket.Close();
+
+		for (const TileInFlight& tileInFlight : worker.tilesInFlight)
+		{
+			if (tileInFlight.frameIndex == m_FrameIndex && !m_Tiles[tileInFlight.tileIndex].isDone)
+				m_PendingTiles.push_front(tileInFlight.tileIndex);
+		}
+		worker.tilesInFlight.clear();
+	}
+
+	uint32_t RenderCoordinator::GetNumAliveWorkers() const
+	{
+		return static_cast<uint32_t>(std::count_if(m_Workers.begin(), m_Workers.end(), [](const Worker& worker) { return worker.isAlive; }));
+	}
+#pragma endregion
+
+#pragma region RenderWorker
+	int RenderWorker::Run(const std::string& host, uint16_t port)
+	{
+		const Socket socket{ Socket::Connect(host, port) };
+		if (!socket.IsValid())
+		{
+			std::cout << "Could not connect to the coordinator at " << host << ':' << port << '\n';
+			return 1;
+		}
+
+		if (!WriteMessage(socket, MessageType::Hello, &ProtocolVersion, sizeof(ProtocolVersion))) return 1;
+
+		MessageType type{};
+		std::vector<uint8_t> payload{};
+		SetupMessage setup{};
+		if (!ReadMessage(socket, type, payload) || type != MessageType::Setup || !ReadPayload(payload, setup)) return 1;
+
+		const std::string sceneName{ payload.begin() + sizeof(setup), payload.end() };
+		const std::unique_ptr<Scene> pScene{ Benchmark::LoadScene(sceneName) };
+		if (!pScene) return 1;
+
+		const auto pRenderer{ std::make_unique<Renderer>(static_cast<int>(setup.width), static_cast<int>(setup.height)) };
+		bool isRunning{ WriteMessage(socket, MessageType::Ready) };
+
+		std::vector<uint8_t> pixels{};
+		while (isRunning && ReadMessage(socket, type, payload))
+		{
+			switch (type)
+			{
+			case MessageType::Frame:
+			{
+				FrameMessage frame{};
+				if (!ReadPayload(payload, frame)) break;
+
+				Camera& camera{ pScene->GetCamera() };
+				camera.origin = frame.origin;
+				camera.forward = frame.forward;
+				camera.fovAngle = frame.fovAngle;
+				pRenderer->SetSettings(frame.settings);
+				pRenderer->BeginRects(pScene.get());
+				break;
+			}
+			case MessageType::Tile:
+			{
+				TileMessage tile{};
+				if (!ReadPayload(payload, tile)) break;
+
+				pRenderer->RenderRect(pScene.get(), tile.x, tile.y, tile.width, tile.height);
+
+				pixels.resize(static_cast<size_t>(tile.width) * tile.height * 3);
+				pRenderer->ReadRect(tile.x, tile.y, tile.width, tile.height, pixels.data());
+
+				isRunning = WriteMessage(socket, MessageType::TileResult, &tile, sizeof(tile), pixels.data(), static_cast<uint32_t>(pixels.size()));
+				break;
+			}
+			case MessageType::Shutdown:
+			default:
+				isRunning = false;
+				break;
+			}
+		}
+
+		return 0;
+	}
+#pragma endregion
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "Socket.h"
+
+namespace dae
+{
+	class Renderer;
+	class Scene;
+
+	// Splits frames into tiles and hands them to render worker processes over TCP
+	// Workers pull tiles one by one, so faster workers simply end up rendering more of them
+	class RenderCoordinator final
+	{
+	public:
+		RenderCoordinator(Renderer* pRenderer, uint32_t tileSize);
+		~RenderCoordinator();
+
+		RenderCoordinator(const RenderCoordinator&) = delete;
+		RenderCoordinator(RenderCoordinator&&) noexcept = delete;
+		RenderCoordinator& operator=(const RenderCoordinator&) = delete;
+		RenderCoordinator& operator=(RenderCoordinator&&) noexcept = delete;
+
+		// Starts numLocalWorkers copies of this executable and waits for numWorkers workers (local or remote) to load the scene
+		bool Start(const std::string& sceneName, uint32_t numWorkers, uint32_t numLocalWorkers, uint16_t port);
+		void Stop();
+
+		// Renders the camera of pScene into the renderer's buffer, tiles are rendered locally once no worker is left
+		void RenderFrame(Scene* pScene);
+		void PrintStatistics() const;
+
+	private:
+		// Tiles in flight per worker, one being rendered and one waiting so the worker never idles on a round trip
+		static constexpr size_t MaxTilesInFlight{ 2 };
+		// A tile is handed out once more when its worker is slow, never more
+		static constexpr uint32_t MaxIssuesPerTile{ 2 };
+		static constexpr int ConnectTimeoutMs{ 30000 };
+		// A worker that keeps a tile longer than this is taken for hung, its tiles go to the other workers or are rendered here
+		static constexpr int TileTimeoutMs{ 10000 };
+
+		struct Tile
+		{
+			int x{};
+			int y{};
+			int width{};
+			int height{};
+
+			bool isDone{};
+			uint32_t numIssues{};
+			std::chrono::steady_clock::time_point issueTime{};
+		};
+
+		struct TileInFlight
+		{
+			uint32_t frameIndex{};
+			uint32_t tileIndex{};
+			std::chrono::steady_clock::time_point issueTime{};
+		};
+
+		struct Worker
+		{
+			Socket socket{};
+			bool isAlive{ true };
+
+			std::vector<TileInFlight> tilesInFlight{};
+			uint32_t numTilesRendered{};
+		};
+
+		Renderer* m_pRenderer{};
+		uint32_t m_TileSize{};
+
+		Socket m_Listener{};
+		std::vector<Worker> m_Workers{};
+		std::vector<int> m_LocalWorkerProcesses{};
+
+		std::vector<Tile> m_Tiles{};
+		std::deque<uint32_t> m_PendingTiles{};
+		uint32_t m_FrameIndex{};
+		uint32_t m_NumTilesDone{};
+
+		uint32_t m_NumReissuedTiles{};
+		uint32_t m_NumDiscardedTiles{};
+		uint32_t m_NumTimedOutWorkers{};
+
+		bool SpawnLocalWorker(uint16_t port);
+		void AssignTiles();
+		bool IssueTile(Worker& worker, uint32_t tileIndex);
+		void ReceiveTile(Worker& worker);
+		// Loses every worker that has had a tile of this frame for longer than TileTimeoutMs
+		void DropHungWorkers();
+		void LoseWorker(Worker& worker);
+		uint32_t GetNumAliveWorkers() const;
+	};
+
+	// Connects to a RenderCoordinator and renders the tiles it sends until it is told to stop
+	class RenderWorker final
+	{
+	public:
+		static int Run(const std::string& host, uint16_t port);
+	};
+}
@@ -0,0 +1,156 @@
+#include "FramePresenter.h"
+
+//External includes
+#include "SDL.h"
+#include "SDL_surface.h"
+
+//Project includes
+#include "Parallel.h"
+
+//Standard includes
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+namespace dae
+{
+	namespace
+	{
+		constexpr size_t CacheLineSize{ 64 };
+	}
+
+	SDL_Surface* CreateFrameBuffer(int width, int height, uint32_t pixelFormat)
+	{
+		// SDL only aligns its own surfaces to 16 bytes and packs the rows
+		const int pitch{ static_cast<int>((static_cast<size_t>(width) * sizeof(uint32_t) + CacheLineSize - 1) / CacheLineSize * CacheLineSize) };
+		const auto pPixels{ static_cast<uint8_t*>(::operator new(static_cast<size_t>(pitch) * height, std::align_val_t{ CacheLineSize })) };
+
+		concurrency::parallel_for(0, height, [=](int y)
+			{
+				std::memset(pPixels + static_cast<size_t>(y) * pitch, 0, static_cast<size_t>(pitch));
+			});
+
+		return SDL_CreateRGBSurfaceWithFormatFrom(pPixels, width, height, 32, pitch, pixelFormat);
+	}
+
+	void FreeFrameBuffer(SDL_Surface* pBuffer)
+	{
+		if (!pBuffer) return;
+
+		// The surface does not own the pixels it was created from
+		void* pPixels{ pBuffer->pixels };
+		SDL_FreeSurface(pBuffer);
+		::operator delete(pPixels, std::align_val_t{ CacheLineSize });
+	}
+
+	FramePresenter::FramePresenter(SDL_Window* pWindow, int numBuffers) :
+		m_pWindow{ pWindow },
+		m_pWindowSurface{ SDL_GetWindowSurface(pWindow) }
+	{
+		// One buffer is traced while the other one is in the window, a third one keeps tracing while a screenshot holds the last frame
+		for (int i{ 0 }; i < std::max(numBuffers, 2); ++i)
+		{
+			m_Buffers.push_back(CreateFrameBuffer(m_pWindowSurface->w, m_pWindowSurface->h, m_pWindowSurface->format->format));
+		}
+		m_PendingJobs.resize(m_Buffers.size());
+
+		m_Thread = std::thread{ &FramePresenter::Run, this };
+	}
+
+	FramePresenter::~FramePresenter()
+	{
+		{
+			const std::lock_guard lock{ m_Mutex };
+			m_IsRunning = false;
+		}
+		m_JobAdded.notify_one();
+		m_Thread.join();
+
+		for (SDL_Surface* pBuffer : m_Buffers)
+		{
+			FreeFrameBuffer(pBuffer);
+		}
+	}
+
+	SDL_Surface* FramePresenter::AcquireBackBuffer()
+	{
+		std::unique_lock lock{ m_Mutex };
+
+		// Oldest frames are presented first, so the buffer after the last frame frees up first
+		const size_t lastFrame{ m_pLastFrame ? GetBufferIndex(m_pLastFrame) : m_Buffers.size() - 1 };
+		size_t bufferIndex{};
+		m_JobDone.wait(lock, [&]()
+			{
+				for (size_t i{ 1 }; i <= m_Buffers.size(); ++i)
+				{
+					bufferIndex = (lastFrame + i) % m_Buffers.size();
+					if (m_Buffers[bufferIndex] != m_pLastFrame && m_PendingJobs[bufferIndex] == 0) return true;
+				}
+				return false;
+			});
+
+		return m_Buffers[bufferIndex];
+	}
+
+	void FramePresenter::Submit(SDL_Surface* pFrame)
+	{
+		// Same pixel format, the blit is a plain copy of every row
+		SDL_BlitSurface(pFrame, nullptr, m_pWindowSurface, nullptr);
+		SDL_UpdateWindowSurface(m_pWindow);
+		m_pLastFrame = pFrame;
+	}
+
+	void FramePresenter::RequestScreenshot(const std::string& path)
+	{
+		if (m_pLastFrame) Push({ m_pLastFrame, path });
+	}
+
+	void FramePresenter::Push(Job&& job)
+	{
+		{
+			const std::lock_guard lock{ m_Mutex };
+			++m_PendingJobs[GetBufferIndex(job.pFrame)];
+			m_Jobs.push_back(std::move(job));
+		}
+		m_JobAdded.notify_one();
+	}
+
+	void FramePresenter::Run()
+	{
+		std::unique_lock lock{ m_Mutex };
+		while (true)
+		{
+			m_JobAdded.wait(lock, [this]() { return !m_Jobs.empty() || !m_IsRunning; });
+
+			// Shutting down still finishes the queue, a requested screenshot is always written
+			if (m_Jobs.empty()) return;
+
+			const Job job{ std::move(m_Jobs.front()) };
+			m_Jobs.pop_front();
+
+			lock.unlock();
+			Execute(job);
+			lock.lock();
+
+			--m_PendingJobs[GetBufferIndex(job.pFrame)];
+			m_JobDone.notify_all();
+		}
+	}
+
+	void FramePresenter::Execute(const Job& job)
+	{
+		if (SDL_SaveBMP(job.pFrame, job.screenshotPath.c_str()) == 0)
+			std::cout << "Screenshot saved!\n";
+		else
+			std::cout << "Something went wrong. Screenshot not saved!\n";
+	}
+
+	size_t FramePresenter::GetBufferIndex(const SDL_Surface* pFrame) const
+	{
+		const auto buffer{ std::ranges::find(m_Buffers, pFrame) };
+		assert(buffer != m_Buffers.end());
+		return static_cast<size_t>(buffer - m_Buffers.begin());
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct SDL_Window;
+struct SDL_Surface;
+
+namespace dae
+{
+	// Frame surface with 64-byte aligned rows, so a thread writing whole cache lines of a row never shares one with another row
+	// The rows are zeroed by the rendering threads, the pages end up on the memory nodes of the threads instead of all on the caller's
+	SDL_Surface* CreateFrameBuffer(int width, int height, uint32_t pixelFormat);
+	void FreeFrameBuffer(SDL_Surface* pBuffer);
+
+	/**
+	 * \brief Owns the framebuffers of a windowed Renderer, shows them in the window and writes screenshots on its own thread
+	 * SDL only allows the thread that created the window to blit to it and update it, so frames are presented on the calling thread
+	 * A BMP write can take longer than a frame, it runs on the screenshot thread while the next frames are traced into the other buffers
+	 */
+	class FramePresenter final
+	{
+	public:
+		static constexpr int DefaultNumBuffers{ 3 };
+
+		// The buffers use the pixel format of the window surface, presenting is a plain copy
+		FramePresenter(SDL_Window* pWindow, int numBuffers = DefaultNumBuffers);
+		// Finishes every submitted frame and screenshot first
+		~FramePresenter();
+
+		FramePresenter(const FramePresenter&) = delete;
+		FramePresenter(FramePresenter&&) noexcept = delete;
+		FramePresenter& operator=(const FramePresenter&) = delete;
+		FramePresenter& operator=(FramePresenter&&) noexcept = delete;
+
+		// A buffer no pending screenshot uses, never the last submitted frame
+		// Only blocks when screenshots hold every other buffer
+		SDL_Surface* AcquireBackBuffer();
+		// Copies the traced frame to the window, it becomes the last submitted frame
+		// Call it from the thread that created the window
+		void Submit(SDL_Surface* pFrame);
+		// Queues a BMP write of the last submitted frame, the result is printed once it is written
+		void RequestScreenshot(const std::string& path);
+
+		// Still holds the pixels of the last submitted frame, the screenshot thread only reads it
+		const SDL_Surface* GetLastFrame() const { return m_pLastFrame; }
+
+	private:
+		struct Job
+		{
+			SDL_Surface* pFrame{};
+			std::string screenshotPath{};
+		};
+
+		SDL_Window* m_pWindow{};
+		SDL_Surface* m_pWindowSurface{};
+
+		std::vector<SDL_Surface*> m_Buffers{};
+		std::vector<int> m_PendingJobs{}; // Per buffer, it can only be traced into again at 0
+		SDL_Surface* m_pLastFrame{ nullptr };
+
+		std::mutex m_Mutex{};
+		std::condition_variable m_JobAdded{};
+		std::condition_variable m_JobDone{};
+		std::deque<Job> m_Jobs{};
+		bool m_IsRunning{ true };
+
+		std::thread m_Thread{};
+
+		void Run();
+		void Execute(const Job& job);
+		void Push(Job&& job);
+		size_t GetBufferIndex(const SDL_Surface* pFrame) const;
+	};
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	/**
+	 * \brief Pyramid of the rays from one origin through a rectangle of the screen, without near or far plane
+	 * The tests are conservative: whatever they reject can't be hit by a ray inside the pyramid, not everything they keep is
+	 */
+	struct Frustum
+	{
+		Vector3 origin{};
+		Vector3 edges[4]{}; // Corner directions, in order around the rectangle
+		Vector3 normals[4]{}; // Side planes through the origin, pointing inwards
+
+		Frustum(const Vector3& _origin, const Vector3& corner0, const Vector3& corner1, const Vector3& corner2, const Vector3& corner3) :
+			origin{ _origin },
+			edges{ corner0, corner1, corner2, corner3 }
+		{
+			const Vector3 center{ corner0 + corner1 + corner2 + corner3 };
+			for (int i{ 0 }; i < 4; ++i)
+			{
+				normals[i] = Vector3::Cross(edges[i], edges[(i + 1) % 4]);
+				if (Vector3::Dot(normals[i], center) < 0.f) normals[i] = -normals[i];
+			}
+		}
+
+		bool IsSphereInside(const Vector3& center, float radius) const
+		{
+			// The side planes aren't normalized, the radius is scaled along
+			for (const Vector3& normal : normals)
+			{
+				if (Vector3::Dot(normal, center - origin) < -radius * normal.Magnitude()) return false;
+			}
+			return true;
+		}
+
+		bool IsAABBInside(const Vector3& minAABB, const Vector3& maxAABB) const
+		{
+			// Outside as soon as the corner furthest along a side's normal is behind that side
+			for (const Vector3& normal : normals)
+			{
+				const Vector3 furthest
+				{
+					normal.x >= 0.f ? maxAABB.x : minAABB.x,
+					normal.y >= 0.f ? maxAABB.y : minAABB.y,
+					normal.z >= 0.f ? maxAABB.z : minAABB.z
+				};
+				if (Vector3::Dot(normal, furthest - origin) < 0.f) return false;
+			}
+			return true;
+		}
+
+		bool IsPlaneInside(const Plane& plane) const
+		{
+			// Some ray reaches the plane when some corner direction heads towards it, the distance along a direction is linear in it
+			const float distance{ Vector3::Dot(plane.normal, origin - plane.origin) };
+			if (distance == 0.f) return true;
+
+			for (const Vector3& edge : edges)
+			{
+				if (Vector3::Dot(plane.normal, edge) * distance < 0.f) return true;
+			}
+			return false;
+		}
+	};
+
+	// Indices of the objects a frustum can see, see Scene::CullFrustum
+	struct FrustumCandidates
+	{
+		std::vector<uint32_t> spheres{};
+		std::vector<uint32_t> planes{};
+		std::vector<uint32_t> triangleMeshes{};
+		std::vector<uint32_t> triangleMeshInstances{};
+		std::vector<uint32_t> streamedMeshes{};
+
+		size_t GetSize() const { return spheres.size() + planes.size() + triangleMeshes.size() + triangleMeshInstances.size() + streamedMeshes.size(); }
+	};
+}
@@ -0,0 +1,167 @@
+#include "IrradianceCache.h"
+
+//Standard includes
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace dae
+{
+	bool IrradianceCache::Lookup(const Vector3& position, const Vector3& normal, ColorRGB& irradiance, std::span<const Record> pendingRecords) const
+	{
+		ColorRGB weightedSum{};
+		float totalWeight{ 0.f };
+		for (int level{ m_MinLevel }; level <= m_MaxLevel; ++level)
+		{
+			const float cellSize{ std::ldexp(1.f, level) };
+			const auto cell{ m_Cells.find(GetCellKey(level,
+				static_cast<int>(std::floor(position.x / cellSize)),
+				static_cast<int>(std::floor(position.y / cellSize)),
+				static_cast<int>(std::floor(position.z / cellSize)))) };
+			if (cell == m_Cells.end()) continue;
+
+			for (const uint32_t recordIndex : cell->second)
+			{
+				AddWeightedRecord(m_Records[recordIndex], position, normal, weightedSum, totalWeight);
+			}
+		}
+
+		// Only a few of them, not worth a grid
+		for (const Record& record : pendingRecords)
+		{
+			AddWeightedRecord(record, position, normal, weightedSum, totalWeight);
+		}
+
+		if (totalWeight <= 0.f) return false;
+
+		irradiance = weightedSum * (1.f / totalWeight);
+		irradiance.r = std::max(irradiance.r, 0.f);
+		irradiance.g = std::max(irradiance.g, 0.f);
+		irradiance.b = std::max(irradiance.b, 0.f);
+		return true;
+	}
+
+	void IrradianceCache::Insert(std::span<const Record> records)
+	{
+		for (const Record& record : records)
+		{
+			m_Records.push_back(record);
+			AddToCells(static_cast<uint32_t>(m_Records.size() - 1));
+		}
+	}
+
+	void IrradianceCache::Clear()
+	{
+		m_Records.clear();
+		m_Cells.clear();
+		m_MinLevel = INT32_MAX;
+		m_MaxLevel = INT32_MIN;
+	}
+
+	void IrradianceCache::Invalidate(const std::vector<MovedBounds>& movedBounds)
+	{
+		if (movedBounds.empty()) return;
+
+		// The harmonic mean distance is dominated by the nearby geometry, a box further away than a few times that barely changes the record
+		const auto isAffected{ [&](const Record& record)
+			{
+				const float reach{ 2.f * record.radius };
+				for (const MovedBounds& bounds : movedBounds)
+				{
+					const Vector3 closest{ Vector3::Max(bounds.minAABB, Vector3::Min(record.position, bounds.maxAABB)) };
+					if ((closest - record.position).SqrMagnitude() < reach * reach) return true;
+				}
+				return false;
+			} };
+
+		const size_t numRecords{ m_Records.size() };
+		std::erase_if(m_Records, isAffected);
+		if (m_Records.size() == numRecords) return;
+
+		m_Cells.clear();
+		m_MinLevel = INT32_MAX;
+		m_MaxLevel = INT32_MIN;
+		for (uint32_t i{ 0 }; i < m_Records.size(); ++i)
+		{
+			AddToCells(i);
+		}
+	}
+
+	size_t IrradianceCache::GetNumRecords() const
+	{
+		return m_Records.size();
+	}
+
+	void IrradianceCache::AddWeightedRecord(const Record& record, const Vector3& position, const Vector3& normal, ColorRGB& weightedSum, float& totalWeight) const
+	{
+		// Ward's error estimate: distance relative to the surroundings plus the normal difference
+		const Vector3 offset{ position - record.position };
+		const float normalError{ std::sqrt(std::max(1.f - Vector3::Dot(normal, record.normal), 0.f)) };
+		const float error{ offset.Magnitude() / record.radius + normalError };
+		if (error >= m_Accuracy) return;
+
+		// A record in front of the point sees geometry the point may not
+		if (Vector3::Dot(offset, (normal + record.normal) * .5f) < -.05f * record.radius) return;
+
+		// Falls off to 0 at the edge of the record, so records don't pop in
+		const float weight{ 1.f / std::max(error, 1e-4f) - 1.f / m_Accuracy };
+
+		const Vector3 rotation{ Vector3::Cross(record.normal, normal) };
+		const ColorRGB extrapolated
+		{
+			record.irradiance.r + Vector3::Dot(rotation, record.rotationalGradient[0]) + Vector3::Dot(offset, record.translationalGradient[0]),
+			record.irradiance.g + Vector3::Dot(rotation, record.rotationalGradient[1]) + Vector3::Dot(offset, record.translationalGradient[1]),
+			record.irradiance.b + Vector3::Dot(rotation, record.rotationalGradient[2]) + Vector3::Dot(offset, record.translationalGradient[2])
+		};
+
+		weightedSum += extrapolated * weight;
+		totalWeight += weight;
+	}
+
+	int IrradianceCache::GetLevel(float influenceRadius)
+	{
+		return static_cast<int>(std::ceil(std::log2(std::max(2.f * influenceRadius, 1e-6f))));
+	}
+
+	uint64_t IrradianceCache::GetCellKey(int level, int x, int y, int z)
+	{
+		// 6 bits level, 3 x 19 bits cell, far away cells can share a key, that only adds candidates that fail the error test
+		constexpr uint64_t cellMask{ (1u << 19) - 1 };
+		return static_cast<uint64_t>(level + 32) << 57
+			| (static_cast<uint64_t>(x) & cellMask) << 38
+			| (static_cast<uint64_t>(y) & cellMask) << 19
+			| (static_cast<uint64_t>(z) & cellMask);
+	}
+
+	void IrradianceCache::AddToCells(uint32_t recordIndex)
+	{
+		const Record& record{ m_Records[recordIndex] };
+		const float influenceRadius{ GetInfluenceRadius(record) };
+		const int level{ GetLevel(influenceRadius) };
+		const float cellSize{ std::ldexp(1.f, level) };
+
+		m_MinLevel = std::min(m_MinLevel, level);
+		m_MaxLevel = std::max(m_MaxLevel, level);
+
+		// The cell is at least twice the radius wide, so the sphere spans 1 or 2 cells per axis
+		const Vector3 minPoint{ record.position - Vector3{ influenceRadius, influenceRadius, influenceRadius } };
+		const Vector3 maxPoint{ record.position + Vector3{ influenceRadius, influenceRadius, influenceRadius } };
+		const int minX{ static_cast<int>(std::floor(minPoint.x / cellSize)) };
+		const int minY{ static_cast<int>(std::floor(minPoint.y / cellSize)) };
+		const int minZ{ static_cast<int>(std::floor(minPoint.z / cellSize)) };
+		const int maxX{ static_cast<int>(std::floor(maxPoint.x / cellSize)) };
+		const int maxY{ static_cast<int>(std::floor(maxPoint.y / cellSize)) };
+		const int maxZ{ static_cast<int>(std::floor(maxPoint.z / cellSize)) };
+
+		for (int x{ minX }; x <= maxX; ++x)
+		{
+			for (int y{ minY }; y <= maxY; ++y)
+			{
+				for (int z{ minZ }; z <= maxZ; ++z)
+				{
+					m_Cells[GetCellKey(level, x, y, z)].push_back(recordIndex);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "ColorRGB.h"
+#include "DataTypes.h"
+
+namespace dae
+{
+	/**
+	 * \brief Sparse world space irradiance samples, interpolated for the shading points around them (Ward et al. 1988)
+	 * Every record holds the irradiance arriving at one point with its rotational and translational gradient (Ward & Heckbert 1992),
+	 * it is used for every point whose distance and normal difference stay below the accuracy
+	 * Records stay valid while the geometry around them doesn't move, they are kept across frames
+	 */
+	class IrradianceCache final
+	{
+	public:
+		struct Record
+		{
+			Vector3 position{};
+			Vector3 normal{};
+			ColorRGB irradiance{};
+			float radius{}; // Harmonic mean distance to the surrounding geometry, clamped
+			Vector3 rotationalGradient[3]{}; // Per color channel
+			Vector3 translationalGradient[3]{}; // Per color channel
+		};
+
+		// Error allowed per record (a in Ward's paper), smaller is more records and better quality
+		static constexpr float DefaultAccuracy{ .25f };
+
+		explicit IrradianceCache(float accuracy = DefaultAccuracy) : m_Accuracy{ accuracy } {}
+		~IrradianceCache() = default;
+
+		IrradianceCache(const IrradianceCache&) = delete;
+		IrradianceCache(IrradianceCache&&) noexcept = delete;
+		IrradianceCache& operator=(const IrradianceCache&) = delete;
+		IrradianceCache& operator=(IrradianceCache&&) noexcept = delete;
+
+		// Weighted irradiance of the records around the point, false when none of them is close enough
+		// pendingRecords are searched as well, records a thread made that are not inserted yet
+		// Thread safe as long as nothing is inserted at the same time
+		bool Lookup(const Vector3& position, const Vector3& normal, ColorRGB& irradiance, std::span<const Record> pendingRecords = {}) const;
+		// Records are added in the order given, the same records in the same order always give the same cache
+		void Insert(std::span<const Record> records);
+
+		void Clear();
+		// Drops every record close enough to a moved box that the box can be part of what it saw
+		void Invalidate(const std::vector<MovedBounds>& movedBounds);
+
+		size_t GetNumRecords() const;
+		float GetAccuracy() const { return m_Accuracy; }
+
+	private:
+		float m_Accuracy{};
+
+		std::vector<Record> m_Records{};
+
+		// Records live in a grid per power of two cell size, big enough for the area they are used in to touch at most 8 cells
+		// A lookup only has to check the one cell that holds the point on every level in use
+		std::unordered_map<uint64_t, std::vector<uint32_t>> m_Cells{};
+		int m_MinLevel{ INT32_MAX };
+		int m_MaxLevel{ INT32_MIN };
+
+		float GetInfluenceRadius(const Record& record) const { return m_Accuracy * record.radius; }
+		void AddWeightedRecord(const Record& record, const Vector3& position, const Vector3& normal, ColorRGB& weightedSum, float& totalWeight) const;
+		static int GetLevel(float influenceRadius);
+		static uint64_t GetCellKey(int level, int x, int y, int z);
+		void AddToCells(uint32_t recordIndex);
+	};
+}
@@ -5,132 +5,221 @@
 
 namespace dae
 {
-#pragma region Material BASE
-	class Material
+	enum class MaterialType : uint8_t
 	{
-	public:
-		Material() = default;
-		virtual ~Material() = default;
-
-		Material(const Material&) = delete;
-		Material(Material&&) noexcept = delete;
-		Material& operator=(const Material&) = delete;
-		Material& operator=(Material&&) noexcept = delete;
-
-		/**
-		 * \brief Function used to calculate the correct color for the specific material and its parameters
-		 * \param hitRecord current hitrecord
-		 * \param l light direction
-		 * \param v view direction
-		 * \return color
-		 */
-		virtual ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) = 0;
+		SolidColor,
+		Lambert,
+		LambertPhong,
+		CookTorrence
 	};
-#pragma endregion
 
-#pragma region Material SOLID COLOR
-	//SOLID COLOR
-	//===========
-	class Material_SolidColor final : public Material
+	/**
+	 * \brief Plain material description, all materials of a scene live next to each other in one table
+	 * Everything that only depends on the material parameters is calculated once in the Create functions
+	 */
+	struct Material
 	{
-	public:
-		explicit Material_SolidColor(const ColorRGB& color) : m_Color(color)
+		static constexpr uint8_t NoTexture{ 0xFF };
+
+		MaterialType type{ MaterialType::SolidColor };
+		uint8_t albedoTexture{ NoTexture }; // Scene texture that replaces color per hit, see WithAlbedo
+
+		ColorRGB color{ colors::White }; // SolidColor: color, Lambert/LambertPhong: diffuse color, CookTorrence: albedo
+		ColorRGB diffuse{}; // Lambert: kd * cd / PI, CookTorrence: (1 - metalness) * albedo / PI (still scaled by 1 - F)
+		ColorRGB f0{}; // CookTorrence: base reflectivity
+
+		float diffuseReflectance{}; // Lambert/LambertPhong: kd, CookTorrence: 1 - metalness
+		float specularReflectance{}; // LambertPhong: ks
+		float phongExponent{}; // LambertPhong
+		float roughnessSquared{}; // CookTorrence: a = roughness^2 (UE4)
+		float geometryK{}; // CookTorrence: k = (a + 1)^2 / 8 (direct lighting)
+
+		static Material CreateSolidColor(const ColorRGB& color)
 		{
+			Material m{};
+			m.type = MaterialType::SolidColor;
+			m.color = color;
+			return m;
 		}
 
-		ColorRGB Shade([[maybe_unused]] const HitRecord& hitRecord = {}, [[maybe_unused]] const Vector3& l = {}, [[maybe_unused]] const Vector3& v = {}) override
+		static Material CreateLambert(const ColorRGB& diffuseColor, float diffuseReflectance)
 		{
-			return m_Color;
+			Material m{};
+			m.type = MaterialType::Lambert;
+			m.color = diffuseColor;
+			m.diffuse = BRDF::Lambert(diffuseReflectance, diffuseColor);
+			m.diffuseReflectance = diffuseReflectance;
+			return m;
 		}
 
-	private:
-		ColorRGB m_Color{ colors::White };
-	};
-#pragma endregion
-
-#pragma region Material LAMBERT
-	//LAMBERT
-	//=======
-	class Material_Lambert final : public Material
-	{
-	public:
-		Material_Lambert(const ColorRGB& diffuseColor, float diffuseReflectance) :
-			m_DiffuseColor(diffuseColor), m_DiffuseReflectance(diffuseReflectance) {}
-
-		ColorRGB Shade([[maybe_unused]] const HitRecord& hitRecord = {}, [[maybe_unused]] const Vector3& l = {}, [[maybe_unused]] const Vector3& v = {}) override
+		static Material CreateLambertPhong(const ColorRGB& diffuseColor, float kd, float ks, float phongExponent)
 		{
-			return BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor);
+			Material m{ CreateLambert(diffuseColor, kd) };
+			m.type = MaterialType::LambertPhong;
+			m.specularReflectance = ks;
+			m.phongExponent = phongExponent;
+			return m;
 		}
 
-	private:
-		ColorRGB m_DiffuseColor{ colors::White };
-		float m_DiffuseReflectance{ 1.f }; //kd
-	};
-#pragma endregion
-
-#pragma region Material LAMBERT PHONG
-	//LAMBERT-PHONG
-	//=============
-	class Material_LambertPhong final : public Material
-	{
-	public:
-		Material_LambertPhong(const ColorRGB& diffuseColor, float kd, float ks, float phongExponent) :
-			m_DiffuseColor(diffuseColor), m_DiffuseReflectance(kd), m_SpecularReflectance(ks),
-			m_PhongExponent(phongExponent)
+		static Material CreateCookTorrence(const ColorRGB& albedo, float metalness, float roughness)
 		{
+			Material m{};
+			m.type = MaterialType::CookTorrence;
+			m.color = albedo;
+			// Determine F0 value -> (0.04, 0.04, 0.04) or Albedo based on Metalness
+			m.f0 = metalness * albedo + (1.f - metalness) * colors::Specular;
+			// Cancel out the diffuse part if it's a metal (kd = 0)
+			m.diffuse = BRDF::Lambert(1.f - metalness, albedo);
+			m.diffuseReflectance = 1.f - metalness;
+			m.roughnessSquared = roughness * roughness;
+			m.geometryK = (m.roughnessSquared + 1.f) * (m.roughnessSquared + 1.f) / 8.f;
+			return m;
 		}
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		/**
+		 * \brief Same material with another color/albedo, used for the texel under a hit
+		 * Only the color dependent values are recalculated, the rest was already precomputed by the Create functions
+		 */
+		Material WithAlbedo(const ColorRGB& albedo) const
 		{
-			// Why is l negated and not v?
-			return BRDF::Lambert(m_DiffuseReflectance, m_DiffuseColor) + BRDF::Phong(m_SpecularReflectance, m_PhongExponent, l, -v, hitRecord.normal);
+			Material m{ *this };
+			m.color = albedo;
+
+			switch (type)
+			{
+			case MaterialType::SolidColor:
+				break;
+			case MaterialType::Lambert:
+			case MaterialType::LambertPhong:
+				m.diffuse = BRDF::Lambert(diffuseReflectance, albedo);
+				break;
+			case MaterialType::CookTorrence:
+				m.f0 = (1.f - diffuseReflectance) * albedo + diffuseReflectance * colors::Specular;
+				m.diffuse = BRDF::Lambert(diffuseReflectance, albedo);
+				break;
+			}
+
+			return m;
 		}
 
-	private:
-		ColorRGB m_DiffuseColor{ colors::White };
-		float m_DiffuseReflectance{ 0.5f }; //kd
-		float m_SpecularReflectance{ 0.5f }; //ks
-		float m_PhongExponent{ 1.f }; //Phong Exponent
-	};
-#pragma endregion
+		/**
+		 * \brief Function used to calculate the correct color for the specific material and its parameters
+		 * \tparam Math BRDF::PreciseMath or BRDF::FastMath
+		 * \param hitRecord current hitrecord
+		 * \param l light direction
+		 * \param v view direction
+		 * \return color
+		 */
+		template<typename Math = BRDF::PreciseMath>
+		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) const
+		{
+			switch (type)
+			{
+			case MaterialType::SolidColor:
+				return color;
+			case MaterialType::Lambert:
+				return diffuse;
+			case MaterialType::LambertPhong:
+				// Why is l negated and not v?
+				return diffuse + BRDF::Phong<Math>(specularReflectance, phongExponent, l, -v, hitRecord.normal);
+			case MaterialType::CookTorrence:
+				return ShadeCookTorrence<Math>(hitRecord, l, v);
+			}
+
+			return color;
+		}
 
-#pragma region Material COOK TORRENCE
-	//COOK TORRENCE
-	class Material_CookTorrence final : public Material
-	{
-	public:
-		Material_CookTorrence(const ColorRGB& albedo, float metalness, float roughness) :
-			m_Albedo(albedo), m_Metalness(metalness), m_Roughness(roughness)
+#ifdef USE_SSE
+		/**
+		 * \brief Shades 4 light directions for the same hit point at once with the fast approximations
+		 * \param hitRecord current hitrecord
+		 * \param l light directions, unused lanes only need to be valid (normalized) directions
+		 * \param v view direction
+		 * \param result color per light direction
+		 */
+		void Shade4(const HitRecord& hitRecord, const Vector3(&l)[4], const Vector3& v, ColorRGB(&result)[4]) const
 		{
+			switch (type)
+			{
+			case MaterialType::SolidColor:
+				std::fill(std::begin(result), std::end(result), color);
+				return;
+			case MaterialType::Lambert:
+				std::fill(std::begin(result), std::end(result), diffuse);
+				return;
+			case MaterialType::LambertPhong:
+			{
+				alignas(16) float phong[4];
+				_mm_store_ps(phong, BRDF::SIMD::Phong(specularReflectance, phongExponent, BRDF::SIMD::Load(l), -v, hitRecord.normal));
+				for (int i{ 0 }; i < 4; ++i)
+				{
+					result[i] = phong[i] < 0.f ? diffuse : diffuse + ColorRGB{ phong[i], phong[i], phong[i] };
+				}
+				return;
+			}
+			case MaterialType::CookTorrence:
+				ShadeCookTorrence4(hitRecord, l, v, result);
+				return;
+			}
 		}
+#endif
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+	private:
+		template<typename Math>
+		ColorRGB ShadeCookTorrence(const HitRecord& hitRecord, const Vector3& l, const Vector3& v) const
 		{
-			// Determine F0 value -> (0.04, 0.04, 0.04) or Albedo based on Metalness
-			const ColorRGB f0{ m_Metalness * m_Albedo + (1.f - m_Metalness) * colors::Specular };
 			// Calculate half vector between view direction and light direction
-			const Vector3 h{ (l + -v).Normalized() };
+			const Vector3 h{ Math::Normalized(l + -v) };
 			// Calculate fresnel (F)
-			const ColorRGB f{ BRDF::FresnelFunction_Schlick(h, -v, f0) };
+			const ColorRGB f{ BRDF::FresnelFunction_Schlick<Math>(h, -v, f0) };
 			// Calculate Normal Distribution (D)
-			const float d{ BRDF::NormalDistribution_GGX(hitRecord.normal, h, m_Roughness) };
+			const float d{ BRDF::NormalDistribution_GGX_Precomputed<Math>(hitRecord.normal, h, roughnessSquared * roughnessSquared) };
 			// Calculate Geometry (G)
-			const float g{ BRDF::GeometryFunction_Smith(hitRecord.normal, -v, l, m_Roughness) };
+			const float g{ BRDF::GeometryFunction_Smith_Precomputed<Math>(hitRecord.normal, -v, l, geometryK) };
 			// Calculate specular -> Cook-Torrance -> (DFG)/4(dot(v,n)dot(l,n))
-			const ColorRGB specular{ ColorRGB{ d * f * g } / (4.f * Vector3::Dot(-v, hitRecord.normal) * Vector3::Dot(l, hitRecord.normal)) };
-			// Determine kd -> 1 - Fresnel, cancel out if its a metal (kd = 0)
-			const float kd{ (1.f - m_Metalness) * (1.f - f.r) };
-			// Calculate Diffuse = > BRDF::Lambert using the kd
-			const ColorRGB diffuse{ BRDF::Lambert(kd, m_Albedo) };
-
-			// Return final color -> diffuse + specular
-			return diffuse + specular;
+			const ColorRGB specular{ Math::Divide(ColorRGB{ d * f * g }, 4.f * Vector3::Dot(-v, hitRecord.normal) * Vector3::Dot(l, hitRecord.normal)) };
+
+			// Return final color -> diffuse (kd = 1 - Fresnel) + specular
+			return diffuse * (1.f - f.r) + specular;
 		}
 
-	private:
-		ColorRGB m_Albedo{ 0.955f, 0.637f, 0.538f }; //Copper
-		float m_Metalness{ 1.0f };
-		float m_Roughness{ 0.1f }; // [1.0 > 0.0] >> [ROUGH > SMOOTH]
+#ifdef USE_SSE
+		void ShadeCookTorrence4(const HitRecord& hitRecord, const Vector3(&l)[4], const Vector3& v, ColorRGB(&result)[4]) const
+		{
+			using namespace BRDF::SIMD;
+
+			const Vector3& n{ hitRecord.normal };
+			const Vector3 viewDirection{ -v };
+
+			const Vector3x4 lights{ Load(l) };
+			const Vector3x4 h{ Normalized({
+				_mm_add_ps(lights.x, _mm_set1_ps(viewDirection.x)),
+				_mm_add_ps(lights.y, _mm_set1_ps(viewDirection.y)),
+				_mm_add_ps(lights.z, _mm_set1_ps(viewDirection.z)) }) };
+
+			const ColorRGBx4 f{ FresnelFunction_Schlick(h, viewDirection, f0) };
+			const __m128 d{ NormalDistribution_GGX_Precomputed(n, h, roughnessSquared * roughnessSquared) };
+
+			const float nDotV{ Vector3::Dot(viewDirection, n) };
+			const __m128 nDotL{ Dot(lights, n) };
+			const __m128 g{ _mm_mul_ps(GeometryFunction_SchlickGGX_Precomputed(_mm_set1_ps(nDotV), geometryK), GeometryFunction_SchlickGGX_Precomputed(nDotL, geometryK)) };
+
+			// DG / 4(dot(v,n)dot(l,n)), F is applied per channel
+			const __m128 dg{ Divide(_mm_mul_ps(d, g), _mm_mul_ps(_mm_set1_ps(4.f * nDotV), nDotL)) };
+			const __m128 kd{ _mm_sub_ps(_mm_set1_ps(1.f), f.r) };
+
+			alignas(16) float red[4];
+			alignas(16) float green[4];
+			alignas(16) float blue[4];
+			_mm_store_ps(red, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(diffuse.r), kd), _mm_mul_ps(dg, f.r)));
+			_mm_store_ps(green, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(diffuse.g), kd), _mm_mul_ps(dg, f.g)));
+			_mm_store_ps(blue, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(diffuse.b), kd), _mm_mul_ps(dg, f.b)));
+
+			for (int i{ 0 }; i < 4; ++i)
+			{
+				result[i] = ColorRGB{ red[i], green[i], blue[i] };
+			}
+		}
+#endif
 	};
-#pragma endregion
 }
@@ -1,5 +1,13 @@
 #pragma once
+#include <cfloat>
 #include <cmath>
+#include <cstdint>
+
+// SSE2 is used for the 4-wide kernels (BVH node decoding, fast BRDFs) when the target has it
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define USE_SSE
+#include <emmintrin.h>
+#endif
 
 namespace dae
 {
@@ -32,4 +40,38 @@ namespace dae
 	{
 		return a * a;
 	}
+
+	/* --- BIT TRICKS --- */
+	// Removes every odd bit: 0b0a0b0c0d -> 0babcd (used to decode Morton / Z-order indices)
+	inline uint32_t CompactBits1By1(uint32_t x)
+	{
+		x &= 0x55555555;
+		x = (x ^ (x >> 1)) & 0x33333333;
+		x = (x ^ (x >> 2)) & 0x0f0f0f0f;
+		x = (x ^ (x >> 4)) & 0x00ff00ff;
+		x = (x ^ (x >> 8)) & 0x0000ffff;
+		return x;
+	}
+
+	inline void DecodeMorton2D(uint32_t code, uint32_t& x, uint32_t& y)
+	{
+		x = CompactBits1By1(code);
+		y = CompactBits1By1(code >> 1);
+	}
+
+	// Inserts two zero bits above every bit of the low 10: 0b abc -> 0b00a00b00c (used to encode 3D Morton codes)
+	inline uint32_t SpreadBits2By2(uint32_t x)
+	{
+		x &= 0x000003ff;
+		x = (x ^ (x << 16)) & 0xff0000ff;
+		x = (x ^ (x << 8)) & 0x0300f00f;
+		x = (x ^ (x << 4)) & 0x030c30c3;
+		x = (x ^ (x << 2)) & 0x09249249;
+		return x;
+	}
+
+	inline uint32_t EncodeMorton3D(uint32_t x, uint32_t y, uint32_t z)
+	{
+		return SpreadBits2By2(x) | SpreadBits2By2(y) << 1 | SpreadBits2By2(z) << 2;
+	}
 }
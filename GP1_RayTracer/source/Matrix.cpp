@@ -81,6 +81,38 @@ namespace dae {
 		return out;
 	}
 
+	Matrix Matrix::Inverse() const
+	{
+		// Only valid for affine matrices (scale, rotation & translation), which is all we build
+		const Vector3 a{ data[0] };
+		const Vector3 b{ data[1] };
+		const Vector3 c{ data[2] };
+
+		const Vector3 bc{ Vector3::Cross(b, c) };
+		const Vector3 ca{ Vector3::Cross(c, a) };
+		const Vector3 ab{ Vector3::Cross(a, b) };
+
+		const float determinant{ Vector3::Dot(a, bc) };
+		assert(std::abs(determinant) > 0.f);
+		const float invDeterminant{ 1.f / determinant };
+
+		Matrix result
+		{
+			Vector3{ bc.x, ca.x, ab.x } * invDeterminant,
+			Vector3{ bc.y, ca.y, ab.y } * invDeterminant,
+			Vector3{ bc.z, ca.z, ab.z } * invDeterminant,
+			Vector3::Zero
+		};
+		result[3] = Vector4{ -result.TransformVector(GetTranslation()), 1.f };
+
+		return result;
+	}
+
+	Matrix Matrix::Inverse(const Matrix& m)
+	{
+		return m.Inverse();
+	}
+
 	Vector3 Matrix::GetAxisX() const
 	{
 		return data[0];
@@ -223,5 +255,21 @@ namespace dae {
 
 		return *this;
 	}
+
+	bool Matrix::operator==(const Matrix& m) const
+	{
+		// Exact compare, used to detect transforms that did not change
+		for (int r{ 0 }; r < 4; ++r)
+		{
+			if (data[r].x != m.data[r].x || data[r].y != m.data[r].y || data[r].z != m.data[r].z || data[r].w != m.data[r].w)
+				return false;
+		}
+		return true;
+	}
+
+	bool Matrix::operator!=(const Matrix& m) const
+	{
+		return !(*this == m);
+	}
 #pragma endregion
 }
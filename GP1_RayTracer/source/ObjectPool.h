@@ -0,0 +1,175 @@
+#pragma once
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <memory_resource>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace dae
+{
+	// Refers to one object of an ObjectPool, unlike a pointer or index it survives other objects being added or removed
+	// The generation tells a removed object apart from a later one that reuses its slot
+	template<typename T>
+	struct Handle
+	{
+		static constexpr uint32_t InvalidSlot{ UINT32_MAX };
+
+		uint32_t slot{ InvalidSlot };
+		uint32_t generation{};
+
+		bool IsValid() const { return slot != InvalidSlot; }
+		bool operator==(const Handle&) const = default;
+	};
+
+	/**
+	 * \brief Objects of one kind packed in a single array for traversal, referred to by generational handles
+	 * Removing moves the last object into the hole so the array stays dense, a slot table keeps every handle pointing at its object
+	 * Pointers and indices into the array only last until the next Add or Remove, handles last until their object is removed
+	 * The arrays are allocated from pArena, a scene passes one arena to all of its pools so growing them rarely reaches the heap
+	 * Tag sets the handle type, pools that store the same type for different purposes can't take each other's handles
+	 */
+	template<typename T, typename Tag = T>
+	class ObjectPool final
+	{
+	public:
+		explicit ObjectPool(std::pmr::memory_resource* pArena = std::pmr::get_default_resource()) :
+			m_Objects{ pArena },
+			m_ObjectSlots{ pArena },
+			m_Slots{ pArena },
+			m_FreeSlots{ pArena }
+		{
+		}
+
+		template<typename... Args>
+		Handle<Tag> Add(Args&&... args)
+		{
+			const uint32_t slot{ AcquireSlot() };
+			m_Slots[slot].index = static_cast<uint32_t>(m_Objects.size());
+			m_Objects.emplace_back(std::forward<Args>(args)...);
+			m_ObjectSlots.push_back(slot);
+
+			return { slot, m_Slots[slot].generation };
+		}
+
+		// False when the object was removed before
+		bool Remove(Handle<Tag> handle)
+		{
+			if (!IsAlive(handle)) return false;
+
+			const uint32_t index{ m_Slots[handle.slot].index };
+			if (index + 1 != m_Objects.size())
+			{
+				m_Objects[index] = std::move(m_Objects.back());
+				m_ObjectSlots[index] = m_ObjectSlots.back();
+				m_Slots[m_ObjectSlots[index]].index = index;
+			}
+			m_Objects.pop_back();
+			m_ObjectSlots.pop_back();
+
+			++m_Slots[handle.slot].generation;
+			m_FreeSlots.push_back(handle.slot);
+			return true;
+		}
+
+		bool IsAlive(Handle<Tag> handle) const
+		{
+			return handle.slot < m_Slots.size() && m_Slots[handle.slot].generation == handle.generation
+				&& m_Slots[handle.slot].index < m_ObjectSlots.size() && m_ObjectSlots[m_Slots[handle.slot].index] == handle.slot;
+		}
+
+		// nullptr once the object is removed
+		T* Get(Handle<Tag> handle) { return IsAlive(handle) ? &m_Objects[m_Slots[handle.slot].index] : nullptr; }
+		const T* Get(Handle<Tag> handle) const { return IsAlive(handle) ? &m_Objects[m_Slots[handle.slot].index] : nullptr; }
+
+		// Position of a live object in the array
+		uint32_t GetIndex(Handle<Tag> handle) const
+		{
+			assert(IsAlive(handle));
+			return m_Slots[handle.slot].index;
+		}
+
+		Handle<Tag> GetHandle(size_t index) const
+		{
+			assert(index < m_Objects.size());
+			const uint32_t slot{ m_ObjectSlots[index] };
+			return { slot, m_Slots[slot].generation };
+		}
+
+		void Reserve(size_t count)
+		{
+			m_Objects.reserve(count);
+			m_ObjectSlots.reserve(count);
+			m_Slots.reserve(count);
+		}
+
+		// Every handle handed out so far stops being alive
+		void Clear()
+		{
+			// Reversed, so the next objects get the slots in order again
+			for (auto slot{ m_ObjectSlots.rbegin() }; slot != m_ObjectSlots.rend(); ++slot)
+			{
+				++m_Slots[*slot].generation;
+				m_FreeSlots.push_back(*slot);
+			}
+
+			m_Objects.clear();
+			m_ObjectSlots.clear();
+		}
+
+		// Takes over the array as a whole, used when loading a scene snapshot
+		void Assign(std::vector<T>&& objects)
+		{
+			Clear();
+
+			m_Objects.assign(std::make_move_iterator(objects.begin()), std::make_move_iterator(objects.end()));
+			m_ObjectSlots.reserve(m_Objects.size());
+			for (uint32_t index{ 0 }; index < m_Objects.size(); ++index)
+			{
+				const uint32_t slot{ AcquireSlot() };
+				m_Slots[slot].index = index;
+				m_ObjectSlots.push_back(slot);
+			}
+		}
+
+		// The objects in array order, for traversal
+		std::span<const T> GetObjects() const { return m_Objects; }
+
+		size_t size() const { return m_Objects.size(); }
+		bool empty() const { return m_Objects.empty(); }
+
+		T& operator[](size_t index) { return m_Objects[index]; }
+		const T& operator[](size_t index) const { return m_Objects[index]; }
+
+		auto begin() { return m_Objects.begin(); }
+		auto end() { return m_Objects.end(); }
+		auto begin() const { return m_Objects.begin(); }
+		auto end() const { return m_Objects.end(); }
+
+	private:
+		struct Slot
+		{
+			uint32_t index{}; // Into m_Objects
+			uint32_t generation{};
+		};
+
+		std::pmr::vector<T> m_Objects;
+		std::pmr::vector<uint32_t> m_ObjectSlots; // Slot of every object, to fix up the slot of the object that fills a hole
+		std::pmr::vector<Slot> m_Slots;
+		std::pmr::vector<uint32_t> m_FreeSlots;
+
+		uint32_t AcquireSlot()
+		{
+			if (m_FreeSlots.empty())
+			{
+				m_Slots.emplace_back();
+				return static_cast<uint32_t>(m_Slots.size() - 1);
+			}
+
+			const uint32_t slot{ m_FreeSlots.back() };
+			m_FreeSlots.pop_back();
+			return slot;
+		}
+	};
+}
@@ -0,0 +1,320 @@
+#pragma once
+// concurrency::parallel_for and parallel_invoke on every platform, the PPL only ships with MSVC
+#include <cstdint>
+
+#if defined(_WIN32)
+#include <ppl.h>
+#else
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace concurrency
+{
+	namespace detail
+	{
+		// Threads a parallel call may use, the calling one included
+		inline std::atomic<uint32_t> g_ThreadLimit{ 0 }; // 0 is one thread per core
+
+		inline uint32_t GetThreadLimit()
+		{
+			const uint32_t threadLimit{ g_ThreadLimit };
+			return threadLimit > 0 ? threadLimit : std::max(std::thread::hardware_concurrency(), 1u);
+		}
+
+		// The cores the process may run on (taskset and cgroups can leave some out), read once before any worker is pinned
+		inline const std::vector<int>& GetAllowedCores()
+		{
+			static const std::vector<int> allowedCores{ []()
+				{
+					std::vector<int> cores{};
+#if defined(__linux__)
+					cpu_set_t cpuSet{};
+					if (sched_getaffinity(0, sizeof(cpuSet), &cpuSet) == 0)
+					{
+						for (int core{ 0 }; core < CPU_SETSIZE; ++core)
+						{
+							if (CPU_ISSET(core, &cpuSet)) cores.push_back(core);
+						}
+					}
+#endif
+					return cores;
+				}() };
+			return allowedCores;
+		}
+
+		// Pinned, worker n runs on allowed core n + 1, the first one is left to the thread that starts the parallel calls
+		// Unpinned it may run on every allowed core again
+		inline void SetWorkerAffinity(uint32_t workerIndex, bool isPinned)
+		{
+#if defined(__linux__)
+			const std::vector<int>& allowedCores{ GetAllowedCores() };
+			if (allowedCores.empty()) return;
+
+			cpu_set_t cpuSet{};
+			CPU_ZERO(&cpuSet);
+			if (isPinned)
+			{
+				CPU_SET(allowedCores[(workerIndex + 1) % allowedCores.size()], &cpuSet);
+			}
+			else
+			{
+				for (const int core : allowedCores) CPU_SET(core, &cpuSet);
+			}
+			pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+#else
+			(void)workerIndex;
+			(void)isPinned;
+#endif
+		}
+
+		// One parallel call in progress, lives on the stack of the thread that started it
+		// Indices are handed out in chunks, whoever is done early takes the next one
+		struct Job
+		{
+			void (*pRun)(const void* pFunction, size_t begin, size_t end){};
+			const void* pFunction{};
+			size_t count{};
+			size_t chunkSize{};
+			uint32_t numWorkers{}; // Only the workers with a lower index join in
+			uint32_t numActiveWorkers{}; // Guarded by the pool's mutex
+			std::atomic<size_t> next{ 0 };
+
+			bool HasWork() const { return next.load(std::memory_order_relaxed) < count; }
+
+			void Work()
+			{
+				for (size_t begin{ next.fetch_add(chunkSize) }; begin < count; begin = next.fetch_add(chunkSize))
+				{
+					pRun(pFunction, begin, std::min(count, begin + chunkSize));
+				}
+			}
+		};
+
+		/**
+		 * \brief Worker threads started once and kept for the whole run, every parallel call shares them
+		 * A worker keeps its index, its core while pinned and its thread_local data from one call (and one frame) to the next
+		 * Calls made from inside a call (nested parallel_for, frames in flight) are jobs of their own on the same workers,
+		 * the newest job is helped first and the thread that started a job always works on it itself, so nothing waits on an idle worker
+		 */
+		class WorkerPool final
+		{
+		public:
+			static WorkerPool& Get()
+			{
+				static WorkerPool pool{};
+				return pool;
+			}
+
+			~WorkerPool()
+			{
+				{
+					const std::lock_guard lock{ m_Mutex };
+					m_IsStopping = true;
+				}
+				m_WorkAvailable.notify_all();
+
+				for (std::thread& worker : m_Workers)
+				{
+					worker.join();
+				}
+			}
+
+			WorkerPool(const WorkerPool&) = delete;
+			WorkerPool(WorkerPool&&) noexcept = delete;
+			WorkerPool& operator=(const WorkerPool&) = delete;
+			WorkerPool& operator=(WorkerPool&&) noexcept = delete;
+
+			// The calling thread works on the job together with the first numWorkers workers, returns when every index is done
+			void Run(Job& job, uint32_t numWorkers)
+			{
+				job.numWorkers = numWorkers;
+				if (numWorkers > 0)
+				{
+					{
+						const std::lock_guard lock{ m_Mutex };
+						// Only grows past one worker per core when a ConcurrencyLimit asks for more threads
+						while (m_Workers.size() < numWorkers)
+						{
+							m_Workers.emplace_back(&WorkerPool::WorkerLoop, this, static_cast<uint32_t>(m_Workers.size()));
+						}
+						m_Jobs.push_back(&job);
+					}
+					m_WorkAvailable.notify_all();
+				}
+
+				job.Work();
+				if (numWorkers == 0) return;
+
+				// Every index is taken, workers that joined may still be on their last chunk
+				std::unique_lock lock{ m_Mutex };
+				std::erase(m_Jobs, &job);
+				m_JobDone.wait(lock, [&job]() { return job.numActiveWorkers == 0; });
+			}
+
+			// Workers move to (or off) their core the next time they pick up a job
+			void SetPinning(bool isPinned)
+			{
+				GetAllowedCores();
+				if (m_IsPinning.exchange(isPinned) != isPinned) ++m_PinningVersion;
+			}
+
+			bool IsPinning() const { return m_IsPinning; }
+
+		private:
+			WorkerPool() = default;
+
+			std::mutex m_Mutex{};
+			std::condition_variable m_WorkAvailable{};
+			std::condition_variable m_JobDone{};
+			std::vector<Job*> m_Jobs{};
+			std::vector<std::thread> m_Workers{};
+			bool m_IsStopping{ false };
+
+			std::atomic<bool> m_IsPinning{ false };
+			std::atomic<uint32_t> m_PinningVersion{ 0 };
+
+			// Newest job this worker may join that still has indices left
+			Job* FindJob(uint32_t workerIndex) const
+			{
+				for (auto job{ m_Jobs.rbegin() }; job != m_Jobs.rend(); ++job)
+				{
+					if (workerIndex < (*job)->numWorkers && (*job)->HasWork()) return *job;
+				}
+				return nullptr;
+			}
+
+			void WorkerLoop(uint32_t workerIndex)
+			{
+				uint32_t pinningVersion{ 0 };
+
+				std::unique_lock lock{ m_Mutex };
+				while (true)
+				{
+					Job* pJob{ nullptr };
+					m_WorkAvailable.wait(lock, [&]() { return m_IsStopping || (pJob = FindJob(workerIndex)) != nullptr; });
+					if (m_IsStopping) return;
+
+					++pJob->numActiveWorkers;
+					lock.unlock();
+
+					// Pinning only changes between frames, a worker moves once per change
+					if (const uint32_t version{ m_PinningVersion }; version != pinningVersion)
+					{
+						pinningVersion = version;
+						SetWorkerAffinity(workerIndex, m_IsPinning);
+					}
+
+					pJob->Work();
+
+					lock.lock();
+					if (--pJob->numActiveWorkers == 0) m_JobDone.notify_all();
+				}
+			}
+		};
+	}
+
+	// Same contract as the PPL version: function(i) for every i in [first, last), returns when all calls are done
+	// Runs on the calling thread and the workers of the pool, see detail::WorkerPool
+	template<typename Index, typename Function>
+	void parallel_for(Index first, Index last, const Function& function)
+	{
+		if (!(first < last)) return;
+
+		const size_t count{ static_cast<size_t>(last - first) };
+		const uint32_t numWorkers{ static_cast<uint32_t>(std::min<size_t>(detail::GetThreadLimit(), count) - 1) };
+
+		struct Context
+		{
+			Index first;
+			const Function& function;
+		};
+		const Context context{ first, function };
+
+		detail::Job job{};
+		job.pRun = [](const void* pContext, size_t begin, size_t end)
+			{
+				const Context& context{ *static_cast<const Context*>(pContext) };
+				for (size_t i{ begin }; i < end; ++i) context.function(static_cast<Index>(context.first + static_cast<Index>(i)));
+			};
+		job.pFunction = &context;
+		job.count = count;
+		job.chunkSize = std::max<size_t>(count / ((static_cast<size_t>(numWorkers) + 1) * 16), 1);
+
+		detail::WorkerPool::Get().Run(job, numWorkers);
+	}
+
+	// Same contract as the PPL version for two functions, a free worker takes the second one
+	template<typename Function1, typename Function2>
+	void parallel_invoke(const Function1& function1, const Function2& function2)
+	{
+		parallel_for(0, 2, [&](int i)
+			{
+				if (i == 0) function1();
+				else function2();
+			});
+	}
+}
+#endif
+
+namespace dae
+{
+	// Caps the threads the parallel algorithms started from this thread use while it is alive, for scaling measurements
+	class ConcurrencyLimit final
+	{
+	public:
+		explicit ConcurrencyLimit(uint32_t numThreads)
+		{
+#if defined(_WIN32)
+			concurrency::CurrentScheduler::Create(concurrency::SchedulerPolicy(2, concurrency::MinConcurrency, 1u, concurrency::MaxConcurrency, numThreads));
+#else
+			m_PreviousLimit = concurrency::detail::g_ThreadLimit.exchange(numThreads);
+#endif
+		}
+
+		~ConcurrencyLimit()
+		{
+#if defined(_WIN32)
+			concurrency::CurrentScheduler::Detach();
+#else
+			concurrency::detail::g_ThreadLimit = m_PreviousLimit;
+#endif
+		}
+
+		ConcurrencyLimit(const ConcurrencyLimit&) = delete;
+		ConcurrencyLimit(ConcurrencyLimit&&) noexcept = delete;
+		ConcurrencyLimit& operator=(const ConcurrencyLimit&) = delete;
+		ConcurrencyLimit& operator=(ConcurrencyLimit&&) noexcept = delete;
+
+	private:
+		uint32_t m_PreviousLimit{};
+	};
+
+	// Pins every worker thread of the parallel algorithms to its own core, instead of letting the OS move it around
+	// Linux only, the PPL scheduler on Windows places its own threads
+	inline void SetThreadPinning(bool isEnabled)
+	{
+#if !defined(_WIN32)
+		concurrency::detail::WorkerPool::Get().SetPinning(isEnabled);
+#else
+		(void)isEnabled;
+#endif
+	}
+
+	inline bool IsThreadPinning()
+	{
+#if !defined(_WIN32)
+		return concurrency::detail::WorkerPool::Get().IsPinning();
+#else
+		return false;
+#endif
+	}
+}
@@ -0,0 +1,147 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+
+#include "Utils.h"
+
+namespace dae
+{
+	namespace GeometryUtils
+	{
+		// 4 rays walking a binary BVH together
+		constexpr uint32_t RayPacketSize{ 4 };
+
+		/**
+		 * \brief Closest (or with ignoreHitRecord any) hit of up to 4 object space rays in the binary BVH of the mesh, returns the lanes that hit
+		 * Every node is slab tested for the 4 rays at once and visited while any of them still reaches it, leaves are tested per ray
+		 * Same results as HitTest_BinaryBVH for every lane, it only saves work when the rays take similar paths through the tree
+		 */
+		inline uint32_t HitTest_BinaryBVH(const TriangleMesh& mesh, unsigned char materialIndex, TriangleCullMode cullMode,
+			Ray (&rays)[RayPacketSize], HitRecord (&closestHits)[RayPacketSize], uint32_t laneMask, bool ignoreHitRecord)
+		{
+#ifdef USE_SSE
+			const std::vector<BVHNode>& nodes{ mesh.bvh.GetNodes() };
+			const std::vector<uint32_t>& triangles{ mesh.bvh.GetTriangleIndices() };
+
+			const __m128 originX{ _mm_setr_ps(rays[0].origin.x, rays[1].origin.x, rays[2].origin.x, rays[3].origin.x) };
+			const __m128 originY{ _mm_setr_ps(rays[0].origin.y, rays[1].origin.y, rays[2].origin.y, rays[3].origin.y) };
+			const __m128 originZ{ _mm_setr_ps(rays[0].origin.z, rays[1].origin.z, rays[2].origin.z, rays[3].origin.z) };
+
+			const __m128 one{ _mm_set1_ps(1.f) };
+			const __m128 inverseX{ _mm_div_ps(one, _mm_setr_ps(rays[0].direction.x, rays[1].direction.x, rays[2].direction.x, rays[3].direction.x)) };
+			const __m128 inverseY{ _mm_div_ps(one, _mm_setr_ps(rays[0].direction.y, rays[1].direction.y, rays[2].direction.y, rays[3].direction.y)) };
+			const __m128 inverseZ{ _mm_div_ps(one, _mm_setr_ps(rays[0].direction.z, rays[1].direction.z, rays[2].direction.z, rays[3].direction.z)) };
+
+			// Lanes outside the mask never reach a node
+			const auto getRayMax{ [&rays](uint32_t activeLanes)
+				{
+					const auto getMax{ [&](uint32_t lane) { return (activeLanes >> lane & 1) ? rays[lane].max : -FLT_MAX; } };
+					return _mm_setr_ps(getMax(0), getMax(1), getMax(2), getMax(3));
+				} };
+			__m128 rayMax{ getRayMax(laneMask) };
+
+			// Entry distance per lane, FLT_MAX for the lanes that miss the box
+			const __m128 miss{ _mm_set1_ps(FLT_MAX) };
+			const auto slabDistances{ [&](const BVHNode& node)
+				{
+					const __m128 tx1{ _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.minAABB.x), originX), inverseX) };
+					const __m128 tx2{ _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.maxAABB.x), originX), inverseX) };
+					__m128 tmin{ _mm_min_ps(tx1, tx2) };
+					__m128 tmax{ _mm_max_ps(tx1, tx2) };
+
+					const __m128 ty1{ _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.minAABB.y), originY), inverseY) };
+					const __m128 ty2{ _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.maxAABB.y), originY), inverseY) };
+					tmin = _mm_max_ps(tmin, _mm_min_ps(ty1, ty2));
+					tmax = _mm_min_ps(tmax, _mm_max_ps(ty1, ty2));
+
+					const __m128 tz1{ _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.minAABB.z), originZ), inverseZ) };
+					const __m128 tz2{ _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.maxAABB.z), originZ), inverseZ) };
+					tmin = _mm_max_ps(tmin, _mm_min_ps(tz1, tz2));
+					tmax = _mm_min_ps(tmax, _mm_max_ps(tz1, tz2));
+
+					__m128 hit{ _mm_cmpge_ps(tmax, tmin) };
+					hit = _mm_and_ps(hit, _mm_cmpgt_ps(tmax, _mm_setzero_ps()));
+					hit = _mm_and_ps(hit, _mm_cmplt_ps(tmin, rayMax));
+
+					return _mm_or_ps(_mm_and_ps(hit, tmin), _mm_andnot_ps(hit, miss));
+				} };
+
+			struct PacketStackEntry
+			{
+				__m128 distances{};
+				uint32_t node{};
+			};
+			PacketStackEntry stack[BVHStackSize];
+			int stackSize{ 0 };
+
+			const __m128 rootDistances{ slabDistances(nodes[0]) };
+			if (_mm_movemask_ps(_mm_cmplt_ps(rootDistances, miss)) == 0) return 0;
+			stack[stackSize++] = { rootDistances, 0 };
+
+			uint32_t hitLanes{ 0 };
+			while (stackSize > 0)
+			{
+				const PacketStackEntry entry{ stack[--stackSize] };
+
+				// Lanes that still reach the node, closer hits may have been found after it was pushed
+				const uint32_t entryLanes{ static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(entry.distances, rayMax))) };
+				if (entryLanes == 0) continue;
+
+				const BVHNode& node{ nodes[entry.node] };
+				if (node.triangleCount > 0)
+				{
+					for (uint32_t lane{ 0 }; lane < RayPacketSize; ++lane)
+					{
+						if (!(entryLanes >> lane & 1)) continue;
+
+						for (uint32_t i{ node.leftFirst }; i < node.leftFirst + node.triangleCount; ++i)
+						{
+							if (HitTest_MeshTriangle(mesh, triangles[i], materialIndex, cullMode, rays[lane], closestHits[lane], ignoreHitRecord))
+							{
+								hitLanes |= 1u << lane;
+								if (ignoreHitRecord) break;
+							}
+						}
+					}
+
+					// Any hit will do, lanes that found one are done
+					if (ignoreHitRecord)
+					{
+						laneMask &= ~hitLanes;
+						if (laneMask == 0) return hitLanes;
+					}
+					rayMax = getRayMax(laneMask);
+					continue;
+				}
+
+				PacketStackEntry nearEntry{ slabDistances(nodes[node.leftFirst]), node.leftFirst };
+				PacketStackEntry farEntry{ slabDistances(nodes[node.leftFirst + 1]), node.leftFirst + 1 };
+				uint32_t nearLanes{ static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(nearEntry.distances, miss))) };
+				uint32_t farLanes{ static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(farEntry.distances, miss))) };
+
+				// The child most of the lanes enter first ends up on top of the stack
+				const uint32_t bothLanes{ nearLanes & farLanes };
+				const uint32_t farFirstLanes{ static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(farEntry.distances, nearEntry.distances))) & bothLanes };
+				if (2 * std::popcount(farFirstLanes) > std::popcount(bothLanes))
+				{
+					std::swap(nearEntry, farEntry);
+					std::swap(nearLanes, farLanes);
+				}
+
+				assert(stackSize + 2 <= BVHStackSize);
+				if (farLanes != 0) stack[stackSize++] = farEntry;
+				if (nearLanes != 0) stack[stackSize++] = nearEntry;
+			}
+
+			return hitLanes;
+#else
+			uint32_t hitLanes{ 0 };
+			for (uint32_t lane{ 0 }; lane < RayPacketSize; ++lane)
+			{
+				if ((laneMask >> lane & 1) && HitTest_BinaryBVH(mesh, materialIndex, cullMode, rays[lane], closestHits[lane], ignoreHitRecord)) hitLanes |= 1u << lane;
+			}
+			return hitLanes;
+#endif
+		}
+	}
+}
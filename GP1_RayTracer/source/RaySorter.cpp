@@ -0,0 +1,84 @@
+#include "RaySorter.h"
+
+//Standard includes
+#include <algorithm>
+
+//Project includes
+#include "MathHelpers.h"
+
+namespace dae
+{
+	const std::vector<uint32_t>& RaySorter::Sort(const std::vector<Ray>& rays)
+	{
+		const size_t numRays{ rays.size() };
+		m_Keys.resize(numRays);
+		m_Order.resize(numRays);
+		m_TempKeys.resize(numRays);
+		m_TempOrder.resize(numRays);
+
+		if (numRays == 0) return m_Order;
+
+		// Origins are quantized inside the box around this batch, so the grid gets finer when the batch covers less of the scene
+		Vector3 minOrigin{ rays[0].origin };
+		Vector3 maxOrigin{ rays[0].origin };
+		for (const Ray& ray : rays)
+		{
+			minOrigin = Vector3::Min(minOrigin, ray.origin);
+			maxOrigin = Vector3::Max(maxOrigin, ray.origin);
+		}
+
+		constexpr float gridSize{ static_cast<float>(1u << OriginBitsPerAxis) };
+		const Vector3 extent{ maxOrigin - minOrigin };
+		const Vector3 scale
+		{
+			extent.x > 0.f ? (gridSize - 1.f) / extent.x : 0.f,
+			extent.y > 0.f ? (gridSize - 1.f) / extent.y : 0.f,
+			extent.z > 0.f ? (gridSize - 1.f) / extent.z : 0.f
+		};
+
+		for (uint32_t i{ 0 }; i < numRays; ++i)
+		{
+			const Ray& ray{ rays[i] };
+			const uint32_t octant{ static_cast<uint32_t>(ray.direction.x < 0.f) | static_cast<uint32_t>(ray.direction.y < 0.f) << 1 | static_cast<uint32_t>(ray.direction.z < 0.f) << 2 };
+
+			const Vector3 cell{ ray.origin - minOrigin };
+			const uint32_t morton{ EncodeMorton3D(static_cast<uint32_t>(cell.x * scale.x), static_cast<uint32_t>(cell.y * scale.y), static_cast<uint32_t>(cell.z * scale.z)) };
+
+			m_Keys[i] = octant << (3 * OriginBitsPerAxis) | morton;
+			m_Order[i] = i;
+		}
+
+		// LSD radix sort on 8 bit digits, stable, so rays with the same key stay in pixel order
+		for (uint32_t shift{ 0 }; shift < KeyBits; shift += 8)
+		{
+			uint32_t offsets[256]{};
+			for (const uint32_t key : m_Keys)
+			{
+				++offsets[(key >> shift) & 0xFF];
+			}
+
+			// Every key has the same digit, this pass would not move anything
+			if (std::ranges::find(offsets, static_cast<uint32_t>(numRays)) != std::end(offsets)) continue;
+
+			uint32_t sum{ 0 };
+			for (uint32_t& offset : offsets)
+			{
+				const uint32_t count{ offset };
+				offset = sum;
+				sum += count;
+			}
+
+			for (size_t i{ 0 }; i < numRays; ++i)
+			{
+				const uint32_t destination{ offsets[(m_Keys[i] >> shift) & 0xFF]++ };
+				m_TempKeys[destination] = m_Keys[i];
+				m_TempOrder[destination] = m_Order[i];
+			}
+
+			m_Keys.swap(m_TempKeys);
+			m_Order.swap(m_TempOrder);
+		}
+
+		return m_Order;
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	/**
+	 * \brief Orders a batch of secondary rays so rays that start close together and point the same way are traced one after the other
+	 * The sort key holds the direction octant in its top bits and the Morton code of the origin, quantized inside the bounds of the batch, below it
+	 */
+	class RaySorter final
+	{
+	public:
+		static constexpr uint32_t OriginBitsPerAxis{ 9 };
+		static constexpr uint32_t KeyBits{ 3 + 3 * OriginBitsPerAxis };
+
+		RaySorter() = default;
+		~RaySorter() = default;
+
+		RaySorter(const RaySorter&) = delete;
+		RaySorter(RaySorter&&) noexcept = delete;
+		RaySorter& operator=(const RaySorter&) = delete;
+		RaySorter& operator=(RaySorter&&) noexcept = delete;
+
+		// Indices into rays in trace order, valid until the next call
+		const std::vector<uint32_t>& Sort(const std::vector<Ray>& rays);
+
+	private:
+		std::vector<uint32_t> m_Keys{};
+		std::vector<uint32_t> m_Order{};
+		// Radix sort ping-pongs between these and the vectors above
+		std::vector<uint32_t> m_TempKeys{};
+		std::vector<uint32_t> m_TempOrder{};
+	};
+}
@@ -0,0 +1,293 @@
+#include "RegressionSuite.h"
+
+//External includes
+#include "SDL.h"
+#include "SDL_image.h"
+#include "SDL_surface.h"
+
+//Standard includes
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+//Project includes
+#include "Benchmark.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include "Timer.h"
+
+namespace dae
+{
+	RegressionSuite::RegressionSuite(int width, int height, const RegressionOptions& options) :
+		m_Width{ width },
+		m_Height{ height },
+		m_Options{ options }
+	{
+		m_Options.numFrames = std::max(m_Options.numFrames, 1u);
+	}
+
+	std::vector<std::string> RegressionSuite::GetDefaultScenes()
+	{
+		std::vector<std::string> sceneNames{};
+		for (const std::string& name : Scene::GetRegisteredNames())
+		{
+			if (name.starts_with('W')) sceneNames.push_back(name);
+		}
+		return sceneNames;
+	}
+
+	bool RegressionSuite::Run(const std::vector<std::string>& sceneNames)
+	{
+		std::error_code error{};
+		std::filesystem::create_directories(m_Options.directory, error);
+		const std::string historyPath{ m_Options.directory + "/history.csv" };
+
+		std::vector<Result> results{};
+		for (const std::string& sceneName : sceneNames)
+		{
+			Result result{ RunScene(sceneName) };
+
+			// Only compared against runs that passed, a slow run never becomes the new baseline
+			if (result.status == "pass")
+			{
+				const Baseline baseline{ GetBaseline(historyPath, sceneName) };
+				const float allowed{ 1.f + m_Options.threshold / 100.f };
+				if (baseline.numRuns > 0 && (result.msPerFrame > baseline.msPerFrame * allowed || result.raysPerSecond * allowed < baseline.raysPerSecond))
+				{
+					result.status = "slower";
+					std::cout << sceneName << ": " << result.msPerFrame << "ms/frame against a baseline of " << baseline.msPerFrame << "ms/frame (median of "
+						<< baseline.numRuns << " runs)\n";
+				}
+			}
+
+			if (result.status != "error") AppendHistory(historyPath, result);
+			results.push_back(std::move(result));
+		}
+
+		if (!m_Options.fastMathScene.empty() && !m_Options.record)
+			results.push_back(RunFastMathCheck(m_Options.fastMathScene));
+
+		std::cout << '\n' << std::left << std::setw(20) << "Scene" << std::right << std::setw(12) << "ms/frame" << std::setw(16) << "rays/s"
+			<< std::setw(12) << "max error" << std::setw(12) << "mismatched" << "  result\n";
+
+		bool hasPassed{ true };
+		for (const Result& result : results)
+		{
+			std::cout << std::left << std::setw(20) << result.sceneName << std::right << std::fixed << std::setprecision(2) << std::setw(12) << result.msPerFrame
+				<< std::setprecision(0) << std::setw(16) << result.raysPerSecond << std::setw(12) << result.maxChannelError << std::setw(12) << result.numMismatchedPixels
+				<< "  " << result.status << '\n';
+
+			hasPassed &= result.status == "pass" || result.status == "recorded";
+		}
+		std::cout << std::defaultfloat << (hasPassed ? "\nREGRESSION: PASSED\n" : "\nREGRESSION: FAILED\n");
+
+		return hasPassed;
+	}
+
+	RegressionSuite::Result RegressionSuite::RunScene(const std::string& sceneName) const
+	{
+		Result result{ sceneName };
+
+		const std::unique_ptr<Scene> pScene{ Benchmark::LoadScene(sceneName) };
+		if (!pScene)
+		{
+			result.status = "error";
+			return result;
+		}
+
+		// Animated scenes are frozen at the same time every run, the camera keeps its initial transform
+		Timer timer{};
+		timer.SetFixedTime(m_Options.time);
+		pScene->Update(&timer);
+
+		// Every timed frame traces every pixel, nothing moves between them
+		const std::unique_ptr<Renderer> pRenderer{ Benchmark::CreateRenderer(m_Width, m_Height) };
+
+		// Warm-up frame, pages in streamed meshes and fills the caches
+		pRenderer->Render(pScene.get());
+
+		// The frames are all the same so each traces the same rays
+		pScene->ResetNumTracedRays();
+		result.msPerFrame = Benchmark::MeasureMedian(m_Options.numFrames, [&]() { pRenderer->Render(pScene.get()); });
+		const float raysPerFrame{ static_cast<float>(pScene->GetNumTracedRays()) / static_cast<float>(m_Options.numFrames) };
+		result.raysPerSecond = raysPerFrame / (result.msPerFrame / 1000.f);
+
+		std::vector<uint8_t> pixels(static_cast<size_t>(m_Width * m_Height * 3));
+		pRenderer->ReadRect(0, 0, m_Width, m_Height, pixels.data());
+
+		const std::string goldenPath{ m_Options.directory + '/' + sceneName + ".png" };
+		if (m_Options.record)
+		{
+			result.status = SaveImage(goldenPath, pixels) ? "recorded" : "error";
+			return result;
+		}
+
+		// A scene without a golden image is not checked at all, so it can't pass
+		if (!std::filesystem::exists(goldenPath))
+		{
+			std::cout << sceneName << ": no golden image " << goldenPath << ", run with --record to write it\n";
+			result.status = "missing";
+			return result;
+		}
+
+		if (!CompareGolden(goldenPath, pixels, result) || result.numMismatchedPixels > m_Options.maxMismatchedPixels)
+		{
+			result.status = "image";
+
+			// Kept next to the golden image to see what changed
+			const std::string failedPath{ m_Options.directory + '/' + sceneName + "_failed.png" };
+			if (SaveImage(failedPath, pixels))
+				std::cout << sceneName << ": " << result.numMismatchedPixels << " pixels differ from the golden image, written to " << failedPath << '\n';
+			return result;
+		}
+
+		result.status = "pass";
+		return result;
+	}
+
+	RegressionSuite::Result RegressionSuite::RunFastMathCheck(const std::string& sceneName) const
+	{
+		Result result{ sceneName + " fast" };
+
+		const std::unique_ptr<Scene> pScene{ Benchmark::LoadScene(sceneName) };
+		if (!pScene)
+		{
+			result.status = "error";
+			return result;
+		}
+
+		Timer timer{};
+		timer.SetFixedTime(m_Options.time);
+		pScene->Update(&timer);
+
+		const std::unique_ptr<Renderer> pRenderer{ Benchmark::CreateRenderer(m_Width, m_Height) };
+		const Renderer::FastMathError error{ pRenderer->MeasureFastMathError(pScene.get()) };
+
+		result.msPerFrame = error.fastTime;
+		result.maxChannelError = error.maxChannelError;
+		result.numMismatchedPixels = error.numPixelsChanged;
+		result.status = "pass";
+
+		if (error.maxChannelError > m_Options.fastMathTolerance || error.maxRelativeError > m_Options.fastMathRelativeError)
+		{
+			result.status = "accuracy";
+			std::cout << sceneName << ": fast math is off by up to " << error.maxChannelError << " per channel and " << error.maxRelativeError * 100.f
+				<< "% relative, allowed are " << m_Options.fastMathTolerance << " and " << m_Options.fastMathRelativeError * 100.f << "%\n";
+		}
+
+		return result;
+	}
+
+	bool RegressionSuite::CompareGolden(const std::string& path, const std::vector<uint8_t>& pixels, Result& result) const
+	{
+		SDL_Surface* pLoaded{ IMG_Load(path.c_str()) };
+		if (!pLoaded)
+		{
+			std::cout << "Can't read golden image " << path << '\n';
+			return false;
+		}
+
+		// Whatever format the image was written in, compare against packed RGB like ReadRect returns
+		SDL_Surface* pGolden{ SDL_ConvertSurfaceFormat(pLoaded, SDL_PIXELFORMAT_RGB24, 0) };
+		SDL_FreeSurface(pLoaded);
+		if (!pGolden) return false;
+
+		bool isValid{ pGolden->w == m_Width && pGolden->h == m_Height };
+		if (!isValid)
+		{
+			std::cout << "Golden image " << path << " is " << pGolden->w << 'x' << pGolden->h << ", rendered " << m_Width << 'x' << m_Height << '\n';
+		}
+		else
+		{
+			SDL_LockSurface(pGolden);
+			for (int py{ 0 }; py < m_Height; ++py)
+			{
+				const uint8_t* pGoldenRow{ static_cast<const uint8_t*>(pGolden->pixels) + py * pGolden->pitch };
+				const uint8_t* pRow{ pixels.data() + py * m_Width * 3 };
+				for (int px{ 0 }; px < m_Width; ++px)
+				{
+					int pixelError{ 0 };
+					for (int channel{ 0 }; channel < 3; ++channel)
+					{
+						pixelError = std::max(pixelError, std::abs(pRow[px * 3 + channel] - pGoldenRow[px * 3 + channel]));
+					}
+
+					result.maxChannelError = std::max(result.maxChannelError, pixelError);
+					if (pixelError > m_Options.tolerance) ++result.numMismatchedPixels;
+				}
+			}
+			SDL_UnlockSurface(pGolden);
+		}
+
+		SDL_FreeSurface(pGolden);
+		return isValid;
+	}
+
+	bool RegressionSuite::SaveImage(const std::string& path, std::vector<uint8_t>& pixels) const
+	{
+		SDL_Surface* pSurface{ SDL_CreateRGBSurfaceWithFormatFrom(pixels.data(), m_Width, m_Height, 24, m_Width * 3, SDL_PIXELFORMAT_RGB24) };
+		if (!pSurface) return false;
+
+		const bool isSaved{ IMG_SavePNG(pSurface, path.c_str()) == 0 };
+		SDL_FreeSurface(pSurface);
+
+		if (!isSaved) std::cout << "Can't write " << path << ": " << SDL_GetError() << '\n';
+		return isSaved;
+	}
+
+	RegressionSuite::Baseline RegressionSuite::GetBaseline(const std::string& historyPath, const std::string& sceneName) const
+	{
+		std::ifstream history{ historyPath };
+
+		// timestamp,scene,width,height,ms_per_frame,rays_per_second,max_error,mismatched_pixels,result
+		std::vector<float> msPerFrame{};
+		std::vector<float> raysPerSecond{};
+		std::string line{};
+		while (std::getline(history, line))
+		{
+			std::vector<std::string> fields{};
+			std::stringstream stream{ line };
+			for (std::string field{}; std::getline(stream, field, ',');)
+			{
+				fields.push_back(field);
+			}
+
+			// Runs that recorded the golden image passed as well, timings of another resolution can't be compared
+			if (fields.size() != 9 || fields[1] != sceneName || (fields[8] != "pass" && fields[8] != "recorded")) continue;
+			if (fields[2] != std::to_string(m_Width) || fields[3] != std::to_string(m_Height)) continue;
+
+			msPerFrame.push_back(std::stof(fields[4]));
+			raysPerSecond.push_back(std::stof(fields[5]));
+		}
+
+		const size_t numRuns{ std::min<size_t>(msPerFrame.size(), m_Options.historyLength) };
+		return Baseline{
+			Benchmark::GetMedian({ msPerFrame.end() - numRuns, msPerFrame.end() }),
+			Benchmark::GetMedian({ raysPerSecond.end() - numRuns, raysPerSecond.end() }),
+			numRuns };
+	}
+
+	void RegressionSuite::AppendHistory(const std::string& historyPath, const Result& result) const
+	{
+		const bool isNew{ !std::filesystem::exists(historyPath) };
+
+		std::ofstream history{ historyPath, std::ios::app };
+		if (!history)
+		{
+			std::cout << "Can't write " << historyPath << '\n';
+			return;
+		}
+
+		if (isNew)
+			history << "timestamp,scene,width,height,ms_per_frame,rays_per_second,max_error,mismatched_pixels,result\n";
+
+		const auto timestamp{ std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count() };
+		history << timestamp << ',' << result.sceneName << ',' << m_Width << ',' << m_Height << ',' << result.msPerFrame << ',' << result.raysPerSecond << ','
+			<< result.maxChannelError << ',' << result.numMismatchedPixels << ',' << result.status << '\n';
+	}
+}
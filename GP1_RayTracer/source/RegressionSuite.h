@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dae
+{
+	struct RegressionOptions
+	{
+		std::string directory{ "Resources/Regression" }; // Golden images (<scene>.png) and history.csv
+		uint32_t numFrames{ 5 }; // Timed frames per scene, after one untimed warm-up frame
+		float time{ 1.f }; // Scene time in seconds, animated scenes are frozen at it
+		int tolerance{ 2 }; // Largest difference per channel (0-255) a pixel may have against the golden image
+		uint32_t maxMismatchedPixels{ 0 }; // Pixels allowed beyond the tolerance
+		float threshold{ 10.f }; // Slowdown in percent against the history that fails the run
+		uint32_t historyLength{ 5 }; // Passing runs the performance baseline is taken from
+		bool record{ false }; // Writes the golden images instead of comparing against them, a missing golden image fails the run otherwise
+		// BRDF::FastMath against BRDF::PreciseMath on a fixed scene, empty skips the check
+		std::string fastMathScene{ "W4_Reference" };
+		int fastMathTolerance{ 1 }; // Largest difference per channel (0-255) the fast math may cause
+		float fastMathRelativeError{ 5e-3f }; // Largest relative error per channel before the colors are clamped and quantized, about twice what W4_Reference shows
+	};
+
+	/**
+	 * \brief Headless golden image and performance check of the scenes
+	 * Every scene is rendered at its initial camera and a fixed time, compared per pixel with its golden image and timed,
+	 * the timings are appended to a history file and compared with the median of the last passing runs
+	 * The error of the fast shading math against the precise one is checked on one scene
+	 */
+	class RegressionSuite final
+	{
+	public:
+		RegressionSuite(int width, int height, const RegressionOptions& options);
+		~RegressionSuite() = default;
+
+		RegressionSuite(const RegressionSuite&) = delete;
+		RegressionSuite(RegressionSuite&&) noexcept = delete;
+		RegressionSuite& operator=(const RegressionSuite&) = delete;
+		RegressionSuite& operator=(RegressionSuite&&) noexcept = delete;
+
+		// Every registered Scene_W* scene
+		static std::vector<std::string> GetDefaultScenes();
+
+		// True when every image matches and nothing got slower
+		bool Run(const std::vector<std::string>& sceneNames);
+
+	private:
+		struct Result
+		{
+			std::string sceneName{};
+			float msPerFrame{};
+			float raysPerSecond{}; // Every ray the scene traced (camera, shadow and indirect rays), not only one per pixel
+			int maxChannelError{};
+			uint32_t numMismatchedPixels{};
+			std::string status{}; // pass, recorded, missing, image, slower, accuracy or error
+		};
+
+		struct Baseline
+		{
+			float msPerFrame{};
+			float raysPerSecond{};
+			size_t numRuns{};
+		};
+
+		int m_Width{};
+		int m_Height{};
+		RegressionOptions m_Options{};
+
+		Result RunScene(const std::string& sceneName) const;
+		// The error of fast math on the scene, the time is that of the fast frame and it is not added to the history
+		Result RunFastMathCheck(const std::string& sceneName) const;
+		// Compares the rendered RGB pixels with the golden image, false when it can't be read or has another size
+		bool CompareGolden(const std::string& path, const std::vector<uint8_t>& pixels, Result& result) const;
+		// PNG, the golden images are committed and a BMP of every scene would bloat the repository
+		bool SaveImage(const std::string& path, std::vector<uint8_t>& pixels) const;
+		Baseline GetBaseline(const std::string& historyPath, const std::string& sceneName) const;
+		void AppendHistory(const std::string& historyPath, const Result& result) const;
+	};
+}
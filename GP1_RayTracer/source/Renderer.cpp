@@ -3,35 +3,82 @@
 #include "SDL_surface.h"
 
 //Project includes
+#include "FramePresenter.h"
+#include "Frustum.h"
 #include "Material.h"
 #include "Math.h"
 #include "Matrix.h"
+#include "Parallel.h" //Parallel_for
+#include "RaySorter.h"
 #include "Renderer.h"
 #include "Scene.h"
 #include "Utils.h"
 
 // Standard includes
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <future>
 #include <iostream>
-#include <ppl.h> //Parallel_for
 
 //#define ASYNC
 #define PARALLEL_FOR
 
 using namespace dae;
 
+struct Renderer::SurfacePoint
+{
+	Ray viewRay{};
+	HitRecord hit{};
+	const Material* pMaterial{}; // In the scene's material table
+	Material texturedMaterial{}; // Textured meshes only, pMaterial with the texel under the pixel
+	bool isTextured{};
+
+	const Material& GetMaterial() const { return isTextured ? texturedMaterial : *pMaterial; }
+};
+
 Renderer::Renderer(SDL_Window* pWindow) :
 	m_pWindow(pWindow),
-	m_pBuffer(SDL_GetWindowSurface(pWindow))
+	m_pPresenter(std::make_unique<FramePresenter>(pWindow))
 {
 	//Initialize
+	m_pBuffer = m_pPresenter->AcquireBackBuffer();
 	SDL_GetWindowSize(pWindow, &m_Width, &m_Height);
 	m_pBufferPixels = static_cast<uint32_t*>(m_pBuffer->pixels);
+	m_BufferStride = m_pBuffer->pitch / static_cast<int>(sizeof(uint32_t));
+	m_AspectRatio = static_cast<float>(m_Width) / static_cast<float>(m_Height);
+
+	m_NumTilesX = (static_cast<uint32_t>(m_Width) + m_TileSize - 1) >> m_TileSizeLog2;
+	m_NumTilesY = (static_cast<uint32_t>(m_Height) + m_TileSize - 1) >> m_TileSizeLog2;
+
+	m_DirtyRegions.Resize(m_Width, m_Height);
+}
+
+Renderer::Renderer(int width, int height) :
+	m_pBuffer(CreateFrameBuffer(width, height, SDL_PIXELFORMAT_ARGB8888)),
+	m_Width(width),
+	m_Height(height)
+{
+	m_pBufferPixels = static_cast<uint32_t*>(m_pBuffer->pixels);
+	m_BufferStride = m_pBuffer->pitch / static_cast<int>(sizeof(uint32_t));
 	m_AspectRatio = static_cast<float>(m_Width) / static_cast<float>(m_Height);
+
+	m_NumTilesX = (static_cast<uint32_t>(m_Width) + m_TileSize - 1) >> m_TileSizeLog2;
+	m_NumTilesY = (static_cast<uint32_t>(m_Height) + m_TileSize - 1) >> m_TileSizeLog2;
+
+	m_DirtyRegions.Resize(m_Width, m_Height);
 }
 
-void Renderer::Render(Scene* pScene) const
+Renderer::~Renderer()
 {
+	// With a window the buffers belong to the presenter
+	if (!m_pWindow) FreeFrameBuffer(m_pBuffer);
+}
+
+void Renderer::Render(Scene* pScene)
+{
+	pScene->BeginFrame();
+
 	Camera& camera{ pScene->GetCamera() };
 	camera.CalculateCameraToWorld();
 
@@ -43,10 +90,57 @@ void Renderer::Render(Scene* pScene) const
 	//const float aspectRatio{ static_cast<float>(m_Width) / static_cast<float>(m_Height) };
 
 	auto& materials{ pScene->GetMaterials() };
-	auto& lights{ pScene->GetLights() };
+	const auto lights{ pScene->GetLights() };
 
 	const uint32_t numPixels{ static_cast<uint32_t>(m_Width * m_Height) };
 
+	// Always compared, so the frame after turning incremental rendering back on knows what changed
+	const RenderSettings settings{ GetSettings() };
+	const uint32_t settingsKey{ settings.lightingMode | static_cast<uint32_t>(settings.shadowsEnabled) << 8 | static_cast<uint32_t>(settings.fastMathEnabled) << 16
+		| static_cast<uint32_t>(settings.sampleSequence) << 17 | static_cast<uint32_t>(settings.indirectLighting) << 18 | static_cast<uint32_t>(settings.visibilityCacheEnabled) << 20
+		| static_cast<uint32_t>(settings.samplesPerPixel) << 24 };
+	// Only the first sample's hit is cached, with more samples a pixel can see things its cached hit doesn't
+	// Indirect light reaches a pixel from anywhere, a moved mesh can change every pixel
+	m_IsIncrementalFrame = m_DirtyRegions.BeginFrame(*pScene, camera, fov, m_AspectRatio, settingsKey) && m_IncrementalEnabled && m_SamplesPerPixel == 1
+		&& m_IndirectLighting == IndirectLighting::Off;
+
+	// Irradiance records and shadow ray answers of static geometry stay valid, whatever the camera does
+	if (m_DirtyRegions.IsSceneUnchanged())
+	{
+		m_IrradianceCache.Invalidate(pScene->GetMovedBounds());
+		m_VisibilityCache.Invalidate(pScene->GetMovedBounds(), pScene->GetLights());
+	}
+	else
+	{
+		m_IrradianceCache.Clear();
+		m_VisibilityCache.Clear();
+	}
+	m_VisibilityCache.ResetStatistics();
+
+	// Earlier frames can still be on their way to the window, trace into a buffer the present thread is done with
+	if (m_pPresenter)
+	{
+		m_pBuffer = m_pPresenter->AcquireBackBuffer();
+		m_pBufferPixels = static_cast<uint32_t*>(m_pBuffer->pixels);
+	}
+
+	// Pixels that are not traced keep the last frame, without its overlay and not whatever older frame the back buffer holds
+	if (m_IsIncrementalFrame)
+	{
+		if (!m_OverlayBackup.empty())
+			std::ranges::copy(m_OverlayBackup, m_pBufferPixels);
+		else if (m_pPresenter && m_pPresenter->GetLastFrame() != m_pBuffer)
+			std::memcpy(m_pBufferPixels, m_pPresenter->GetLastFrame()->pixels, static_cast<size_t>(m_pBuffer->pitch) * m_Height);
+	}
+	m_OverlayBackup.clear();
+
+	m_NumShadowRays = 0;
+	m_NumIndirectRays = 0;
+	m_NumTileCandidates = 0;
+	m_NumCulledTiles = 0;
+
+	PrepareIrradianceCache(pScene, 0, 0, m_Width, m_Height, fov, camera, lights, materials);
+
 #if defined(ASYNC)
 	//Async Logic
 	//+++++++++++
@@ -90,33 +184,460 @@ void Renderer::Render(Scene* pScene) const
 #elif defined(PARALLEL_FOR)
 	//Parallel-For Logic
 	//++++++++++++++++++
-	concurrency::parallel_for(0u, numPixels, [=, this](int i)
-		{
-			RenderPixel(pScene, i, fov, camera, lights, materials);
-		});
+	if (IsRaySortingActive())
+	{
+		concurrency::parallel_for(0u, GetNumRaySortBatches(), [=, this](uint32_t batchIndex)
+			{
+				RenderSortedBatch(pScene, batchIndex, fov, camera, lights, materials);
+			});
+	}
+	else if (m_CurrentPixelTraversal == PixelTraversal::Morton)
+	{
+		const uint32_t numTiles{ m_NumTilesX * m_NumTilesY };
+		concurrency::parallel_for(0u, numTiles, [=, this](uint32_t tileIndex)
+			{
+				RenderTile(pScene, tileIndex, fov, camera, lights, materials);
+			});
+	}
+	else if (m_TileBuffersEnabled)
+	{
+		concurrency::parallel_for(0, m_Height, [=, this](int py)
+			{
+				RenderRow(pScene, py, fov, camera, lights, materials);
+			});
+	}
+	else
+	{
+		concurrency::parallel_for(0u, numPixels, [=, this](int i)
+			{
+				RenderPixel(pScene, i, fov, camera, lights, materials);
+			});
+	}
 
 #else
 	//Synchronous Logic (no threading)
 	//++++++++++++++++++++++++++++++++
-	for (uint32_t i{ 0 }; i < numPixels; ++i)
+	if (IsRaySortingActive())
 	{
-		RenderPixel(pScene, i, fov, pScene->GetCamera(), lights, materials);
+		for (uint32_t batchIndex{ 0 }; batchIndex < GetNumRaySortBatches(); ++batchIndex)
+		{
+			RenderSortedBatch(pScene, batchIndex, fov, camera, lights, materials);
+		}
+	}
+	else if (m_CurrentPixelTraversal == PixelTraversal::Morton)
+	{
+		const uint32_t numTiles{ m_NumTilesX * m_NumTilesY };
+		for (uint32_t tileIndex{ 0 }; tileIndex < numTiles; ++tileIndex)
+		{
+			RenderTile(pScene, tileIndex, fov, camera, lights, materials);
+		}
+	}
+	else
+	{
+		for (uint32_t i{ 0 }; i < numPixels; ++i)
+		{
+			RenderPixel(pScene, i, fov, pScene->GetCamera(), lights, materials);
+		}
 	}
 
 #endif
 
+	m_TracedPixelFraction = static_cast<float>(m_DirtyRegions.CountTracedPixels()) / static_cast<float>(numPixels);
+	if (m_ShowDirtyRegions) DrawDirtyRegionOverlay();
+
 	//@END
 	//Update SDL Surface
-	SDL_UpdateWindowSurface(m_pWindow);
+	Present();
+}
+
+void Renderer::BeginRects(Scene* pScene)
+{
+	pScene->BeginFrame();
+
+	// Tiles of a distributed frame are always traced completely
+	m_IsIncrementalFrame = false;
+	m_DirtyRegions.Invalidate();
+	m_IrradianceCache.Invalidate(pScene->GetMovedBounds());
+	m_VisibilityCache.Invalidate(pScene->GetMovedBounds(), pScene->GetLights());
+
+	pScene->GetCamera().CalculateCameraToWorld();
+}
+
+void Renderer::RenderRect(Scene* pScene, int x, int y, int width, int height)
+{
+	const Camera& camera{ pScene->GetCamera() };
+	const float fov{ tanf(camera.fovAngle * TO_RADIANS / 2.f) };
+	const auto& materials{ pScene->GetMaterials() };
+	const auto lights{ pScene->GetLights() };
+
+	PrepareIrradianceCache(pScene, x, y, width, height, fov, camera, lights, materials);
+
+	const int endX{ std::min(x + width, m_Width) };
+	const int endY{ std::min(y + height, m_Height) };
+	concurrency::parallel_for(y, endY, [&](int py)
+		{
+			for (int px{ x }; px < endX; ++px)
+			{
+				RenderPixel(pScene, px, py, fov, camera, lights, materials);
+			}
+		});
+}
+
+void Renderer::ReadRect(int x, int y, int width, int height, uint8_t* pRGB) const
+{
+	for (int py{ y }; py < y + height; ++py)
+	{
+		for (int px{ x }; px < x + width; ++px)
+		{
+			SDL_GetRGB(m_pBufferPixels[px + (py * m_BufferStride)], m_pBuffer->format, pRGB, pRGB + 1, pRGB + 2);
+			pRGB += 3;
+		}
+	}
+}
+
+void Renderer::WriteRect(int x, int y, int width, int height, const uint8_t* pRGB)
+{
+	// Pixels from somewhere else, the cached hits do not match them anymore
+	m_DirtyRegions.Invalidate();
+
+	for (int py{ y }; py < y + height; ++py)
+	{
+		for (int px{ x }; px < x + width; ++px)
+		{
+			m_pBufferPixels[px + (py * m_BufferStride)] = SDL_MapRGB(m_pBuffer->format, pRGB[0], pRGB[1], pRGB[2]);
+			pRGB += 3;
+		}
+	}
+}
+
+void Renderer::Present() const
+{
+	// Render runs on the thread that created the window, the only one SDL lets update it
+	if (m_pPresenter) m_pPresenter->Submit(m_pBuffer);
+}
+
+void Renderer::RenderTile(const Scene* pScene, uint32_t tileIndex, const float& fov, const Camera& camera, std::span<const Light> lights, const std::vector<Material>& materials) const
+{
+	// Only one divide per tile, the pixels inside the tile are decoded with bit tricks
+	const uint32_t tileX{ (tileIndex % m_NumTilesX) << m_TileSizeLog2 };
+	const uint32_t tileY{ (tileIndex / m_NumTilesX) << m_TileSizeLog2 };
+
+	const FrustumCandidates* pCandidates{ CullTile(pScene, tileIndex, fov, camera) };
+
+	// Walk the tile in Z-order so neighbouring rays (and the geometry they touch) stay close together
+	constexpr uint32_t numTilePixels{ m_TileSize * m_TileSize };
+	if (!m_TileBuffersEnabled)
+	{
+		for (uint32_t mortonIndex{ 0 }; mortonIndex < numTilePixels; ++mortonIndex)
+		{
+			uint32_t x{};
+			uint32_t y{};
+			DecodeMorton2D(mortonIndex, x, y);
+
+			const int px{ static_cast<int>(tileX | x) };
+			const int py{ static_cast<int>(tileY | y) };
+
+			// Tiles on the right and bottom edge can stick out of the screen
+			if (px >= m_Width || py >= m_Height) continue;
+
+			RenderPixel(pScene, px, py, fov, camera, lights, materials, pCandidates);
+		}
+		return;
+	}
+
+	// The tile is traced into the worker's own stack and reaches the frame one row (one cache line) at a time
+	// The frame's rows are aligned, so tiles never share a cache line either way, the buffer only turns 16 scattered writes into one
+	const uint32_t tileWidth{ std::min(m_TileSize, static_cast<uint32_t>(m_Width) - tileX) };
+	const uint32_t tileHeight{ std::min(m_TileSize, static_cast<uint32_t>(m_Height) - tileY) };
+	alignas(64) uint32_t tilePixels[numTilePixels];
+
+	// Pixels an incremental frame skips keep the color of the last frame
+	if (m_IsIncrementalFrame)
+	{
+		for (uint32_t y{ 0 }; y < tileHeight; ++y)
+		{
+			std::memcpy(&tilePixels[y << m_TileSizeLog2], &m_pBufferPixels[tileX + (tileY + y) * m_BufferStride], tileWidth * sizeof(uint32_t));
+		}
+	}
+
+	for (uint32_t mortonIndex{ 0 }; mortonIndex < numTilePixels; ++mortonIndex)
+	{
+		uint32_t x{};
+		uint32_t y{};
+		DecodeMorton2D(mortonIndex, x, y);
+
+		if (x >= tileWidth || y >= tileHeight) continue;
+
+		ComputePixel(pScene, static_cast<int>(tileX | x), static_cast<int>(tileY | y), fov, camera, lights, materials, pCandidates, tilePixels[(y << m_TileSizeLog2) | x]);
+	}
+
+	for (uint32_t y{ 0 }; y < tileHeight; ++y)
+	{
+		std::memcpy(&m_pBufferPixels[tileX + (tileY + y) * m_BufferStride], &tilePixels[y << m_TileSizeLog2], tileWidth * sizeof(uint32_t));
+	}
+}
+
+void Renderer::RenderRow(const Scene* pScene, int py, const float& fov, const Camera& camera, std::span<const Light> lights, const std::vector<Material>& materials) const
+{
+	// Rows start on a cache line, the threads tracing neighbouring rows never write into the same one
+	thread_local std::vector<uint32_t> rowPixels{};
+	uint32_t* pRow{ &m_pBufferPixels[py * m_BufferStride] };
+
+	// Pixels an incremental frame skips keep the color of the last frame
+	if (m_IsIncrementalFrame)
+		rowPixels.assign(pRow, pRow + m_Width);
+	else
+		rowPixels.resize(static_cast<size_t>(m_Width));
+
+	for (int px{ 0 }; px < m_Width; ++px)
+	{
+		ComputePixel(pScene, px, py, fov, camera, lights, materials, nullptr, rowPixels[px]);
+	}
+
+	std::memcpy(pRow, rowPixels.data(), m_Width * sizeof(uint32_t));
+}
+
+const FrustumCandidates* Renderer::CullTile(const Scene* pScene, uint32_t tileIndex, const float& fov, const Camera& camera) const
+{
+	if (!m_FrustumCullingEnabled) return nullptr;
+
+	// Reused by every tile this thread renders
+	thread_local FrustumCandidates candidates{};
+	pScene->CullFrustum(GetTileFrustum(tileIndex, fov, camera), candidates);
+
+	m_NumTileCandidates += static_cast<uint32_t>(candidates.GetSize());
+	++m_NumCulledTiles;
+	return &candidates;
+}
+
+Frustum Renderer::GetTileFrustum(uint32_t tileIndex, const float& fov, const Camera& camera) const
+{
+	// Pixel edges of the tile, sub-pixel samples reach from the left/top edge of a pixel up to its right/bottom edge
+	// A hundredth of a pixel wider, a sample right on the edge stays inside after rounding
+	constexpr float margin{ .01f };
+	const uint32_t tileX{ (tileIndex % m_NumTilesX) << m_TileSizeLog2 };
+	const uint32_t tileY{ (tileIndex / m_NumTilesX) << m_TileSizeLog2 };
+	const float minX{ static_cast<float>(tileX) - margin };
+	const float minY{ static_cast<float>(tileY) - margin };
+	const float maxX{ static_cast<float>(std::min(tileX + m_TileSize, static_cast<uint32_t>(m_Width))) + margin };
+	const float maxY{ static_cast<float>(std::min(tileY + m_TileSize, static_cast<uint32_t>(m_Height))) + margin };
+
+	// Same mapping as TracePrimary
+	const auto getDirection{ [&](float rx, float ry)
+		{
+			const float cx{ (2.f * (rx / static_cast<float>(m_Width)) - 1.f) * m_AspectRatio * fov };
+			const float cy{ (1.f - 2.f * (ry / static_cast<float>(m_Height))) * fov };
+			return camera.cameraToWorld.TransformVector(Vector3{ cx, cy, 1.f });
+		} };
+
+	return Frustum{ camera.origin, getDirection(minX, minY), getDirection(maxX, minY), getDirection(maxX, maxY), getDirection(minX, maxY) };
 }
 
-void Renderer::RenderPixel(const Scene* pScene, uint32_t pixelIndex, const float& fov, const Camera& camera, const std::vector<Light>& lights, const std::vector<Material*>& materials) const
+void Renderer::RenderSortedBatch(const Scene* pScene, uint32_t batchIndex, const float& fov, const Camera& camera, std::span<const Light> lights, const std::vector<Material>& materials) const
+{
+	// One per sample, the samples of a pixel are next to each other
+	struct BatchPixel
+	{
+		int px{};
+		int py{};
+		uint32_t sampleIndex{};
+		bool didHit{};
+		uint32_t firstShadowAnswer{};
+		SurfacePoint point{};
+	};
+
+	// Shadow ray the visibility cache couldn't answer
+	struct TracedShadowRay
+	{
+		uint32_t answerIndex{};
+		uint32_t lightIndex{};
+		uint32_t pixelIndex{};
+	};
+
+	// Reused by every batch this thread renders
+	thread_local std::vector<BatchPixel> pixels{};
+	thread_local std::vector<Ray> shadowRays{};
+	thread_local std::vector<TracedShadowRay> tracedShadowRays{};
+	thread_local std::vector<uint8_t> isOccluded{};
+	thread_local RaySorter raySorter{};
+
+	pixels.clear();
+	shadowRays.clear();
+	tracedShadowRays.clear();
+	isOccluded.clear();
+
+	// 1. Primary rays in the usual tile order, every shadow ray they need is only collected
+	const uint32_t numTiles{ m_NumTilesX * m_NumTilesY };
+	const uint32_t firstTile{ batchIndex * GetTilesPerRaySortBatch() };
+	const uint32_t endTile{ std::min(firstTile + GetTilesPerRaySortBatch(), numTiles) };
+	for (uint32_t tileIndex{ firstTile }; tileIndex < endTile; ++tileIndex)
+	{
+		const uint32_t tileX{ (tileIndex % m_NumTilesX) << m_TileSizeLog2 };
+		const uint32_t tileY{ (tileIndex / m_NumTilesX) << m_TileSizeLog2 };
+		const FrustumCandidates* pCandidates{ CullTile(pScene, tileIndex, fov, camera) };
+
+		constexpr uint32_t numTilePixels{ m_TileSize * m_TileSize };
+		for (uint32_t mortonIndex{ 0 }; mortonIndex < numTilePixels; ++mortonIndex)
+		{
+			uint32_t x{};
+			uint32_t y{};
+			DecodeMorton2D(mortonIndex, x, y);
+
+			const int px{ static_cast<int>(tileX | x) };
+			const int py{ static_cast<int>(tileY | y) };
+
+			if (px >= m_Width || py >= m_Height) continue;
+			if (m_IsIncrementalFrame && !m_DirtyRegions.IsDirty(px, py)) continue;
+
+			for (uint32_t sampleIndex{ 0 }; sampleIndex < m_SamplesPerPixel; ++sampleIndex)
+			{
+				BatchPixel& pixel{ pixels.emplace_back() };
+				pixel.px = px;
+				pixel.py = py;
+				pixel.sampleIndex = sampleIndex;
+				pixel.didHit = TracePrimary(pScene, px, py, GetPixelOffset(px, py, sampleIndex), fov, camera, materials, pixel.point, pCandidates);
+				pixel.firstShadowAnswer = static_cast<uint32_t>(isOccluded.size());
+				if (sampleIndex == 0) m_DirtyRegions.SetPrimaryHit(px, py, pixel.point.hit);
+
+				if (!pixel.didHit) continue;
+
+				// Same lights in the same order ShadePoint asks for them, answers from the visibility cache are known right away
+				const HitRecord& hit{ pixel.point.hit };
+				for (uint32_t lightIndex{ 0 }; lightIndex < lights.size(); ++lightIndex)
+				{
+					const Vector3 lightDirection{ LightUtils::GetDirectionToLight(lights[lightIndex], hit.origin).Normalized() };
+					if (!NeedsShadowRay(Vector3::Dot(hit.normal, lightDirection))) continue;
+
+					bool isVisible{};
+					if (CanCacheVisibility(lightIndex)
+						&& m_VisibilityCache.Lookup(VisibilityCache::GetKey(hit.origin, hit.normal, lightIndex, GetPixelFootprint(hit, fov)), isVisible))
+					{
+						isOccluded.push_back(!isVisible);
+						continue;
+					}
+
+					tracedShadowRays.push_back({ static_cast<uint32_t>(isOccluded.size()), lightIndex, static_cast<uint32_t>(pixels.size() - 1) });
+					shadowRays.push_back(GetShadowRay(hit, lights[lightIndex], lightDirection));
+					isOccluded.push_back(false);
+				}
+			}
+		}
+	}
+
+	// 2. Shadow rays by direction octant and origin, neighbouring rays walk the same BVH nodes
+	for (const uint32_t rayIndex : raySorter.Sort(shadowRays))
+	{
+		const TracedShadowRay& shadowRay{ tracedShadowRays[rayIndex] };
+		const bool doesHit{ pScene->DoesHit(shadowRays[rayIndex]) };
+		isOccluded[shadowRay.answerIndex] = doesHit;
+
+		if (CanCacheVisibility(shadowRay.lightIndex))
+		{
+			const HitRecord& hit{ pixels[shadowRay.pixelIndex].point.hit };
+			m_VisibilityCache.Insert(VisibilityCache::GetKey(hit.origin, hit.normal, shadowRay.lightIndex, GetPixelFootprint(hit, fov)), !doesHit);
+		}
+	}
+	m_NumShadowRays += static_cast<uint32_t>(shadowRays.size());
+
+	// 3. Shading only reads the answers back, a pixel is written after its last sample
+	ColorRGB finalColor{};
+	for (const BatchPixel& pixel : pixels)
+	{
+		if (pixel.didHit)
+		{
+			uint32_t shadowAnswerIndex{ pixel.firstShadowAnswer };
+			finalColor += ShadePoint(pixel.point, lights, m_FastMathEnabled, [&](const Ray&, uint32_t) { return !isOccluded[shadowAnswerIndex++]; });
+			finalColor += GetIndirectLighting(pScene, pixel.point, pixel.px, pixel.py, pixel.sampleIndex, lights, materials);
+		}
+
+		if (pixel.sampleIndex + 1 < m_SamplesPerPixel) continue;
+
+		if (m_SamplesPerPixel > 1) finalColor *= 1.f / static_cast<float>(m_SamplesPerPixel);
+		WritePixel(pixel.px, pixel.py, finalColor);
+		finalColor = {};
+	}
+}
+
+void Renderer::RenderPixel(const Scene* pScene, uint32_t pixelIndex, const float& fov, const Camera& camera, std::span<const Light> lights, const std::vector<Material>& materials) const
 {
 	const int px{ static_cast<int>(pixelIndex % m_Width) };
 	const int py{ static_cast<int>(pixelIndex / m_Width) };
 
-	const float rx{ static_cast<float>(px) + .5f };
-	const float ry{ static_cast<float>(py) + .5f };
+	RenderPixel(pScene, px, py, fov, camera, lights, materials);
+}
+
+void Renderer::RenderPixel(const Scene* pScene, int px, int py, const float& fov, const Camera& camera, std::span<const Light> lights, const std::vector<Material>& materials,
+	const FrustumCandidates* pCandidates) const
+{
+	uint32_t pixel{};
+	if (ComputePixel(pScene, px, py, fov, camera, lights, materials, pCandidates, pixel)) m_pBufferPixels[px + (py * m_BufferStride)] = pixel;
+}
+
+bool Renderer::ComputePixel(const Scene* pScene, int px, int py, const float& fov, const Camera& camera, std::span<const Light> lights, const std::vector<Material>& materials,
+	const FrustumCandidates* pCandidates, uint32_t& pixel) const
+{
+	// Incremental frames skip every pixel no moved mesh can reach, it keeps the color of the last frame
+	if (m_IsIncrementalFrame && !m_DirtyRegions.IsDirty(px, py)) return false;
+
+	HitRecord primaryHit{};
+	const ColorRGB finalColor{ TracePixel(pScene, px, py, fov, camera, lights, materials, m_FastMathEnabled, &primaryHit, pCandidates) };
+	m_DirtyRegions.SetPrimaryHit(px, py, primaryHit);
+
+	pixel = ToPixel(finalColor);
+	return true;
+}
+
+void Renderer::WritePixel(int px, int py, ColorRGB finalColor) const
+{
+	//Update Color in Buffer
+	m_pBufferPixels[px + (py * m_BufferStride)] = ToPixel(finalColor);
+}
+
+uint32_t Renderer::ToPixel(ColorRGB finalColor) const
+{
+	finalColor.MaxToOne();
+
+	return SDL_MapRGB(m_pBuffer->format,
+		static_cast<uint8_t>(finalColor.r * 255),
+		static_cast<uint8_t>(finalColor.g * 255),
+		static_cast<uint8_t>(finalColor.b * 255));
+}
+
+ColorRGB Renderer::TracePixel(const Scene* pScene, int px, int py, const float& fov, const Camera& camera, std::span<const Light> lights, const std::vector<Material>& materials, bool fastMath,
+	HitRecord* pPrimaryHit, const FrustumCandidates* pCandidates) const
+{
+	// Box filter over the samples, the primary hit of the first one is reported
+	ColorRGB finalColor{};
+	for (uint32_t sampleIndex{ 0 }; sampleIndex < m_SamplesPerPixel; ++sampleIndex)
+	{
+		SurfacePoint point{};
+		const bool didHit{ TracePrimary(pScene, px, py, GetPixelOffset(px, py, sampleIndex), fov, camera, materials, point, pCandidates) };
+		if (pPrimaryHit && sampleIndex == 0) *pPrimaryHit = point.hit;
+
+		if (!didHit) continue;
+
+		finalColor += ShadePoint(point, lights, fastMath, [&](const Ray& lightRay, uint32_t lightIndex) { return IsLightVisible(pScene, point.hit, lightIndex, lightRay, fov); });
+		finalColor += GetIndirectLighting(pScene, point, px, py, sampleIndex, lights, materials);
+	}
+
+	if (m_SamplesPerPixel > 1) finalColor *= 1.f / static_cast<float>(m_SamplesPerPixel);
+	return finalColor;
+}
+
+Vector2 Renderer::GetPixelOffset(int px, int py, uint32_t sampleIndex) const
+{
+	// A single sample stays in the pixel center, the image doesn't change when anti-aliasing is off
+	if (m_SamplesPerPixel <= 1) return { .5f, .5f };
+
+	const PixelSampler sampler{ static_cast<uint32_t>(px), static_cast<uint32_t>(py), sampleIndex, m_SampleSequence, m_SampleSeed };
+	return sampler.Get2D(PixelSampler::SubPixel);
+}
+
+bool Renderer::TracePrimary(const Scene* pScene, int px, int py, const Vector2& pixelOffset, const float& fov, const Camera& camera, const std::vector<Material>& materials, SurfacePoint& point,
+	const FrustumCandidates* pCandidates) const
+{
+	const float rx{ static_cast<float>(px) + pixelOffset.x };
+	const float ry{ static_cast<float>(py) + pixelOffset.y };
 
 	const float cx{ (2.f * (rx / static_cast<float>(m_Width)) - 1.f) * m_AspectRatio * fov };
 	const float cy{ (1.f - 2.f * (ry / static_cast<float>(m_Height))) * fov };
@@ -126,35 +647,143 @@ void Renderer::RenderPixel(const Scene* pScene, uint32_t pixelIndex, const float
 	// Transform rayDirection with cameraToWorld
 	rayDirection = camera.cameraToWorld.TransformVector(rayDirection).Normalized();
 
-	const Ray viewRay{ camera.origin, rayDirection };
+	point.viewRay = Ray{ camera.origin, rayDirection };
+
+	HitRecord& closestHit{ point.hit };
+	if (pCandidates)
+		pScene->GetClosestHit(point.viewRay, closestHit, *pCandidates);
+	else
+		pScene->GetClosestHit(point.viewRay, closestHit);
+
+	if (!closestHit.didHit) return false;
+
+	point.pMaterial = &materials[closestHit.materialIndex];
+
+	// On textured meshes the texel under the pixel replaces the material color
+	// The mip level follows from the rays through the neighbouring pixels (ray differentials)
+	if (point.pMaterial->albedoTexture != Material::NoTexture && closestHit.pMesh && !closestHit.pMesh->uvs.empty())
+	{
+		const Texture& texture{ pScene->GetTextures()[point.pMaterial->albedoTexture] };
+		if (texture.IsValid())
+		{
+			const float pixelWidth{ 2.f * m_AspectRatio * fov / static_cast<float>(m_Width) };
+			const float pixelHeight{ 2.f * fov / static_cast<float>(m_Height) };
+			const RayDifferentials differentials
+			{
+				camera.cameraToWorld.TransformVector(Vector3{ cx + pixelWidth, cy, 1.f }).Normalized(),
+				camera.cameraToWorld.TransformVector(Vector3{ cx, cy - pixelHeight, 1.f }).Normalized()
+			};
+
+			Vector2 dUVdx{};
+			Vector2 dUVdy{};
+			const Vector2 uv{ GeometryUtils::GetTextureCoordinate(closestHit, point.viewRay, differentials, dUVdx, dUVdy) };
+
+			point.texturedMaterial = point.pMaterial->WithAlbedo(texture.Sample(uv, dUVdx, dUVdy));
+			point.isTextured = true;
+		}
+	}
+
+	return true;
+}
+
+bool Renderer::NeedsShadowRay(float observedArea) const
+{
+	// Lights behind the surface add nothing in these modes, whether they are blocked doesn't matter
+	if (m_CurrentLightingMode == LightingMode::ObservedArea || m_CurrentLightingMode == LightingMode::Combined)
+		return m_ShadowsEnabled && observedArea >= 0.f;
 
-	HitRecord closestHit{};
-	pScene->GetClosestHit(viewRay, closestHit);
+	return m_ShadowsEnabled;
+}
 
-	if (!closestHit.didHit) return;
+Ray Renderer::GetShadowRay(const HitRecord& hit, const Light& light, const Vector3& lightDirection)
+{
+	return Ray
+	{
+		hit.origin + hit.normal * 0.0001f,
+		lightDirection,
+		0.0001f,
+		(light.origin - hit.origin).Magnitude()
+	};
+}
+
+bool Renderer::IsLightVisible(const Scene* pScene, const HitRecord& hit, uint32_t lightIndex, const Ray& shadowRay, const float& fov) const
+{
+	if (!CanCacheVisibility(lightIndex)) return !pScene->DoesHit(shadowRay);
+
+	const VisibilityCache::Key key{ VisibilityCache::GetKey(hit.origin, hit.normal, lightIndex, GetPixelFootprint(hit, fov)) };
+
+	bool isVisible{};
+	if (m_VisibilityCache.Lookup(key, isVisible)) return isVisible;
+
+	isVisible = !pScene->DoesHit(shadowRay);
+	m_VisibilityCache.Insert(key, isVisible);
+	return isVisible;
+}
+
+template<typename IsVisible>
+ColorRGB Renderer::ShadePoint(const SurfacePoint& point, std::span<const Light> lights, bool fastMath, const IsVisible& isVisible) const
+{
+	const HitRecord& closestHit{ point.hit };
+	const Ray& viewRay{ point.viewRay };
+	const Material& material{ point.GetMaterial() };
 
 	//Color to write to the color buffer
 	ColorRGB finalColor{};
 
+	// With fast math the BRDF is evaluated for 4 lights at once, every light is weighted after shading
+	Vector3 batchDirections[4]{};
+	ColorRGB batchRadiance[4]{};
+	float batchObservedArea[4]{};
+	int batchSize{ 0 };
+
+	const auto flushBatch{ [&]()
+		{
+#ifdef USE_SSE
+			if (batchSize == 0) return;
+
+			for (int i{ batchSize }; i < 4; ++i) batchDirections[i] = batchDirections[0];
+
+			ColorRGB brdf[4]{};
+			material.Shade4(closestHit, batchDirections, viewRay.direction, brdf);
+			for (int i{ 0 }; i < batchSize; ++i)
+			{
+				finalColor += brdf[i] * batchRadiance[i] * batchObservedArea[i];
+			}
+
+			batchSize = 0;
+#endif
+		} };
+
+	const auto shade{ [&](const Vector3& lightDirection, const ColorRGB& radiance, float observedArea)
+		{
+#ifdef USE_SSE
+			if (fastMath)
+			{
+				batchDirections[batchSize] = lightDirection;
+				batchRadiance[batchSize] = radiance;
+				batchObservedArea[batchSize] = observedArea;
+				if (++batchSize == 4) flushBatch();
+				return;
+			}
+#else
+			if (fastMath)
+			{
+				finalColor += material.Shade<BRDF::FastMath>(closestHit, lightDirection, viewRay.direction) * radiance * observedArea;
+				return;
+			}
+#endif
+			finalColor += material.Shade(closestHit, lightDirection, viewRay.direction) * radiance * observedArea;
+		} };
+
 	// For each light
-	for (const Light& light : lights)
+	for (uint32_t lightIndex{ 0 }; lightIndex < lights.size(); ++lightIndex)
 	{
+		const Light& light{ lights[lightIndex] };
 		const Vector3 lightDirection{ LightUtils::GetDirectionToLight(light, closestHit.origin).Normalized() };
 		const float observedArea{ Vector3::Dot(closestHit.normal, lightDirection) };
 
-		// We need to check the LightingMode because
-		if (m_ShadowsEnabled)
-		{
-			const Ray lightRay
-			{
-				closestHit.origin + closestHit.normal * 0.0001f,
-				lightDirection,
-				0.0001f,
-				(light.origin - closestHit.origin).Magnitude()
-			};
-
-			if (pScene->DoesHit(lightRay)) continue;
-		}
+		// Sorted batches answer from the shadow rays they traced up front, asked in the same light order they were made in
+		if (NeedsShadowRay(observedArea) && !isVisible(GetShadowRay(closestHit, light, lightDirection), lightIndex)) continue;
 
 		switch (m_CurrentLightingMode)
 		{
@@ -166,27 +795,257 @@ void Renderer::RenderPixel(const Scene* pScene, uint32_t pixelIndex, const float
 			finalColor += LightUtils::GetRadiance(light, closestHit.origin);
 			break;
 		case LightingMode::BRDF:
-			finalColor += materials[closestHit.materialIndex]->Shade(closestHit, lightDirection, viewRay.direction);
+			shade(lightDirection, colors::White, 1.f);
 			break;
 		case LightingMode::Combined:
 			if (observedArea < 0.f) break;
-			finalColor += materials[closestHit.materialIndex]->Shade(closestHit, lightDirection, viewRay.direction) * LightUtils::GetRadiance(light, closestHit.origin) * observedArea;
+			shade(lightDirection, LightUtils::GetRadiance(light, closestHit.origin), observedArea);
 			break;
 		}
 	}
 
-	//Update Color in Buffer
-	finalColor.MaxToOne();
+	flushBatch();
 
-	m_pBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBuffer->format,
-		static_cast<uint8_t>(finalColor.r * 255),
-		static_cast<uint8_t>(finalColor.g * 255),
-		static_cast<uint8_t>(finalColor.b * 255));
+	return finalColor;
+}
+
+void Renderer::PrepareIrradianceCache(const Scene* pScene, int x, int y, int width, int height, const float& fov, const Camera& camera, std::span<const Light> lights,
+	const std::vector<Material>& materials) const
+{
+	if (m_IndirectLighting != IndirectLighting::IrradianceCache || m_CurrentLightingMode != LightingMode::Combined) return;
+
+	const int endX{ std::min(x + width, m_Width) };
+	const int endY{ std::min(y + height, m_Height) };
+	const int numBlocksX{ (endX - x + m_IrradianceBlockSize - 1) / m_IrradianceBlockSize };
+	const int numBlocksY{ (endY - y + m_IrradianceBlockSize - 1) / m_IrradianceBlockSize };
+	if (numBlocksX <= 0 || numBlocksY <= 0) return;
+
+	std::vector<std::vector<IrradianceCache::Record>> blockRecords(static_cast<size_t>(numBlocksX * numBlocksY));
+
+	// Coarse to fine, the records of the widely spaced pixels cover most of the screen before the finer passes fill the gaps
+	for (int spacing{ m_IrradiancePrePassSpacing }; spacing >= 1; spacing /= 2)
+	{
+		concurrency::parallel_for(0, numBlocksX * numBlocksY, [&](int blockIndex)
+			{
+				std::vector<IrradianceCache::Record>& records{ blockRecords[blockIndex] };
+				records.clear();
+
+				// Pixels on the grid of this pass, those on the grid of the pass before are done already
+				const auto alignUp{ [spacing](int value) { return (value + spacing - 1) / spacing * spacing; } };
+				const int blockX{ x + (blockIndex % numBlocksX) * m_IrradianceBlockSize };
+				const int blockY{ y + (blockIndex / numBlocksX) * m_IrradianceBlockSize };
+				const int blockEndX{ std::min(blockX + m_IrradianceBlockSize, endX) };
+				const int blockEndY{ std::min(blockY + m_IrradianceBlockSize, endY) };
+				for (int py{ alignUp(blockY) }; py < blockEndY; py += spacing)
+				{
+					for (int px{ alignUp(blockX) }; px < blockEndX; px += spacing)
+					{
+						if (spacing < m_IrradiancePrePassSpacing && px % (2 * spacing) == 0 && py % (2 * spacing) == 0) continue;
+
+						// The point the first sample of the pixel shades
+						SurfacePoint point{};
+						if (!TracePrimary(pScene, px, py, GetPixelOffset(px, py, 0), fov, camera, materials, point, nullptr) || !ReceivesIndirectLighting(point)) continue;
+
+						const Vector3 normal{ Vector3::Dot(point.hit.normal, point.viewRay.direction) > 0.f ? -point.hit.normal : point.hit.normal };
+						ColorRGB irradiance{};
+						if (m_IrradianceCache.Lookup(point.hit.origin, normal, irradiance, records)) continue;
+
+						const PixelSampler sampler{ static_cast<uint32_t>(px), static_cast<uint32_t>(py), 0, m_SampleSequence, m_SampleSeed };
+						IrradianceCache::Record& record{ records.emplace_back(SampleIrradiance(pScene, point.hit.origin, normal, lights, materials, sampler)) };
+
+						// Where the irradiance changes fast the record can't reach as far, E / |grad E| per channel (Krivanek et al.)
+						const float channels[3]{ record.irradiance.r, record.irradiance.g, record.irradiance.b };
+						for (int channel{ 0 }; channel < 3; ++channel)
+						{
+							const float gradient{ record.translationalGradient[channel].Magnitude() };
+							if (gradient > 0.f && channels[channel] > 0.f) record.radius = std::min(record.radius, channels[channel] / gradient);
+						}
+
+						// Between a few and a few tens of pixels on screen (Tabellion & Lamorlette), so close walls don't get a record per pixel
+						const float pixelSize{ GetPixelFootprint(point.hit, fov) };
+						const float accuracy{ m_IrradianceCache.GetAccuracy() };
+						record.radius = std::clamp(record.radius, m_MinRecordPixels * pixelSize / accuracy, m_MaxRecordPixels * pixelSize / accuracy);
+					}
+				}
+			});
+
+		for (const std::vector<IrradianceCache::Record>& records : blockRecords)
+		{
+			m_IrradianceCache.Insert(records);
+		}
+	}
+}
+
+bool Renderer::ReceivesIndirectLighting(const SurfacePoint& point) const
+{
+	// Only the diffuse part bounces, and only the combined lighting mode has units it can be added to
+	if (m_IndirectLighting == IndirectLighting::Off || m_CurrentLightingMode != LightingMode::Combined) return false;
+
+	const ColorRGB& diffuse{ point.GetMaterial().diffuse };
+	return diffuse.r > 0.f || diffuse.g > 0.f || diffuse.b > 0.f;
+}
+
+ColorRGB Renderer::GetIndirectLighting(const Scene* pScene, const SurfacePoint& point, int px, int py, uint32_t sampleIndex, std::span<const Light> lights,
+	const std::vector<Material>& materials) const
+{
+	if (!ReceivesIndirectLighting(point)) return {};
+
+	const ColorRGB& diffuse{ point.GetMaterial().diffuse };
+
+	// Faces the camera, planes and single sided triangles can be hit from behind
+	const Vector3 normal{ Vector3::Dot(point.hit.normal, point.viewRay.direction) > 0.f ? -point.hit.normal : point.hit.normal };
+
+	if (m_IndirectLighting == IndirectLighting::IrradianceCache)
+	{
+		ColorRGB irradiance{};
+		if (m_IrradianceCache.Lookup(point.hit.origin, normal, irradiance)) return diffuse * irradiance;
+	}
+
+	// Records are only made by PrepareIrradianceCache, a sub-pixel sample out of reach of all of them gets a hemisphere of its own
+	const PixelSampler sampler{ static_cast<uint32_t>(px), static_cast<uint32_t>(py), sampleIndex, m_SampleSequence, m_SampleSeed };
+	return diffuse * SampleIrradiance(pScene, point.hit.origin, normal, lights, materials, sampler).irradiance;
+}
+
+IrradianceCache::Record Renderer::SampleIrradiance(const Scene* pScene, const Vector3& origin, const Vector3& normal, std::span<const Light> lights, const std::vector<Material>& materials,
+	const PixelSampler& sampler) const
+{
+	constexpr int M{ m_IrradianceThetaStrata };
+	constexpr int N{ m_IrradiancePhiStrata };
+
+	// Orthonormal basis around the normal (Duff et al. 2017)
+	const float sign{ std::copysign(1.f, normal.z) };
+	const float a{ -1.f / (sign + normal.z) };
+	const float b{ normal.x * normal.y * a };
+	const Vector3 tangent{ 1.f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x };
+	const Vector3 bitangent{ b, sign + normal.y * normal.y * a, -normal.y };
+
+	// Radiance and hit distance per stratum, one cosine weighted ray in each: sin^2(theta) in [j, j + 1) / M, phi in [k, k + 1) / N
+	ColorRGB radiance[M][N]{};
+	float distance[M][N]{};
+	float sinTheta[M][N]{};
+	float cosTheta[M][N]{};
+	float phi[M][N]{};
+
+	IrradianceCache::Record record{ origin, normal };
+	float inverseDistanceSum{ 0.f };
+
+	for (int j{ 0 }; j < M; ++j)
+	{
+		for (int k{ 0 }; k < N; ++k)
+		{
+			const Vector2 jitter{ sampler.Get2D(PixelSampler::Hemisphere + j * N + k) };
+			sinTheta[j][k] = std::sqrt((static_cast<float>(j) + jitter.x) / M);
+			cosTheta[j][k] = std::sqrt(std::max(1.f - sinTheta[j][k] * sinTheta[j][k], 0.f));
+			phi[j][k] = PI_2 * (static_cast<float>(k) + jitter.y) / N;
+
+			const Vector3 direction{ tangent * (std::cos(phi[j][k]) * sinTheta[j][k]) + bitangent * (std::sin(phi[j][k]) * sinTheta[j][k]) + normal * cosTheta[j][k] };
+			const Ray ray{ origin + normal * 0.0001f, direction };
+
+			SurfacePoint hitPoint{ ray };
+			pScene->GetClosestHit(ray, hitPoint.hit);
+			if (!hitPoint.hit.didHit)
+			{
+				distance[j][k] = FLT_MAX;
+				continue;
+			}
+
+			// Single bounce: the direct light the hit point sends back along the ray
+			hitPoint.pMaterial = &materials[hitPoint.hit.materialIndex];
+			radiance[j][k] = ShadePoint(hitPoint, lights, false, [pScene](const Ray& lightRay, uint32_t) { return !pScene->DoesHit(lightRay); });
+			distance[j][k] = hitPoint.hit.t;
+
+			record.irradiance += radiance[j][k];
+			inverseDistanceSum += 1.f / hitPoint.hit.t;
+		}
+	}
+	m_NumIndirectRays += M * N;
+
+	// Cosine weighted, so every ray carries pi / (M * N)
+	record.irradiance *= PI / static_cast<float>(M * N);
+	record.radius = inverseDistanceSum > 0.f ? static_cast<float>(M * N) / inverseDistanceSum : FLT_MAX;
+
+	// Irradiance gradients (Ward & Heckbert 1992), one per color channel
+	const auto getChannel{ [](const ColorRGB& color, int channel) { return channel == 0 ? color.r : channel == 1 ? color.g : color.b; } };
+	for (int channel{ 0 }; channel < 3; ++channel)
+	{
+		Vector3 rotational{};
+		Vector3 translational{};
+		for (int k{ 0 }; k < N; ++k)
+		{
+			// Rotational: how the cosine weights change when the normal tilts towards v_k
+			float tiltSum{ 0.f };
+			for (int j{ 0 }; j < M; ++j)
+			{
+				tiltSum -= sinTheta[j][k] / std::max(cosTheta[j][k], 1e-4f) * getChannel(radiance[j][k], channel);
+			}
+			const float phiK{ PI_2 * (static_cast<float>(k) + .5f) / N };
+			const Vector3 v{ tangent * -std::sin(phiK) + bitangent * std::cos(phiK) };
+			rotational += v * tiltSum;
+
+			// Translational: how the boundaries between the strata move, towards u_k between rings and v_k- between wedges
+			const Vector3 u{ tangent * std::cos(phiK) + bitangent * std::sin(phiK) };
+			for (int j{ 1 }; j < M; ++j)
+			{
+				const float sinThetaMinus{ std::sqrt(static_cast<float>(j) / M) };
+				const float cosThetaMinusSquared{ 1.f - static_cast<float>(j) / M };
+				const float nearest{ std::min(distance[j][k], distance[j - 1][k]) };
+				translational += u * (PI_2 / N * sinThetaMinus * cosThetaMinusSquared / nearest * (getChannel(radiance[j][k], channel) - getChannel(radiance[j - 1][k], channel)));
+			}
+
+			const int previousK{ (k + N - 1) % N };
+			const float phiKMinus{ PI_2 * static_cast<float>(k) / N };
+			const Vector3 vMinus{ tangent * -std::sin(phiKMinus) + bitangent * std::cos(phiKMinus) };
+			for (int j{ 0 }; j < M; ++j)
+			{
+				const float sinThetaMinus{ std::sqrt(static_cast<float>(j) / M) };
+				const float sinThetaPlus{ std::sqrt(static_cast<float>(j + 1) / M) };
+				const float nearest{ std::min(distance[j][k], distance[j][previousK]) };
+				translational += vMinus * ((sinThetaPlus - sinThetaMinus) / nearest * (getChannel(radiance[j][k], channel) - getChannel(radiance[j][previousK], channel)));
+			}
+		}
+
+		record.rotationalGradient[channel] = rotational * (PI / static_cast<float>(M * N));
+		record.translationalGradient[channel] = translational;
+	}
+
+	return record;
+}
+
+bool Renderer::SaveBufferToImage(const std::string& path) const
+{
+	return SDL_SaveBMP(m_pBuffer, path.c_str());
+}
+
+void Renderer::RequestScreenshot() const
+{
+	if (m_pPresenter)
+	{
+		m_pPresenter->RequestScreenshot("RayTracing_Buffer.bmp");
+		return;
+	}
+
+	if (!SaveBufferToImage())
+		std::cout << "Screenshot saved!\n";
+	else
+		std::cout << "Something went wrong. Screenshot not saved!\n";
 }
 
-bool Renderer::SaveBufferToImage() const
+RenderSettings Renderer::GetSettings() const
 {
-	return SDL_SaveBMP(m_pBuffer, "RayTracing_Buffer.bmp");
+	return { static_cast<uint8_t>(m_CurrentLightingMode), m_ShadowsEnabled, m_FastMathEnabled, static_cast<uint8_t>(m_SamplesPerPixel), static_cast<uint8_t>(m_SampleSequence), m_SampleSeed,
+		static_cast<uint8_t>(m_IndirectLighting), m_VisibilityCacheEnabled };
+}
+
+void Renderer::SetSettings(const RenderSettings& settings)
+{
+	m_CurrentLightingMode = static_cast<LightingMode>(settings.lightingMode);
+	m_ShadowsEnabled = settings.shadowsEnabled;
+	m_FastMathEnabled = settings.fastMathEnabled;
+	m_SamplesPerPixel = std::max<uint32_t>(settings.samplesPerPixel, 1);
+	m_SampleSequence = static_cast<SampleSequence>(settings.sampleSequence);
+	m_SampleSeed = settings.sampleSeed;
+	m_IndirectLighting = static_cast<IndirectLighting>(settings.indirectLighting);
+	m_VisibilityCacheEnabled = settings.visibilityCacheEnabled;
 }
 
 void Renderer::CycleLightingMode()
@@ -211,3 +1070,221 @@ void Renderer::CycleLightingMode()
 		break;
 	}
 }
+
+void Renderer::CyclePixelTraversal()
+{
+	m_CurrentPixelTraversal = m_CurrentPixelTraversal == PixelTraversal::Morton ? PixelTraversal::Scanline : PixelTraversal::Morton;
+
+	// Print current m_CurrentPixelTraversal
+	switch (m_CurrentPixelTraversal)
+	{
+	case PixelTraversal::Scanline:
+		std::cout << "\nPIXEL TRAVERSAL: SCANLINE\n\n";
+		break;
+	case PixelTraversal::Morton:
+		std::cout << "\nPIXEL TRAVERSAL: MORTON TILES\n\n";
+		break;
+	}
+}
+
+void Renderer::ToggleFastMath()
+{
+	m_FastMathEnabled = !m_FastMathEnabled;
+
+	if (m_FastMathEnabled)
+		std::cout << "\nBRDF MATH: FAST\n\n";
+	else
+		std::cout << "\nBRDF MATH: PRECISE\n\n";
+}
+
+void Renderer::ToggleIncrementalRendering()
+{
+	m_IncrementalEnabled = !m_IncrementalEnabled;
+
+	if (m_IncrementalEnabled)
+		std::cout << "\nINCREMENTAL RENDERING: ON\n\n";
+	else
+		std::cout << "\nINCREMENTAL RENDERING: OFF\n\n";
+}
+
+void Renderer::ToggleDirtyRegionOverlay()
+{
+	m_ShowDirtyRegions = !m_ShowDirtyRegions;
+
+	if (m_ShowDirtyRegions)
+		std::cout << "\nDIRTY REGION OVERLAY: ON\n\n";
+	else
+		std::cout << "\nDIRTY REGION OVERLAY: OFF\n\n";
+}
+
+void Renderer::ToggleRaySorting()
+{
+	m_RaySortingEnabled = !m_RaySortingEnabled;
+
+	if (m_RaySortingEnabled)
+		std::cout << "\nRAY SORTING: ON\n\n";
+	else
+		std::cout << "\nRAY SORTING: OFF\n\n";
+}
+
+void Renderer::ToggleFrustumCulling()
+{
+	m_FrustumCullingEnabled = !m_FrustumCullingEnabled;
+
+	if (m_FrustumCullingEnabled)
+		std::cout << "\nTILE FRUSTUM CULLING: ON\n\n";
+	else
+		std::cout << "\nTILE FRUSTUM CULLING: OFF\n\n";
+}
+
+void Renderer::ToggleThreadPinning()
+{
+	SetThreadPinning(!IsThreadPinning());
+
+	if (IsThreadPinning())
+		std::cout << "\nTHREAD PINNING: ON\n\n";
+	else
+		std::cout << "\nTHREAD PINNING: OFF\n\n";
+}
+
+void Renderer::CycleSamplesPerPixel()
+{
+	m_SamplesPerPixel = m_SamplesPerPixel >= 16 ? 1 : m_SamplesPerPixel * 4;
+
+	std::cout << "\nSAMPLES PER PIXEL: " << m_SamplesPerPixel << "\n\n";
+}
+
+void Renderer::ToggleVisibilityCache()
+{
+	m_VisibilityCacheEnabled = !m_VisibilityCacheEnabled;
+
+	if (m_VisibilityCacheEnabled)
+		std::cout << "\nVISIBILITY CACHE: ON\n\n";
+	else
+		std::cout << "\nVISIBILITY CACHE: OFF\n\n";
+}
+
+void Renderer::CycleIndirectLighting()
+{
+	m_IndirectLighting = static_cast<IndirectLighting>((static_cast<int>(m_IndirectLighting) + 1) % 3);
+
+	switch (m_IndirectLighting)
+	{
+	case IndirectLighting::Off:
+		std::cout << "\nINDIRECT LIGHTING: OFF\n\n";
+		break;
+	case IndirectLighting::Hemisphere:
+		std::cout << "\nINDIRECT LIGHTING: HEMISPHERE (EVERY PIXEL)\n\n";
+		break;
+	case IndirectLighting::IrradianceCache:
+		std::cout << "\nINDIRECT LIGHTING: IRRADIANCE CACHE\n\n";
+		break;
+	}
+}
+
+void Renderer::DrawDirtyRegionOverlay() const
+{
+	m_OverlayBackup.assign(m_pBufferPixels, m_pBufferPixels + m_BufferStride * m_Height);
+
+	// Traced pixels are tinted red, the screen footprints of the moved meshes are outlined in yellow
+	for (int py{ 0 }; py < m_Height; ++py)
+	{
+		for (int px{ 0 }; px < m_Width; ++px)
+		{
+			if (!m_DirtyRegions.WasTraced(px, py)) continue;
+
+			uint32_t& pixel{ m_pBufferPixels[px + (py * m_BufferStride)] };
+			uint8_t r{};
+			uint8_t g{};
+			uint8_t b{};
+			SDL_GetRGB(pixel, m_pBuffer->format, &r, &g, &b);
+			pixel = SDL_MapRGB(m_pBuffer->format, static_cast<uint8_t>((r + 255) / 2), static_cast<uint8_t>(g / 2), static_cast<uint8_t>(b / 2));
+		}
+	}
+
+	const uint32_t outlineColor{ SDL_MapRGB(m_pBuffer->format, 255, 255, 0) };
+	for (const DirtyRegions::Rect& footprint : m_DirtyRegions.GetFootprints())
+	{
+		if (footprint.minX >= footprint.maxX || footprint.minY >= footprint.maxY) continue;
+
+		for (int px{ footprint.minX }; px < footprint.maxX; ++px)
+		{
+			m_pBufferPixels[px + (footprint.minY * m_BufferStride)] = outlineColor;
+			m_pBufferPixels[px + ((footprint.maxY - 1) * m_BufferStride)] = outlineColor;
+		}
+		for (int py{ footprint.minY }; py < footprint.maxY; ++py)
+		{
+			m_pBufferPixels[footprint.minX + (py * m_BufferStride)] = outlineColor;
+			m_pBufferPixels[footprint.maxX - 1 + (py * m_BufferStride)] = outlineColor;
+		}
+	}
+}
+
+Renderer::FastMathError Renderer::MeasureFastMathError(Scene* pScene) const
+{
+	pScene->BeginFrame();
+
+	Camera& camera{ pScene->GetCamera() };
+	camera.CalculateCameraToWorld();
+
+	const float fov{ tanf(camera.fovAngle * TO_RADIANS / 2.f) };
+	const auto& materials{ pScene->GetMaterials() };
+	const auto lights{ pScene->GetLights() };
+
+	const uint32_t numPixels{ static_cast<uint32_t>(m_Width * m_Height) };
+	std::vector<ColorRGB> precise(numPixels);
+	std::vector<ColorRGB> fast(numPixels);
+
+	const auto renderAll{ [&](std::vector<ColorRGB>& colors, bool fastMath)
+		{
+			const auto start{ std::chrono::steady_clock::now() };
+			concurrency::parallel_for(0u, numPixels, [&](uint32_t i)
+				{
+					colors[i] = TracePixel(pScene, static_cast<int>(i % m_Width), static_cast<int>(i / m_Width), fov, camera, lights, materials, fastMath);
+				});
+			return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+		} };
+
+	FastMathError error{};
+	error.preciseTime = renderAll(precise, false);
+	error.fastTime = renderAll(fast, true);
+
+	for (uint32_t i{ 0 }; i < numPixels; ++i)
+	{
+		const float p[3]{ precise[i].r, precise[i].g, precise[i].b };
+		const float f[3]{ fast[i].r, fast[i].g, fast[i].b };
+		for (int c{ 0 }; c < 3; ++c)
+		{
+			const float absoluteError{ std::abs(p[c] - f[c]) };
+			error.maxAbsoluteError = std::max(error.maxAbsoluteError, absoluteError);
+			if (p[c] > 1e-3f) error.maxRelativeError = std::max(error.maxRelativeError, absoluteError / p[c]);
+		}
+
+		// What ends up on screen
+		ColorRGB preciseColor{ precise[i] };
+		ColorRGB fastColor{ fast[i] };
+		preciseColor.MaxToOne();
+		fastColor.MaxToOne();
+
+		const int channelError{ std::max({
+			std::abs(static_cast<int>(preciseColor.r * 255) - static_cast<int>(fastColor.r * 255)),
+			std::abs(static_cast<int>(preciseColor.g * 255) - static_cast<int>(fastColor.g * 255)),
+			std::abs(static_cast<int>(preciseColor.b * 255) - static_cast<int>(fastColor.b * 255)) }) };
+
+		error.maxChannelError = std::max(error.maxChannelError, channelError);
+		if (channelError > 0) ++error.numPixelsChanged;
+	}
+
+	return error;
+}
+
+void Renderer::ReportFastMathError(Scene* pScene) const
+{
+	const FastMathError error{ MeasureFastMathError(pScene) };
+
+	std::cout << "\n**FAST MATH ACCURACY**\n";
+	std::cout << ">> MAX ABSOLUTE ERROR = " << error.maxAbsoluteError << '\n';
+	std::cout << ">> MAX RELATIVE ERROR = " << error.maxRelativeError << '\n';
+	std::cout << ">> MAX 8 BIT ERROR = " << error.maxChannelError << " (" << error.numPixelsChanged << " of " << m_Width * m_Height << " pixels changed)\n";
+	std::cout << ">> PRECISE = " << error.preciseTime << "ms, FAST = " << error.fastTime << "ms\n\n";
+}
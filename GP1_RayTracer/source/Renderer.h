@@ -1,41 +1,153 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
 #include <vector>
 
+#include "DirtyRegions.h"
+#include "IrradianceCache.h"
+#include "Sampler.h"
+#include "VisibilityCache.h"
+
 struct SDL_Window;
 struct SDL_Surface;
 
 namespace dae
 {
-	class Material;
+	struct ColorRGB;
+	struct Material;
 	class Scene;
 	struct Camera;
 	struct Light;
+	struct HitRecord;
+	struct Ray;
+	struct Vector3;
+	struct Frustum;
+	struct FrustumCandidates;
+	class FramePresenter;
+
+	// Everything besides the scene and camera that changes the rendered pixels, a remote renderer needs the same values
+	struct RenderSettings
+	{
+		uint8_t lightingMode{};
+		bool shadowsEnabled{};
+		bool fastMathEnabled{};
+		uint8_t samplesPerPixel{ 1 };
+		uint8_t sampleSequence{}; // SampleSequence
+		uint32_t sampleSeed{};
+		uint8_t indirectLighting{};
+		bool visibilityCacheEnabled{};
+	};
 
 	class Renderer final
 	{
 	public:
+		// Traces into back buffers, a FramePresenter shows them and writes screenshots on its own thread
 		Renderer(SDL_Window* pWindow);
-		~Renderer() = default;
+		// Headless, renders into its own surface (render workers, offline renders)
+		Renderer(int width, int height);
+		~Renderer();
 
 		Renderer(const Renderer&) = delete;
 		Renderer(Renderer&&) noexcept = delete;
 		Renderer& operator=(const Renderer&) = delete;
 		Renderer& operator=(Renderer&&) noexcept = delete;
 
-		void Render(Scene* pScene) const;
-		void RenderPixel(const Scene* pScene, uint32_t pixelIndex, const float& fov, const Camera& camera, const std::vector<Light>& lights, const std::vector<Material*>& materials) const;
-		bool SaveBufferToImage() const;
+		void Render(Scene* pScene);
+		void RenderPixel(const Scene* pScene, uint32_t pixelIndex, const float& fov, const Camera& camera, std::span<const Light> lights, const std::vector<Material>& materials) const;
+		// pCandidates are the objects culled for the pixel's tile, nullptr tests the whole scene
+		void RenderPixel(const Scene* pScene, int px, int py, const float& fov, const Camera& camera, std::span<const Light> lights, const std::vector<Material>& materials,
+			const FrustumCandidates* pCandidates = nullptr) const;
+		void RenderTile(const Scene* pScene, uint32_t tileIndex, const float& fov, const Camera& camera, std::span<const Light> lights, const std::vector<Material>& materials) const;
+		// Scanline traversal with tile buffers, the row is traced into a buffer of the worker thread
+		void RenderRow(const Scene* pScene, int py, const float& fov, const Camera& camera, std::span<const Light> lights, const std::vector<Material>& materials) const;
+		// Unclamped color of one pixel, pPrimaryHit receives the hit of the camera ray
+		ColorRGB TracePixel(const Scene* pScene, int px, int py, const float& fov, const Camera& camera, std::span<const Light> lights, const std::vector<Material>& materials, bool fastMath,
+			HitRecord* pPrimaryHit = nullptr, const FrustumCandidates* pCandidates = nullptr) const;
+		// Once per distributed frame, after its camera and settings are set: applies the scene changes and updates the caches for the tiles
+		void BeginRects(Scene* pScene);
+		// One tile of a distributed frame, its rows on all cores
+		void RenderRect(Scene* pScene, int x, int y, int width, int height);
+		// Packed 8 bit RGB, independent of the surface pixel format
+		void ReadRect(int x, int y, int width, int height, uint8_t* pRGB) const;
+		void WriteRect(int x, int y, int width, int height, const uint8_t* pRGB);
+		void Present() const;
+		bool SaveBufferToImage(const std::string& path = "RayTracing_Buffer.bmp") const;
+		// Writes the last rendered frame without waiting for it, on the present thread when there is a window
+		void RequestScreenshot() const;
+
+		int GetWidth() const { return m_Width; }
+		int GetHeight() const { return m_Height; }
+		RenderSettings GetSettings() const;
+		void SetSettings(const RenderSettings& settings);
 
 		void CycleLightingMode();
+		void CyclePixelTraversal();
+		void SetScanlineTraversal(bool isEnabled) { m_CurrentPixelTraversal = isEnabled ? PixelTraversal::Scanline : PixelTraversal::Morton; }
 		void ToggleShadows() { m_ShadowsEnabled = !m_ShadowsEnabled; }
+		void ToggleFastMath();
+		void ToggleIncrementalRendering();
+		void SetIncrementalRendering(bool isEnabled) { m_IncrementalEnabled = isEnabled; }
+		void ToggleDirtyRegionOverlay();
+		void ToggleRaySorting();
+		void ToggleFrustumCulling();
+		void SetFrustumCulling(bool isEnabled) { m_FrustumCullingEnabled = isEnabled; }
+		// Every worker thread of the parallel algorithms stays on its own core, Linux only (see dae::SetThreadPinning)
+		void ToggleThreadPinning();
+		// Tiles (or rows, with scanline traversal) are traced into a buffer of the worker thread and copied to the frame in whole cache lines, instead of pixel by pixel
+		void SetTileBuffers(bool isEnabled) { m_TileBuffersEnabled = isEnabled; }
+		// Objects the primary rays of a tile were tested against in the last frame, on average
+		float GetAverageTileCandidates() const { return m_NumCulledTiles ? static_cast<float>(m_NumTileCandidates) / static_cast<float>(m_NumCulledTiles) : 0.f; }
+		// 1, 4 or 16 samples per pixel, jittered inside the pixel by the sample sequence
+		void CycleSamplesPerPixel();
+		void SetSamplesPerPixel(uint32_t numSamples) { m_SamplesPerPixel = std::clamp(numSamples, 1u, 255u); }
+		void SetSampleSequence(SampleSequence sequence) { m_SampleSequence = sequence; }
+		// Another seed gives another, equally deterministic, set of samples
+		void SetSampleSeed(uint32_t seed) { m_SampleSeed = seed; }
+		// Off, a full hemisphere of rays at every pixel, or interpolated from the irradiance cache
+		void CycleIndirectLighting();
+		// Hemisphere rays traced for indirect light in the last frame
+		uint32_t GetNumIndirectRays() const { return m_NumIndirectRays; }
+		size_t GetNumIrradianceRecords() const { return m_IrradianceCache.GetNumRecords(); }
+		// Shadow ray answers shared by the hits in the same world space cell, kept while the camera moves
+		void ToggleVisibilityCache();
+		void SetVisibilityCaching(bool isEnabled) { m_VisibilityCacheEnabled = isEnabled; }
+		// Shadow rays asked from the visibility cache in the last frame, every hit is a DoesHit that wasn't traced
+		uint32_t GetNumVisibilityLookups() const { return m_VisibilityCache.GetNumLookups(); }
+		uint32_t GetNumVisibilityHits() const { return m_VisibilityCache.GetNumHits(); }
+		size_t GetNumVisibilityCells() const { return m_VisibilityCache.GetNumCells(); }
+		// Pixels per batch whose shadow rays are sorted together, rounded up to whole tiles
+		void SetRaySortBatchSize(uint32_t numPixels) { m_RaySortBatchSize = numPixels; }
+		void SetRaySorting(bool isEnabled) { m_RaySortingEnabled = isEnabled; }
+		// Shadow rays of the last frame, only counted while ray sorting is active
+		uint32_t GetNumShadowRays() const { return m_NumShadowRays; }
+		// Fraction of the pixels that were traced in the last frame, below 1 when only moved meshes were re-rendered
+		float GetTracedPixelFraction() const { return m_TracedPixelFraction; }
+		struct FastMathError
+		{
+			float maxAbsoluteError{};
+			float maxRelativeError{}; // Only over channels brighter than 1e-3, relative error is meaningless for (nearly) black ones
+			int maxChannelError{}; // 0-255, on screen
+			uint32_t numPixelsChanged{}; // On screen
+			float preciseTime{}; // ms
+			float fastTime{}; // ms
+		};
+		// Renders the scene with both math policies, every pixel traced once with its first sample
+		FastMathError MeasureFastMathError(Scene* pScene) const;
+		// Prints MeasureFastMathError
+		void ReportFastMathError(Scene* pScene) const;
 
 	private:
 		SDL_Window* m_pWindow{};
 
-		SDL_Surface* m_pBuffer{};
+		SDL_Surface* m_pBuffer{}; //Back buffer of the frame being traced, the presenter owns it when there is a window
 		uint32_t* m_pBufferPixels{};
+		int m_BufferStride{}; // Pixels from one row of the buffer to the next, rows are padded to whole cache lines
+		std::unique_ptr<FramePresenter> m_pPresenter{};
 
 		int m_Width{};
 		int m_Height{};
@@ -52,5 +164,117 @@ namespace dae
 
 		LightingMode m_CurrentLightingMode{ LightingMode::Combined };
 		bool m_ShadowsEnabled{ true };
+		bool m_FastMathEnabled{ false }; // BRDF::FastMath (4 lights at once with SSE) instead of BRDF::PreciseMath
+		uint32_t m_SamplesPerPixel{ 1 };
+		SampleSequence m_SampleSequence{ SampleSequence::Sobol };
+		uint32_t m_SampleSeed{ 0 };
+
+		// One bounce of diffuse light, only in LightingMode::Combined
+		enum class IndirectLighting : uint8_t
+		{
+			Off,
+			Hemisphere, // M x N rays at every shading point, the reference
+			IrradianceCache // Records with gradients, interpolated in between
+		};
+
+		IndirectLighting m_IndirectLighting{ IndirectLighting::Off };
+		// Stratified hemisphere, N ~ pi * M (Ward)
+		static constexpr int m_IrradianceThetaStrata{ 6 };
+		static constexpr int m_IrradiancePhiStrata{ 18 };
+		// Size of a record's area on screen, in pixels at the depth it was made
+		static constexpr float m_MinRecordPixels{ 3.f };
+		static constexpr float m_MaxRecordPixels{ 40.f };
+		// The pre-pass starts on pixels this far apart and halves the spacing down to every pixel, one block of the screen per task
+		static constexpr int m_IrradiancePrePassSpacing{ 16 };
+		static constexpr int m_IrradianceBlockSize{ 64 };
+		mutable IrradianceCache m_IrradianceCache{};
+		mutable std::atomic<uint32_t> m_NumIndirectRays{};
+
+		// Off by default, a cell is up to a pixel wide, so shadow edges can move by a pixel
+		bool m_VisibilityCacheEnabled{ false };
+		mutable VisibilityCache m_VisibilityCache{};
+
+		enum class PixelTraversal
+		{
+			Scanline, // Row by row over the whole screen
+			Morton // Z-order inside square tiles
+		};
+
+		// Tiles are (1 << m_TileSizeLog2) pixels wide and high, so a tile holds exactly one Morton curve
+		static constexpr uint32_t m_TileSizeLog2{ 4 };
+		static constexpr uint32_t m_TileSize{ 1u << m_TileSizeLog2 };
+
+		PixelTraversal m_CurrentPixelTraversal{ PixelTraversal::Morton };
+		// A tile row is 64 bytes, exactly one cache line of the frame's aligned rows, so only the per pixel scanline traversal has threads writing into the same line
+		// (RayTracer --scaling measures it)
+		bool m_TileBuffersEnabled{ false };
+		uint32_t m_NumTilesX{};
+		uint32_t m_NumTilesY{};
+
+		// Primary rays of a tile only test the objects that reach into the tile's part of the view (scanline traversal tests everything)
+		bool m_FrustumCullingEnabled{ true };
+		mutable std::atomic<uint32_t> m_NumTileCandidates{};
+		mutable std::atomic<uint32_t> m_NumCulledTiles{};
+
+		// Rays through the tile's pixels, including every sub-pixel sample
+		Frustum GetTileFrustum(uint32_t tileIndex, const float& fov, const Camera& camera) const;
+		// Candidates for the tile when culling is on, nullptr otherwise
+		const FrustumCandidates* CullTile(const Scene* pScene, uint32_t tileIndex, const float& fov, const Camera& camera) const;
+
+		// While only meshes move, pixels none of them can reach (directly or through a shadow ray) keep last frame's color
+		bool m_IncrementalEnabled{ true };
+		bool m_ShowDirtyRegions{ false };
+		mutable DirtyRegions m_DirtyRegions{};
+		mutable bool m_IsIncrementalFrame{ false };
+		mutable float m_TracedPixelFraction{ 1.f };
+		mutable std::vector<uint32_t> m_OverlayBackup{}; // The frame without the overlay, its pixels are reused by the next frame
+
+		void DrawDirtyRegionOverlay() const;
+
+		// Shadow rays are collected per batch of tiles and traced sorted by RaySorter instead of right after their primary ray
+		// Off by default, it only pays off on big meshes and with small batches (RayTracer --raysort measures it)
+		bool m_RaySortingEnabled{ false };
+		uint32_t m_RaySortBatchSize{ 256 };
+		mutable std::atomic<uint32_t> m_NumShadowRays{};
+
+		bool IsRaySortingActive() const { return m_RaySortingEnabled && m_ShadowsEnabled; }
+		uint32_t GetTilesPerRaySortBatch() const { return std::max(m_RaySortBatchSize >> (2 * m_TileSizeLog2), 1u); }
+		uint32_t GetNumRaySortBatches() const { return (m_NumTilesX * m_NumTilesY + GetTilesPerRaySortBatch() - 1) / GetTilesPerRaySortBatch(); }
+		void RenderSortedBatch(const Scene* pScene, uint32_t batchIndex, const float& fov, const Camera& camera, std::span<const Light> lights, const std::vector<Material>& materials) const;
+
+		// Primary hit and the material at it, shaded once the shadow rays are answered
+		struct SurfacePoint;
+		bool TracePrimary(const Scene* pScene, int px, int py, const Vector2& pixelOffset, const float& fov, const Camera& camera, const std::vector<Material>& materials, SurfacePoint& point,
+			const FrustumCandidates* pCandidates) const;
+		// Where in the pixel (0 to 1) the camera ray of this sample goes through
+		Vector2 GetPixelOffset(int px, int py, uint32_t sampleIndex) const;
+		bool NeedsShadowRay(float observedArea) const;
+		static Ray GetShadowRay(const HitRecord& hit, const Light& light, const Vector3& lightDirection);
+		// World space size of a pixel at the hit, the visibility cache cell it falls in is about as big
+		float GetPixelFootprint(const HitRecord& hit, const float& fov) const { return 2.f * fov * hit.t / static_cast<float>(m_Height); }
+		bool CanCacheVisibility(uint32_t lightIndex) const { return m_VisibilityCacheEnabled && lightIndex <= UINT8_MAX; }
+		// Traces the shadow ray, or answers it from the visibility cache
+		bool IsLightVisible(const Scene* pScene, const HitRecord& hit, uint32_t lightIndex, const Ray& shadowRay, const float& fov) const;
+		// isVisible(shadowRay, lightIndex) decides whether a light reaches the point
+		template<typename IsVisible>
+		ColorRGB ShadePoint(const SurfacePoint& point, std::span<const Light> lights, bool fastMath, const IsVisible& isVisible) const;
+		// Traces the pixel, false for a pixel the incremental frame skips
+		bool ComputePixel(const Scene* pScene, int px, int py, const float& fov, const Camera& camera, std::span<const Light> lights, const std::vector<Material>& materials,
+			const FrustumCandidates* pCandidates, uint32_t& pixel) const;
+		void WritePixel(int px, int py, ColorRGB finalColor) const;
+		// Clamped and in the pixel format of the frame
+		uint32_t ToPixel(ColorRGB finalColor) const;
+
+		// Fills the irradiance cache for the pixels in the rectangle before they are traced, tracing only looks records up
+		// Every block of a pass only sees the records of earlier passes and its own, they are inserted in block order after the pass,
+		// so the cache (and the image) is the same whatever thread gets to a block first
+		void PrepareIrradianceCache(const Scene* pScene, int x, int y, int width, int height, const float& fov, const Camera& camera, std::span<const Light> lights,
+			const std::vector<Material>& materials) const;
+		bool ReceivesIndirectLighting(const SurfacePoint& point) const;
+		ColorRGB GetIndirectLighting(const Scene* pScene, const SurfacePoint& point, int px, int py, uint32_t sampleIndex, std::span<const Light> lights,
+			const std::vector<Material>& materials) const;
+		// Irradiance, harmonic mean distance and gradients from one cosine weighted ray per stratum
+		IrradianceCache::Record SampleIrradiance(const Scene* pScene, const Vector3& origin, const Vector3& normal, std::span<const Light> lights, const std::vector<Material>& materials,
+			const PixelSampler& sampler) const;
 	};
 }
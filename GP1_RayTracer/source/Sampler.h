@@ -0,0 +1,119 @@
+#pragma once
+#include <cstdint>
+
+#include "Vector2.h"
+
+namespace dae
+{
+	enum class SampleSequence : uint8_t
+	{
+		Random, // Hashed PCG, white noise
+		Sobol // Owen scrambled and shuffled Sobol (0,2) sequence, stratified for every power of two samples
+	};
+
+	/* --- HASHES --- */
+	// PCG output permutation as a stateless hash (Jarzynski & Olano, "Hash Functions for GPU Rendering")
+	inline uint32_t PcgHash(uint32_t value)
+	{
+		const uint32_t state{ value * 747796405u + 2891336453u };
+		const uint32_t word{ ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u };
+		return (word >> 22u) ^ word;
+	}
+
+	inline uint32_t HashCombine(uint32_t seed, uint32_t value)
+	{
+		return PcgHash(seed ^ PcgHash(value));
+	}
+
+	// Top 24 bits, so the result never rounds up to 1
+	inline float ToUnitFloat(uint32_t bits)
+	{
+		return static_cast<float>(bits >> 8) * (1.f / 16777216.f);
+	}
+
+	inline uint32_t ReverseBits(uint32_t x)
+	{
+		x = (x << 16) | (x >> 16);
+		x = ((x & 0x00ff00ff) << 8) | ((x & 0xff00ff00) >> 8);
+		x = ((x & 0x0f0f0f0f) << 4) | ((x & 0xf0f0f0f0) >> 4);
+		x = ((x & 0x33333333) << 2) | ((x & 0xcccccccc) >> 2);
+		x = ((x & 0x55555555) << 1) | ((x & 0xaaaaaaaa) >> 1);
+		return x;
+	}
+
+	/* --- SOBOL --- */
+	// The first two Sobol dimensions need no direction tables: the first is the bit reversed index,
+	// the second one's generator matrix is Pascal's triangle mod 2
+	inline uint32_t SobolDimension0(uint32_t index)
+	{
+		return ReverseBits(index);
+	}
+
+	inline uint32_t SobolDimension1(uint32_t index)
+	{
+		uint32_t result{ 0 };
+		for (uint32_t direction{ 1u << 31 }; index != 0; index >>= 1, direction ^= direction >> 1)
+		{
+			if (index & 1) result ^= direction;
+		}
+		return result;
+	}
+
+	// Base 2 Owen scrambling with a hash (Burley, "Practical Hash-based Owen Scrambling")
+	inline uint32_t NestedUniformScramble(uint32_t x, uint32_t seed)
+	{
+		x = ReverseBits(x);
+		x += seed;
+		x ^= x * 0x6c50b47cu;
+		x ^= x * 0xb82f1e52u;
+		x ^= x * 0xc7afe638u;
+		x ^= x * 0x8d22f6e6u;
+		return ReverseBits(x);
+	}
+
+	/**
+	 * \brief Random numbers for one sample of one pixel, everything follows from the pixel, the sample index and the seed
+	 * Nothing is shared between pixels or threads, so an image is the same however its pixels are spread over threads
+	 * Dimensions come in pairs: every pair is its own scrambled and shuffled 2D Sobol sequence (or hashed white noise)
+	 */
+	class PixelSampler final
+	{
+	public:
+		// The 2D dimensions the renderer uses, a dimension only seeds the hash so any two different ones are independent
+		static constexpr uint32_t SubPixel{ 0 };
+		// First of the stratified hemisphere rays of the indirect lighting, stratum i uses Hemisphere + i
+		static constexpr uint32_t Hemisphere{ 1 };
+
+		PixelSampler(uint32_t px, uint32_t py, uint32_t sampleIndex, SampleSequence sequence, uint32_t seed = 0) :
+			m_PixelSeed{ HashCombine(HashCombine(seed, px), py) },
+			m_SampleIndex{ sampleIndex },
+			m_Sequence{ sequence }
+		{
+		}
+
+		// Point in [0, 1)^2, the same dimension of the same sample always returns the same point
+		Vector2 Get2D(uint32_t dimension) const
+		{
+			const uint32_t seed{ HashCombine(m_PixelSeed, dimension) };
+
+			if (m_Sequence == SampleSequence::Random)
+			{
+				const uint32_t bits{ HashCombine(seed, m_SampleIndex) };
+				return { ToUnitFloat(bits), ToUnitFloat(PcgHash(bits)) };
+			}
+
+			// Shuffling the index decorrelates the dimension pairs, scrambling the values decorrelates the pixels
+			const uint32_t index{ NestedUniformScramble(m_SampleIndex, seed) };
+			return
+			{
+				ToUnitFloat(NestedUniformScramble(SobolDimension0(index), HashCombine(seed, 0))),
+				ToUnitFloat(NestedUniformScramble(SobolDimension1(index), HashCombine(seed, 1)))
+			};
+		}
+
+	private:
+		uint32_t m_PixelSeed{};
+		uint32_t m_SampleIndex{};
+		SampleSequence m_Sequence{};
+	};
+}
@@ -1,33 +1,230 @@
 #include "Scene.h"
 #include "Utils.h"
+#include "RayPacket.h"
 #include "Material.h"
+#include "SceneSnapshot.h"
 #include <algorithm>
+#include <bit>
+#include <cctype>
+#include <cfloat>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
 
 namespace dae {
 #pragma region Base Scene
 	//Initialize Scene with Default Solid Color Material (RED)
 	Scene::Scene() :
-		m_Materials({ new Material_SolidColor({1,0,0}) })
+		m_Materials({ Material::CreateSolidColor({1,0,0}) })
 	{
-		m_SphereGeometries.reserve(32);
-		m_PlaneGeometries.reserve(32);
-		m_TriangleMeshGeometries.reserve(32);
-		m_Lights.reserve(32);
 	}
 
-	Scene::~Scene()
+	Scene::~Scene() = default;
+
+	namespace
+	{
+		template<typename SceneType>
+		Scene* CreateScene() { return new SceneType(); }
+
+		struct RegisteredScene
+		{
+			const char* name;
+			Scene* (*create)();
+		};
+
+		constexpr RegisteredScene registeredScenes[]
+		{
+			{ "W1", CreateScene<Scene_W1> },
+			{ "W2", CreateScene<Scene_W2> },
+			{ "W3", CreateScene<Scene_W3> },
+			{ "W3_Test", CreateScene<Scene_W3_TestScene> },
+			{ "W4_Test", CreateScene<Scene_W4_TestScene> },
+			{ "W4_Reference", CreateScene<Scene_W4_ReferenceScene> },
+			{ "W4_Bunny", CreateScene<Scene_W4_BunnyScene> },
+			{ "BVH_Dense", CreateScene<Scene_BVH_DenseScene> }
+		};
+	}
+
+	Scene* Scene::Create(const std::string& name)
+	{
+		if (name.ends_with(".scene")) return new Scene_File(name);
+
+		for (const RegisteredScene& scene : registeredScenes)
+		{
+			if (name == scene.name) return scene.create();
+		}
+		return nullptr;
+	}
+
+	std::vector<std::string> Scene::GetRegisteredNames()
+	{
+		std::vector<std::string> names{};
+		for (const RegisteredScene& scene : registeredScenes)
+		{
+			names.emplace_back(scene.name);
+		}
+		return names;
+	}
+
+	void Scene::InitializeFromSnapshot()
+	{
+		// Scene classes are hard-coded, so the snapshot is also keyed on when this file was compiled
+		const std::string sceneName{ GetSnapshotName() };
+
+		const std::string snapshotPath{ "Resources/Snapshots/" + sceneName + ".rtsnap" };
+		const uint64_t assetHash{ SceneSnapshot::HashAssets(sceneName + __DATE__ " " __TIME__, GetAssetPaths()) };
+
+		const auto start{ std::chrono::steady_clock::now() };
+
+		if (SceneSnapshot::Load(*this, snapshotPath, assetHash))
+		{
+			OnSnapshotLoaded();
+			LoadTextures();
+			BuildAccelerationStructures();
+		}
+		else
+		{
+			Initialize();
+			LoadTextures();
+			BuildAccelerationStructures();
+			UpdateTransforms();
+
+			if (!SceneSnapshot::Save(*this, snapshotPath, assetHash))
+				std::cout << "Could not write scene snapshot " << snapshotPath << '\n';
+		}
+
+		const std::chrono::duration<float, std::milli> duration{ std::chrono::steady_clock::now() - start };
+		std::cout << "Scene " << sceneName << " ready in " << duration.count() << "ms\n";
+	}
+
+	void Scene::CycleBVHLayout()
+	{
+		m_BVHLayout = static_cast<BVHLayout>((static_cast<int>(m_BVHLayout) + 1) % 3);
+
+		std::cout << "BVH Layout: ";
+		switch (m_BVHLayout)
+		{
+		case BVHLayout::None:
+			std::cout << "None\n";
+			break;
+		case BVHLayout::Binary:
+			std::cout << "Binary\n";
+			break;
+		case BVHLayout::Quantized:
+			std::cout << "Quantized\n";
+			break;
+		}
+
+		BuildAccelerationStructures();
+	}
+
+	void Scene::CompressMeshes()
+	{
+		const size_t oldMemoryUsage{ GetMeshMemoryUsage() };
+
+		std::ranges::for_each(m_TriangleMeshGeometries, [](TriangleMesh& mesh) { mesh.Compress(); });
+		std::ranges::for_each(m_SharedTriangleMeshes, [](TriangleMesh& mesh) { mesh.Compress(); });
+
+		std::cout << "Compressed meshes: " << static_cast<float>(oldMemoryUsage) / 1024.f << "KB -> " << static_cast<float>(GetMeshMemoryUsage()) / 1024.f << "KB\n";
+	}
+
+	size_t Scene::GetMeshMemoryUsage() const
+	{
+		size_t memoryUsage{};
+		const auto addMesh{ [&memoryUsage](const TriangleMesh& mesh) { memoryUsage += mesh.GetGeometryMemoryUsage() + mesh.bvh.GetMemoryUsage(); } };
+
+		std::ranges::for_each(m_TriangleMeshGeometries, addMesh);
+		std::ranges::for_each(m_SharedTriangleMeshes, addMesh);
+		return memoryUsage;
+	}
+
+	void Scene::UpdateTransforms()
+	{
+		// Only dirty meshes and instances do any work, shared meshes are never transformed themselves
+		// Whatever moved keeps the union of its old and new box, so the renderer knows which pixels it can have changed
+		m_MovedBounds = std::move(m_RemovedBounds);
+		m_RemovedBounds.clear();
+		const auto updateTransforms{ [this](auto& object, const auto&... meshAABB)
+			{
+				const bool hasMoved{ object.isTransformDirty };
+				const Vector3 oldMinAABB{ object.transformedMinAABB };
+				const Vector3 oldMaxAABB{ object.transformedMaxAABB };
+
+				object.UpdateTransforms(meshAABB...);
+
+				if (hasMoved)
+				{
+					m_MovedBounds.push_back({ Vector3::Min(oldMinAABB, object.transformedMinAABB), Vector3::Max(oldMaxAABB, object.transformedMaxAABB) });
+				}
+			} };
+
+		std::ranges::for_each(m_TriangleMeshGeometries, updateTransforms);
+		for (TriangleMeshInstance& instance : m_TriangleMeshInstances)
+		{
+			const TriangleMesh& mesh{ m_SharedTriangleMeshes[instance.meshIndex] };
+			updateTransforms(instance, mesh.minAABB, mesh.maxAABB);
+		}
+
+		for (const std::unique_ptr<StreamedMesh>& pStreamedMesh : m_StreamedMeshes)
+		{
+			updateTransforms(pStreamedMesh->instance, pStreamedMesh->GetMinAABB(), pStreamedMesh->GetMaxAABB());
+		}
+	}
+
+	void Scene::BeginFrame()
 	{
-		for (auto& pMaterial : m_Materials)
+		UpdateTransforms();
+
+		m_StreamingStatistics = {};
+		for (const std::unique_ptr<StreamedMesh>& pStreamedMesh : m_StreamedMeshes)
 		{
-			delete pMaterial;
-			pMaterial = nullptr;
+			m_StreamingStatistics += pStreamedMesh->BeginFrame();
 		}
+	}
 
-		m_Materials.clear();
+	void Scene::LoadTextures()
+	{
+		for (size_t i{ m_Textures.size() }; i < m_TexturePaths.size(); ++i)
+		{
+			const Texture& texture{ m_Textures.emplace_back(m_TexturePaths[i]) };
+			if (!texture.IsValid()) continue;
+
+			std::cout << "Texture " << m_TexturePaths[i] << ": " << texture.GetWidth() << 'x' << texture.GetHeight()
+				<< " | " << texture.GetNumLevels() << " mip levels | " << static_cast<float>(texture.GetMemoryUsage()) / 1024.f << "KB\n";
+		}
+	}
+
+	void Scene::BuildAccelerationStructures()
+	{
+		size_t memoryUsage{};
+		const auto buildMesh{ [&](TriangleMesh& mesh)
+			{
+				// A mesh too big for the quantized layout already has the binary tree it falls back to
+				const bool isFallback{ m_BVHLayout == BVHLayout::Quantized && mesh.bvh.GetLayout() == BVHLayout::Binary && mesh.bvh.GetQuantizedMemoryUsage() == 0 };
+				if (mesh.bvh.GetLayout() != m_BVHLayout && !isFallback)
+				{
+					mesh.BuildBVH(m_BVHLayout);
+					if (mesh.bvh.IsBuilt()) mesh.bvh.PrintStatistics();
+				}
+				memoryUsage += mesh.bvh.GetMemoryUsage();
+			} };
+
+		std::ranges::for_each(m_TriangleMeshGeometries, buildMesh);
+		std::ranges::for_each(m_SharedTriangleMeshes, buildMesh);
+
+		if (memoryUsage > 0)
+			std::cout << "Total BVH memory: " << static_cast<float>(memoryUsage) / 1024.f << "KB\n";
 	}
 
 	void dae::Scene::GetClosestHit(const Ray& ray, HitRecord& closestHit) const
 	{
+		CountRays(1);
+
 		// This function iterates all spheres planes, triangles and returns the HitRecord of the closest (smallest t-value) hit
 		for (const Sphere& sphere : m_SphereGeometries)
 		{
@@ -55,9 +252,128 @@ namespace dae {
 				closestHit = hit;
 			}
 		}
+
+		for (const TriangleMeshInstance& instance : m_TriangleMeshInstances)
+		{
+			HitRecord hit{};
+			if (GeometryUtils::HitTest_TriangleMeshInstance(instance, m_SharedTriangleMeshes[instance.meshIndex], ray, hit) && hit.t < closestHit.t)
+			{
+				closestHit = hit;
+			}
+		}
+
+		for (const std::unique_ptr<StreamedMesh>& pStreamedMesh : m_StreamedMeshes)
+		{
+			HitRecord hit{};
+			if (pStreamedMesh->HitTest(ray, hit) && hit.t < closestHit.t)
+			{
+				closestHit = hit;
+			}
+		}
+	}
+
+	void Scene::GetClosestHit(const Ray& ray, HitRecord& closestHit, const FrustumCandidates& candidates) const
+	{
+		CountRays(1);
+
+		// Same order as the full test, so ties between objects are decided the same way
+		for (const uint32_t sphereIndex : candidates.spheres)
+		{
+			HitRecord hit{};
+			if (GeometryUtils::HitTest_Sphere(m_SphereGeometries[sphereIndex], ray, hit) && hit.t < closestHit.t)
+			{
+				closestHit = hit;
+			}
+		}
+
+		for (const uint32_t planeIndex : candidates.planes)
+		{
+			HitRecord hit{};
+			if (GeometryUtils::HitTest_Plane(m_PlaneGeometries[planeIndex], ray, hit) && hit.t < closestHit.t)
+			{
+				closestHit = hit;
+			}
+		}
+
+		for (const uint32_t meshIndex : candidates.triangleMeshes)
+		{
+			HitRecord hit{};
+			if (GeometryUtils::HitTest_TriangleMesh(m_TriangleMeshGeometries[meshIndex], ray, hit) && hit.t < closestHit.t)
+			{
+				closestHit = hit;
+			}
+		}
+
+		for (const uint32_t instanceIndex : candidates.triangleMeshInstances)
+		{
+			const TriangleMeshInstance& instance{ m_TriangleMeshInstances[instanceIndex] };
+
+			HitRecord hit{};
+			if (GeometryUtils::HitTest_TriangleMeshInstance(instance, m_SharedTriangleMeshes[instance.meshIndex], ray, hit) && hit.t < closestHit.t)
+			{
+				closestHit = hit;
+			}
+		}
+
+		for (const uint32_t streamedMeshIndex : candidates.streamedMeshes)
+		{
+			HitRecord hit{};
+			if (m_StreamedMeshes[streamedMeshIndex]->HitTest(ray, hit) && hit.t < closestHit.t)
+			{
+				closestHit = hit;
+			}
+		}
+	}
+
+	void Scene::CullFrustum(const Frustum& frustum, FrustumCandidates& candidates) const
+	{
+		candidates.spheres.clear();
+		candidates.planes.clear();
+		candidates.triangleMeshes.clear();
+		candidates.triangleMeshInstances.clear();
+		candidates.streamedMeshes.clear();
+
+		for (uint32_t i{ 0 }; i < m_SphereGeometries.size(); ++i)
+		{
+			if (frustum.IsSphereInside(m_SphereGeometries[i].origin, m_SphereGeometries[i].radius)) candidates.spheres.push_back(i);
+		}
+
+		for (uint32_t i{ 0 }; i < m_PlaneGeometries.size(); ++i)
+		{
+			if (frustum.IsPlaneInside(m_PlaneGeometries[i])) candidates.planes.push_back(i);
+		}
+
+		for (uint32_t i{ 0 }; i < m_TriangleMeshGeometries.size(); ++i)
+		{
+			const TriangleMesh& mesh{ m_TriangleMeshGeometries[i] };
+			if (frustum.IsAABBInside(mesh.transformedMinAABB, mesh.transformedMaxAABB)) candidates.triangleMeshes.push_back(i);
+		}
+
+		for (uint32_t i{ 0 }; i < m_TriangleMeshInstances.size(); ++i)
+		{
+			const TriangleMeshInstance& instance{ m_TriangleMeshInstances[i] };
+			if (frustum.IsAABBInside(instance.transformedMinAABB, instance.transformedMaxAABB)) candidates.triangleMeshInstances.push_back(i);
+		}
+
+		for (uint32_t i{ 0 }; i < m_StreamedMeshes.size(); ++i)
+		{
+			const TriangleMeshInstance& instance{ m_StreamedMeshes[i]->instance };
+			if (frustum.IsAABBInside(instance.transformedMinAABB, instance.transformedMaxAABB)) candidates.streamedMeshes.push_back(i);
+		}
+	}
+
+	size_t Scene::GetNumObjects() const
+	{
+		return m_SphereGeometries.size() + m_PlaneGeometries.size() + m_TriangleMeshGeometries.size() + m_TriangleMeshInstances.size() + m_StreamedMeshes.size();
 	}
 
 	bool Scene::DoesHit(const Ray& ray) const
+	{
+		CountRays(1);
+		return TraceAnyHit(ray);
+	}
+
+	bool Scene::TraceAnyHit(const Ray& ray) const
 	{
 		// this function should return true on the first hit for the given ray,
 		// otherwise false. (No need to check for the closest hit, or filling in the HitRecord...)
@@ -86,43 +402,287 @@ namespace dae {
 					return GeometryUtils::HitTest_TriangleMesh(mesh, ray);
 				}
 			)
+			|| std::ranges::any_of
+			(
+				m_TriangleMeshInstances, [&ray, this](const TriangleMeshInstance& instance)
+				{
+					return GeometryUtils::HitTest_TriangleMeshInstance(instance, m_SharedTriangleMeshes[instance.meshIndex], ray);
+				}
+			)
+			|| std::ranges::any_of
+			(
+				m_StreamedMeshes, [&ray](const std::unique_ptr<StreamedMesh>& pStreamedMesh)
+				{
+					return pStreamedMesh->HitTest(ray);
+				}
+			)
 		};
 	}
 
+	void Scene::GetClosestHits(std::span<const Ray> rays, std::span<RayHit> hits) const
+	{
+		assert(hits.size() >= rays.size());
+		CountRays(rays.size());
+
+		const uint32_t numBatches{ static_cast<uint32_t>((rays.size() + m_RayBatchSize - 1) / m_RayBatchSize) };
+		concurrency::parallel_for(0u, numBatches, [&](uint32_t batchIndex)
+			{
+				const size_t end{ std::min(rays.size(), size_t{ batchIndex + 1 } * m_RayBatchSize) };
+				for (size_t first{ size_t{ batchIndex } * m_RayBatchSize }; first < end; first += GeometryUtils::RayPacketSize)
+				{
+					const uint32_t numRays{ static_cast<uint32_t>(std::min<size_t>(end - first, GeometryUtils::RayPacketSize)) };
+
+					HitRecord packetHits[GeometryUtils::RayPacketSize]{};
+					const uint32_t hitLanes{ TracePacket(&rays[first], numRays, packetHits) };
+					for (uint32_t i{ 0 }; i < numRays; ++i)
+					{
+						const HitRecord& hit{ packetHits[i] };
+						hits[first + i] = (hitLanes >> i & 1) ? RayHit{ hit.normal, hit.t, hit.triangleIndex, hit.materialIndex } : RayHit{};
+					}
+				}
+			});
+	}
+
+	void Scene::DoesHit(std::span<const Ray> rays, std::span<uint8_t> didHit) const
+	{
+		assert(didHit.size() >= rays.size());
+		CountRays(rays.size());
+
+		const uint32_t numBatches{ static_cast<uint32_t>((rays.size() + m_RayBatchSize - 1) / m_RayBatchSize) };
+		concurrency::parallel_for(0u, numBatches, [&](uint32_t batchIndex)
+			{
+				const size_t end{ std::min(rays.size(), size_t{ batchIndex + 1 } * m_RayBatchSize) };
+				for (size_t i{ size_t{ batchIndex } * m_RayBatchSize }; i < end; ++i)
+				{
+					didHit[i] = TraceAnyHit(rays[i]);
+				}
+			});
+	}
+
+	uint64_t Scene::GetNumTracedRays() const
+	{
+		uint64_t numRays{ 0 };
+		for (const RayCounter& counter : m_RayCounters)
+		{
+			numRays += counter.numRays.load(std::memory_order_relaxed);
+		}
+		return numRays;
+	}
+
+	void Scene::ResetNumTracedRays()
+	{
+		for (RayCounter& counter : m_RayCounters)
+		{
+			counter.numRays.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	void Scene::CountRays(uint64_t numRays) const
+	{
+		// Threads get their slot in the order they first trace, with up to m_NumRayCounters threads no two share one
+		static std::atomic<uint32_t> s_NextSlot{ 0 };
+		thread_local const uint32_t slot{ s_NextSlot++ % m_NumRayCounters };
+
+		m_RayCounters[slot].numRays.fetch_add(numRays, std::memory_order_relaxed);
+	}
+
+	uint32_t Scene::TracePacket(const Ray* pRays, uint32_t numRays, HitRecord* pHits) const
+	{
+		// One ray at a time, hitTest has the signature of the GeometryUtils mesh hit tests without the mesh
+		const auto testLanes{ [&](const auto& hitTest)
+			{
+				for (uint32_t lane{ 0 }; lane < numRays; ++lane)
+				{
+					HitRecord hit{};
+					if (hitTest(pRays[lane], hit, false) && hit.t < pHits[lane].t) pHits[lane] = hit;
+				}
+			} };
+
+		// Rays that start far apart or point different ways split up in the tree, a packet would visit the nodes of every one of them
+		// Only worked out once a mesh is reached, most packets of short rays never get that far
+		float sqrOriginSpread{ -1.f }; // Negative until worked out, FLT_MAX when the directions differ too much
+		const auto isCoherent{ [&](const Vector3& minAABB, const Vector3& maxAABB)
+			{
+				if (sqrOriginSpread < 0.f)
+				{
+					sqrOriginSpread = 0.f;
+					const float sqrDirection{ pRays[0].direction.SqrMagnitude() };
+					for (uint32_t lane{ 1 }; lane < numRays; ++lane)
+					{
+						const float cosAngle{ Vector3::Dot(pRays[lane].direction, pRays[0].direction) };
+						if (cosAngle <= 0.f || cosAngle * cosAngle < m_PacketMinCosAngle * m_PacketMinCosAngle * pRays[lane].direction.SqrMagnitude() * sqrDirection)
+						{
+							sqrOriginSpread = FLT_MAX;
+							break;
+						}
+						sqrOriginSpread = std::max(sqrOriginSpread, (pRays[lane].origin - pRays[0].origin).SqrMagnitude());
+					}
+				}
+				return sqrOriginSpread <= m_PacketMaxOriginSpread * m_PacketMaxOriginSpread * (maxAABB - minAABB).SqrMagnitude();
+			} };
+
+		// The lanes that reach the box walk the binary BVH as one packet when they are coherent compared to the size of the mesh
+		const auto testMeshPacket{ [&](const TriangleMesh& mesh, const Matrix& inverseWorldTransform, const Matrix& worldTransform,
+			const Vector3& minAABB, const Vector3& maxAABB, unsigned char materialIndex, TriangleCullMode cullMode)
+			{
+				Ray objectRays[GeometryUtils::RayPacketSize]{};
+				HitRecord objectHits[GeometryUtils::RayPacketSize]{};
+
+				uint32_t packetLanes{ 0 };
+				for (uint32_t lane{ 0 }; lane < numRays; ++lane)
+				{
+					if (!GeometryUtils::SlabTest_AABB(minAABB, maxAABB, pRays[lane])) continue;
+
+					objectRays[lane] = GeometryUtils::ToObjectSpace(inverseWorldTransform, pRays[lane]);
+					objectRays[lane].max = std::min(pRays[lane].max, pHits[lane].t);
+					packetLanes |= 1u << lane;
+				}
+				if (packetLanes == 0) return;
+
+				uint32_t hitLanes{ 0 };
+				if (std::popcount(packetLanes) > 1 && isCoherent(minAABB, maxAABB))
+				{
+					hitLanes = GeometryUtils::HitTest_BinaryBVH(mesh, materialIndex, cullMode, objectRays, objectHits, packetLanes, false);
+				}
+				else
+				{
+					for (uint32_t lane{ 0 }; lane < numRays; ++lane)
+					{
+						if ((packetLanes >> lane & 1) && GeometryUtils::HitTest_BinaryBVH(mesh, materialIndex, cullMode, objectRays[lane], objectHits[lane], false)) hitLanes |= 1u << lane;
+					}
+				}
+				for (uint32_t lane{ 0 }; lane < numRays; ++lane)
+				{
+					if (!(hitLanes >> lane & 1)) continue;
+
+					GeometryUtils::ToWorldSpace(inverseWorldTransform, pRays[lane], objectHits[lane], pHits[lane]);
+					pHits[lane].pWorldTransform = &worldTransform;
+				}
+			} };
+
+		// Spheres and planes are cheap to test, each ray goes through all of them on its own
+		// Same order as GetClosestHit, so ties between objects are decided the same way
+		for (uint32_t lane{ 0 }; lane < numRays; ++lane)
+		{
+			const Ray& ray{ pRays[lane] };
+			for (const Sphere& sphere : m_SphereGeometries)
+			{
+				HitRecord hit{};
+				if (GeometryUtils::HitTest_Sphere(sphere, ray, hit) && hit.t < pHits[lane].t) pHits[lane] = hit;
+			}
+
+			for (const Plane& plane : m_PlaneGeometries)
+			{
+				HitRecord hit{};
+				if (GeometryUtils::HitTest_Plane(plane, ray, hit) && hit.t < pHits[lane].t) pHits[lane] = hit;
+			}
+		}
+		// The quantized layout already tests 4 children per step for a single ray, those meshes are traced one ray at a time
+		for (const TriangleMesh& mesh : m_TriangleMeshGeometries)
+		{
+			if (mesh.bvh.GetLayout() == BVHLayout::Binary)
+			{
+				testMeshPacket(mesh, mesh.inverseWorldTransform, mesh.worldTransform, mesh.transformedMinAABB, mesh.transformedMaxAABB, mesh.materialIndex, mesh.cullMode);
+			}
+			else
+			{
+				testLanes([&mesh](const Ray& ray, HitRecord& hit, bool ignoreHitRecord) { return GeometryUtils::HitTest_TriangleMesh(mesh, ray, hit, ignoreHitRecord); });
+			}
+		}
+		for (const TriangleMeshInstance& instance : m_TriangleMeshInstances)
+		{
+			const TriangleMesh& mesh{ m_SharedTriangleMeshes[instance.meshIndex] };
+			if (mesh.bvh.GetLayout() == BVHLayout::Binary)
+			{
+				testMeshPacket(mesh, instance.inverseWorldTransform, instance.worldTransform, instance.transformedMinAABB, instance.transformedMaxAABB, instance.materialIndex, instance.cullMode);
+			}
+			else
+			{
+				testLanes([&](const Ray& ray, HitRecord& hit, bool ignoreHitRecord) { return GeometryUtils::HitTest_TriangleMeshInstance(instance, mesh, ray, hit, ignoreHitRecord); });
+			}
+		}
+		for (const std::unique_ptr<StreamedMesh>& pStreamedMesh : m_StreamedMeshes)
+		{
+			testLanes([&pStreamedMesh](const Ray& ray, HitRecord& hit, bool ignoreHitRecord) { return pStreamedMesh->HitTest(ray, hit, ignoreHitRecord); });
+		}
+
+		uint32_t hitLanes{ 0 };
+		for (uint32_t lane{ 0 }; lane < numRays; ++lane)
+		{
+			if (pHits[lane].didHit) hitLanes |= 1u << lane;
+		}
+		return hitLanes;
+	}
+
 #pragma region Scene Helpers
-	Sphere* Scene::AddSphere(const Vector3& origin, float radius, unsigned char materialIndex)
+	Handle<Sphere> Scene::AddSphere(const Vector3& origin, float radius, unsigned char materialIndex)
 	{
 		Sphere s;
 		s.origin = origin;
 		s.radius = radius;
 		s.materialIndex = materialIndex;
 
-		m_SphereGeometries.emplace_back(s);
-		return &m_SphereGeometries.back();
+		return m_SphereGeometries.Add(s);
 	}
 
-	Plane* Scene::AddPlane(const Vector3& origin, const Vector3& normal, unsigned char materialIndex)
+	Handle<Plane> Scene::AddPlane(const Vector3& origin, const Vector3& normal, unsigned char materialIndex)
 	{
 		Plane p;
 		p.origin = origin;
 		p.normal = normal;
 		p.materialIndex = materialIndex;
 
-		m_PlaneGeometries.emplace_back(p);
-		return &m_PlaneGeometries.back();
+		return m_PlaneGeometries.Add(p);
 	}
 
-	TriangleMesh* Scene::AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex)
+	Handle<TriangleMesh> Scene::AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex)
 	{
 		TriangleMesh m{};
 		m.cullMode = cullMode;
 		m.materialIndex = materialIndex;
 
-		m_TriangleMeshGeometries.emplace_back(m);
-		return &m_TriangleMeshGeometries.back();
+		return m_TriangleMeshGeometries.Add(std::move(m));
+	}
+
+	Handle<SharedMesh> Scene::AddSharedTriangleMesh()
+	{
+		return m_SharedTriangleMeshes.Add();
+	}
+
+	Handle<TriangleMeshInstance> Scene::AddTriangleMeshInstance(Handle<SharedMesh> sharedMesh, TriangleCullMode cullMode, unsigned char materialIndex)
+	{
+		// The box is taken from the shared mesh in UpdateTransforms, the mesh can still be filled in after this
+		assert(m_SharedTriangleMeshes.Get(sharedMesh));
+
+		TriangleMeshInstance i{};
+		i.meshIndex = m_SharedTriangleMeshes.GetIndex(sharedMesh);
+		i.cullMode = cullMode;
+		i.materialIndex = materialIndex;
+
+		return m_TriangleMeshInstances.Add(i);
 	}
 
-	Light* Scene::AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color)
+	StreamedMesh* Scene::AddStreamedMesh(const std::string& objPath, TriangleCullMode cullMode, unsigned char materialIndex, uint32_t trianglesPerCluster)
+	{
+		// Lives next to the snapshot, a stale snapshot is rebuilt together with its cluster files
+		const std::string path{ "Resources/Snapshots/" + GetSnapshotName() + '_' + std::to_string(m_StreamedMeshes.size()) + ".rtclusters" };
+
+		auto pStreamedMesh{ std::make_unique<StreamedMesh>() };
+		if (!StreamedMesh::WriteClusterFileFromOBJ(objPath, path, trianglesPerCluster) || !pStreamedMesh->Open(path, m_StreamingBudget))
+		{
+			std::cout << "Could not write cluster file " << path << '\n';
+			return nullptr;
+		}
+
+		TriangleMeshInstance& instance{ pStreamedMesh->instance };
+		instance.cullMode = cullMode;
+		instance.materialIndex = materialIndex;
+
+		m_StreamedMeshes.push_back(std::move(pStreamedMesh));
+		return m_StreamedMeshes.back().get();
+	}
+
+	Handle<Light> Scene::AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color)
 	{
 		Light l;
 		l.origin = origin;
@@ -130,11 +690,10 @@ namespace dae {
 		l.color = color;
 		l.type = LightType::Point;
 
-		m_Lights.emplace_back(l);
-		return &m_Lights.back();
+		return m_Lights.Add(l);
 	}
 
-	Light* Scene::AddDirectionalLight(const Vector3& direction, float intensity, const ColorRGB& color)
+	Handle<Light> Scene::AddDirectionalLight(const Vector3& direction, float intensity, const ColorRGB& color)
 	{
 		Light l;
 		l.direction = direction;
@@ -142,15 +701,60 @@ namespace dae {
 		l.color = color;
 		l.type = LightType::Directional;
 
-		m_Lights.emplace_back(l);
-		return &m_Lights.back();
+		return m_Lights.Add(l);
+	}
+
+	// Spheres, planes and lights are compared every frame by the renderer, only meshes have to report where they were
+	bool Scene::RemoveSphere(Handle<Sphere> sphere)
+	{
+		return m_SphereGeometries.Remove(sphere);
+	}
+
+	bool Scene::RemovePlane(Handle<Plane> plane)
+	{
+		return m_PlaneGeometries.Remove(plane);
+	}
+
+	bool Scene::RemoveTriangleMesh(Handle<TriangleMesh> mesh)
+	{
+		const TriangleMesh* pMesh{ m_TriangleMeshGeometries.Get(mesh) };
+		if (!pMesh) return false;
+
+		m_RemovedBounds.push_back({ pMesh->transformedMinAABB, pMesh->transformedMaxAABB });
+		return m_TriangleMeshGeometries.Remove(mesh);
+	}
+
+	bool Scene::RemoveTriangleMeshInstance(Handle<TriangleMeshInstance> instance)
+	{
+		const TriangleMeshInstance* pInstance{ m_TriangleMeshInstances.Get(instance) };
+		if (!pInstance) return false;
+
+		m_RemovedBounds.push_back({ pInstance->transformedMinAABB, pInstance->transformedMaxAABB });
+		return m_TriangleMeshInstances.Remove(instance);
 	}
 
-	unsigned char Scene::AddMaterial(Material* pMaterial)
+	bool Scene::RemoveLight(Handle<Light> light)
 	{
-		m_Materials.push_back(pMaterial);
+		return m_Lights.Remove(light);
+	}
+
+	unsigned char Scene::AddMaterial(const Material& material)
+	{
+		assert(m_Materials.size() <= UINT8_MAX);
+		m_Materials.push_back(material);
 		return static_cast<unsigned char>(m_Materials.size() - 1);
 	}
+
+	uint8_t Scene::AddTexture(const std::string& path)
+	{
+		// Only recorded here, LoadTextures decodes them once Initialize is done
+		const auto texturePath{ std::ranges::find(m_TexturePaths, path) };
+		if (texturePath != m_TexturePaths.end()) return static_cast<uint8_t>(texturePath - m_TexturePaths.begin());
+
+		assert(m_TexturePaths.size() < Material::NoTexture);
+		m_TexturePaths.push_back(path);
+		return static_cast<uint8_t>(m_TexturePaths.size() - 1);
+	}
 #pragma endregion
 #pragma endregion
 
@@ -159,11 +763,11 @@ namespace dae {
 	{
 		//default: Material id0 >> SolidColor Material (RED)
 		constexpr unsigned char matId_Solid_Red = 0;
-		const unsigned char matId_Solid_Blue = AddMaterial(new Material_SolidColor{ colors::Blue });
+		const unsigned char matId_Solid_Blue = AddMaterial(Material::CreateSolidColor(colors::Blue));
 
-		const unsigned char matId_Solid_Yellow = AddMaterial(new Material_SolidColor{ colors::Yellow });
-		const unsigned char matId_Solid_Green = AddMaterial(new Material_SolidColor{ colors::Green });
-		const unsigned char matId_Solid_Magenta = AddMaterial(new Material_SolidColor{ colors::Magenta });
+		const unsigned char matId_Solid_Yellow = AddMaterial(Material::CreateSolidColor(colors::Yellow));
+		const unsigned char matId_Solid_Green = AddMaterial(Material::CreateSolidColor(colors::Green));
+		const unsigned char matId_Solid_Magenta = AddMaterial(Material::CreateSolidColor(colors::Magenta));
 
 		//Spheres
 		AddSphere({ -25.f, 0.f, 100.f }, 50.f, matId_Solid_Red);
@@ -186,11 +790,11 @@ namespace dae {
 
 		//default: Material id0 >> SolidColor Material (RED)
 		constexpr unsigned char matId_Solid_Red = 0;
-		const unsigned char matId_Solid_Blue = AddMaterial(new Material_SolidColor{ colors::Blue });
+		const unsigned char matId_Solid_Blue = AddMaterial(Material::CreateSolidColor(colors::Blue));
 
-		const unsigned char matId_Solid_Yellow = AddMaterial(new Material_SolidColor{ colors::Yellow });
-		const unsigned char matId_Solid_Green = AddMaterial(new Material_SolidColor{ colors::Green });
-		const unsigned char matId_Solid_Magenta = AddMaterial(new Material_SolidColor{ colors::Magenta });
+		const unsigned char matId_Solid_Yellow = AddMaterial(Material::CreateSolidColor(colors::Yellow));
+		const unsigned char matId_Solid_Green = AddMaterial(Material::CreateSolidColor(colors::Green));
+		const unsigned char matId_Solid_Magenta = AddMaterial(Material::CreateSolidColor(colors::Magenta));
 
 		//Plane
 		AddPlane({ -5.f, 0.f, 0.f }, { 1.f, 0.f,0.f }, matId_Solid_Green);
@@ -219,16 +823,16 @@ namespace dae {
 		m_Camera.fovAngle = 45.f;
 
 		//Metal
-		const auto matCT_GrayRoughMetal{ AddMaterial(new Material_CookTorrence{ {.972f, .960f, .915f }, 1.f, 1.f }) };
-		const auto matCT_GrayMediumMetal{ AddMaterial(new Material_CookTorrence{ {.972f, .960f, .915f }, 1.f, .6f }) };
-		const auto matCT_GraySmoothMetal{ AddMaterial(new Material_CookTorrence{ {.972f, .960f, .915f }, 1.f, .1f }) };
+		const auto matCT_GrayRoughMetal{ AddMaterial(Material::CreateCookTorrence({.972f, .960f, .915f }, 1.f, 1.f)) };
+		const auto matCT_GrayMediumMetal{ AddMaterial(Material::CreateCookTorrence({.972f, .960f, .915f }, 1.f, .6f)) };
+		const auto matCT_GraySmoothMetal{ AddMaterial(Material::CreateCookTorrence({.972f, .960f, .915f }, 1.f, .1f)) };
 
 		//Plastic
-		const auto matCT_GrayRoughPlastic{ AddMaterial(new Material_CookTorrence{ {.75f, .75f, .75f }, .0f, 1.f }) };
-		const auto matCT_GrayMediumPlastic{ AddMaterial(new Material_CookTorrence{ {.75f, .75f, .75f }, .0f, .6f }) };
-		const auto matCT_GraySmoothPlastic{ AddMaterial(new Material_CookTorrence{ {.75f, .75f, .75f }, .0f, .1f }) };
+		const auto matCT_GrayRoughPlastic{ AddMaterial(Material::CreateCookTorrence({.75f, .75f, .75f }, .0f, 1.f)) };
+		const auto matCT_GrayMediumPlastic{ AddMaterial(Material::CreateCookTorrence({.75f, .75f, .75f }, .0f, .6f)) };
+		const auto matCT_GraySmoothPlastic{ AddMaterial(Material::CreateCookTorrence({.75f, .75f, .75f }, .0f, .1f)) };
 
-		const auto matLambert_GrayBlue{ AddMaterial(new Material_Lambert{ {.49f, .57f, .57f }, 1.f }) };
+		const auto matLambert_GrayBlue{ AddMaterial(Material::CreateLambert({.49f, .57f, .57f }, 1.f)) };
 
 		//Planes
 		AddPlane({ 0.f, 0.f, 10.f }, { 0.f, 0.f,-1.f }, matLambert_GrayBlue); //Back
@@ -258,9 +862,9 @@ namespace dae {
 		m_Camera.origin = { 0.f,1.f,-5.f };
 		m_Camera.fovAngle = 45.f;
 
-		const auto matLambert_Red{ AddMaterial(new Material_Lambert(colors::Red, 1.f)) };
-		const auto matLambert_Blue{ AddMaterial(new Material_LambertPhong(colors::Blue, 1.f, 1.f, 60.f)) };
-		const auto matLambert_Yellow{ AddMaterial(new Material_Lambert(colors::Yellow, 1.f)) };
+		const auto matLambert_Red{ AddMaterial(Material::CreateLambert(colors::Red, 1.f)) };
+		const auto matLambert_Blue{ AddMaterial(Material::CreateLambertPhong(colors::Blue, 1.f, 1.f, 60.f)) };
+		const auto matLambert_Yellow{ AddMaterial(Material::CreateLambert(colors::Yellow, 1.f)) };
 
 		AddSphere({ -.75f, 1.f, .0f }, 1.f, matLambert_Red);
 		AddSphere({ .75f, 1.f, .0f }, 1.f, matLambert_Blue);
@@ -281,8 +885,8 @@ namespace dae {
 		m_Camera.fovAngle = 45.f;
 
 		//Materials
-		const auto matLambert_GrayBlue{ AddMaterial(new Material_Lambert({.49f, .57f, .57f}, 1.f)) };
-		const auto matLambert_White{ AddMaterial(new Material_Lambert(colors::White, 1.f)) };
+		const auto matLambert_GrayBlue{ AddMaterial(Material::CreateLambert({.49f, .57f, .57f}, 1.f)) };
+		const auto matLambert_White{ AddMaterial(Material::CreateLambert(colors::White, 1.f)) };
 
 		//Planes
 		AddPlane(Vector3{ 0.f, 0.f, 10.f }, Vector3{ 0.f, 0.f, -1.f }, matLambert_GrayBlue); //BACK
@@ -292,14 +896,14 @@ namespace dae {
 		AddPlane(Vector3{ -5.f, 0.f, 0.f }, Vector3{ 1.f, 0.f, 0.f }, matLambert_GrayBlue); //LEFT
 
 		//Triangle Mesh - Cube
-		m_pMesh = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
-		Utils::ParseOBJ("Resources/simple_cube.obj", m_pMesh->positions, m_pMesh->normals, m_pMesh->indices);
+		m_Mesh = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
+		TriangleMesh& mesh{ *m_TriangleMeshGeometries.Get(m_Mesh) };
+		Utils::ParseOBJ("Resources/simple_cube.obj", mesh.positions, mesh.normals, mesh.indices);
 
-		m_pMesh->Scale({ .7f, .7f, .7f });
-		m_pMesh->Translate({ 0.f,1.f,0.f });
+		mesh.Scale({ .7f, .7f, .7f });
+		mesh.Translate({ 0.f,1.f,0.f });
 
-		m_pMesh->UpdateAABB();
-		m_pMesh->UpdateTransforms();
+		mesh.UpdateAABB();
 
 		//Light
 		AddPointLight(Vector3{ 0.f, 5.f, 5.f }, 50.f, ColorRGB{ 1.f, .61f, .45f }); //Backlight
@@ -312,8 +916,17 @@ namespace dae {
 		// Call base update
 		Scene::Update(pTimer);
 
-		m_pMesh->RotateY(PI_DIV_2 * pTimer->GetTotal());
-		m_pMesh->UpdateTransforms();
+		if (TriangleMesh* pMesh{ m_TriangleMeshGeometries.Get(m_Mesh) }) pMesh->RotateY(PI_DIV_2 * pTimer->GetTotal());
+	}
+
+	void Scene_W4_TestScene::OnSnapshotLoaded()
+	{
+		m_Mesh = m_TriangleMeshGeometries.GetHandle(0);
+	}
+
+	std::vector<std::string> Scene_W4_TestScene::GetAssetPaths() const
+	{
+		return { "Resources/simple_cube.obj" };
 	}
 #pragma endregion
 
@@ -325,17 +938,17 @@ namespace dae {
 		m_Camera.fovAngle = 45.f;
 
 		//Metals
-		const auto matCT_GrayRoughMetal{ AddMaterial(new Material_CookTorrence({.972f,.960f,.915f}, 1.f, 1.f)) };
-		const auto matCT_GrayMediumMetal{ AddMaterial(new Material_CookTorrence({.972f,.960f,.915f}, 1.f, .6f)) };
-		const auto matCT_GraySmoothMetal{ AddMaterial(new Material_CookTorrence({.972f,.960f,.915f}, 1.f, .1f)) };
+		const auto matCT_GrayRoughMetal{ AddMaterial(Material::CreateCookTorrence({.972f,.960f,.915f}, 1.f, 1.f)) };
+		const auto matCT_GrayMediumMetal{ AddMaterial(Material::CreateCookTorrence({.972f,.960f,.915f}, 1.f, .6f)) };
+		const auto matCT_GraySmoothMetal{ AddMaterial(Material::CreateCookTorrence({.972f,.960f,.915f}, 1.f, .1f)) };
 
 		//Plastics
-		const auto matCT_GrayRoughPlastic{ AddMaterial(new Material_CookTorrence({.75f,.75f,.75f }, .0f, 1.f)) };
-		const auto matCT_GrayMediumPlastic{ AddMaterial(new Material_CookTorrence({.75f,.75f,.75f }, .0f, .6f)) };
-		const auto matCT_GraySmoothPlastic{ AddMaterial(new Material_CookTorrence({.75f,.75f,.75f }, .0f, .1f)) };
+		const auto matCT_GrayRoughPlastic{ AddMaterial(Material::CreateCookTorrence({.75f,.75f,.75f }, .0f, 1.f)) };
+		const auto matCT_GrayMediumPlastic{ AddMaterial(Material::CreateCookTorrence({.75f,.75f,.75f }, .0f, .6f)) };
+		const auto matCT_GraySmoothPlastic{ AddMaterial(Material::CreateCookTorrence({.75f,.75f,.75f }, .0f, .1f)) };
 
-		const auto matLambert_GrayBlue{ AddMaterial(new Material_Lambert({.49f,.57f,.57f}, 1.f)) };
-		const auto matLambert_White{ AddMaterial(new Material_Lambert(colors::White, 1.f)) };
+		const auto matLambert_GrayBlue{ AddMaterial(Material::CreateLambert({.49f,.57f,.57f}, 1.f)) };
+		const auto matLambert_White{ AddMaterial(Material::CreateLambert(colors::White, 1.f)) };
 
 		//Planes
 		AddPlane(Vector3{ 0.f, 0.f, 10.f }, Vector3{ 0.f, 0.f, -1.f }, matLambert_GrayBlue); //BACK
@@ -355,23 +968,19 @@ namespace dae {
 		//CW Winding Order!
 		const Triangle baseTriangle{ Vector3{-.75f, 1.5f, .0f }, Vector3{.75f, .0f, .0f }, Vector3{-.75f, .0f, .0f } };
 
-		m_Meshes[0] = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
-		m_Meshes[0]->AppendTriangle(baseTriangle, true);
-		m_Meshes[0]->Translate({ -1.75f, 4.5f, .0f });
-		m_Meshes[0]->UpdateAABB();
-		m_Meshes[0]->UpdateTransforms();
+		// One shared triangle, three instances with their own transform, cull mode & material
+		const Handle<SharedMesh> baseMesh{ AddSharedTriangleMesh() };
+		m_SharedTriangleMeshes.Get(baseMesh)->AppendTriangle(baseTriangle);
+		m_SharedTriangleMeshes.Get(baseMesh)->UpdateAABB();
 
-		m_Meshes[1] = AddTriangleMesh(TriangleCullMode::FrontFaceCulling, matLambert_White);
-		m_Meshes[1]->AppendTriangle(baseTriangle, true);
-		m_Meshes[1]->Translate({ .0f, 4.5f, .0f });
-		m_Meshes[1]->UpdateAABB();
-		m_Meshes[1]->UpdateTransforms();
+		m_Instances[0] = AddTriangleMeshInstance(baseMesh, TriangleCullMode::BackFaceCulling, matLambert_White);
+		m_TriangleMeshInstances.Get(m_Instances[0])->Translate({ -1.75f, 4.5f, .0f });
 
-		m_Meshes[2] = AddTriangleMesh(TriangleCullMode::NoCulling, matLambert_White);
-		m_Meshes[2]->AppendTriangle(baseTriangle, true);
-		m_Meshes[2]->Translate({ 1.75f, 4.5f, .0f });
-		m_Meshes[2]->UpdateAABB();
-		m_Meshes[2]->UpdateTransforms();
+		m_Instances[1] = AddTriangleMeshInstance(baseMesh, TriangleCullMode::FrontFaceCulling, matLambert_White);
+		m_TriangleMeshInstances.Get(m_Instances[1])->Translate({ .0f, 4.5f, .0f });
+
+		m_Instances[2] = AddTriangleMeshInstance(baseMesh, TriangleCullMode::NoCulling, matLambert_White);
+		m_TriangleMeshInstances.Get(m_Instances[2])->Translate({ 1.75f, 4.5f, .0f });
 
 		//Light
 		AddPointLight(Vector3{ 0.f, 5.f, 5.f }, 50.f, ColorRGB{ 1.f, .61f, .45f }); //Backlight
@@ -385,10 +994,17 @@ namespace dae {
 		Scene::Update(pTimer);
 
 		const auto yawAngle{ (cosf(pTimer->GetTotal()) + 1.f) / 2.f * PI_2 };
-		for (const auto& m : m_Meshes)
+		for (const auto& i : m_Instances)
+		{
+			if (TriangleMeshInstance* pInstance{ m_TriangleMeshInstances.Get(i) }) pInstance->RotateY(yawAngle);
+		}
+	}
+
+	void Scene_W4_ReferenceScene::OnSnapshotLoaded()
+	{
+		for (size_t i{ 0 }; i < std::size(m_Instances); ++i)
 		{
-			m->RotateY(yawAngle);
-			m->UpdateTransforms();
+			m_Instances[i] = m_TriangleMeshInstances.GetHandle(i);
 		}
 	}
 #pragma endregion
@@ -401,8 +1017,8 @@ namespace dae {
 		m_Camera.fovAngle = 45.f;
 
 		//Materials
-		const auto matLambert_GrayBlue{ AddMaterial(new Material_Lambert({.49f, .57f, .57f}, 1.f)) };
-		const auto matLambert_White{ AddMaterial(new Material_Lambert(colors::White, 1.f)) };
+		const auto matLambert_GrayBlue{ AddMaterial(Material::CreateLambert({.49f, .57f, .57f}, 1.f)) };
+		const auto matLambert_White{ AddMaterial(Material::CreateLambert(colors::White, 1.f)) };
 
 		//Planes
 		AddPlane(Vector3{ 0.f, 0.f, 10.f }, Vector3{ 0.f, 0.f, -1.f }, matLambert_GrayBlue); //BACK
@@ -412,12 +1028,12 @@ namespace dae {
 		AddPlane(Vector3{ -5.f, 0.f, 0.f }, Vector3{ 1.f, 0.f, 0.f }, matLambert_GrayBlue); //LEFT
 
 		//Triangle Mesh
-		m_pMesh = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
-		Utils::ParseOBJ("Resources/lowpoly_bunny2.obj", m_pMesh->positions, m_pMesh->normals, m_pMesh->indices);
+		m_Mesh = AddTriangleMesh(TriangleCullMode::BackFaceCulling, matLambert_White);
+		TriangleMesh& mesh{ *m_TriangleMeshGeometries.Get(m_Mesh) };
+		Utils::ParseOBJ("Resources/lowpoly_bunny2.obj", mesh.positions, mesh.normals, mesh.indices);
 
-		m_pMesh->Scale({ 2.f, 2.f, 2.f });
-		m_pMesh->UpdateAABB();
-		m_pMesh->UpdateTransforms();
+		mesh.Scale({ 2.f, 2.f, 2.f });
+		mesh.UpdateAABB();
 
 		//Light
 		AddPointLight(Vector3{ 0.f, 5.f, 5.f }, 50.f, ColorRGB{ 1.f, .61f, .45f }); //Backlight
@@ -430,8 +1046,469 @@ namespace dae {
 		// Call base update
 		Scene::Update(pTimer);
 
-		m_pMesh->RotateY((cosf(pTimer->GetTotal()) + 1.f) / 2.f * PI_2);
-		m_pMesh->UpdateTransforms();
+		if (TriangleMesh* pMesh{ m_TriangleMeshGeometries.Get(m_Mesh) }) pMesh->RotateY((cosf(pTimer->GetTotal()) + 1.f) / 2.f * PI_2);
+	}
+
+	void Scene_W4_BunnyScene::OnSnapshotLoaded()
+	{
+		m_Mesh = m_TriangleMeshGeometries.GetHandle(0);
+	}
+
+	std::vector<std::string> Scene_W4_BunnyScene::GetAssetPaths() const
+	{
+		return { "Resources/lowpoly_bunny2.obj" };
+	}
+#pragma endregion
+
+#pragma region SCENE BVH DENSE SCENE
+	void Scene_BVH_DenseScene::Initialize()
+	{
+		m_SceneName = "BVH Dense Scene";
+		m_Camera.origin = { 0.f, 3.f, -9.f };
+		m_Camera.fovAngle = 45.f;
+
+		//Materials
+		const auto matLambert_GrayBlue{ AddMaterial(Material::CreateLambert({.49f, .57f, .57f}, 1.f)) };
+		const auto matCT_GrayMediumPlastic{ AddMaterial(Material::CreateCookTorrence({.75f, .75f, .75f }, .0f, .6f)) };
+		const auto matCT_GrayMediumMetal{ AddMaterial(Material::CreateCookTorrence({.972f, .960f, .915f}, 1.f, .6f)) };
+
+		//Planes
+		AddPlane(Vector3{ 0.f, 0.f, 10.f }, Vector3{ 0.f, 0.f, -1.f }, matLambert_GrayBlue); //BACK
+		AddPlane(Vector3{ 0.f, 0.f, 0.f }, Vector3{ 0.f, 1.f, 0.f }, matLambert_GrayBlue); //BOTTOM
+
+		// Finely tessellated unit sphere, ~3 million triangles
+		constexpr int numRings{ 1024 };
+		constexpr int numSegments{ 1536 };
+
+		const Handle<SharedMesh> sphere{ AddSharedTriangleMesh() };
+		TriangleMesh* pSphere{ m_SharedTriangleMeshes.Get(sphere) };
+		pSphere->positions.reserve(static_cast<size_t>(numRings + 1) * (numSegments + 1));
+		pSphere->indices.reserve(static_cast<size_t>(numRings) * numSegments * 6);
+
+		for (int ring{ 0 }; ring <= numRings; ++ring)
+		{
+			const float theta{ PI * static_cast<float>(ring) / numRings };
+			for (int segment{ 0 }; segment <= numSegments; ++segment)
+			{
+				const float phi{ PI_2 * static_cast<float>(segment) / numSegments };
+				pSphere->positions.emplace_back(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+			}
+		}
+
+		for (int ring{ 0 }; ring < numRings; ++ring)
+		{
+			for (int segment{ 0 }; segment < numSegments; ++segment)
+			{
+				const int i0{ ring * (numSegments + 1) + segment };
+				const int i1{ i0 + 1 };
+				const int i2{ i0 + numSegments + 1 };
+				const int i3{ i2 + 1 };
+
+				// Skip the degenerate triangles at the poles
+				if (ring > 0) pSphere->indices.insert(pSphere->indices.end(), { i0, i1, i2 });
+				if (ring < numRings - 1) pSphere->indices.insert(pSphere->indices.end(), { i1, i3, i2 });
+			}
+		}
+
+		pSphere->CalculateNormals();
+		pSphere->UpdateAABB();
+
+		// Same geometry traced three times, only stored once
+		const unsigned char materials[3]{ matCT_GrayMediumPlastic, matCT_GrayMediumMetal, matCT_GrayMediumPlastic };
+		for (int i{ 0 }; i < 3; ++i)
+		{
+			TriangleMeshInstance* pInstance{ m_TriangleMeshInstances.Get(AddTriangleMeshInstance(sphere, TriangleCullMode::BackFaceCulling, materials[i])) };
+			pInstance->Translate({ -2.f + 2.f * static_cast<float>(i), 1.f, 0.f });
+			pInstance->Scale({ .9f, .9f, .9f });
+		}
+
+		//Light
+		AddPointLight(Vector3{ 0.f, 5.f, 5.f }, 50.f, ColorRGB{ 1.f, .61f, .45f }); //Backlight
+		AddPointLight(Vector3{ -2.5f, 5.f, -5.f }, 70.f, ColorRGB{ 1.f, .8f, .45f }); //Front Light Left
+		AddPointLight(Vector3{ 2.5f, 2.5f, -5.f }, 50.f, ColorRGB{ .34f, .47f, .68f });
+	}
+#pragma endregion
+
+#pragma region SCENE FILE
+	namespace
+	{
+		// One "mesh" line, each one becomes an instance of the shared mesh loaded from its OBJ
+		struct MeshDescription
+		{
+			uint32_t meshIndex{};
+			unsigned char materialIndex{};
+			TriangleCullMode cullMode{ TriangleCullMode::BackFaceCulling };
+			Vector3 translation{};
+			float yaw{};
+			Vector3 scale{ 1.f, 1.f, 1.f };
+			bool isStreamed{};
+		};
+
+		// One line of a scene file split in words, numbers are read with from_chars because libstdc++ allocates for every float an istream extracts
+		// Reading past the last word or a word that is not a number fails every read after it, the same as an istream
+		class LineReader final
+		{
+		public:
+			void Reset(std::string_view line)
+			{
+				m_Line = line;
+				m_IsValid = true;
+			}
+
+			explicit operator bool() const { return m_IsValid; }
+
+			LineReader& operator>>(std::string& word)
+			{
+				const std::string_view next{ NextWord() };
+				if (m_IsValid) word.assign(next);
+				return *this;
+			}
+
+			template<typename T> requires std::is_arithmetic_v<T>
+			LineReader& operator>>(T& value)
+			{
+				const std::string_view next{ NextWord() };
+				if (!m_IsValid) return *this;
+
+				const auto result{ std::from_chars(next.data(), next.data() + next.size(), value) };
+				m_IsValid = result.ec == std::errc{} && result.ptr == next.data() + next.size();
+				return *this;
+			}
+
+			// Everything after the words read so far, without the surrounding spaces
+			std::string_view GetRest() const
+			{
+				const size_t begin{ m_Line.find_first_not_of(Spaces) };
+				if (begin == std::string_view::npos) return {};
+				return m_Line.substr(begin, m_Line.find_last_not_of(Spaces) + 1 - begin);
+			}
+
+		private:
+			static constexpr std::string_view Spaces{ " \t\r" };
+
+			std::string_view m_Line{};
+			bool m_IsValid{ true };
+
+			std::string_view NextWord()
+			{
+				const size_t begin{ m_Line.find_first_not_of(Spaces) };
+				if (begin == std::string_view::npos) m_IsValid = false;
+				if (!m_IsValid) return {};
+
+				const size_t end{ std::min(m_Line.find_first_of(Spaces, begin), m_Line.size()) };
+				const std::string_view word{ m_Line.substr(begin, end - begin) };
+				m_Line.remove_prefix(end);
+				return word;
+			}
+		};
+
+		bool ReadVector(LineReader& stream, Vector3& v)
+		{
+			return static_cast<bool>(stream >> v.x >> v.y >> v.z);
+		}
+
+		bool ReadColor(LineReader& stream, ColorRGB& c)
+		{
+			return static_cast<bool>(stream >> c.r >> c.g >> c.b);
+		}
+
+		float ToMilliseconds(std::chrono::steady_clock::duration duration)
+		{
+			return std::chrono::duration<float, std::milli>(duration).count();
+		}
+	}
+
+	void Scene_File::Initialize()
+	{
+		const auto start{ std::chrono::steady_clock::now() };
+
+		std::ifstream file{ m_Path };
+		if (!file)
+		{
+			std::cout << "Could not open scene file " << m_Path << '\n';
+			return;
+		}
+
+		m_SceneName = std::filesystem::path{ m_Path }.stem().string();
+
+		std::unordered_map<std::string, unsigned char> materials{};
+		std::vector<std::string> meshPaths{};
+		std::vector<MeshDescription> meshes{};
+		uint32_t trianglesPerCluster{ StreamedMesh::DefaultTrianglesPerCluster };
+
+		// Reused for every line, a scene with many objects would otherwise allocate a few times per line
+		std::string line{};
+		LineReader stream{};
+		std::string keyword{};
+		int lineNumber{ 0 };
+		while (std::getline(file, line))
+		{
+			++lineNumber;
+			if (const size_t comment{ line.find('#') }; comment != std::string::npos) line.resize(comment);
+
+			stream.Reset(line);
+			if (!(stream >> keyword)) continue;
+
+			const auto reportError{ [&](const std::string& message)
+				{
+					std::cout << m_Path << '(' << lineNumber << "): " << message << '\n';
+				} };
+
+			const auto readMaterial{ [&](unsigned char& materialIndex)
+				{
+					std::string name{};
+					if (!(stream >> name)) return false;
+
+					const auto material{ materials.find(name) };
+					if (material == materials.end())
+					{
+						reportError("unknown material " + name);
+						return false;
+					}
+
+					materialIndex = material->second;
+					return true;
+				} };
+
+			bool isValid{ true };
+			if (keyword == "name")
+			{
+				m_SceneName = stream.GetRest();
+			}
+			else if (keyword == "camera")
+			{
+				// Angles in degrees, yaw and pitch are optional
+				float yaw{};
+				float pitch{};
+				isValid = ReadVector(stream, m_Camera.origin) && stream >> m_Camera.fovAngle;
+				stream >> yaw >> pitch;
+
+				m_Camera.totalYaw = yaw * TO_RADIANS;
+				m_Camera.totalPitch = pitch * TO_RADIANS;
+				m_Camera.forward = (Matrix::CreateRotationX(m_Camera.totalPitch) * Matrix::CreateRotationY(m_Camera.totalYaw)).TransformVector(Vector3::UnitZ);
+			}
+			else if (keyword == "material")
+			{
+				std::string name{};
+				std::string type{};
+				ColorRGB color{};
+				float a{};
+				float b{};
+				float c{};
+				isValid = stream >> name >> type && ReadColor(stream, color);
+
+				Material material{};
+				if (isValid)
+				{
+					if (type == "solid") material = Material::CreateSolidColor(color);
+					else if (type == "lambert" && stream >> a) material = Material::CreateLambert(color, a);
+					else if (type == "phong" && stream >> a >> b >> c) material = Material::CreateLambertPhong(color, a, b, c);
+					else if (type == "cooktorrance" && stream >> a >> b) material = Material::CreateCookTorrence(color, a, b);
+					else isValid = false;
+				}
+
+				// Optional "texture <image>", the texels replace the color on meshes with texture coordinates
+				std::string option{};
+				std::string texturePath{};
+				if (isValid && stream >> option) isValid = option == "texture" && stream >> texturePath;
+
+				// Both indices are a byte, and texture index 0xFF is Material::NoTexture
+				if (isValid && m_Materials.size() > UINT8_MAX)
+				{
+					reportError("more than " + std::to_string(UINT8_MAX + 1) + " materials, line ignored");
+					continue;
+				}
+				if (isValid && !texturePath.empty() && m_TexturePaths.size() >= Material::NoTexture && std::ranges::find(m_TexturePaths, texturePath) == m_TexturePaths.end())
+				{
+					reportError("more than " + std::to_string(Material::NoTexture) + " textures, line ignored");
+					continue;
+				}
+
+				if (isValid && !texturePath.empty()) material.albedoTexture = AddTexture(texturePath);
+				if (isValid) materials[name] = AddMaterial(material);
+			}
+			else if (keyword == "sphere")
+			{
+				Vector3 origin{};
+				float radius{};
+				unsigned char materialIndex{};
+				isValid = ReadVector(stream, origin) && stream >> radius && readMaterial(materialIndex);
+				if (isValid) AddSphere(origin, radius, materialIndex);
+			}
+			else if (keyword == "plane")
+			{
+				Vector3 origin{};
+				Vector3 normal{};
+				unsigned char materialIndex{};
+				isValid = ReadVector(stream, origin) && ReadVector(stream, normal) && readMaterial(materialIndex);
+				if (isValid) AddPlane(origin, normal.Normalized(), materialIndex);
+			}
+			else if (keyword == "mesh")
+			{
+				std::string path{};
+				MeshDescription mesh{};
+				isValid = stream >> path && readMaterial(mesh.materialIndex);
+
+				std::string option{};
+				while (isValid && stream >> option)
+				{
+					if (option == "translate") isValid = ReadVector(stream, mesh.translation);
+					else if (option == "rotate") isValid = static_cast<bool>(stream >> mesh.yaw);
+					else if (option == "scale") isValid = ReadVector(stream, mesh.scale);
+					else if (option == "stream") mesh.isStreamed = true;
+					else if (option == "cull")
+					{
+						std::string cullMode{};
+						stream >> cullMode;
+
+						if (cullMode == "back") mesh.cullMode = TriangleCullMode::BackFaceCulling;
+						else if (cullMode == "front") mesh.cullMode = TriangleCullMode::FrontFaceCulling;
+						else if (cullMode == "none") mesh.cullMode = TriangleCullMode::NoCulling;
+						else isValid = false;
+					}
+					else isValid = false;
+				}
+
+				// Every OBJ is only loaded once, using it again only adds an instance
+				const auto meshPath{ std::ranges::find(meshPaths, path) };
+				mesh.meshIndex = static_cast<uint32_t>(meshPath - meshPaths.begin());
+				if (isValid && meshPath == meshPaths.end()) meshPaths.push_back(path);
+				if (isValid) meshes.push_back(mesh);
+			}
+			else if (keyword == "streaming")
+			{
+				// Memory budget in MB per streamed mesh, optionally followed by the cluster size in triangles
+				float budget{};
+				isValid = stream >> budget && budget > 0.f;
+				if (isValid) m_StreamingBudget = static_cast<size_t>(budget * 1024.f * 1024.f);
+				if (isValid && stream >> trianglesPerCluster) isValid = trianglesPerCluster > 0;
+			}
+			else if (keyword == "pointlight" || keyword == "directionallight")
+			{
+				Vector3 vector{};
+				float intensity{};
+				ColorRGB color{};
+				isValid = ReadVector(stream, vector) && stream >> intensity && ReadColor(stream, color);
+
+				if (isValid && keyword == "pointlight") AddPointLight(vector, intensity, color);
+				else if (isValid) AddDirectionalLight(vector.Normalized(), intensity, color);
+			}
+			else
+			{
+				reportError("unknown keyword " + keyword);
+				continue;
+			}
+
+			if (!isValid) reportError("invalid " + keyword + ", line ignored");
+		}
+
+		const auto parseEnd{ std::chrono::steady_clock::now() };
+		std::cout << "Scene file " << m_Path << " parsed in " << ToMilliseconds(parseEnd - start) << "ms\n";
+
+		// Each OBJ is parsed and gets its BVH on its own thread, the meshes only touch their own data
+		const size_t firstMesh{ m_SharedTriangleMeshes.size() };
+		m_SharedTriangleMeshes.Reserve(firstMesh + meshPaths.size());
+		for (size_t i{ 0 }; i < meshPaths.size(); ++i)
+		{
+			AddSharedTriangleMesh();
+		}
+
+		// Meshes that are only streamed are never parsed into memory, their OBJ is streamed into the cluster files below
+		// Their shared mesh stays empty, the slot only keeps the instance mesh indices valid
+		std::vector<char> isInstanced(meshPaths.size());
+		for (const MeshDescription& mesh : meshes)
+		{
+			if (!mesh.isStreamed) isInstanced[mesh.meshIndex] = true;
+		}
+
+		std::vector<char> isLoaded(meshPaths.size());
+		std::vector<float> loadTimes(meshPaths.size());
+		std::vector<float> buildTimes(meshPaths.size());
+
+		concurrency::parallel_for(size_t{ 0 }, meshPaths.size(), [&](size_t i)
+			{
+				if (!isInstanced[i]) return;
+				TriangleMesh& mesh{ m_SharedTriangleMeshes[firstMesh + i] };
+
+				const auto loadStart{ std::chrono::steady_clock::now() };
+				isLoaded[i] = Utils::ParseOBJ(meshPaths[i], mesh.positions, mesh.normals, mesh.indices, mesh.uvs);
+				mesh.UpdateAABB();
+
+				const auto buildStart{ std::chrono::steady_clock::now() };
+				mesh.BuildBVH(m_BVHLayout);
+
+				loadTimes[i] = ToMilliseconds(buildStart - loadStart);
+				buildTimes[i] = ToMilliseconds(std::chrono::steady_clock::now() - buildStart);
+			});
+
+		float totalAssetTime{};
+		for (size_t i{ 0 }; i < meshPaths.size(); ++i)
+		{
+			if (!isInstanced[i]) continue;
+			if (!isLoaded[i])
+			{
+				std::cout << "Could not load " << meshPaths[i] << '\n';
+				continue;
+			}
+
+			std::cout << "Asset " << meshPaths[i] << ": " << m_SharedTriangleMeshes[firstMesh + i].indices.size() / 3 << " triangles"
+				<< " | parse " << loadTimes[i] << "ms | BVH " << buildTimes[i] << "ms\n";
+			totalAssetTime += loadTimes[i] + buildTimes[i];
+		}
+
+		for (const MeshDescription& mesh : meshes)
+		{
+			if (mesh.isStreamed)
+			{
+				const auto streamStart{ std::chrono::steady_clock::now() };
+				StreamedMesh* pStreamedMesh{ AddStreamedMesh(meshPaths[mesh.meshIndex], mesh.cullMode, mesh.materialIndex, trianglesPerCluster) };
+				if (!pStreamedMesh) continue;
+
+				const float streamTime{ ToMilliseconds(std::chrono::steady_clock::now() - streamStart) };
+				std::cout << "Asset " << meshPaths[mesh.meshIndex] << ": streamed into " << pStreamedMesh->GetNumClusters() << " clusters in " << streamTime << "ms\n";
+				totalAssetTime += streamTime;
+
+				pStreamedMesh->instance.Scale(mesh.scale);
+				pStreamedMesh->instance.RotateY(mesh.yaw * TO_RADIANS);
+				pStreamedMesh->instance.Translate(mesh.translation);
+				continue;
+			}
+
+			if (!isLoaded[mesh.meshIndex]) continue;
+
+			TriangleMeshInstance* pInstance{ m_TriangleMeshInstances.Get(
+				AddTriangleMeshInstance(m_SharedTriangleMeshes.GetHandle(firstMesh + mesh.meshIndex), mesh.cullMode, mesh.materialIndex)) };
+			pInstance->Scale(mesh.scale);
+			pInstance->RotateY(mesh.yaw * TO_RADIANS);
+			pInstance->Translate(mesh.translation);
+		}
+
+		std::cout << "Assets loaded in " << ToMilliseconds(std::chrono::steady_clock::now() - parseEnd) << "ms (" << totalAssetTime << "ms summed over all assets)\n";
+	}
+
+	std::string Scene_File::GetSnapshotName() const
+	{
+		std::string name{ std::filesystem::path{ m_Path }.stem().string() };
+		std::erase_if(name, [](char c) { return !std::isalnum(static_cast<unsigned char>(c)) && c != '_'; });
+
+		return "SceneFile_" + name;
+	}
+
+	std::vector<std::string> Scene_File::GetAssetPaths() const
+	{
+		std::vector<std::string> assetPaths{ m_Path };
+
+		std::ifstream file{ m_Path };
+		std::string line{};
+		while (std::getline(file, line))
+		{
+			std::istringstream stream{ line.substr(0, line.find('#')) };
+			std::string keyword{};
+			std::string path{};
+			if (stream >> keyword >> path && keyword == "mesh") assetPaths.push_back(path);
+		}
+
+		return assetPaths;
 	}
 #pragma endregion
 }
@@ -1,19 +1,30 @@
 #pragma once
+#include <array>
+#include <atomic>
+#include <memory>
+#include <memory_resource>
+#include <span>
 #include <string>
 #include <vector>
 
 #include "Math.h"
 #include "DataTypes.h"
 #include "Camera.h"
+#include "Frustum.h"
+#include "Material.h"
+#include "ObjectPool.h"
+#include "Texture.h"
+#include "StreamedMesh.h"
 
 namespace dae
 {
 	//Forward Declarations
 	class Timer;
-	class Material;
 	struct Plane;
 	struct Sphere;
 	struct Light;
+	// Handle type of the shared meshes, they are TriangleMeshes like the regular meshes but the two kinds of handles can't be mixed up
+	struct SharedMesh;
 
 	//Scene Base Class
 	class Scene
@@ -27,7 +38,23 @@ namespace dae
 		Scene& operator=(const Scene&) = delete;
 		Scene& operator=(Scene&&) noexcept = delete;
 
+		// Scenes by name so another process (a render worker) can create the same scene, nullptr for unknown names
+		// Names ending in .scene create a Scene_File
+		static Scene* Create(const std::string& name);
+		static std::vector<std::string> GetRegisteredNames();
+
 		virtual void Initialize() = 0;
+		void InitializeFromSnapshot();
+		void CycleBVHLayout();
+		// Switches every mesh to 16 bit positions and normals, see TriangleMesh::Compress, streamed meshes keep their float clusters
+		void CompressMeshes();
+		// Vertex, index and BVH bytes of the meshes in memory
+		size_t GetMeshMemoryUsage() const;
+		// Applies the transform changes made since the last call, the Renderer calls this right before tracing
+		// Every mesh or instance that moved is listed in GetMovedBounds until the next call
+		void UpdateTransforms();
+		// UpdateTransforms and the frame boundary of the streamed meshes, call it once before tracing a frame
+		void BeginFrame();
 		virtual void Update(dae::Timer* pTimer)
 		{
 			m_Camera.Update(pTimer);
@@ -35,31 +62,117 @@ namespace dae
 
 		Camera& GetCamera() { return m_Camera; }
 		void GetClosestHit(const Ray& ray, HitRecord& closestHit) const;
+		// Only tests the candidates, every ray has to lie inside the frustum they were culled with
+		void GetClosestHit(const Ray& ray, HitRecord& closestHit, const FrustumCandidates& candidates) const;
+		// Every object (or its box) that reaches into the frustum
+		void CullFrustum(const Frustum& frustum, FrustumCandidates& candidates) const;
+		size_t GetNumObjects() const;
 		bool DoesHit(const Ray& ray) const;
-
-		const std::vector<Plane>& GetPlaneGeometries() const { return m_PlaneGeometries; }
-		const std::vector<Sphere>& GetSphereGeometries() const { return m_SphereGeometries; }
-		const std::vector<Light>& GetLights() const { return m_Lights; }
-		const std::vector<Material*> GetMaterials() const { return m_Materials; }
+		// Batch queries for whatever isn't a pixel (line of sight, probes), one result per ray
+		// The rays are spread over all cores, for closest hits 4 neighbouring rays that start close together and point the same way walk the mesh BVHs as one packet
+		// Any hit rays stop at different times and lose to the packets, each is traced on its own like DoesHit does (shadow rays go through DoesHit directly)
+		void GetClosestHits(std::span<const Ray> rays, std::span<RayHit> hits) const;
+		// 1 for the rays that hit something, 0 for the others
+		void DoesHit(std::span<const Ray> rays, std::span<uint8_t> didHit) const;
+		// Rays traced through GetClosestHit and DoesHit (one at a time or batched) since the last ResetNumTracedRays
+		uint64_t GetNumTracedRays() const;
+		void ResetNumTracedRays();
+
+		std::span<const Plane> GetPlaneGeometries() const { return m_PlaneGeometries.GetObjects(); }
+		std::span<const Sphere> GetSphereGeometries() const { return m_SphereGeometries.GetObjects(); }
+		std::span<const Light> GetLights() const { return m_Lights.GetObjects(); }
+		const std::vector<Material>& GetMaterials() const { return m_Materials; }
+		const std::vector<Texture>& GetTextures() const { return m_Textures; }
+		bool HasStreamedMeshes() const { return !m_StreamedMeshes.empty(); }
+		// Paging of all streamed meshes during the last traced frame
+		const StreamingStatistics& GetStreamingStatistics() const { return m_StreamingStatistics; }
+		const std::vector<MovedBounds>& GetMovedBounds() const { return m_MovedBounds; }
 
 	protected:
+		friend class SceneSnapshot;
+
 		std::string	m_SceneName{};
 
-		std::vector<Plane> m_PlaneGeometries{};
-		std::vector<Sphere> m_SphereGeometries{};
-		std::vector<TriangleMesh> m_TriangleMeshGeometries{};
-		std::vector<Light> m_Lights{};
-		std::vector<Material*> m_Materials{};
+		// Every kind of object is packed in its own array, scenes hold on to their objects through handles
+		// The arrays come from one arena that grows in large blocks and is released with the scene
+		std::pmr::monotonic_buffer_resource m_ObjectArena{ 64 * 1024 };
+		ObjectPool<Plane> m_PlaneGeometries{ &m_ObjectArena };
+		ObjectPool<Sphere> m_SphereGeometries{ &m_ObjectArena };
+		ObjectPool<TriangleMesh> m_TriangleMeshGeometries{ &m_ObjectArena };
+		ObjectPool<TriangleMesh, SharedMesh> m_SharedTriangleMeshes{ &m_ObjectArena }; //Only traced through m_TriangleMeshInstances
+		ObjectPool<TriangleMeshInstance> m_TriangleMeshInstances{ &m_ObjectArena };
+		ObjectPool<Light> m_Lights{ &m_ObjectArena };
+		std::vector<Material> m_Materials{};
+		std::vector<std::string> m_TexturePaths{}; //The snapshot only stores the paths, the textures are loaded again
+		std::vector<Texture> m_Textures{};
+		std::vector<std::unique_ptr<StreamedMesh>> m_StreamedMeshes{};
+
+		size_t m_StreamingBudget{ 256 * 1024 * 1024 }; //Bytes of cluster geometry each streamed mesh keeps in memory
+		StreamingStatistics m_StreamingStatistics{};
+
+		std::vector<MovedBounds> m_MovedBounds{};
+		std::vector<MovedBounds> m_RemovedBounds{}; //Boxes of the meshes removed since the last UpdateTransforms
 
 		Camera m_Camera{};
 
-		Sphere* AddSphere(const Vector3& origin, float radius, unsigned char materialIndex = 0);
-		Plane* AddPlane(const Vector3& origin, const Vector3& normal, unsigned char materialIndex = 0);
-		TriangleMesh* AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex = 0);
+		BVHLayout m_BVHLayout{ BVHLayout::Binary };
+
+		Handle<Sphere> AddSphere(const Vector3& origin, float radius, unsigned char materialIndex = 0);
+		Handle<Plane> AddPlane(const Vector3& origin, const Vector3& normal, unsigned char materialIndex = 0);
+		Handle<TriangleMesh> AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex = 0);
+		// Shared meshes are never removed, instances refer to them by index
+		Handle<SharedMesh> AddSharedTriangleMesh();
+		Handle<TriangleMeshInstance> AddTriangleMeshInstance(Handle<SharedMesh> sharedMesh, TriangleCullMode cullMode, unsigned char materialIndex = 0);
+		// Streams the OBJ into a cluster file next to the snapshot and traces it from there, the mesh is never fully in memory
+		StreamedMesh* AddStreamedMesh(const std::string& objPath, TriangleCullMode cullMode, unsigned char materialIndex = 0,
+			uint32_t trianglesPerCluster = StreamedMesh::DefaultTrianglesPerCluster);
+
+		Handle<Light> AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color);
+		Handle<Light> AddDirectionalLight(const Vector3& direction, float intensity, const ColorRGB& color);
+
+		// False for an object that was already removed, the handles of the other objects stay valid
+		bool RemoveSphere(Handle<Sphere> sphere);
+		bool RemovePlane(Handle<Plane> plane);
+		bool RemoveTriangleMesh(Handle<TriangleMesh> mesh);
+		bool RemoveTriangleMeshInstance(Handle<TriangleMeshInstance> instance);
+		bool RemoveLight(Handle<Light> light);
+
+		unsigned char AddMaterial(const Material& material);
+		uint8_t AddTexture(const std::string& path);
+
+		// Loads every texture in m_TexturePaths that is not loaded yet
+		void LoadTextures();
+		// (Re)builds the BVH of every mesh that does not match m_BVHLayout yet
+		void BuildAccelerationStructures();
+
+		// Snapshot file name and the name in the log, the name the scene is registered under
+		virtual std::string GetSnapshotName() const = 0;
+		// Files read by Initialize, a change in any of them invalidates the scene snapshot
+		virtual std::vector<std::string> GetAssetPaths() const { return {}; }
+		// Scenes that keep handles to their objects have to re-acquire them after a snapshot replaced the containers
+		virtual void OnSnapshotLoaded() {}
+
+	private:
+		// Rays per task of the batch queries
+		static constexpr uint32_t m_RayBatchSize{ 1024 };
+		// Packets are only used when every ray is within this angle of the first one and starts within this fraction of the mesh's box diagonal of it
+		static constexpr float m_PacketMinCosAngle{ .95f };
+		static constexpr float m_PacketMaxOriginSpread{ .1f };
+
+		// Every thread counts in its own slot, a single counter would bounce its cache line between the cores on every ray
+		struct alignas(64) RayCounter
+		{
+			std::atomic<uint64_t> numRays{};
+		};
+		static constexpr uint32_t m_NumRayCounters{ 64 };
+		mutable std::array<RayCounter, m_NumRayCounters> m_RayCounters{};
 
-		Light* AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color);
-		Light* AddDirectionalLight(const Vector3& direction, float intensity, const ColorRGB& color);
-		unsigned char AddMaterial(Material* pMaterial);
+		void CountRays(uint64_t numRays) const;
+
+		// DoesHit without counting the ray
+		bool TraceAnyHit(const Ray& ray) const;
+		// Closest hit of up to 4 rays into pHits, returns the lanes that hit something
+		uint32_t TracePacket(const Ray* pRays, uint32_t numRays, HitRecord* pHits) const;
 	};
 
 	//+++++++++++++++++++++++++++++++++++++++++
@@ -76,6 +189,9 @@ namespace dae
 		Scene_W1& operator=(Scene_W1&&) noexcept = delete;
 
 		void Initialize() override;
+
+	protected:
+		std::string GetSnapshotName() const override { return "W1"; }
 	};
 
 	//+++++++++++++++++++++++++++++++++++++++++
@@ -92,6 +208,9 @@ namespace dae
 		Scene_W2& operator=(Scene_W2&&) noexcept = delete;
 
 		void Initialize() override;
+
+	protected:
+		std::string GetSnapshotName() const override { return "W2"; }
 	};
 
 	//+++++++++++++++++++++++++++++++++++++++++
@@ -108,6 +227,9 @@ namespace dae
 		Scene_W3& operator=(Scene_W3&&) noexcept = delete;
 
 		void Initialize() override;
+
+	protected:
+		std::string GetSnapshotName() const override { return "W3"; }
 	};
 
 	//+++++++++++++++++++++++++++++++++++++++++
@@ -124,6 +246,9 @@ namespace dae
 		Scene_W3_TestScene& operator=(Scene_W3_TestScene&&) noexcept = delete;
 
 		void Initialize() override;
+
+	protected:
+		std::string GetSnapshotName() const override { return "W3_Test"; }
 	};
 
 	//+++++++++++++++++++++++++++++++++++++++++
@@ -142,8 +267,13 @@ namespace dae
 		void Initialize() override;
 		void Update(Timer* pTimer) override;
 
+	protected:
+		std::string GetSnapshotName() const override { return "W4_Test"; }
+		void OnSnapshotLoaded() override;
+		std::vector<std::string> GetAssetPaths() const override;
+
 	private:
-		TriangleMesh* m_pMesh{ nullptr };
+		Handle<TriangleMesh> m_Mesh{};
 	};
 
 	//+++++++++++++++++++++++++++++++++++++++++
@@ -162,8 +292,12 @@ namespace dae
 		void Initialize() override;
 		void Update(Timer* pTimer) override;
 
+	protected:
+		std::string GetSnapshotName() const override { return "W4_Reference"; }
+		void OnSnapshotLoaded() override;
+
 	private:
-		TriangleMesh* m_Meshes[3]{};
+		Handle<TriangleMeshInstance> m_Instances[3]{};
 	};
 
 	//+++++++++++++++++++++++++++++++++++++++++
@@ -182,7 +316,54 @@ namespace dae
 		void Initialize() override;
 		void Update(Timer* pTimer) override;
 
+	protected:
+		std::string GetSnapshotName() const override { return "W4_Bunny"; }
+		void OnSnapshotLoaded() override;
+		std::vector<std::string> GetAssetPaths() const override;
+
+	private:
+		Handle<TriangleMesh> m_Mesh{};
+	};
+
+	//+++++++++++++++++++++++++++++++++++++++++
+	//BVH Dense Scene (several million triangles)
+	class Scene_BVH_DenseScene final : public Scene
+	{
+	public:
+		Scene_BVH_DenseScene() = default;
+		~Scene_BVH_DenseScene() override = default;
+
+		Scene_BVH_DenseScene(const Scene_BVH_DenseScene&) = delete;
+		Scene_BVH_DenseScene(Scene_BVH_DenseScene&&) noexcept = delete;
+		Scene_BVH_DenseScene& operator=(const Scene_BVH_DenseScene&) = delete;
+		Scene_BVH_DenseScene& operator=(Scene_BVH_DenseScene&&) noexcept = delete;
+
+		void Initialize() override;
+
+	protected:
+		std::string GetSnapshotName() const override { return "BVH_Dense"; }
+	};
+
+	//+++++++++++++++++++++++++++++++++++++++++
+	//Scene described by a text file, see Resources/Scenes/showcase.scene for the format
+	class Scene_File final : public Scene
+	{
+	public:
+		explicit Scene_File(const std::string& path) : m_Path{ path } {}
+		~Scene_File() override = default;
+
+		Scene_File(const Scene_File&) = delete;
+		Scene_File(Scene_File&&) noexcept = delete;
+		Scene_File& operator=(const Scene_File&) = delete;
+		Scene_File& operator=(Scene_File&&) noexcept = delete;
+
+		void Initialize() override;
+
+	protected:
+		std::string GetSnapshotName() const override;
+		std::vector<std::string> GetAssetPaths() const override;
+
 	private:
-		TriangleMesh* m_pMesh{ nullptr };
+		std::string m_Path{};
 	};
 }
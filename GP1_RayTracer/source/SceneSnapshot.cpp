@@ -0,0 +1,531 @@
+#include "SceneSnapshot.h"
+
+//Project includes
+#include "Material.h"
+#include "Scene.h"
+
+//Standard includes
+#include <cfloat>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <type_traits>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace dae
+{
+#pragma region MappedFile
+	MappedFile::MappedFile(const std::string& path)
+	{
+#if defined(_WIN32)
+		const HANDLE file{ CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr) };
+		if (file == INVALID_HANDLE_VALUE) return;
+		m_FileHandle = file;
+
+		LARGE_INTEGER size{};
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) return;
+
+		const HANDLE mapping{ CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) };
+		if (!mapping) return;
+		m_MappingHandle = mapping;
+
+		m_pData = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		m_Size = m_pData ? static_cast<size_t>(size.QuadPart) : 0;
+#else
+		const int file{ open(path.c_str(), O_RDONLY) };
+		if (file < 0) return;
+
+		struct stat fileStat {};
+		if (fstat(file, &fileStat) == 0 && fileStat.st_size > 0)
+		{
+			void* pMapping{ mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0) };
+			if (pMapping != MAP_FAILED)
+			{
+				m_pData = static_cast<const uint8_t*>(pMapping);
+				m_Size = static_cast<size_t>(fileStat.st_size);
+			}
+		}
+
+		//The mapping stays valid after closing the descriptor
+		close(file);
+#endif
+	}
+
+	MappedFile::~MappedFile()
+	{
+#if defined(_WIN32)
+		if (m_pData) UnmapViewOfFile(m_pData);
+		if (m_MappingHandle) CloseHandle(m_MappingHandle);
+		if (m_FileHandle) CloseHandle(m_FileHandle);
+#else
+		if (m_pData) munmap(const_cast<uint8_t*>(m_pData), m_Size);
+#endif
+	}
+#pragma endregion
+
+#pragma region Snapshot Layout
+	namespace
+	{
+		struct SnapshotHeader
+		{
+			char magic[4]{ 'G', 'P', 'R', 'T' };
+			uint32_t version{ SceneSnapshot::Version };
+			uint64_t assetHash{};
+
+			// A snapshot written by a different compiler/struct layout is rejected instead of misread
+			uint32_t structSizes[7]
+			{
+				static_cast<uint32_t>(sizeof(Vector3)),
+				static_cast<uint32_t>(sizeof(Sphere)),
+				static_cast<uint32_t>(sizeof(Plane)),
+				static_cast<uint32_t>(sizeof(Light)),
+				static_cast<uint32_t>(sizeof(Material)),
+				static_cast<uint32_t>(sizeof(BVHNode)),
+				static_cast<uint32_t>(sizeof(QuantizedBVHNode))
+			};
+		};
+
+		class SnapshotWriter final
+		{
+		public:
+			explicit SnapshotWriter(const std::string& path) : m_File(path, std::ios::binary) {}
+
+			bool IsValid() const { return m_File.good(); }
+
+			template<typename T>
+			void Write(const T& value)
+			{
+				static_assert(std::is_trivially_copyable_v<T>);
+				m_File.write(reinterpret_cast<const char*>(&value), sizeof(T));
+			}
+
+			template<typename T>
+			void WriteArray(const std::vector<T>& values)
+			{
+				WriteArray(std::span<const T>{ values });
+			}
+
+			template<typename T>
+			void WriteArray(std::span<const T> values)
+			{
+				static_assert(std::is_trivially_copyable_v<T>);
+				Write(static_cast<uint64_t>(values.size()));
+				m_File.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size() * sizeof(T)));
+			}
+
+			void WriteString(const std::string& value)
+			{
+				Write(static_cast<uint64_t>(value.size()));
+				m_File.write(value.data(), static_cast<std::streamsize>(value.size()));
+			}
+
+			void WriteMatrix(const Matrix& m)
+			{
+				for (int row{ 0 }; row < 4; ++row)
+				{
+					Write(m[row]);
+				}
+			}
+
+		private:
+			std::ofstream m_File;
+		};
+
+		// Reads straight from the mapped file, every array is a single memcpy
+		class SnapshotReader final
+		{
+		public:
+			SnapshotReader(const uint8_t* pData, size_t size) : m_pData(pData), m_Size(size) {}
+
+			bool IsValid() const { return m_IsValid; }
+
+			template<typename T>
+			void Read(T& value)
+			{
+				static_assert(std::is_trivially_copyable_v<T>);
+				if (!Reserve(sizeof(T))) return;
+				std::memcpy(&value, m_pData + m_Offset, sizeof(T));
+				m_Offset += sizeof(T);
+			}
+
+			template<typename T>
+			void ReadArray(std::vector<T>& values)
+			{
+				static_assert(std::is_trivially_copyable_v<T>);
+				uint64_t count{};
+				Read(count);
+				if (!Reserve(count * sizeof(T))) return;
+
+				values.resize(count);
+				std::memcpy(values.data(), m_pData + m_Offset, count * sizeof(T));
+				m_Offset += count * sizeof(T);
+			}
+
+			void ReadString(std::string& value)
+			{
+				uint64_t count{};
+				Read(count);
+				if (!Reserve(count)) return;
+
+				value.assign(reinterpret_cast<const char*>(m_pData + m_Offset), count);
+				m_Offset += count;
+			}
+
+			void ReadMatrix(Matrix& m)
+			{
+				for (int row{ 0 }; row < 4; ++row)
+				{
+					Read(m[row]);
+				}
+			}
+
+		private:
+			const uint8_t* m_pData{};
+			size_t m_Size{};
+			size_t m_Offset{};
+			bool m_IsValid{ true };
+
+			bool Reserve(uint64_t numBytes)
+			{
+				if (!m_IsValid || numBytes > m_Size - m_Offset)
+				{
+					m_IsValid = false;
+					return false;
+				}
+				return true;
+			}
+		};
+
+		void WriteMesh(SnapshotWriter& writer, const TriangleMesh& mesh)
+		{
+			// Snapshots keep the float meshes, Scene::CompressMeshes runs after loading
+			assert(!mesh.isCompressed);
+			writer.WriteArray(mesh.positions);
+			writer.WriteArray(mesh.normals);
+			writer.WriteArray(mesh.indices);
+			writer.WriteArray(mesh.uvs);
+			writer.Write(mesh.materialIndex);
+			writer.Write(mesh.cullMode);
+
+			writer.WriteMatrix(mesh.rotationTransform);
+			writer.WriteMatrix(mesh.translationTransform);
+			writer.WriteMatrix(mesh.scaleTransform);
+
+			writer.Write(mesh.minAABB);
+			writer.Write(mesh.maxAABB);
+			writer.Write(mesh.transformedMinAABB);
+			writer.Write(mesh.transformedMaxAABB);
+
+			writer.WriteMatrix(mesh.worldTransform);
+			writer.WriteMatrix(mesh.inverseWorldTransform);
+
+			writer.Write(mesh.bvh.GetLayout());
+			writer.WriteArray(mesh.bvh.GetNodes());
+			writer.WriteArray(mesh.bvh.GetQuantizedNodes());
+			writer.WriteArray(mesh.bvh.GetTriangleIndices());
+			writer.Write(static_cast<uint64_t>(mesh.bvh.GetBinaryMemoryUsage()));
+			writer.Write(static_cast<uint64_t>(mesh.bvh.GetQuantizedMemoryUsage()));
+		}
+
+		void ReadMesh(SnapshotReader& reader, TriangleMesh& mesh)
+		{
+			reader.ReadArray(mesh.positions);
+			reader.ReadArray(mesh.normals);
+			reader.ReadArray(mesh.indices);
+			reader.ReadArray(mesh.uvs);
+			reader.Read(mesh.materialIndex);
+			reader.Read(mesh.cullMode);
+
+			reader.ReadMatrix(mesh.rotationTransform);
+			reader.ReadMatrix(mesh.translationTransform);
+			reader.ReadMatrix(mesh.scaleTransform);
+
+			reader.Read(mesh.minAABB);
+			reader.Read(mesh.maxAABB);
+			reader.Read(mesh.transformedMinAABB);
+			reader.Read(mesh.transformedMaxAABB);
+
+			reader.ReadMatrix(mesh.worldTransform);
+			reader.ReadMatrix(mesh.inverseWorldTransform);
+
+			BVHLayout layout{};
+			std::vector<BVHNode> nodes{};
+			std::vector<QuantizedBVHNode> quantizedNodes{};
+			std::vector<uint32_t> triangleIndices{};
+			uint64_t binaryMemoryUsage{};
+			uint64_t quantizedMemoryUsage{};
+
+			reader.Read(layout);
+			reader.ReadArray(nodes);
+			reader.ReadArray(quantizedNodes);
+			reader.ReadArray(triangleIndices);
+			reader.Read(binaryMemoryUsage);
+			reader.Read(quantizedMemoryUsage);
+
+			mesh.bvh.Restore(layout, std::move(nodes), std::move(quantizedNodes), std::move(triangleIndices), static_cast<size_t>(binaryMemoryUsage),
+				static_cast<size_t>(quantizedMemoryUsage));
+		}
+
+		void WriteInstance(SnapshotWriter& writer, const TriangleMeshInstance& instance)
+		{
+			writer.Write(instance.meshIndex);
+			writer.Write(instance.materialIndex);
+			writer.Write(instance.cullMode);
+
+			writer.WriteMatrix(instance.rotationTransform);
+			writer.WriteMatrix(instance.translationTransform);
+			writer.WriteMatrix(instance.scaleTransform);
+			writer.WriteMatrix(instance.worldTransform);
+			writer.WriteMatrix(instance.inverseWorldTransform);
+
+			writer.Write(instance.transformedMinAABB);
+			writer.Write(instance.transformedMaxAABB);
+		}
+
+		void ReadInstance(SnapshotReader& reader, TriangleMeshInstance& instance)
+		{
+			reader.Read(instance.meshIndex);
+			reader.Read(instance.materialIndex);
+			reader.Read(instance.cullMode);
+
+			reader.ReadMatrix(instance.rotationTransform);
+			reader.ReadMatrix(instance.translationTransform);
+			reader.ReadMatrix(instance.scaleTransform);
+			reader.ReadMatrix(instance.worldTransform);
+			reader.ReadMatrix(instance.inverseWorldTransform);
+
+			reader.Read(instance.transformedMinAABB);
+			reader.Read(instance.transformedMaxAABB);
+		}
+	}
+#pragma endregion
+
+#pragma region SceneSnapshot
+	uint64_t SceneSnapshot::HashAssets(const std::string& sceneName, const std::vector<std::string>& assetPaths)
+	{
+		// FNV-1a over the scene name and the contents of every source asset
+		constexpr uint64_t fnvPrime{ 1099511628211ull };
+		uint64_t hash{ 14695981039346656037ull };
+
+		auto hashBytes{ [&hash](const char* pBytes, size_t numBytes)
+			{
+				for (size_t i{ 0 }; i < numBytes; ++i)
+				{
+					hash ^= static_cast<uint8_t>(pBytes[i]);
+					hash *= fnvPrime;
+				}
+			} };
+
+		hashBytes(sceneName.data(), sceneName.size());
+
+		for (const std::string& assetPath : assetPaths)
+		{
+			hashBytes(assetPath.data(), assetPath.size());
+
+			const MappedFile asset{ assetPath };
+			if (asset.IsValid())
+			{
+				hashBytes(reinterpret_cast<const char*>(asset.GetData()), asset.GetSize());
+			}
+		}
+
+		return hash;
+	}
+
+	bool SceneSnapshot::Save(const Scene& scene, const std::string& path, uint64_t assetHash)
+	{
+		std::error_code error{};
+		std::filesystem::create_directories(std::filesystem::path{ path }.parent_path(), error);
+
+		SnapshotWriter writer{ path };
+		if (!writer.IsValid()) return false;
+
+		SnapshotHeader header{};
+		header.assetHash = assetHash;
+		writer.Write(header);
+
+		writer.WriteString(scene.m_SceneName);
+
+		//Camera
+		const Camera& camera{ scene.m_Camera };
+		writer.Write(camera.origin);
+		writer.Write(camera.fovAngle);
+		writer.Write(camera.lastFovAngle);
+		writer.Write(camera.fov);
+		writer.Write(camera.forward);
+		writer.Write(camera.totalPitch);
+		writer.Write(camera.totalYaw);
+
+		//Geometry & Lights
+		writer.WriteArray(scene.m_SphereGeometries.GetObjects());
+		writer.WriteArray(scene.m_PlaneGeometries.GetObjects());
+		writer.WriteArray(scene.m_Lights.GetObjects());
+
+		//Materials
+		writer.WriteArray(scene.m_Materials);
+		writer.Write(static_cast<uint64_t>(scene.m_TexturePaths.size()));
+		for (const std::string& texturePath : scene.m_TexturePaths)
+		{
+			writer.WriteString(texturePath);
+		}
+
+		//Meshes
+		writer.Write(static_cast<uint64_t>(scene.m_TriangleMeshGeometries.size()));
+		for (const TriangleMesh& mesh : scene.m_TriangleMeshGeometries)
+		{
+			WriteMesh(writer, mesh);
+		}
+
+		writer.Write(static_cast<uint64_t>(scene.m_SharedTriangleMeshes.size()));
+		for (const TriangleMesh& mesh : scene.m_SharedTriangleMeshes)
+		{
+			WriteMesh(writer, mesh);
+		}
+
+		writer.Write(static_cast<uint64_t>(scene.m_TriangleMeshInstances.size()));
+		for (const TriangleMeshInstance& instance : scene.m_TriangleMeshInstances)
+		{
+			WriteInstance(writer, instance);
+		}
+
+		// Only the cluster file path, the geometry stays in the cluster file
+		writer.Write(static_cast<uint64_t>(scene.m_StreamedMeshes.size()));
+		for (const std::unique_ptr<StreamedMesh>& pStreamedMesh : scene.m_StreamedMeshes)
+		{
+			writer.WriteString(pStreamedMesh->GetPath());
+			writer.Write(static_cast<uint64_t>(pStreamedMesh->GetMemoryBudget()));
+			WriteInstance(writer, pStreamedMesh->instance);
+		}
+
+		return writer.IsValid();
+	}
+
+	bool SceneSnapshot::Load(Scene& scene, const std::string& path, uint64_t assetHash)
+	{
+		const MappedFile file{ path };
+		if (!file.IsValid()) return false;
+
+		SnapshotReader reader{ file.GetData(), file.GetSize() };
+
+		const SnapshotHeader expectedHeader{};
+		SnapshotHeader header{};
+		reader.Read(header);
+
+		// Stale (assets changed) or incompatible (different version/layout) snapshots are rebuilt
+		if (!reader.IsValid()
+			|| std::memcmp(header.magic, expectedHeader.magic, sizeof(header.magic)) != 0
+			|| header.version != expectedHeader.version
+			|| std::memcmp(header.structSizes, expectedHeader.structSizes, sizeof(header.structSizes)) != 0
+			|| header.assetHash != assetHash)
+		{
+			return false;
+		}
+
+		std::string sceneName{};
+		reader.ReadString(sceneName);
+
+		//Camera
+		Camera camera{};
+		reader.Read(camera.origin);
+		reader.Read(camera.fovAngle);
+		reader.Read(camera.lastFovAngle);
+		reader.Read(camera.fov);
+		reader.Read(camera.forward);
+		reader.Read(camera.totalPitch);
+		reader.Read(camera.totalYaw);
+
+		//Geometry & Lights
+		std::vector<Sphere> spheres{};
+		std::vector<Plane> planes{};
+		std::vector<Light> lights{};
+		reader.ReadArray(spheres);
+		reader.ReadArray(planes);
+		reader.ReadArray(lights);
+
+		//Materials
+		std::vector<Material> materials{};
+		reader.ReadArray(materials);
+
+		uint64_t numTextures{};
+		reader.Read(numTextures);
+		std::vector<std::string> texturePaths(reader.IsValid() ? numTextures : 0);
+		for (std::string& texturePath : texturePaths)
+		{
+			reader.ReadString(texturePath);
+		}
+
+		//Meshes
+		uint64_t numMeshes{};
+		reader.Read(numMeshes);
+		std::vector<TriangleMesh> meshes(reader.IsValid() ? numMeshes : 0);
+		for (TriangleMesh& mesh : meshes)
+		{
+			ReadMesh(reader, mesh);
+		}
+
+		uint64_t numSharedMeshes{};
+		reader.Read(numSharedMeshes);
+		std::vector<TriangleMesh> sharedMeshes(reader.IsValid() ? numSharedMeshes : 0);
+		for (TriangleMesh& mesh : sharedMeshes)
+		{
+			ReadMesh(reader, mesh);
+		}
+
+		uint64_t numInstances{};
+		reader.Read(numInstances);
+		std::vector<TriangleMeshInstance> instances(reader.IsValid() ? numInstances : 0);
+		for (TriangleMeshInstance& instance : instances)
+		{
+			ReadInstance(reader, instance);
+		}
+
+		uint64_t numStreamedMeshes{};
+		reader.Read(numStreamedMeshes);
+		std::vector<std::unique_ptr<StreamedMesh>> streamedMeshes(reader.IsValid() ? numStreamedMeshes : 0);
+		for (std::unique_ptr<StreamedMesh>& pStreamedMesh : streamedMeshes)
+		{
+			std::string clusterPath{};
+			uint64_t memoryBudget{};
+			reader.ReadString(clusterPath);
+			reader.Read(memoryBudget);
+
+			// A missing or damaged cluster file rebuilds the whole scene
+			pStreamedMesh = std::make_unique<StreamedMesh>();
+			if (!reader.IsValid() || !pStreamedMesh->Open(clusterPath, static_cast<size_t>(memoryBudget))) return false;
+
+			ReadInstance(reader, pStreamedMesh->instance);
+		}
+
+		// Only touch the scene once the whole file was read successfully
+		if (!reader.IsValid()) return false;
+
+		scene.m_SceneName = std::move(sceneName);
+		scene.m_Camera = camera;
+
+		scene.m_SphereGeometries.Assign(std::move(spheres));
+		scene.m_PlaneGeometries.Assign(std::move(planes));
+		scene.m_Lights.Assign(std::move(lights));
+		scene.m_TriangleMeshGeometries.Assign(std::move(meshes));
+		scene.m_SharedTriangleMeshes.Assign(std::move(sharedMeshes));
+		scene.m_TriangleMeshInstances.Assign(std::move(instances));
+		scene.m_StreamedMeshes = std::move(streamedMeshes);
+		scene.m_Materials = std::move(materials);
+		scene.m_TexturePaths = std::move(texturePaths);
+		scene.m_Textures.clear();
+
+		return true;
+	}
+#pragma endregion
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dae
+{
+	class Scene;
+
+	// Read-only memory mapping of a whole file (CreateFileMapping on Windows, mmap everywhere else)
+	class MappedFile final
+	{
+	public:
+		explicit MappedFile(const std::string& path);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile(MappedFile&&) noexcept = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile& operator=(MappedFile&&) noexcept = delete;
+
+		bool IsValid() const { return m_pData != nullptr; }
+		const uint8_t* GetData() const { return m_pData; }
+		size_t GetSize() const { return m_Size; }
+
+	private:
+		const uint8_t* m_pData{ nullptr };
+		size_t m_Size{};
+
+		void* m_FileHandle{ nullptr };
+		void* m_MappingHandle{ nullptr };
+	};
+
+	// Binary dump of a fully initialized scene, loading it skips OBJ parsing and all precomputation
+	class SceneSnapshot final
+	{
+	public:
+		// Bump whenever the file layout (or anything stored in it) changes
+		static constexpr uint32_t Version{ 9 };
+
+		static uint64_t HashAssets(const std::string& sceneName, const std::vector<std::string>& assetPaths);
+
+		static bool Save(const Scene& scene, const std::string& path, uint64_t assetHash);
+		static bool Load(Scene& scene, const std::string& path, uint64_t assetHash);
+	};
+}
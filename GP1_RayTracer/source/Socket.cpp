@@ -0,0 +1,234 @@
+#include "Socket.h"
+
+//Standard includes
+#include <algorithm>
+#include <climits>
+#include <iostream>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace dae
+{
+	namespace
+	{
+#if defined(_WIN32)
+		using NativeSocket = SOCKET;
+
+		// Winsock has to be started once per process before the first socket call
+		void InitializeNetwork()
+		{
+			static const bool isInitialized{ []
+				{
+					WSADATA data{};
+					return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+				}() };
+			(void)isInitialized;
+		}
+
+		int poll(pollfd* pFds, size_t count, int timeoutMs) { return WSAPoll(pFds, static_cast<ULONG>(count), timeoutMs); }
+		void CloseNative(NativeSocket s) { closesocket(s); }
+#else
+		using NativeSocket = int;
+
+		void InitializeNetwork() {}
+		void CloseNative(NativeSocket s) { close(s); }
+#endif
+
+		NativeSocket ToNative(intptr_t handle) { return static_cast<NativeSocket>(handle); }
+
+		// Tiles are small request/response messages, Nagle would hold them back
+		void DisableNagle(NativeSocket s)
+		{
+			int noDelay{ 1 };
+			setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+		}
+	}
+
+	Socket::~Socket()
+	{
+		Close();
+	}
+
+	Socket::Socket(Socket&& other) noexcept :
+		m_Handle{ other.m_Handle }
+	{
+		other.m_Handle = InvalidHandle;
+	}
+
+	Socket& Socket::operator=(Socket&& other) noexcept
+	{
+		if (this != &other)
+		{
+			Close();
+			m_Handle = other.m_Handle;
+			other.m_Handle = InvalidHandle;
+		}
+		return *this;
+	}
+
+	Socket Socket::Listen(uint16_t port)
+	{
+		InitializeNetwork();
+
+		const NativeSocket s{ socket(AF_INET, SOCK_STREAM, IPPROTO_TCP) };
+		Socket listener{ static_cast<Handle>(s) };
+		if (!listener.IsValid()) return {};
+
+		int reuseAddress{ 1 };
+		setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuseAddress), sizeof(reuseAddress));
+
+		// Any interface, workers on other machines are allowed to join
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_ANY);
+		address.sin_port = htons(port);
+
+		if (bind(s, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(s, SOMAXCONN) != 0)
+		{
+			std::cout << "Could not listen on port " << port << '\n';
+			return {};
+		}
+
+		return listener;
+	}
+
+	Socket Socket::Connect(const std::string& host, uint16_t port)
+	{
+		InitializeNetwork();
+
+		addrinfo hints{};
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_protocol = IPPROTO_TCP;
+
+		addrinfo* pAddresses{ nullptr };
+		if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &pAddresses) != 0)
+		{
+			std::cout << "Could not resolve " << host << '\n';
+			return {};
+		}
+
+		Socket connection{};
+		for (const addrinfo* pAddress{ pAddresses }; pAddress; pAddress = pAddress->ai_next)
+		{
+			const NativeSocket s{ socket(pAddress->ai_family, pAddress->ai_socktype, pAddress->ai_protocol) };
+			connection = Socket{ static_cast<Handle>(s) };
+			if (!connection.IsValid()) continue;
+
+			if (connect(s, pAddress->ai_addr, static_cast<int>(pAddress->ai_addrlen)) == 0)
+			{
+				DisableNagle(s);
+				break;
+			}
+
+			connection.Close();
+		}
+
+		freeaddrinfo(pAddresses);
+		return connection;
+	}
+
+	Socket Socket::Accept() const
+	{
+		const NativeSocket s{ accept(ToNative(m_Handle), nullptr, nullptr) };
+		Socket connection{ static_cast<Handle>(s) };
+		if (connection.IsValid()) DisableNagle(s);
+
+		return connection;
+	}
+
+	bool Socket::Poll(const std::vector<const Socket*>& sockets, std::vector<bool>& readable, int timeoutMs)
+	{
+		std::vector<pollfd> fds(sockets.size());
+		for (size_t i{ 0 }; i < sockets.size(); ++i)
+		{
+			fds[i].fd = ToNative(sockets[i]->m_Handle);
+			fds[i].events = POLLIN;
+		}
+
+		readable.assign(sockets.size(), false);
+		if (poll(fds.data(), fds.size(), timeoutMs) <= 0) return false;
+
+		// A closed connection shows up as readable, the following receive reports the error
+		for (size_t i{ 0 }; i < sockets.size(); ++i)
+		{
+			readable[i] = (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+		}
+
+		return true;
+	}
+
+	bool Socket::IsValid() const
+	{
+		return m_Handle != InvalidHandle;
+	}
+
+	uint16_t Socket::GetPort() const
+	{
+		sockaddr_in address{};
+		socklen_t size{ sizeof(address) };
+		if (getsockname(ToNative(m_Handle), reinterpret_cast<sockaddr*>(&address), &size) != 0) return 0;
+
+		return ntohs(address.sin_port);
+	}
+
+	void Socket::Close()
+	{
+		if (!IsValid()) return;
+
+		CloseNative(ToNative(m_Handle));
+		m_Handle = InvalidHandle;
+	}
+
+	bool Socket::SendAll(const void* pData, size_t size) const
+	{
+		const char* pBytes{ static_cast<const char*>(pData) };
+		while (size > 0)
+		{
+#if defined(_WIN32)
+			const int sent{ send(ToNative(m_Handle), pBytes, static_cast<int>(std::min<size_t>(size, INT_MAX)), 0) };
+#else
+			// A dead peer must not kill the process with SIGPIPE
+			const ssize_t sent{ send(ToNative(m_Handle), pBytes, size, MSG_NOSIGNAL) };
+#endif
+			if (sent <= 0) return false;
+
+			pBytes += sent;
+			size -= static_cast<size_t>(sent);
+		}
+
+		return true;
+	}
+
+	bool Socket::ReceiveAll(void* pData, size_t size) const
+	{
+		char* pBytes{ static_cast<char*>(pData) };
+		while (size > 0)
+		{
+#if defined(_WIN32)
+			const int received{ recv(ToNative(m_Handle), pBytes, static_cast<int>(std::min<size_t>(size, INT_MAX)), 0) };
+#else
+			const ssize_t received{ recv(ToNative(m_Handle), pBytes, size, 0) };
+#endif
+			if (received <= 0) return false;
+
+			pBytes += received;
+			size -= static_cast<size_t>(received);
+		}
+
+		return true;
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dae
+{
+	// Blocking TCP socket (Winsock on Windows, BSD sockets everywhere else), only movable so the handle has one owner
+	class Socket final
+	{
+	public:
+		Socket() = default;
+		~Socket();
+
+		Socket(const Socket&) = delete;
+		Socket(Socket&& other) noexcept;
+		Socket& operator=(const Socket&) = delete;
+		Socket& operator=(Socket&& other) noexcept;
+
+		// Port 0 lets the OS pick a free port, see GetPort
+		static Socket Listen(uint16_t port);
+		static Socket Connect(const std::string& host, uint16_t port);
+		Socket Accept() const;
+
+		// Waits until at least one socket has data (or got closed), returns false on timeout
+		static bool Poll(const std::vector<const Socket*>& sockets, std::vector<bool>& readable, int timeoutMs);
+
+		bool IsValid() const;
+		uint16_t GetPort() const;
+		void Close();
+
+		// Both only return once every byte went through, false means the connection is gone
+		bool SendAll(const void* pData, size_t size) const;
+		bool ReceiveAll(void* pData, size_t size) const;
+
+	private:
+		// SOCKET is a pointer sized integer on Windows, an int everywhere else
+		using Handle = intptr_t;
+		static constexpr Handle InvalidHandle{ -1 };
+
+		explicit Socket(Handle handle) : m_Handle{ handle } {}
+
+		Handle m_Handle{ InvalidHandle };
+	};
+}
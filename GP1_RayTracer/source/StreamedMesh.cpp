@@ -0,0 +1,723 @@
+#include "StreamedMesh.h"
+
+//Project includes
+#include "SceneSnapshot.h"
+#include "Utils.h"
+
+//Standard includes
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+
+namespace dae
+{
+	StreamingStatistics& StreamingStatistics::operator+=(const StreamingStatistics& other)
+	{
+		numPageIns += other.numPageIns;
+		pagedInBytes += other.pagedInBytes;
+		numEvictions += other.numEvictions;
+		numResidentClusters += other.numResidentClusters;
+		residentBytes += other.residentBytes;
+		return *this;
+	}
+
+#pragma region Cluster File
+	namespace
+	{
+		struct ClusterFileHeader
+		{
+			char magic[4]{ 'G', 'P', 'C', 'L' };
+			uint32_t version{ 2 };
+			BVHLayout clusterLayout{};
+			uint32_t numNodes{};
+			uint32_t numClusters{};
+			uint64_t nodesOffset{};
+			uint64_t clustersOffset{};
+		};
+
+		template<typename T>
+		size_t WriteArray(std::ofstream& file, const std::vector<T>& values)
+		{
+			const size_t numBytes{ values.size() * sizeof(T) };
+			file.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(numBytes));
+			return numBytes;
+		}
+
+		template<typename T>
+		void ReadArray(const uint8_t*& pData, size_t count, std::vector<T>& values)
+		{
+			values.resize(count);
+			std::memcpy(values.data(), pData, count * sizeof(T));
+			pData += count * sizeof(T);
+		}
+
+		// Copies the triangles with their own (deduplicated) vertices into one cluster and gives it a BVH
+		// localIndices maps mesh vertices to cluster vertices, it is all -1 before and after the call
+		TriangleMesh BuildCluster(const TriangleMesh& mesh, const uint32_t* pTriangles, uint32_t numTriangles, std::vector<int>& localIndices)
+		{
+			TriangleMesh cluster{};
+			cluster.indices.reserve(numTriangles * size_t{ 3 });
+
+			for (uint32_t i{ 0 }; i < numTriangles * 3; ++i)
+			{
+				const int meshIndex{ mesh.indices[pTriangles[i / 3] * size_t{ 3 } + i % 3] };
+
+				int& localIndex{ localIndices[meshIndex] };
+				if (localIndex < 0)
+				{
+					localIndex = static_cast<int>(cluster.positions.size());
+					cluster.positions.push_back(mesh.positions[meshIndex]);
+				}
+
+				cluster.indices.push_back(localIndex);
+			}
+
+			for (uint32_t i{ 0 }; i < numTriangles * 3; ++i)
+			{
+				localIndices[mesh.indices[pTriangles[i / 3] * size_t{ 3 } + i % 3]] = -1;
+			}
+
+			// Quantized, half the node memory of the binary layout for every paged in cluster
+			cluster.BuildBVH(BVHLayout::Quantized);
+			return cluster;
+		}
+
+		// Three vertex indices, the temporary files of the OBJ streaming hold nothing else
+		struct TriangleRecord
+		{
+			uint32_t indices[3]{};
+		};
+
+		// Triangles waiting to be split, stored in a temporary file
+		struct TriangleBucket
+		{
+			std::string path{};
+			uint32_t numTriangles{};
+			Vector3 minCentroid{ FLT_MAX, FLT_MAX, FLT_MAX };
+			Vector3 maxCentroid{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		};
+
+		const char* SkipSpaces(const char* pText, const char* pEnd)
+		{
+			while (pText != pEnd && (*pText == ' ' || *pText == '\t')) ++pText;
+			return pText;
+		}
+
+		Vector3 GetCentroid(const Vector3* pPositions, const TriangleRecord& triangle)
+		{
+			return (pPositions[triangle.indices[0]] + pPositions[triangle.indices[1]] + pPositions[triangle.indices[2]]) / 3.f;
+		}
+
+		// Calls onTriangles with chunks of the bucket, a bucket can be far bigger than the memory
+		template<typename Function>
+		bool ReadBucket(const TriangleBucket& bucket, const Function& onTriangles)
+		{
+			std::ifstream file{ bucket.path, std::ios::binary };
+			std::vector<TriangleRecord> triangles(std::min(bucket.numTriangles, 65536u));
+			for (uint32_t first{ 0 }; first < bucket.numTriangles && file; first += static_cast<uint32_t>(triangles.size()))
+			{
+				triangles.resize(std::min(bucket.numTriangles - first, static_cast<uint32_t>(triangles.size())));
+				file.read(reinterpret_cast<char*>(triangles.data()), static_cast<std::streamsize>(triangles.size() * sizeof(TriangleRecord)));
+				onTriangles(triangles);
+			}
+			return static_cast<bool>(file);
+		}
+	}
+
+	// Appends clusters to a cluster file, each call to WriteMesh or WriteBucket fills the cluster BVH below one node
+	class StreamedMesh::ClusterFileWriter final
+	{
+	public:
+		ClusterFileWriter(const std::string& path, uint32_t trianglesPerCluster) :
+			m_Path{ path },
+			m_TrianglesPerCluster{ trianglesPerCluster }
+		{
+			std::error_code error{};
+			std::filesystem::create_directories(std::filesystem::path{ path }.parent_path(), error);
+
+			m_File.open(path, std::ios::binary);
+			m_Header.clusterLayout = BVHLayout::Quantized;
+			m_File.write(reinterpret_cast<const char*>(&m_Header), sizeof(m_Header));
+		}
+
+		~ClusterFileWriter()
+		{
+			// Unmapped first, a mapped file can't be deleted everywhere
+			m_pPositions.reset();
+			for (const std::string& temporaryPath : m_TemporaryPaths)
+			{
+				std::error_code error{};
+				std::filesystem::remove(temporaryPath, error);
+			}
+		}
+
+		ClusterFileWriter(const ClusterFileWriter&) = delete;
+		ClusterFileWriter(ClusterFileWriter&&) noexcept = delete;
+		ClusterFileWriter& operator=(const ClusterFileWriter&) = delete;
+		ClusterFileWriter& operator=(ClusterFileWriter&&) noexcept = delete;
+
+		bool IsValid() const { return m_File.good(); }
+
+		// Median splits along the longest axis until a node is small enough to become a cluster, the splits are the cluster BVH
+		void WriteMesh(const TriangleMesh& mesh, uint32_t rootNode)
+		{
+			// Clusters are cut from the float positions
+			assert(!mesh.isCompressed);
+			const uint32_t numTriangles{ static_cast<uint32_t>(mesh.indices.size() / 3) };
+
+			std::vector<uint32_t> triangles(numTriangles);
+			std::iota(triangles.begin(), triangles.end(), 0u);
+
+			std::vector<Vector3> centroids(numTriangles);
+			for (uint32_t i{ 0 }; i < numTriangles; ++i)
+			{
+				const size_t index{ i * size_t{ 3 } };
+				centroids[i] = (mesh.positions[mesh.indices[index]] + mesh.positions[mesh.indices[index + 1]] + mesh.positions[mesh.indices[index + 2]]) / 3.f;
+			}
+
+			std::vector<int> localIndices(mesh.positions.size(), -1);
+
+			struct Range
+			{
+				uint32_t node{};
+				uint32_t begin{};
+				uint32_t end{};
+			};
+			std::vector<Range> ranges{ { rootNode, 0, numTriangles } };
+
+			while (!ranges.empty())
+			{
+				const Range range{ ranges.back() };
+				ranges.pop_back();
+
+				Vector3 minAABB{ FLT_MAX, FLT_MAX, FLT_MAX };
+				Vector3 maxAABB{ -FLT_MAX, -FLT_MAX, -FLT_MAX };
+				Vector3 minCentroid{ minAABB };
+				Vector3 maxCentroid{ maxAABB };
+				for (uint32_t i{ range.begin }; i < range.end; ++i)
+				{
+					for (size_t corner{ 0 }; corner < 3; ++corner)
+					{
+						const Vector3& position{ mesh.positions[mesh.indices[triangles[i] * size_t{ 3 } + corner]] };
+						minAABB = Vector3::Min(minAABB, position);
+						maxAABB = Vector3::Max(maxAABB, position);
+					}
+					minCentroid = Vector3::Min(minCentroid, centroids[triangles[i]]);
+					maxCentroid = Vector3::Max(maxCentroid, centroids[triangles[i]]);
+				}
+
+				m_Nodes[range.node].minAABB = minAABB;
+				m_Nodes[range.node].maxAABB = maxAABB;
+
+				const uint32_t count{ range.end - range.begin };
+				if (count <= m_TrianglesPerCluster)
+				{
+					const TriangleMesh cluster{ BuildCluster(mesh, &triangles[range.begin], count, localIndices) };
+
+					ClusterInfo info{};
+					info.offset = static_cast<uint64_t>(m_File.tellp());
+					info.numPositions = static_cast<uint32_t>(cluster.positions.size());
+					info.numIndices = static_cast<uint32_t>(cluster.indices.size());
+					info.numNodes = static_cast<uint32_t>(cluster.bvh.GetNodes().size());
+					info.numQuantizedNodes = static_cast<uint32_t>(cluster.bvh.GetQuantizedNodes().size());
+					info.numTriangleIndices = static_cast<uint32_t>(cluster.bvh.GetTriangleIndices().size());
+					info.binaryMemoryUsage = static_cast<uint32_t>(cluster.bvh.GetBinaryMemoryUsage());
+					info.quantizedMemoryUsage = static_cast<uint32_t>(cluster.bvh.GetQuantizedMemoryUsage());
+
+					size_t size{ WriteArray(m_File, cluster.positions) };
+					size += WriteArray(m_File, cluster.indices);
+					size += WriteArray(m_File, cluster.bvh.GetNodes());
+					size += WriteArray(m_File, cluster.bvh.GetQuantizedNodes());
+					size += WriteArray(m_File, cluster.bvh.GetTriangleIndices());
+					info.size = static_cast<uint32_t>(size);
+
+					// Leaves hold exactly one cluster
+					m_Nodes[range.node].leftFirst = static_cast<uint32_t>(m_Clusters.size());
+					m_Nodes[range.node].triangleCount = 1;
+					m_Clusters.push_back(info);
+					continue;
+				}
+
+				const Vector3 extent{ maxCentroid - minCentroid };
+				int axis{ extent.x > extent.y ? 0 : 1 };
+				if (extent.z > extent[axis]) axis = 2;
+
+				const uint32_t middle{ range.begin + count / 2 };
+				std::nth_element(triangles.begin() + range.begin, triangles.begin() + middle, triangles.begin() + range.end,
+					[&centroids, axis](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+
+				const uint32_t left{ AddChildren(range.node) };
+				ranges.push_back({ left + 1, middle, range.end });
+				ranges.push_back({ left, range.begin, middle });
+			}
+		}
+
+		// Only positions and faces are read, the positions go to a mapped temporary file and the faces become the first bucket
+		bool WriteOBJ(const std::string& objPath)
+		{
+			std::ifstream objFile{ objPath };
+			if (!objFile) return false;
+
+			TriangleBucket bucket{ CreateTemporaryPath() };
+			const std::string positionsPath{ CreateTemporaryPath() };
+			{
+				std::ofstream positionsFile{ positionsPath, std::ios::binary };
+				std::ofstream trianglesFile{ bucket.path, std::ios::binary };
+
+				uint32_t numPositions{ 0 };
+				uint32_t maxIndex{ 0 };
+				std::string line{};
+				while (std::getline(objFile, line))
+				{
+					const char* pEnd{ line.data() + line.size() };
+					const char* pText{ SkipSpaces(line.data(), pEnd) };
+					if (pEnd - pText < 2 || (pText[1] != ' ' && pText[1] != '\t')) continue;
+
+					if (pText[0] == 'v')
+					{
+						float position[3]{};
+						++pText;
+						for (float& value : position)
+						{
+							pText = SkipSpaces(pText, pEnd);
+							const auto result{ std::from_chars(pText, pEnd, value) };
+							if (result.ec != std::errc{}) return false;
+							pText = result.ptr;
+						}
+						positionsFile.write(reinterpret_cast<const char*>(position), sizeof(position));
+						++numPositions;
+					}
+					else if (pText[0] == 'f')
+					{
+						// Only the first three corners, the same as the regular OBJ parser
+						TriangleRecord triangle{};
+						++pText;
+						for (uint32_t& index : triangle.indices)
+						{
+							pText = SkipSpaces(pText, pEnd);
+							int objIndex{};
+							const auto result{ std::from_chars(pText, pEnd, objIndex) };
+							//OBJ format uses 1-based arrays
+							if (result.ec != std::errc{} || objIndex < 1) return false;
+
+							index = static_cast<uint32_t>(objIndex - 1);
+							maxIndex = std::max(maxIndex, index);
+							pText = result.ptr;
+							while (pText != pEnd && *pText != ' ' && *pText != '\t') ++pText;
+						}
+						trianglesFile.write(reinterpret_cast<const char*>(&triangle), sizeof(triangle));
+						++bucket.numTriangles;
+					}
+				}
+
+				if (bucket.numTriangles == 0 || maxIndex >= numPositions || !positionsFile || !trianglesFile) return false;
+			}
+
+			m_pPositions = std::make_unique<MappedFile>(positionsPath);
+			if (!m_pPositions->IsValid()) return false;
+
+			// Only a bucket that gets split needs its centroid bounds
+			if (bucket.numTriangles > MaxTrianglesInMemory)
+			{
+				const Vector3* pPositions{ reinterpret_cast<const Vector3*>(m_pPositions->GetData()) };
+				const bool isRead{ ReadBucket(bucket, [&](const std::vector<TriangleRecord>& triangles)
+					{
+						for (const TriangleRecord& triangle : triangles)
+						{
+							const Vector3 centroid{ GetCentroid(pPositions, triangle) };
+							bucket.minCentroid = Vector3::Min(bucket.minCentroid, centroid);
+							bucket.maxCentroid = Vector3::Max(bucket.maxCentroid, centroid);
+						}
+					}) };
+				if (!isRead) return false;
+			}
+
+			return WriteBucket(bucket, 0);
+		}
+
+		bool Finish()
+		{
+			m_Header.numNodes = static_cast<uint32_t>(m_Nodes.size());
+			m_Header.numClusters = static_cast<uint32_t>(m_Clusters.size());
+			m_Header.nodesOffset = static_cast<uint64_t>(m_File.tellp());
+			WriteArray(m_File, m_Nodes);
+			m_Header.clustersOffset = static_cast<uint64_t>(m_File.tellp());
+			WriteArray(m_File, m_Clusters);
+
+			m_File.seekp(0);
+			m_File.write(reinterpret_cast<const char*>(&m_Header), sizeof(m_Header));
+
+			return m_File.good();
+		}
+
+	private:
+		std::string m_Path{};
+		uint32_t m_TrianglesPerCluster{};
+
+		std::ofstream m_File{};
+		ClusterFileHeader m_Header{};
+		std::vector<BVHNode> m_Nodes{ 1 };
+		std::vector<ClusterInfo> m_Clusters{};
+
+		// Positions of the OBJ being streamed, the buckets only hold indices into them
+		std::unique_ptr<MappedFile> m_pPositions{};
+		std::vector<std::string> m_TemporaryPaths{};
+
+		std::string CreateTemporaryPath()
+		{
+			return m_TemporaryPaths.emplace_back(m_Path + '.' + std::to_string(m_TemporaryPaths.size()) + ".tmp");
+		}
+
+		// Children always come in pairs, the left one is returned
+		uint32_t AddChildren(uint32_t node)
+		{
+			const uint32_t left{ static_cast<uint32_t>(m_Nodes.size()) };
+			m_Nodes.resize(m_Nodes.size() + 2);
+			m_Nodes[node].leftFirst = left;
+			m_Nodes[node].triangleCount = 0;
+			return left;
+		}
+
+		// Halves the bucket at the middle of its centroid bounds until it fits in memory, then clusters it like a regular mesh
+		bool WriteBucket(const TriangleBucket& bucket, uint32_t node)
+		{
+			const Vector3* pPositions{ reinterpret_cast<const Vector3*>(m_pPositions->GetData()) };
+
+			if (bucket.numTriangles <= MaxTrianglesInMemory)
+			{
+				std::vector<TriangleRecord> triangles{};
+				triangles.reserve(bucket.numTriangles);
+				if (!ReadBucket(bucket, [&triangles](const std::vector<TriangleRecord>& chunk) { triangles.insert(triangles.end(), chunk.begin(), chunk.end()); })) return false;
+
+				// Only the vertices of this bucket, in their OBJ order
+				std::vector<uint32_t> vertices{};
+				vertices.reserve(triangles.size() * 3);
+				for (const TriangleRecord& triangle : triangles)
+				{
+					vertices.insert(vertices.end(), std::begin(triangle.indices), std::end(triangle.indices));
+				}
+				std::ranges::sort(vertices);
+				vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+				TriangleMesh mesh{};
+				mesh.positions.reserve(vertices.size());
+				for (const uint32_t vertex : vertices)
+				{
+					mesh.positions.push_back(pPositions[vertex]);
+				}
+
+				mesh.indices.reserve(triangles.size() * 3);
+				for (const TriangleRecord& triangle : triangles)
+				{
+					for (const uint32_t index : triangle.indices)
+					{
+						mesh.indices.push_back(static_cast<int>(std::ranges::lower_bound(vertices, index) - vertices.begin()));
+					}
+				}
+
+				WriteMesh(mesh, node);
+				return true;
+			}
+
+			const Vector3 extent{ bucket.maxCentroid - bucket.minCentroid };
+			int axis{ extent.x > extent.y ? 0 : 1 };
+			if (extent.z > extent[axis]) axis = 2;
+
+			// Triangles that all share one centroid can't be split in space, they are split by their order instead
+			const float split{ (bucket.minCentroid[axis] + bucket.maxCentroid[axis]) * .5f };
+			const bool isSpatialSplit{ split > bucket.minCentroid[axis] };
+
+			TriangleBucket halves[2]{ { CreateTemporaryPath() }, { CreateTemporaryPath() } };
+			{
+				std::ofstream files[2]{ std::ofstream{ halves[0].path, std::ios::binary }, std::ofstream{ halves[1].path, std::ios::binary } };
+				uint32_t index{ 0 };
+				const bool isRead{ ReadBucket(bucket, [&](const std::vector<TriangleRecord>& triangles)
+					{
+						for (const TriangleRecord& triangle : triangles)
+						{
+							const Vector3 centroid{ GetCentroid(pPositions, triangle) };
+							TriangleBucket& half{ halves[isSpatialSplit ? centroid[axis] >= split : index++ >= bucket.numTriangles / 2] };
+							files[&half - halves].write(reinterpret_cast<const char*>(&triangle), sizeof(triangle));
+
+							++half.numTriangles;
+							half.minCentroid = Vector3::Min(half.minCentroid, centroid);
+							half.maxCentroid = Vector3::Max(half.maxCentroid, centroid);
+						}
+					}) };
+				if (!isRead || !files[0] || !files[1]) return false;
+			}
+
+			std::error_code error{};
+			std::filesystem::remove(bucket.path, error);
+
+			const uint32_t left{ AddChildren(node) };
+			if (!WriteBucket(halves[0], left) || !WriteBucket(halves[1], left + 1)) return false;
+
+			m_Nodes[node].minAABB = Vector3::Min(m_Nodes[left].minAABB, m_Nodes[left + 1].minAABB);
+			m_Nodes[node].maxAABB = Vector3::Max(m_Nodes[left].maxAABB, m_Nodes[left + 1].maxAABB);
+			return true;
+		}
+	};
+
+	bool StreamedMesh::WriteClusterFile(const TriangleMesh& mesh, const std::string& path, uint32_t trianglesPerCluster)
+	{
+		if (mesh.indices.size() < 3 || trianglesPerCluster == 0) return false;
+
+		ClusterFileWriter writer{ path, trianglesPerCluster };
+		if (!writer.IsValid()) return false;
+
+		writer.WriteMesh(mesh, 0);
+		return writer.Finish();
+	}
+
+	bool StreamedMesh::WriteClusterFileFromOBJ(const std::string& objPath, const std::string& path, uint32_t trianglesPerCluster)
+	{
+		if (trianglesPerCluster == 0) return false;
+
+		ClusterFileWriter writer{ path, trianglesPerCluster };
+		return writer.IsValid() && writer.WriteOBJ(objPath) && writer.Finish();
+	}
+#pragma endregion
+
+#pragma region Paging
+	StreamedMesh::~StreamedMesh() = default;
+
+	bool StreamedMesh::Open(const std::string& path, size_t memoryBudget)
+	{
+		m_Path = path;
+		m_MemoryBudget = memoryBudget;
+		m_pFile = std::make_unique<MappedFile>(path);
+		if (!m_pFile->IsValid()) return false;
+
+		const uint8_t* pData{ m_pFile->GetData() };
+		const size_t size{ m_pFile->GetSize() };
+
+		const ClusterFileHeader expectedHeader{};
+		ClusterFileHeader header{};
+		if (size < sizeof(header)) return false;
+		std::memcpy(&header, pData, sizeof(header));
+
+		if (std::memcmp(header.magic, expectedHeader.magic, sizeof(header.magic)) != 0
+			|| header.version != expectedHeader.version
+			|| header.numNodes == 0
+			|| header.nodesOffset + header.numNodes * sizeof(BVHNode) > size
+			|| header.clustersOffset + header.numClusters * sizeof(ClusterInfo) > size)
+		{
+			return false;
+		}
+
+		const uint8_t* pNodes{ pData + header.nodesOffset };
+		ReadArray(pNodes, header.numNodes, m_Nodes);
+		const uint8_t* pClusters{ pData + header.clustersOffset };
+		ReadArray(pClusters, header.numClusters, m_Clusters);
+
+		if (std::ranges::any_of(m_Clusters, [size](const ClusterInfo& cluster) { return cluster.offset + cluster.size > size; })) return false;
+
+		m_ClusterLayout = header.clusterLayout;
+		m_pResidentClusters = std::make_unique<std::atomic<const TriangleMesh*>[]>(m_Clusters.size());
+		m_pNumUsers = std::make_unique<std::atomic<uint32_t>[]>(m_Clusters.size());
+		m_pLastUsedFrames = std::make_unique<std::atomic<uint32_t>[]>(m_Clusters.size());
+		m_OwnedClusters.resize(m_Clusters.size());
+		m_EvictedClusters.resize(m_Clusters.size());
+
+		std::cout << "Streamed mesh " << path << ": " << m_Clusters.size() << " clusters | cluster BVH " << static_cast<float>(m_Nodes.size() * sizeof(BVHNode)) / 1024.f
+			<< "KB | budget " << static_cast<float>(m_MemoryBudget) / (1024.f * 1024.f) << "MB\n";
+		return true;
+	}
+
+	StreamingStatistics StreamedMesh::BeginFrame()
+	{
+		const std::lock_guard lock{ m_Mutex };
+
+		StreamingStatistics statistics{ m_FrameStatistics };
+		statistics.numResidentClusters = static_cast<uint32_t>(m_PageInOrder.size() + m_InUseEvictedClusters.size());
+
+		// No ray is traced now, so nothing evicted is in use anymore
+		FreeUnusedEvictedClusters();
+
+		// Residency carries over, only the page-ins and evictions are per frame
+		const size_t residentBytes{ m_FrameStatistics.residentBytes };
+		m_FrameStatistics = {};
+		m_FrameStatistics.residentBytes = residentBytes;
+		++m_Frame;
+
+		return statistics;
+	}
+
+	StreamedMesh::ClusterReference StreamedMesh::AcquireCluster(uint32_t clusterIndex) const
+	{
+		// Only written when it changes, every ray touching a cluster would otherwise write to the same cache line
+		std::atomic<uint32_t>& lastUsedFrame{ m_pLastUsedFrames[clusterIndex] };
+		if (lastUsedFrame.load(std::memory_order_relaxed) != m_Frame) lastUsedFrame.store(m_Frame, std::memory_order_relaxed);
+
+		// Counted before the pointer is read and the eviction clears the pointer before it reads the count (both sequentially consistent),
+		// so either this ray sees no cluster and pages it in, or the eviction sees this ray and leaves the cluster alive
+		std::atomic<uint32_t>& numUsers{ m_pNumUsers[clusterIndex] };
+		numUsers.fetch_add(1);
+
+		const TriangleMesh* pCluster{ m_pResidentClusters[clusterIndex].load() };
+		return ClusterReference{ pCluster ? pCluster : &PageIn(clusterIndex), &numUsers };
+	}
+
+	const TriangleMesh& StreamedMesh::PageIn(uint32_t clusterIndex) const
+	{
+		const std::lock_guard lock{ m_Mutex };
+
+		// Another thread might have paged it in while this one waited
+		if (const TriangleMesh* pCluster{ m_pResidentClusters[clusterIndex].load(std::memory_order_acquire) }) return *pCluster;
+
+		// Still traced by another ray since it was evicted, its memory was never released so it is taken back as it is
+		std::unique_ptr<TriangleMesh> pCluster{ std::move(m_EvictedClusters[clusterIndex]) };
+		if (pCluster) std::erase(m_InUseEvictedClusters, clusterIndex);
+
+		const ClusterInfo& info{ m_Clusters[clusterIndex] };
+		if (!pCluster)
+		{
+			// Only clusters that are traced right now can keep this above the budget, at most one per thread
+			FreeUnusedEvictedClusters();
+			while (m_FrameStatistics.residentBytes + info.size > m_MemoryBudget && EvictLeastRecentlyUsed(clusterIndex)) {}
+
+			pCluster = std::make_unique<TriangleMesh>();
+			const uint8_t* pData{ m_pFile->GetData() + info.offset };
+			ReadArray(pData, info.numPositions, pCluster->positions);
+			ReadArray(pData, info.numIndices, pCluster->indices);
+
+			std::vector<BVHNode> nodes{};
+			std::vector<QuantizedBVHNode> quantizedNodes{};
+			std::vector<uint32_t> triangleIndices{};
+			ReadArray(pData, info.numNodes, nodes);
+			ReadArray(pData, info.numQuantizedNodes, quantizedNodes);
+			ReadArray(pData, info.numTriangleIndices, triangleIndices);
+			pCluster->bvh.Restore(m_ClusterLayout, std::move(nodes), std::move(quantizedNodes), std::move(triangleIndices), info.binaryMemoryUsage, info.quantizedMemoryUsage);
+
+			++m_FrameStatistics.numPageIns;
+			m_FrameStatistics.pagedInBytes += info.size;
+			m_FrameStatistics.residentBytes += info.size;
+		}
+
+		const TriangleMesh& cluster{ *pCluster };
+		m_OwnedClusters[clusterIndex] = std::move(pCluster);
+		m_PageInOrder.push_back(clusterIndex);
+		m_pResidentClusters[clusterIndex].store(&cluster);
+
+		return cluster;
+	}
+
+	bool StreamedMesh::EvictLeastRecentlyUsed(uint32_t keepCluster) const
+	{
+		// Oldest frame of use first, ties go to the cluster that was paged in first
+		// Clusters that are traced right now are skipped, evicting them would not release anything
+		auto victim{ m_PageInOrder.end() };
+		uint32_t victimFrame{ UINT32_MAX };
+		for (auto it{ m_PageInOrder.begin() }; it != m_PageInOrder.end(); ++it)
+		{
+			const uint32_t frame{ m_pLastUsedFrames[*it].load(std::memory_order_relaxed) };
+			if (*it != keepCluster && frame < victimFrame && m_pNumUsers[*it].load(std::memory_order_relaxed) == 0)
+			{
+				victim = it;
+				victimFrame = frame;
+			}
+		}
+
+		if (victim == m_PageInOrder.end()) return false;
+
+		const uint32_t clusterIndex{ *victim };
+		m_PageInOrder.erase(victim);
+
+		// A ray that started using it since the check above keeps it alive until FreeUnusedEvictedClusters sees it is done
+		m_pResidentClusters[clusterIndex].store(nullptr);
+		m_EvictedClusters[clusterIndex] = std::move(m_OwnedClusters[clusterIndex]);
+		m_InUseEvictedClusters.push_back(clusterIndex);
+		++m_FrameStatistics.numEvictions;
+
+		FreeUnusedEvictedClusters();
+		return true;
+	}
+
+	void StreamedMesh::FreeUnusedEvictedClusters() const
+	{
+		std::erase_if(m_InUseEvictedClusters, [this](uint32_t clusterIndex)
+			{
+				if (m_pNumUsers[clusterIndex].load() > 0) return false;
+
+				m_EvictedClusters[clusterIndex].reset();
+				m_FrameStatistics.residentBytes -= m_Clusters[clusterIndex].size;
+				return true;
+			});
+	}
+#pragma endregion
+
+#pragma region HitTest
+	bool StreamedMesh::HitTest(const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord) const
+	{
+		if (m_Nodes.empty() || !GeometryUtils::SlabTest_AABB(instance.transformedMinAABB, instance.transformedMaxAABB, ray)) return false;
+
+		Ray objectRay{ GeometryUtils::ToObjectSpace(instance.inverseWorldTransform, ray) };
+		objectRay.max = std::min(ray.max, hitRecord.t);
+		const Vector3 inverseDirection{ 1.f / objectRay.direction.x, 1.f / objectRay.direction.y, 1.f / objectRay.direction.z };
+
+		// Same front to back traversal as the binary mesh BVH, clusters are only paged in when a ray actually reaches them
+		GeometryUtils::BVHStackEntry stack[GeometryUtils::BVHStackSize];
+		int stackSize{ 0 };
+
+		const float rootDistance{ GeometryUtils::SlabDistance_AABB(m_Nodes[0].minAABB, m_Nodes[0].maxAABB, objectRay.origin, inverseDirection, objectRay.max) };
+		if (rootDistance == FLT_MAX) return false;
+		stack[stackSize++] = { 0, rootDistance };
+
+		HitRecord closestHit{};
+		bool didHit{ false };
+		while (stackSize > 0)
+		{
+			const GeometryUtils::BVHStackEntry entry{ stack[--stackSize] };
+			if (entry.distance >= objectRay.max) continue;
+
+			const BVHNode& node{ m_Nodes[entry.node] };
+			if (node.triangleCount > 0)
+			{
+				const ClusterReference cluster{ AcquireCluster(node.leftFirst) };
+				if (GeometryUtils::HitTest_ObjectSpaceMesh(*cluster.pCluster, instance.materialIndex, instance.cullMode, objectRay, closestHit, ignoreHitRecord))
+				{
+					if (ignoreHitRecord) return true;
+					didHit = true;
+					// The cluster can be freed as soon as the reference is gone, streamed meshes have no vertex attributes to interpolate anyway
+					closestHit.pMesh = nullptr;
+				}
+				continue;
+			}
+
+			uint32_t nearChild{ node.leftFirst };
+			uint32_t farChild{ node.leftFirst + 1 };
+			float nearDistance{ GeometryUtils::SlabDistance_AABB(m_Nodes[nearChild].minAABB, m_Nodes[nearChild].maxAABB, objectRay.origin, inverseDirection, objectRay.max) };
+			float farDistance{ GeometryUtils::SlabDistance_AABB(m_Nodes[farChild].minAABB, m_Nodes[farChild].maxAABB, objectRay.origin, inverseDirection, objectRay.max) };
+
+			if (nearDistance > farDistance)
+			{
+				std::swap(nearChild, farChild);
+				std::swap(nearDistance, farDistance);
+			}
+
+			assert(stackSize + 2 <= GeometryUtils::BVHStackSize);
+			if (farDistance != FLT_MAX) stack[stackSize++] = { farChild, farDistance };
+			if (nearDistance != FLT_MAX) stack[stackSize++] = { nearChild, nearDistance };
+		}
+
+		if (!didHit) return false;
+
+		GeometryUtils::ToWorldSpace(instance.inverseWorldTransform, ray, closestHit, hitRecord);
+		hitRecord.pWorldTransform = &instance.worldTransform;
+		return true;
+	}
+
+	bool StreamedMesh::HitTest(const Ray& ray) const
+	{
+		HitRecord temp{};
+		return HitTest(ray, temp, true);
+	}
+#pragma endregion
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	class MappedFile;
+
+	struct StreamingStatistics
+	{
+		uint32_t numPageIns{};
+		uint64_t pagedInBytes{};
+		uint32_t numEvictions{};
+		uint32_t numResidentClusters{};
+		size_t residentBytes{}; // Includes evicted clusters that are still traced by a ray, they count against the budget until they are freed
+
+		StreamingStatistics& operator+=(const StreamingStatistics& other);
+	};
+
+	/**
+	 * \brief Out-of-core triangle mesh, the triangles are split in spatial clusters stored in a memory mapped cluster file
+	 * Only the small BVH over the clusters stays in memory, the geometry of a cluster (positions, indices and its own BVH) is
+	 * paged in when a ray reaches it and the least recently used clusters are evicted once the memory budget is exceeded
+	 */
+	class StreamedMesh final
+	{
+	public:
+		static constexpr uint32_t DefaultTrianglesPerCluster{ 16384 };
+		static constexpr uint32_t MaxTrianglesInMemory{ 1u << 21 };
+
+		StreamedMesh() = default;
+		~StreamedMesh();
+
+		StreamedMesh(const StreamedMesh&) = delete;
+		StreamedMesh(StreamedMesh&&) noexcept = delete;
+		StreamedMesh& operator=(const StreamedMesh&) = delete;
+		StreamedMesh& operator=(StreamedMesh&&) noexcept = delete;
+
+		// Splits the (object space) triangles of mesh into clusters and writes them to path, mesh can be freed afterwards
+		static bool WriteClusterFile(const TriangleMesh& mesh, const std::string& path, uint32_t trianglesPerCluster = DefaultTrianglesPerCluster);
+		// Same clusters straight from an OBJ file (positions and faces only), the whole mesh is never in memory at once:
+		// the triangles are halved in temporary files next to path until a half fits in MaxTrianglesInMemory
+		static bool WriteClusterFileFromOBJ(const std::string& objPath, const std::string& path, uint32_t trianglesPerCluster = DefaultTrianglesPerCluster);
+
+		// Maps the cluster file and loads the cluster BVH, no geometry is read yet
+		bool Open(const std::string& path, size_t memoryBudget);
+
+		// Returns the statistics of the last frame, no ray may be traced while this runs
+		StreamingStatistics BeginFrame();
+
+		bool HitTest(const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false) const;
+		bool HitTest(const Ray& ray) const;
+
+		const std::string& GetPath() const { return m_Path; }
+		size_t GetMemoryBudget() const { return m_MemoryBudget; }
+		uint32_t GetNumClusters() const { return static_cast<uint32_t>(m_Clusters.size()); }
+		// Object space bounds of all triangles, only valid once Open succeeded
+		const Vector3& GetMinAABB() const { return m_Nodes[0].minAABB; }
+		const Vector3& GetMaxAABB() const { return m_Nodes[0].maxAABB; }
+
+		// Transform, material and cull mode of the mesh, meshIndex is not used
+		TriangleMeshInstance instance{};
+
+	private:
+		class ClusterFileWriter;
+
+		struct ClusterInfo
+		{
+			uint64_t offset{};
+			uint32_t numPositions{};
+			uint32_t numIndices{};
+			uint32_t numNodes{};
+			uint32_t numQuantizedNodes{};
+			uint32_t numTriangleIndices{};
+			uint32_t binaryMemoryUsage{}; // Of the cluster's BVH in either layout, only the cluster layout is stored
+			uint32_t quantizedMemoryUsage{};
+			uint32_t size{}; // Bytes in memory once paged in
+		};
+
+		std::string m_Path{};
+		std::unique_ptr<MappedFile> m_pFile{};
+		BVHLayout m_ClusterLayout{ BVHLayout::None };
+
+		// Always resident: BVH over the clusters (leaves hold one cluster index) and where each cluster is stored
+		std::vector<BVHNode> m_Nodes{};
+		std::vector<ClusterInfo> m_Clusters{};
+
+		// Rays read the cluster pointers without locking, paging in and evicting is serialized by m_Mutex
+		// A ray counts itself as a user of a cluster before it reads the pointer, an evicted cluster is only freed once it has no users
+		std::unique_ptr<std::atomic<const TriangleMesh*>[]> m_pResidentClusters{};
+		std::unique_ptr<std::atomic<uint32_t>[]> m_pNumUsers{};
+		std::unique_ptr<std::atomic<uint32_t>[]> m_pLastUsedFrames{};
+		uint32_t m_Frame{ 1 };
+
+		mutable std::mutex m_Mutex{};
+		mutable std::vector<std::unique_ptr<TriangleMesh>> m_OwnedClusters{};
+		mutable std::vector<uint32_t> m_PageInOrder{}; // Resident clusters, oldest page in first
+		// Evicted while a ray still traced them, freed as soon as the last one is done
+		// Until then they are the first place a page in looks, so there is never more than one copy of a cluster
+		mutable std::vector<std::unique_ptr<TriangleMesh>> m_EvictedClusters{};
+		mutable std::vector<uint32_t> m_InUseEvictedClusters{};
+		mutable StreamingStatistics m_FrameStatistics{};
+
+		size_t m_MemoryBudget{};
+
+		// Keeps a cluster from being freed while a ray traces it
+		struct ClusterReference final
+		{
+			const TriangleMesh* pCluster{};
+			std::atomic<uint32_t>* pNumUsers{};
+
+			ClusterReference(const TriangleMesh* pCluster, std::atomic<uint32_t>* pNumUsers) : pCluster{ pCluster }, pNumUsers{ pNumUsers } {}
+			~ClusterReference() { pNumUsers->fetch_sub(1, std::memory_order_release); }
+
+			ClusterReference(const ClusterReference&) = delete;
+			ClusterReference(ClusterReference&&) noexcept = delete;
+			ClusterReference& operator=(const ClusterReference&) = delete;
+			ClusterReference& operator=(ClusterReference&&) noexcept = delete;
+		};
+
+		ClusterReference AcquireCluster(uint32_t clusterIndex) const;
+		const TriangleMesh& PageIn(uint32_t clusterIndex) const;
+		bool EvictLeastRecentlyUsed(uint32_t keepCluster) const;
+		void FreeUnusedEvictedClusters() const;
+	};
+}
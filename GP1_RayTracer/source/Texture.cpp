@@ -0,0 +1,186 @@
+#include "Texture.h"
+
+//External includes
+#include "SDL_image.h"
+
+//Standard includes
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace dae
+{
+	namespace
+	{
+		ColorRGB ToColor(uint32_t texel)
+		{
+			// Use a precomputed value for 1/255
+			constexpr float inv255{ 1.f / 255.f };
+			return ColorRGB
+			{
+				static_cast<float>(texel & 0xFF) * inv255,
+				static_cast<float>((texel >> 8) & 0xFF) * inv255,
+				static_cast<float>((texel >> 16) & 0xFF) * inv255
+			};
+		}
+
+		int Wrap(int coordinate, int size)
+		{
+			const int wrapped{ coordinate % size };
+			return wrapped < 0 ? wrapped + size : wrapped;
+		}
+	}
+
+	Texture::Texture(const std::string& path)
+	{
+		SDL_Surface* pImage{ IMG_Load(path.c_str()) };
+		if (!pImage)
+		{
+			std::cout << "Texture::Texture() failed to load " << path << ": " << IMG_GetError() << '\n';
+			return;
+		}
+
+		// Whatever the file holds (palette, RGB, BGRA, ...), the texels are always stored as RGBA
+		SDL_Surface* pSurface{ SDL_ConvertSurfaceFormat(pImage, SDL_PIXELFORMAT_RGBA32, 0) };
+		SDL_FreeSurface(pImage);
+		if (!pSurface)
+		{
+			std::cout << "Texture::Texture() failed to convert " << path << ": " << SDL_GetError() << '\n';
+			return;
+		}
+
+		MipLevel level{ pSurface->w, pSurface->h };
+		level.texels.resize(static_cast<size_t>(level.width) * level.height);
+
+		// Rows can be padded
+		const uint8_t* pPixels{ static_cast<const uint8_t*>(pSurface->pixels) };
+		for (int y{ 0 }; y < level.height; ++y)
+		{
+			std::memcpy(&level.texels[static_cast<size_t>(y) * level.width], pPixels + static_cast<size_t>(y) * pSurface->pitch, level.width * sizeof(uint32_t));
+		}
+		SDL_FreeSurface(pSurface);
+
+		m_Levels.push_back(std::move(level));
+		BuildMipLevels();
+	}
+
+	size_t Texture::GetMemoryUsage() const
+	{
+		size_t memoryUsage{};
+		for (const MipLevel& level : m_Levels)
+		{
+			memoryUsage += level.texels.size() * sizeof(uint32_t);
+		}
+		return memoryUsage;
+	}
+
+	float Texture::GetLevelOfDetail(const Vector2& dUVdx, const Vector2& dUVdy) const
+	{
+		if (!IsValid()) return 0.f;
+
+		// Longest side of the pixel footprint, measured in texels of the full resolution level
+		const float width{ static_cast<float>(GetWidth()) };
+		const float height{ static_cast<float>(GetHeight()) };
+		const float footprintX{ Vector2{ dUVdx.x * width, dUVdx.y * height }.SqrMagnitude() };
+		const float footprintY{ Vector2{ dUVdy.x * width, dUVdy.y * height }.SqrMagnitude() };
+
+		// Differentials (nearly) parallel to the triangle give an infinite or NaN footprint, the pixel covers the whole texture
+		const float lastLevel{ static_cast<float>(m_Levels.size() - 1) };
+		if (std::isnan(footprintX) || std::isnan(footprintY)) return lastLevel;
+
+		// log2 of a squared length, so halved
+		return std::clamp(.5f * log2f(std::max(footprintX, footprintY)), 0.f, lastLevel);
+	}
+
+	ColorRGB Texture::Sample(const Vector2& uv, float levelOfDetail) const
+	{
+		if (!IsValid()) return colors::Black;
+
+		// Clamped again, a NaN or out of range level would index past the pyramid
+		if (std::isnan(levelOfDetail)) levelOfDetail = 0.f;
+		levelOfDetail = std::clamp(levelOfDetail, 0.f, static_cast<float>(m_Levels.size() - 1));
+
+		const size_t level{ static_cast<size_t>(levelOfDetail) };
+		const float blend{ levelOfDetail - static_cast<float>(level) };
+
+		const ColorRGB color{ SampleBilinear(m_Levels[level], uv) };
+		if (blend <= 0.f || level + 1 >= m_Levels.size()) return color;
+
+		return color * (1.f - blend) + SampleBilinear(m_Levels[level + 1], uv) * blend;
+	}
+
+	ColorRGB Texture::Sample(const Vector2& uv, const Vector2& dUVdx, const Vector2& dUVdy) const
+	{
+		return Sample(uv, GetLevelOfDetail(dUVdx, dUVdy));
+	}
+
+	void Texture::BuildMipLevels()
+	{
+		// Every texel of the next level is the average of a 2x2 block, odd sizes repeat the last row/column
+		while (m_Levels.back().width > 1 || m_Levels.back().height > 1)
+		{
+			const MipLevel& source{ m_Levels.back() };
+
+			MipLevel level{ std::max(source.width / 2, 1), std::max(source.height / 2, 1) };
+			level.texels.resize(static_cast<size_t>(level.width) * level.height);
+
+			for (int y{ 0 }; y < level.height; ++y)
+			{
+				const int y0{ std::min(y * 2, source.height - 1) };
+				const int y1{ std::min(y * 2 + 1, source.height - 1) };
+
+				for (int x{ 0 }; x < level.width; ++x)
+				{
+					const int x0{ std::min(x * 2, source.width - 1) };
+					const int x1{ std::min(x * 2 + 1, source.width - 1) };
+
+					const uint32_t block[4]
+					{
+						source.texels[static_cast<size_t>(y0) * source.width + x0],
+						source.texels[static_cast<size_t>(y0) * source.width + x1],
+						source.texels[static_cast<size_t>(y1) * source.width + x0],
+						source.texels[static_cast<size_t>(y1) * source.width + x1]
+					};
+
+					uint32_t texel{};
+					for (uint32_t shift{ 0 }; shift < 32; shift += 8)
+					{
+						uint32_t sum{ 2 }; // Rounds to nearest
+						for (const uint32_t blockTexel : block) sum += (blockTexel >> shift) & 0xFF;
+						texel |= (sum / 4) << shift;
+					}
+
+					level.texels[static_cast<size_t>(y) * level.width + x] = texel;
+				}
+			}
+
+			m_Levels.push_back(std::move(level));
+		}
+	}
+
+	ColorRGB Texture::SampleBilinear(const MipLevel& level, const Vector2& uv) const
+	{
+		// Texel centers sit at half coordinates
+		const float x{ uv.x * static_cast<float>(level.width) - .5f };
+		const float y{ uv.y * static_cast<float>(level.height) - .5f };
+
+		const float floorX{ std::floor(x) };
+		const float floorY{ std::floor(y) };
+		const float weightX{ x - floorX };
+		const float weightY{ y - floorY };
+
+		const int x0{ Wrap(static_cast<int>(floorX), level.width) };
+		const int x1{ Wrap(x0 + 1, level.width) };
+		const int y0{ Wrap(static_cast<int>(floorY), level.height) };
+		const int y1{ Wrap(y0 + 1, level.height) };
+
+		const uint32_t* pRow0{ &level.texels[static_cast<size_t>(y0) * level.width] };
+		const uint32_t* pRow1{ &level.texels[static_cast<size_t>(y1) * level.width] };
+
+		const ColorRGB top{ ToColor(pRow0[x0]) * (1.f - weightX) + ToColor(pRow0[x1]) * weightX };
+		const ColorRGB bottom{ ToColor(pRow1[x0]) * (1.f - weightX) + ToColor(pRow1[x1]) * weightX };
+		return top * (1.f - weightY) + bottom * weightY;
+	}
+}
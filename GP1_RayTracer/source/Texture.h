@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ColorRGB.h"
+#include "Vector2.h"
+
+namespace dae
+{
+	/**
+	 * \brief Image loaded with SDL_image and stored as a mip pyramid (box filtered, every level half the size of the previous one)
+	 * Lookups pick the level whose texels match the footprint of a pixel, so distant surfaces read a few small levels instead of
+	 * skipping through the full resolution image
+	 */
+	class Texture final
+	{
+	public:
+		explicit Texture(const std::string& path);
+		~Texture() = default;
+
+		Texture(const Texture&) = delete;
+		Texture(Texture&&) noexcept = default;
+		Texture& operator=(const Texture&) = delete;
+		Texture& operator=(Texture&&) noexcept = default;
+
+		bool IsValid() const { return !m_Levels.empty(); }
+		int GetWidth() const { return IsValid() ? m_Levels[0].width : 0; }
+		int GetHeight() const { return IsValid() ? m_Levels[0].height : 0; }
+		size_t GetNumLevels() const { return m_Levels.size(); }
+		size_t GetMemoryUsage() const;
+
+		// Level of detail for a pixel whose texture coordinate changes by dUVdx and dUVdy towards its neighbours
+		float GetLevelOfDetail(const Vector2& dUVdx, const Vector2& dUVdy) const;
+
+		// Trilinear lookup, the texture repeats outside [0, 1]
+		ColorRGB Sample(const Vector2& uv, float levelOfDetail) const;
+		ColorRGB Sample(const Vector2& uv, const Vector2& dUVdx, const Vector2& dUVdy) const;
+
+	private:
+		struct MipLevel
+		{
+			int width{};
+			int height{};
+			std::vector<uint32_t> texels{}; // RGBA, 8 bits per channel, red in the lowest byte
+		};
+
+		std::vector<MipLevel> m_Levels{};
+
+		void BuildMipLevels();
+		ColorRGB SampleBilinear(const MipLevel& level, const Vector2& uv) const;
+	};
+}
@@ -1,5 +1,6 @@
 #include "Timer.h"
 
+#include <cfloat>
 #include <iostream>
 #include <numeric>
 
@@ -25,11 +26,13 @@ void Timer::Reset()
 	m_FPSTimer = 0.0f;
 	m_FPSCount = 0;
 	m_IsStopped = false;
+	m_IsFixed = false;
 }
 
 void Timer::Start()
 {
 	const uint64_t startTime = SDL_GetPerformanceCounter();
+	m_IsFixed = false;
 
 	if (m_IsStopped)
 	{
@@ -66,6 +69,8 @@ void Timer::StartBenchmark(int numFrames)
 
 void Timer::Update()
 {
+	if (m_IsFixed) return;
+
 	if (m_IsStopped)
 	{
 		m_FPS = 0;
@@ -131,6 +136,13 @@ void Timer::Update()
 	}
 }
 
+void Timer::SetFixedTime(float totalTime)
+{
+	m_IsFixed = true;
+	m_TotalTime = totalTime;
+	m_ElapsedTime = 0.0f;
+}
+
 void Timer::Stop()
 {
 	if (!m_IsStopped)
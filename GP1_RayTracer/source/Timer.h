@@ -23,6 +23,9 @@ namespace dae
 		void Start();
 		void Update();
 		void Stop();
+		// Freezes the clock at totalTime with no elapsed time, Update leaves it there until Start or Reset
+		// Animated scenes then render the exact same frame every run (regression tests, offline renders)
+		void SetFixedTime(float totalTime);
 
 		uint32_t GetFPS() const { return m_FPS; };
 		float GetdFPS() const { return m_dFPS; };
@@ -48,6 +51,7 @@ namespace dae
 		float m_FPSTimer = 0.0f;
 
 		bool m_IsStopped = true;
+		bool m_IsFixed = false;
 		bool m_ForceElapsedUpperBound = false;
 
 		bool m_BenchmarkActive = false;
@@ -1,5 +1,10 @@
 #pragma once
+#include <cassert>
+#include <cstring>
 #include <fstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
 #include "Math.h"
 #include "DataTypes.h"
 
@@ -143,6 +148,7 @@ namespace dae
 				hitRecord.origin = ray.origin + ray.direction * t;
 				hitRecord.normal = Vector3::Cross(edge1, edge2).Normalized();
 				hitRecord.t = t;
+				hitRecord.barycentrics = Vector2{ u, v };
 
 				return true;
 			}
@@ -212,34 +218,346 @@ namespace dae
 		}
 #pragma endregion
 #pragma region TriangeMesh SlabTest
-		inline bool SlabTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
+		inline bool SlabTest_AABB(const Vector3& minAABB, const Vector3& maxAABB, const Ray& ray)
 		{
-			const float tx1{ (mesh.transformedMinAABB.x - ray.origin.x) / ray.direction.x };
-			const float tx2{ (mesh.transformedMaxAABB.x - ray.origin.x) / ray.direction.x };
+			const float tx1{ (minAABB.x - ray.origin.x) / ray.direction.x };
+			const float tx2{ (maxAABB.x - ray.origin.x) / ray.direction.x };
 
 			float tmin{ std::min(tx1, tx2) };
 			float tmax{ std::max(tx1, tx2) };
 
-			const float ty1{ (mesh.transformedMinAABB.y - ray.origin.y) / ray.direction.y };
-			const float ty2{ (mesh.transformedMaxAABB.y - ray.origin.y) / ray.direction.y };
+			const float ty1{ (minAABB.y - ray.origin.y) / ray.direction.y };
+			const float ty2{ (maxAABB.y - ray.origin.y) / ray.direction.y };
 
 			tmin = std::max(tmin, std::min(ty1, ty2));
 			tmax = std::min(tmax, std::max(ty1, ty2));
 
-			const float tz1{ (mesh.transformedMinAABB.z - ray.origin.z) / ray.direction.z };
-			const float tz2{ (mesh.transformedMaxAABB.z - ray.origin.z) / ray.direction.z };
+			const float tz1{ (minAABB.z - ray.origin.z) / ray.direction.z };
+			const float tz2{ (maxAABB.z - ray.origin.z) / ray.direction.z };
 
 			tmin = std::max(tmin, std::min(tz1, tz2));
 			tmax = std::min(tmax, std::max(tz1, tz2));
 
 			return tmax > 0.f && tmax >= tmin;
 		}
+
+		inline bool SlabTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray)
+		{
+			return SlabTest_AABB(mesh.transformedMinAABB, mesh.transformedMaxAABB, ray);
+		}
+#pragma endregion
+#pragma region BVH Traversal
+		// Nodes waiting to be visited, the binary tree leaves at most one node per level behind, the 4-wide tree at most three
+		// BVH::Build keeps every leaf within MaxDepth, the 4-wide tree is never deeper than the binary one it is collapsed from
+		constexpr int BVHStackSize{ 3 * static_cast<int>(BVH::MaxDepth) + 1 };
+
+		struct BVHStackEntry
+		{
+			uint32_t node{};
+			float distance{};
+		};
+
+		// Entry distance of the ray into the box, FLT_MAX when the box is missed or lies beyond maxDistance
+		inline float SlabDistance_AABB(const Vector3& minAABB, const Vector3& maxAABB, const Vector3& origin, const Vector3& inverseDirection, float maxDistance)
+		{
+			const float tx1{ (minAABB.x - origin.x) * inverseDirection.x };
+			const float tx2{ (maxAABB.x - origin.x) * inverseDirection.x };
+
+			float tmin{ std::min(tx1, tx2) };
+			float tmax{ std::max(tx1, tx2) };
+
+			const float ty1{ (minAABB.y - origin.y) * inverseDirection.y };
+			const float ty2{ (maxAABB.y - origin.y) * inverseDirection.y };
+
+			tmin = std::max(tmin, std::min(ty1, ty2));
+			tmax = std::min(tmax, std::max(ty1, ty2));
+
+			const float tz1{ (minAABB.z - origin.z) * inverseDirection.z };
+			const float tz2{ (maxAABB.z - origin.z) * inverseDirection.z };
+
+			tmin = std::max(tmin, std::min(tz1, tz2));
+			tmax = std::min(tmax, std::max(tz1, tz2));
+
+			return (tmax > 0.f && tmax >= tmin && tmin < maxDistance) ? tmin : FLT_MAX;
+		}
+
+		// Decodes the 4 child boxes of a quantized node and slab tests them at once
+		inline void SlabDistance_QuantizedChildren(const QuantizedBVHNode& node, const Vector3& origin, const Vector3& inverseDirection, float maxDistance, float distances[4])
+		{
+#ifdef USE_SSE
+			const __m128i zero{ _mm_setzero_si128() };
+			const auto decode{ [&zero](const uint8_t(&quantized)[4], float nodeOrigin, float nodeScale)
+				{
+					int32_t packed{};
+					std::memcpy(&packed, quantized, sizeof(packed));
+
+					__m128i widened{ _mm_cvtsi32_si128(packed) };
+					widened = _mm_unpacklo_epi8(widened, zero);
+					widened = _mm_unpacklo_epi16(widened, zero);
+
+					return _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(widened), _mm_set1_ps(nodeScale)), _mm_set1_ps(nodeOrigin));
+				} };
+
+			const auto slab{ [](__m128 minBound, __m128 maxBound, float rayOrigin, float rayInverseDirection, __m128& tmin, __m128& tmax)
+				{
+					const __m128 o{ _mm_set1_ps(rayOrigin) };
+					const __m128 invD{ _mm_set1_ps(rayInverseDirection) };
+
+					const __m128 t1{ _mm_mul_ps(_mm_sub_ps(minBound, o), invD) };
+					const __m128 t2{ _mm_mul_ps(_mm_sub_ps(maxBound, o), invD) };
+
+					tmin = _mm_max_ps(tmin, _mm_min_ps(t1, t2));
+					tmax = _mm_min_ps(tmax, _mm_max_ps(t1, t2));
+				} };
+
+			__m128 tmin{ _mm_set1_ps(-FLT_MAX) };
+			__m128 tmax{ _mm_set1_ps(FLT_MAX) };
+
+			slab(decode(node.minX, node.origin.x, node.scale.x), decode(node.maxX, node.origin.x, node.scale.x), origin.x, inverseDirection.x, tmin, tmax);
+			slab(decode(node.minY, node.origin.y, node.scale.y), decode(node.maxY, node.origin.y, node.scale.y), origin.y, inverseDirection.y, tmin, tmax);
+			slab(decode(node.minZ, node.origin.z, node.scale.z), decode(node.maxZ, node.origin.z, node.scale.z), origin.z, inverseDirection.z, tmin, tmax);
+
+			__m128 hit{ _mm_cmpge_ps(tmax, tmin) };
+			hit = _mm_and_ps(hit, _mm_cmpgt_ps(tmax, _mm_setzero_ps()));
+			hit = _mm_and_ps(hit, _mm_cmplt_ps(tmin, _mm_set1_ps(maxDistance)));
+
+			// Missed lanes become FLT_MAX
+			_mm_storeu_ps(distances, _mm_or_ps(_mm_and_ps(hit, tmin), _mm_andnot_ps(hit, _mm_set1_ps(FLT_MAX))));
+#else
+			for (int i{ 0 }; i < 4; ++i)
+			{
+				const Vector3 minAABB
+				{
+					node.origin.x + node.minX[i] * node.scale.x,
+					node.origin.y + node.minY[i] * node.scale.y,
+					node.origin.z + node.minZ[i] * node.scale.z
+				};
+				const Vector3 maxAABB
+				{
+					node.origin.x + node.maxX[i] * node.scale.x,
+					node.origin.y + node.maxY[i] * node.scale.y,
+					node.origin.z + node.maxZ[i] * node.scale.z
+				};
+
+				distances[i] = SlabDistance_AABB(minAABB, maxAABB, origin, inverseDirection, maxDistance);
+			}
+#endif
+			for (int i{ 0 }; i < 4; ++i)
+			{
+				if (node.children[i] == QuantizedBVHNode::EmptyChild) distances[i] = FLT_MAX;
+			}
+		}
+
+		// Tests one triangle of the mesh in object space, every hit shrinks ray.max so later hits are always closer
+		inline bool HitTest_MeshTriangle(const TriangleMesh& mesh, uint32_t triangleIndex, unsigned char materialIndex, TriangleCullMode cullMode, Ray& ray, HitRecord& closestHit, bool ignoreHitRecord)
+		{
+			const size_t i{ triangleIndex * size_t{ 3 } };
+
+			Triangle triangle{};
+			triangle.v0 = mesh.GetPosition(mesh.indices[i]);
+			triangle.v1 = mesh.GetPosition(mesh.indices[i + 1]);
+			triangle.v2 = mesh.GetPosition(mesh.indices[i + 2]);
+			triangle.materialIndex = materialIndex;
+			triangle.cullMode = cullMode;
+
+			if (!HitTest_Triangle(triangle, ray, closestHit, ignoreHitRecord)) return false;
+			if (ignoreHitRecord) return true;
+
+			ray.max = closestHit.t;
+			closestHit.triangleIndex = triangleIndex;
+			closestHit.pMesh = &mesh;
+			return true;
+		}
+
+		inline bool HitTest_BinaryBVH(const TriangleMesh& mesh, unsigned char materialIndex, TriangleCullMode cullMode, Ray& ray, HitRecord& closestHit, bool ignoreHitRecord)
+		{
+			const std::vector<BVHNode>& nodes{ mesh.bvh.GetNodes() };
+			const std::vector<uint32_t>& triangles{ mesh.bvh.GetTriangleIndices() };
+			const Vector3 inverseDirection{ 1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z };
+
+			BVHStackEntry stack[BVHStackSize];
+			int stackSize{ 0 };
+
+			const float rootDistance{ SlabDistance_AABB(nodes[0].minAABB, nodes[0].maxAABB, ray.origin, inverseDirection, ray.max) };
+			if (rootDistance == FLT_MAX) return false;
+			stack[stackSize++] = { 0, rootDistance };
+
+			bool didHit{ false };
+			while (stackSize > 0)
+			{
+				const BVHStackEntry entry{ stack[--stackSize] };
+
+				// A closer hit was found after this node was pushed
+				if (entry.distance >= ray.max) continue;
+
+				const BVHNode& node{ nodes[entry.node] };
+				if (node.triangleCount > 0)
+				{
+					for (uint32_t i{ node.leftFirst }; i < node.leftFirst + node.triangleCount; ++i)
+					{
+						if (HitTest_MeshTriangle(mesh, triangles[i], materialIndex, cullMode, ray, closestHit, ignoreHitRecord))
+						{
+							if (ignoreHitRecord) return true;
+							didHit = true;
+						}
+					}
+					continue;
+				}
+
+				uint32_t nearChild{ node.leftFirst };
+				uint32_t farChild{ node.leftFirst + 1 };
+				float nearDistance{ SlabDistance_AABB(nodes[nearChild].minAABB, nodes[nearChild].maxAABB, ray.origin, inverseDirection, ray.max) };
+				float farDistance{ SlabDistance_AABB(nodes[farChild].minAABB, nodes[farChild].maxAABB, ray.origin, inverseDirection, ray.max) };
+
+				if (nearDistance > farDistance)
+				{
+					std::swap(nearChild, farChild);
+					std::swap(nearDistance, farDistance);
+				}
+
+				// Far child first so the near child is popped next
+				assert(stackSize + 2 <= BVHStackSize);
+				if (farDistance != FLT_MAX) stack[stackSize++] = { farChild, farDistance };
+				if (nearDistance != FLT_MAX) stack[stackSize++] = { nearChild, nearDistance };
+			}
+
+			return didHit;
+		}
+
+		inline bool HitTest_QuantizedBVH(const TriangleMesh& mesh, unsigned char materialIndex, TriangleCullMode cullMode, Ray& ray, HitRecord& closestHit, bool ignoreHitRecord)
+		{
+			const std::vector<QuantizedBVHNode>& nodes{ mesh.bvh.GetQuantizedNodes() };
+			const std::vector<uint32_t>& triangles{ mesh.bvh.GetTriangleIndices() };
+			const Vector3 inverseDirection{ 1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z };
+
+			// Entries hold the encoded child, leaves are tested when they are popped so they are visited nearest first as well
+			BVHStackEntry stack[BVHStackSize];
+			int stackSize{ 0 };
+			stack[stackSize++] = { 0, 0.f };
+
+			bool didHit{ false };
+			while (stackSize > 0)
+			{
+				const BVHStackEntry entry{ stack[--stackSize] };
+				if (entry.distance >= ray.max) continue;
+
+				if (entry.node & QuantizedBVHNode::LeafFlag)
+				{
+					const uint32_t first{ entry.node & QuantizedBVHNode::LeafFirstMask };
+					const uint32_t count{ (entry.node >> QuantizedBVHNode::LeafCountShift) & QuantizedBVHNode::LeafCountMask };
+
+					for (uint32_t i{ first }; i < first + count; ++i)
+					{
+						if (HitTest_MeshTriangle(mesh, triangles[i], materialIndex, cullMode, ray, closestHit, ignoreHitRecord))
+						{
+							if (ignoreHitRecord) return true;
+							didHit = true;
+						}
+					}
+					continue;
+				}
+
+				const QuantizedBVHNode& node{ nodes[entry.node] };
+
+				float distances[4];
+				SlabDistance_QuantizedChildren(node, ray.origin, inverseDirection, ray.max, distances);
+
+				// Sort the children far to near, the nearest ends up on top of the stack
+				int order[4]{ 0, 1, 2, 3 };
+				for (int i{ 1 }; i < 4; ++i)
+				{
+					for (int j{ i }; j > 0 && distances[order[j - 1]] < distances[order[j]]; --j)
+					{
+						std::swap(order[j - 1], order[j]);
+					}
+				}
+
+				assert(stackSize + 4 <= BVHStackSize);
+				for (const int child : order)
+				{
+					if (distances[child] == FLT_MAX) continue;
+					stack[stackSize++] = { node.children[child], distances[child] };
+				}
+			}
+
+			return didHit;
+		}
 #pragma endregion
 #pragma region TriangeMesh HitTest
+		// Hit test against the untransformed mesh positions, the ray has to be in object space already
+		inline bool HitTest_ObjectSpaceMesh(const TriangleMesh& mesh, unsigned char materialIndex, TriangleCullMode cullMode, Ray& objectRay, HitRecord& closestHit, bool ignoreHitRecord)
+		{
+			switch (mesh.bvh.GetLayout())
+			{
+			case BVHLayout::Binary:
+				return HitTest_BinaryBVH(mesh, materialIndex, cullMode, objectRay, closestHit, ignoreHitRecord);
+			case BVHLayout::Quantized:
+				return HitTest_QuantizedBVH(mesh, materialIndex, cullMode, objectRay, closestHit, ignoreHitRecord);
+			default:
+				break;
+			}
+
+			bool didHit{ false };
+			const uint32_t numTriangles{ static_cast<uint32_t>(mesh.indices.size() / 3) };
+			for (uint32_t i{ 0 }; i < numTriangles; ++i)
+			{
+				if (HitTest_MeshTriangle(mesh, i, materialIndex, cullMode, objectRay, closestHit, ignoreHitRecord))
+				{
+					if (ignoreHitRecord) return true;
+					didHit = true;
+				}
+			}
+			return didHit;
+		}
+
+		// Bring the ray to object space instead of transforming the mesh
+		// The direction is not normalized so t stays the same in both spaces
+		inline Ray ToObjectSpace(const Matrix& inverseWorldTransform, const Ray& ray)
+		{
+			return Ray
+			{
+				inverseWorldTransform.TransformPoint(ray.origin),
+				inverseWorldTransform.TransformVector(ray.direction),
+				ray.min,
+				ray.max
+			};
+		}
+
+		// Back to world space, normals use the inverse transpose so non-uniform scales stay correct
+		// Compressed meshes decode the normal of the original triangle here, once for the closest hit
+		inline void ToWorldSpace(const Matrix& inverseWorldTransform, const Ray& ray, const HitRecord& objectHit, HitRecord& hitRecord)
+		{
+			const Matrix& inv{ inverseWorldTransform };
+			const Vector3 normal{ objectHit.pMesh && objectHit.pMesh->isCompressed ? objectHit.pMesh->GetTriangleNormal(objectHit.triangleIndex) : objectHit.normal };
+			hitRecord = objectHit;
+			hitRecord.origin = ray.origin + ray.direction * objectHit.t;
+			hitRecord.normal = Vector3
+			{
+				Vector3::Dot(inv.GetAxisX(), normal),
+				Vector3::Dot(inv.GetAxisY(), normal),
+				Vector3::Dot(inv.GetAxisZ(), normal)
+			}.Normalized();
+		}
+
 		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
 		{
 			// SlabTest
 			if (!SlabTest_TriangleMesh(mesh, ray)) return false;
+
+			if (mesh.bvh.IsBuilt())
+			{
+				Ray objectRay{ ToObjectSpace(mesh.inverseWorldTransform, ray) };
+				objectRay.max = std::min(ray.max, hitRecord.t);
+
+				HitRecord closestHit{};
+				if (!HitTest_ObjectSpaceMesh(mesh, mesh.materialIndex, mesh.cullMode, objectRay, closestHit, ignoreHitRecord)) return false;
+				if (ignoreHitRecord) return true;
+
+				ToWorldSpace(mesh.inverseWorldTransform, ray, closestHit, hitRecord);
+				hitRecord.pWorldTransform = &mesh.worldTransform;
+				return true;
+			}
+
 			// Each set of 3 indices represents a Triangle  use HitTest_Triangle to find the triangle of the TriangleMesh with the (!) closest hit
 			// Use the transformedPositions & transformedNormals to define each individual triangle!
 
@@ -247,14 +565,11 @@ namespace dae
 
 			for (size_t i{ 0 }; i < mesh.indices.size(); i += 3)
 			{
-				Triangle triangle
-				{
-					mesh.transformedPositions[mesh.indices[i]],
-					mesh.transformedPositions[mesh.indices[i + 1]],
-					mesh.transformedPositions[mesh.indices[i + 2]],
-					mesh.normals[mesh.indices[i]]
-				};
-
+				// HitTest_Triangle derives the normal from the edges, compressed meshes have no float normals to pass along
+				Triangle triangle{};
+				triangle.v0 = mesh.transformedPositions[mesh.indices[i]];
+				triangle.v1 = mesh.transformedPositions[mesh.indices[i + 1]];
+				triangle.v2 = mesh.transformedPositions[mesh.indices[i + 2]];
 				triangle.materialIndex = mesh.materialIndex;
 				triangle.cullMode = mesh.cullMode;
 
@@ -265,6 +580,9 @@ namespace dae
 					if (hitRecord.t > temp.t)
 					{
 						hitRecord = temp;
+						hitRecord.triangleIndex = static_cast<uint32_t>(i / 3);
+						hitRecord.pMesh = &mesh;
+						hitRecord.pWorldTransform = &mesh.worldTransform;
 					}
 				}
 			}
@@ -276,6 +594,95 @@ namespace dae
 			HitRecord temp{};
 			return HitTest_TriangleMesh(mesh, ray, temp, true);
 		}
+#pragma endregion
+#pragma region TriangleMeshInstance HitTest
+		inline bool HitTest_TriangleMeshInstance(const TriangleMeshInstance& instance, const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
+		{
+			if (!SlabTest_AABB(instance.transformedMinAABB, instance.transformedMaxAABB, ray)) return false;
+
+			// Same object space test as the meshes, so instances share the BVH of their mesh as well
+			Ray objectRay{ ToObjectSpace(instance.inverseWorldTransform, ray) };
+			objectRay.max = std::min(ray.max, hitRecord.t);
+
+			HitRecord closestHit{};
+			if (!HitTest_ObjectSpaceMesh(mesh, instance.materialIndex, instance.cullMode, objectRay, closestHit, ignoreHitRecord)) return false;
+			if (ignoreHitRecord) return true;
+
+			ToWorldSpace(instance.inverseWorldTransform, ray, closestHit, hitRecord);
+			hitRecord.pWorldTransform = &instance.worldTransform;
+			return true;
+		}
+
+		inline bool HitTest_TriangleMeshInstance(const TriangleMeshInstance& instance, const TriangleMesh& mesh, const Ray& ray)
+		{
+			HitRecord temp{};
+			return HitTest_TriangleMeshInstance(instance, mesh, ray, temp, true);
+		}
+#pragma endregion
+#pragma region Texture Coordinates
+		// Texture coordinate of a mesh hit plus how much it changes towards the next pixel in x and y (ray differentials)
+		// The neighbouring rays are intersected with the plane of the hit triangle and that offset is expressed in dP/du and dP/dv
+		inline Vector2 GetTextureCoordinate(const HitRecord& hitRecord, const Ray& ray, const RayDifferentials& differentials, Vector2& dUVdx, Vector2& dUVdy)
+		{
+			dUVdx = {};
+			dUVdy = {};
+
+			const TriangleMesh& mesh{ *hitRecord.pMesh };
+			const size_t i{ hitRecord.triangleIndex * size_t{ 3 } };
+			const int i0{ mesh.indices[i] };
+			const int i1{ mesh.indices[i + 1] };
+			const int i2{ mesh.indices[i + 2] };
+
+			const Vector2& uv0{ mesh.uvs[i0] };
+			const Vector2& uv1{ mesh.uvs[i1] };
+			const Vector2& uv2{ mesh.uvs[i2] };
+
+			const float w1{ hitRecord.barycentrics.x };
+			const float w2{ hitRecord.barycentrics.y };
+			const Vector2 uv{ uv0 * (1.f - w1 - w2) + uv1 * w1 + uv2 * w2 };
+
+			// dP/du and dP/dv of the triangle in world space
+			const Matrix& worldTransform{ *hitRecord.pWorldTransform };
+			const Vector3 p0{ mesh.GetPosition(i0) };
+			const Vector3 edge1{ worldTransform.TransformVector(mesh.GetPosition(i1) - p0) };
+			const Vector3 edge2{ worldTransform.TransformVector(mesh.GetPosition(i2) - p0) };
+			const Vector2 deltaUV1{ uv1 - uv0 };
+			const Vector2 deltaUV2{ uv2 - uv0 };
+
+			const float uvDeterminant{ Vector2::Cross(deltaUV1, deltaUV2) };
+			if (std::abs(uvDeterminant) < FLT_EPSILON) return uv;
+
+			const Vector3 dpdu{ (edge1 * deltaUV2.y - edge2 * deltaUV1.y) / uvDeterminant };
+			const Vector3 dpdv{ (edge2 * deltaUV1.x - edge1 * deltaUV2.x) / uvDeterminant };
+
+			// Offset from the hit point to where a neighbouring ray hits the plane of the triangle
+			const Vector3& normal{ hitRecord.normal };
+			const float planeDistance{ Vector3::Dot(normal, hitRecord.origin - ray.origin) };
+			const auto offsetOnPlane{ [&](const Vector3& direction)
+				{
+					const float denominator{ Vector3::Dot(normal, direction) };
+					if (std::abs(denominator) < FLT_EPSILON) return Vector3{};
+					return ray.origin + direction * (planeDistance / denominator) - hitRecord.origin;
+				} };
+
+			// Least squares solution of offset = du * dP/du + dv * dP/dv
+			const float uDotU{ Vector3::Dot(dpdu, dpdu) };
+			const float uDotV{ Vector3::Dot(dpdu, dpdv) };
+			const float vDotV{ Vector3::Dot(dpdv, dpdv) };
+			const float determinant{ uDotU * vDotV - uDotV * uDotV };
+			if (std::abs(determinant) < FLT_EPSILON * uDotU * vDotV) return uv;
+
+			const auto toTextureSpace{ [&](const Vector3& offset)
+				{
+					const float u{ Vector3::Dot(dpdu, offset) };
+					const float v{ Vector3::Dot(dpdv, offset) };
+					return Vector2{ (vDotV * u - uDotV * v) / determinant, (uDotU * v - uDotV * u) / determinant };
+				} };
+
+			dUVdx = toTextureSpace(offsetOnPlane(differentials.directionX));
+			dUVdy = toTextureSpace(offsetOnPlane(differentials.directionY));
+			return uv;
+		}
 #pragma endregion
 	}
 	namespace LightUtils
@@ -302,21 +709,29 @@ namespace dae
 
 	namespace Utils
 	{
-		//Just parses vertices and indices
+		//Parses vertices, texture coordinates and indices
+		//Faces can be "f v v v", "f v/vt v/vt v/vt" or "f v/vt/vn ...", every unique position/texture coordinate pair becomes one vertex
+		//uvs stays empty when the file has no texture coordinates
 #pragma warning(push)
 #pragma warning(disable : 4505) //Warning unreferenced local function
-		static bool ParseOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices)
+		static bool ParseOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices, std::vector<Vector2>& uvs)
 		{
 			std::ifstream file(filename);
 			if (!file)
 				return false;
 
+			std::vector<Vector3> filePositions{};
+			std::vector<Vector2> fileUVs{};
+			std::vector<std::pair<int, int>> corners{}; // (position, texture coordinate) per face corner
+
 			std::string sCommand;
 			// start a while iteration ending when the end of file is reached (ios::eof)
 			while (!file.eof())
 			{
 				//read the first word of the string, use the >> operator (istream::operator>>)
-				file >> sCommand;
+				//a trailing newline only hits the end of the file here, the previous command must not be repeated
+				if (!(file >> sCommand))
+					break;
 				//use conditional statements to process the different commands
 				if (sCommand == "#")
 				{
@@ -327,16 +742,28 @@ namespace dae
 					//Vertex
 					float x, y, z;
 					file >> x >> y >> z;
-					positions.push_back({ x, y, z });
+					filePositions.push_back({ x, y, z });
+				}
+				else if (sCommand == "vt")
+				{
+					//Texture coordinate, flipped because the images are stored top row first
+					float u, v;
+					file >> u >> v;
+					fileUVs.push_back({ u, 1.f - v });
 				}
 				else if (sCommand == "f")
 				{
-					float i0, i1, i2;
-					file >> i0 >> i1 >> i2;
+					for (int i{ 0 }; i < 3; ++i)
+					{
+						std::string corner;
+						file >> corner;
+
+						const size_t slash{ corner.find('/') };
+						const bool hasUV{ slash != std::string::npos && slash + 1 < corner.size() && corner[slash + 1] != '/' };
 
-					indices.push_back(static_cast<int>(i0) - 1);
-					indices.push_back(static_cast<int>(i1) - 1);
-					indices.push_back(static_cast<int>(i2) - 1);
+						//OBJ format uses 1-based arrays
+						corners.emplace_back(std::stoi(corner) - 1, hasUV ? std::stoi(corner.substr(slash + 1)) - 1 : -1);
+					}
 				}
 				//read till end of line and ignore all remaining chars
 				file.ignore(1000, '\n');
@@ -345,6 +772,31 @@ namespace dae
 					break;
 			}
 
+			if (fileUVs.empty())
+			{
+				//Positions are used as they are
+				positions = std::move(filePositions);
+				for (const auto& corner : corners)
+				{
+					indices.push_back(corner.first);
+				}
+			}
+			else
+			{
+				std::unordered_map<uint64_t, int> vertices{};
+				for (const auto& corner : corners)
+				{
+					const uint64_t key{ static_cast<uint64_t>(static_cast<uint32_t>(corner.first)) << 32 | static_cast<uint32_t>(corner.second) };
+					const auto vertex{ vertices.try_emplace(key, static_cast<int>(positions.size())) };
+					if (vertex.second)
+					{
+						positions.push_back(filePositions[corner.first]);
+						uvs.push_back(corner.second >= 0 ? fileUVs[corner.second] : Vector2{});
+					}
+					indices.push_back(vertex.first->second);
+				}
+			}
+
 			//Precompute normals
 			for (uint64_t index = 0; index < indices.size(); index += 3)
 			{
@@ -362,6 +814,13 @@ namespace dae
 
 			return true;
 		}
+
+		//Just parses vertices and indices
+		static bool ParseOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices)
+		{
+			std::vector<Vector2> uvs{};
+			return ParseOBJ(filename, positions, normals, indices, uvs);
+		}
 #pragma warning(pop)
 	}
 }
@@ -0,0 +1,202 @@
+#include "VisibilityCache.h"
+
+//Project includes
+#include "Sampler.h" //HashCombine
+#include "Utils.h"
+
+//Standard includes
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <mutex>
+
+namespace dae
+{
+	VisibilityCache::Key VisibilityCache::GetKey(const Vector3& position, const Vector3& normal, uint32_t lightIndex, float footprint)
+	{
+		// Rounded down, a cell is never bigger than the pixel, so the cached answers stay close to what the pixel itself would trace
+		const int level{ static_cast<int>(std::floor(std::log2(std::max(footprint, 1e-6f)))) };
+		const float inverseCellSize{ std::ldexp(1.f, -level) };
+
+		const auto getNormalBits{ [](float component) { return static_cast<uint8_t>(std::lround(component) + 1); } };
+
+		return Key
+		{
+			static_cast<int32_t>(std::floor(position.x * inverseCellSize)),
+			static_cast<int32_t>(std::floor(position.y * inverseCellSize)),
+			static_cast<int32_t>(std::floor(position.z * inverseCellSize)),
+			static_cast<int16_t>(level),
+			static_cast<uint8_t>(getNormalBits(normal.x) | getNormalBits(normal.y) << 2 | getNormalBits(normal.z) << 4),
+			static_cast<uint8_t>(lightIndex)
+		};
+	}
+
+	bool VisibilityCache::Lookup(const Key& key, bool& isVisible) const
+	{
+		m_NumLookups.fetch_add(1, std::memory_order_relaxed);
+
+		const Key blockKey{ GetBlockKey(key) };
+		const uint32_t hash{ GetHash(blockKey) };
+		const Shard& shard{ m_Shards[hash >> 26] };
+		const std::shared_lock lock{ shard.mutex };
+
+		if (shard.blocks.empty()) return false;
+
+		const Block& block{ shard.blocks[FindSlot(shard.blocks, blockKey, hash)] };
+		const uint64_t cellBit{ GetCellBit(key) };
+		if (!(block.knownCells & cellBit)) return false;
+
+		m_NumHits.fetch_add(1, std::memory_order_relaxed);
+		isVisible = block.visibleCells & cellBit;
+		return true;
+	}
+
+	void VisibilityCache::Insert(const Key& key, bool isVisible)
+	{
+		const Key blockKey{ GetBlockKey(key) };
+		const uint32_t hash{ GetHash(blockKey) };
+		Shard& shard{ m_Shards[hash >> 26] };
+		const std::lock_guard lock{ shard.mutex };
+
+		if (shard.numBlocks >= m_MaxBlocksPerShard)
+		{
+			shard.blocks.assign(shard.blocks.size(), Block{});
+			shard.numBlocks = 0;
+		}
+		else if (2 * (shard.numBlocks + 1) > shard.blocks.size())
+		{
+			Rehash(shard, std::max(2 * shard.blocks.size(), m_InitialBlocksPerShard));
+		}
+
+		Block& block{ shard.blocks[FindSlot(shard.blocks, blockKey, hash)] };
+		if (!block.knownCells)
+		{
+			block.key = blockKey;
+			++shard.numBlocks;
+		}
+
+		// Two threads can trace the same cell at once, the first answer stays
+		const uint64_t cellBit{ GetCellBit(key) };
+		if (block.knownCells & cellBit) return;
+
+		block.knownCells |= cellBit;
+		if (isVisible) block.visibleCells |= cellBit;
+	}
+
+	void VisibilityCache::Clear()
+	{
+		for (Shard& shard : m_Shards)
+		{
+			const std::lock_guard lock{ shard.mutex };
+			shard.blocks.clear();
+			shard.numBlocks = 0;
+		}
+	}
+
+	void VisibilityCache::Invalidate(const std::vector<MovedBounds>& movedBounds, std::span<const Light> lights)
+	{
+		if (movedBounds.empty()) return;
+
+		const auto isAffected{ [&](const Key& blockKey)
+			{
+				if (blockKey.lightIndex >= lights.size()) return true;
+
+				// Every point of the block is within half a block of its center, a box grown by a block covers the segments of all of them
+				const float blockSize{ std::ldexp(1.f, blockKey.level + m_BlockSizeLog2) };
+				const Vector3 center
+				{
+					(static_cast<float>(blockKey.x) + .5f) * blockSize,
+					(static_cast<float>(blockKey.y) + .5f) * blockSize,
+					(static_cast<float>(blockKey.z) + .5f) * blockSize
+				};
+				const Vector3 margin{ blockSize, blockSize, blockSize };
+				const Vector3 toLight{ LightUtils::GetDirectionToLight(lights[blockKey.lightIndex], center) };
+				const Vector3 inverseDirection{ 1.f / toLight.x, 1.f / toLight.y, 1.f / toLight.z };
+
+				for (const MovedBounds& bounds : movedBounds)
+				{
+					// From the block (t = 0) to the light (t = 1)
+					if (GeometryUtils::SlabDistance_AABB(bounds.minAABB - margin, bounds.maxAABB + margin, center, inverseDirection, 1.f) != FLT_MAX) return true;
+				}
+				return false;
+			} };
+
+		for (Shard& shard : m_Shards)
+		{
+			const std::lock_guard lock{ shard.mutex };
+
+			// Linear probing can't leave holes behind, the shard is built again from what is left
+			std::vector<Block> blocks{ std::move(shard.blocks) };
+			shard.blocks.assign(blocks.size(), Block{});
+			shard.numBlocks = 0;
+			for (const Block& block : blocks)
+			{
+				if (!block.knownCells || isAffected(block.key)) continue;
+
+				shard.blocks[FindSlot(shard.blocks, block.key, GetHash(block.key))] = block;
+				++shard.numBlocks;
+			}
+		}
+	}
+
+	void VisibilityCache::ResetStatistics()
+	{
+		m_NumLookups = 0;
+		m_NumHits = 0;
+	}
+
+	size_t VisibilityCache::GetNumCells() const
+	{
+		size_t numCells{ 0 };
+		for (const Shard& shard : m_Shards)
+		{
+			const std::shared_lock lock{ shard.mutex };
+			for (const Block& block : shard.blocks)
+			{
+				numCells += std::popcount(block.knownCells);
+			}
+		}
+		return numCells;
+	}
+
+	VisibilityCache::Key VisibilityCache::GetBlockKey(const Key& key)
+	{
+		// Arithmetic shifts, negative cells round down like the positive ones
+		return Key{ key.x >> m_BlockSizeLog2, key.y >> m_BlockSizeLog2, key.z >> m_BlockSizeLog2, key.level, key.normal, key.lightIndex };
+	}
+
+	uint64_t VisibilityCache::GetCellBit(const Key& key)
+	{
+		constexpr int32_t cellMask{ (1 << m_BlockSizeLog2) - 1 };
+		return uint64_t{ 1 } << ((key.x & cellMask) | (key.y & cellMask) << m_BlockSizeLog2 | (key.z & cellMask) << (2 * m_BlockSizeLog2));
+	}
+
+	uint32_t VisibilityCache::GetHash(const Key& blockKey)
+	{
+		// The top 6 bits pick the shard, the low bits the slot
+		uint32_t hash{ HashCombine(static_cast<uint32_t>(blockKey.x), static_cast<uint32_t>(blockKey.y)) };
+		hash = HashCombine(hash, static_cast<uint32_t>(blockKey.z));
+		return HashCombine(hash, static_cast<uint32_t>(static_cast<uint16_t>(blockKey.level)) | static_cast<uint32_t>(blockKey.normal) << 16
+			| static_cast<uint32_t>(blockKey.lightIndex) << 24);
+	}
+
+	size_t VisibilityCache::FindSlot(const std::vector<Block>& blocks, const Key& blockKey, uint32_t hash)
+	{
+		// Never full, the probe always ends
+		const size_t mask{ blocks.size() - 1 };
+		for (size_t index{ hash & mask };; index = (index + 1) & mask)
+		{
+			if (!blocks[index].knownCells || blocks[index].key == blockKey) return index;
+		}
+	}
+
+	void VisibilityCache::Rehash(Shard& shard, size_t numSlots)
+	{
+		std::vector<Block> blocks{ std::move(shard.blocks) };
+		shard.blocks.assign(numSlots, Block{});
+		for (const Block& block : blocks)
+		{
+			if (block.knownCells) shard.blocks[FindSlot(shard.blocks, block.key, GetHash(block.key))] = block;
+		}
+	}
+}
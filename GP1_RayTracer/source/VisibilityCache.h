@@ -0,0 +1,96 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <shared_mutex>
+#include <span>
+#include <vector>
+
+#include "DataTypes.h"
+
+namespace dae
+{
+	/**
+	 * \brief Whether a light reaches a world space point, shared by every pixel (and frame) whose hit lands in the same cell
+	 * The cells are a hashed grid with a power of two size per level, a hit picks the level of its pixel's footprint so a cell covers about a pixel
+	 * Cells are stored in blocks of 4x4x4, neighbouring pixels land in the same block and find it in the CPU cache
+	 * Shadow rays don't depend on the camera, while the geometry doesn't move the answers stay valid when the camera moves
+	 */
+	class VisibilityCache final
+	{
+	public:
+		struct Key
+		{
+			int32_t x{};
+			int32_t y{};
+			int32_t z{};
+			int16_t level{}; // Cell size is 2^level
+			uint8_t normal{}; // Every component rounded to -1, 0 or 1, the two sides of a thin surface get their own cells
+			uint8_t lightIndex{};
+
+			bool operator==(const Key&) const = default;
+		};
+
+		VisibilityCache() = default;
+		~VisibilityCache() = default;
+
+		VisibilityCache(const VisibilityCache&) = delete;
+		VisibilityCache(VisibilityCache&&) noexcept = delete;
+		VisibilityCache& operator=(const VisibilityCache&) = delete;
+		VisibilityCache& operator=(VisibilityCache&&) noexcept = delete;
+
+		// footprint is the world space size of a pixel at the hit
+		static Key GetKey(const Vector3& position, const Vector3& normal, uint32_t lightIndex, float footprint);
+
+		// Thread safe, also while other threads insert
+		bool Lookup(const Key& key, bool& isVisible) const;
+		void Insert(const Key& key, bool isVisible);
+
+		void Clear();
+		// Drops every cell whose shadow segments to its light can pass through a moved box, the lights are the ones the cells were made with
+		void Invalidate(const std::vector<MovedBounds>& movedBounds, std::span<const Light> lights);
+
+		// Lookups and hits since the last call, every hit is a DoesHit that wasn't traced
+		void ResetStatistics();
+		uint32_t GetNumLookups() const { return m_NumLookups; }
+		uint32_t GetNumHits() const { return m_NumHits; }
+		// Cells with an answer
+		size_t GetNumCells() const;
+
+	private:
+		// One bit per cell of the block, the key holds the block coordinates
+		struct Block
+		{
+			Key key{};
+			uint64_t knownCells{}; // 0 for an empty slot
+			uint64_t visibleCells{};
+		};
+
+		// Open addressing with linear probing, a chained map pays a cache miss per bucket and per node
+		// Every pixel looks up every light, one lock for the whole cache would be fought over by all threads
+		struct Shard
+		{
+			mutable std::shared_mutex mutex{};
+			std::vector<Block> blocks{}; // Power of two size, at most half full
+			size_t numBlocks{};
+		};
+
+		static constexpr int m_BlockSizeLog2{ 2 };
+		static constexpr uint32_t m_NumShards{ 64 };
+		static constexpr size_t m_InitialBlocksPerShard{ 1u << 8 };
+		// A camera flying around keeps adding cells, a full shard starts over
+		static constexpr size_t m_MaxBlocksPerShard{ 1u << 14 };
+
+		std::array<Shard, m_NumShards> m_Shards{};
+
+		mutable std::atomic<uint32_t> m_NumLookups{};
+		mutable std::atomic<uint32_t> m_NumHits{};
+
+		static Key GetBlockKey(const Key& key);
+		static uint64_t GetCellBit(const Key& key);
+		static uint32_t GetHash(const Key& blockKey);
+		// The slot holding the block, or the empty slot it goes in
+		static size_t FindSlot(const std::vector<Block>& blocks, const Key& blockKey, uint32_t hash);
+		static void Rehash(Shard& shard, size_t numSlots);
+	};
+}
@@ -1,16 +1,33 @@
 //External includes
+#if defined(_WIN32)
 #include "vld.h"
+#endif
 #include "SDL.h"
 #include "SDL_surface.h"
 #undef main
 
 //Standard includes
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
 
 //Project includes
 #include "Timer.h"
 #include "Renderer.h"
 #include "Scene.h"
+#include "DistributedRenderer.h"
+#include "RegressionSuite.h"
+#include "AnimationRenderer.h"
+#include "Parallel.h"
+#include "Benchmark.h"
 
 using namespace dae;
 
@@ -20,18 +37,855 @@ void ShutDown(SDL_Window* pWindow)
 	SDL_Quit();
 }
 
-int main(int argc, char* args[])
+// Value following "--name" on the command line
+uint32_t GetOption(int argc, char* args[], const char* name, uint32_t defaultValue)
 {
-	//Unreferenced parameters
-	(void)argc;
-	(void)args;
+	for (int i{ 1 }; i + 1 < argc; ++i)
+	{
+		if (std::strcmp(args[i], name) == 0)
+			return static_cast<uint32_t>(std::stoul(args[i + 1]));
+	}
+	return defaultValue;
+}
 
-	//Create window + surfaces
-	SDL_Init(SDL_INIT_VIDEO);
+float GetFloatOption(int argc, char* args[], const char* name, float defaultValue)
+{
+	for (int i{ 1 }; i + 1 < argc; ++i)
+	{
+		if (std::strcmp(args[i], name) == 0)
+			return std::stof(args[i + 1]);
+	}
+	return defaultValue;
+}
+
+// Scene named right after the mode, "RayTracer --mode [scene] [--options]"
+std::string GetSceneArgument(int argc, char* args[], const char* defaultScene)
+{
+	return argc > 2 && std::strncmp(args[2], "--", 2) != 0 ? args[2] : defaultScene;
+}
+
+// Headless offline render of a registered scene, the tiles are rendered by worker processes
+// RayTracer --coordinator <scene> [--workers N] [--spawn N] [--port P] [--frames N] [--tile N]
+int RunCoordinator(int argc, char* args[], uint32_t width, uint32_t height)
+{
+	// Writes the snapshot before any worker starts, so the workers only have to load it
+	const std::string sceneName{ argc > 2 ? args[2] : "" };
+	const std::unique_ptr<Scene> pScene{ Benchmark::LoadScene(sceneName) };
+	if (!pScene) return 1;
+
+	const uint32_t numWorkers{ GetOption(argc, args, "--workers", std::max(std::thread::hardware_concurrency(), 1u)) };
+	const uint32_t numLocalWorkers{ GetOption(argc, args, "--spawn", numWorkers) };
+	const uint16_t port{ static_cast<uint16_t>(GetOption(argc, args, "--port", 0)) };
+	const uint32_t numFrames{ GetOption(argc, args, "--frames", 10) };
+	const uint32_t tileSize{ GetOption(argc, args, "--tile", 32) };
+
+	const auto pRenderer{ std::make_unique<Renderer>(static_cast<int>(width), static_cast<int>(height)) };
+	const auto pCoordinator{ std::make_unique<RenderCoordinator>(pRenderer.get(), tileSize) };
+
+	if (pCoordinator->Start(sceneName, numWorkers, numLocalWorkers, port))
+	{
+		float totalTime{ 0.f };
+		for (uint32_t frame{ 0 }; frame < numFrames; ++frame)
+		{
+			const auto start{ std::chrono::steady_clock::now() };
+			pCoordinator->RenderFrame(pScene.get());
+			const float frameTime{ std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count() };
+
+			totalTime += frameTime;
+			std::cout << "Frame " << frame << ": " << frameTime * 1000.f << "ms | primary rays/s: " << static_cast<float>(width * height) / frameTime << '\n';
+		}
+
+		if (numFrames > 0)
+			std::cout << "Average primary rays/s: " << static_cast<float>(width * height * numFrames) / totalTime << '\n';
+
+		pCoordinator->PrintStatistics();
+
+		if (!pRenderer->SaveBufferToImage())
+			std::cout << "Last frame saved!\n";
+	}
+
+	return 0;
+}
+
+// Headless golden image and performance check, exits with 1 when an image differs or a scene got slower
+// RayTracer --regression [scene...] [--frames N] [--tolerance N] [--mismatch N] [--threshold percent] [--record] [--pin]
+int RunRegression(int argc, char* args[], uint32_t width, uint32_t height)
+{
+	RegressionOptions options{};
+	options.numFrames = GetOption(argc, args, "--frames", options.numFrames);
+	options.tolerance = static_cast<int>(GetOption(argc, args, "--tolerance", static_cast<uint32_t>(options.tolerance)));
+	options.maxMismatchedPixels = GetOption(argc, args, "--mismatch", options.maxMismatchedPixels);
+	options.threshold = GetFloatOption(argc, args, "--threshold", options.threshold);
+
+	// Every argument that is not an option or its value names a scene
+	std::vector<std::string> sceneNames{};
+	for (int i{ 2 }; i < argc; ++i)
+	{
+		if (std::strcmp(args[i], "--record") == 0)
+			options.record = true;
+		else if (std::strcmp(args[i], "--pin") == 0)
+			continue; // Flag without a value, main applies it
+		else if (std::strncmp(args[i], "--", 2) == 0)
+			++i;
+		else
+			sceneNames.emplace_back(args[i]);
+	}
+
+	if (sceneNames.empty())
+		sceneNames = RegressionSuite::GetDefaultScenes();
 
+	RegressionSuite regressionSuite{ static_cast<int>(width), static_cast<int>(height), options };
+	return regressionSuite.Run(sceneNames) ? 0 : 1;
+}
+
+// Headless offline render of an animated scene to numbered images, several frames at the same time
+// RayTracer --animation <scene> [--start seconds] [--frames N] [--fps N] [--inflight N] [--output directory]
+int RunAnimation(int argc, char* args[], uint32_t width, uint32_t height)
+{
+	const std::string sceneName{ argc > 2 && std::strncmp(args[2], "--", 2) != 0 ? args[2] : "W4_Bunny" };
+
+	AnimationOptions options{};
+	options.startTime = GetFloatOption(argc, args, "--start", options.startTime);
+	options.numFrames = GetOption(argc, args, "--frames", options.numFrames);
+	options.framesPerSecond = GetFloatOption(argc, args, "--fps", options.framesPerSecond);
+	options.numFramesInFlight = GetOption(argc, args, "--inflight", options.numFramesInFlight);
+	for (int i{ 2 }; i + 1 < argc; ++i)
+	{
+		if (std::strcmp(args[i], "--output") == 0)
+			options.directory = args[i + 1];
+	}
+
+	AnimationRenderer animationRenderer{ static_cast<int>(width), static_cast<int>(height), options };
+	return animationRenderer.Render(sceneName) ? 0 : 1;
+}
+
+// Headless, renders the scene with and without sorted shadow rays for a range of batch sizes
+// RayTracer --raysort [scene] [--frames N]
+int RunRaySortBenchmark(int argc, char* args[], uint32_t width, uint32_t height)
+{
+	const std::string sceneName{ GetSceneArgument(argc, args, "BVH_Dense") };
+	const std::unique_ptr<Scene> pScene{ Benchmark::LoadScene(sceneName) };
+	if (!pScene) return 1;
+
+	const uint32_t numFrames{ std::max(GetOption(argc, args, "--frames", 5), 1u) };
+
+	const auto pRenderer{ Benchmark::CreateRenderer(static_cast<int>(width), static_cast<int>(height)) };
+
+	// Both orders trace the same shadow rays, the count of a sorted frame is used for every run
+	pRenderer->SetRaySorting(true);
+	pRenderer->Render(pScene.get());
+	const uint32_t numRays{ width * height + pRenderer->GetNumShadowRays() };
+
+	const auto measure{ [&](const char* label)
+		{
+			const float frameTime{ Benchmark::MeasureMedian(numFrames, [&]() { pRenderer->Render(pScene.get()); }) };
+			std::cout << label << ": " << frameTime << "ms | rays/s (primary + shadow): " << static_cast<float>(numRays) / (frameTime / 1000.f) << '\n';
+		} };
+
+	std::cout << sceneName << ", " << numRays << " rays per frame, median of " << numFrames << " frames\n";
+
+	pRenderer->SetRaySorting(false);
+	measure("Unsorted");
+
+	pRenderer->SetRaySorting(true);
+	for (uint32_t batchSize{ 256 }; batchSize <= 65536; batchSize *= 4)
+	{
+		pRenderer->SetRaySortBatchSize(batchSize);
+		measure(("Sorted, batch " + std::to_string(batchSize)).c_str());
+	}
+
+	return 0;
+}
+
+// Headless, error of anti-aliased renders against a converged one, white noise against the Sobol sequence
+// RayTracer --sampling [scene] [--size N]
+int RunSamplingBenchmark(int argc, char* args[])
+{
+	const std::string sceneName{ GetSceneArgument(argc, args, "W4_Reference") };
+	const std::unique_ptr<Scene> pScene{ Benchmark::LoadScene(sceneName) };
+	if (!pScene) return 1;
+
+	// Small, the reference alone traces 1024 samples per pixel
+	const int width{ static_cast<int>(GetOption(argc, args, "--size", 160)) };
+	const int height{ width * 3 / 4 };
+	const size_t numValues{ static_cast<size_t>(width * height * 3) };
+
+	const auto pRenderer{ Benchmark::CreateRenderer(width, height) };
+
+	std::vector<uint8_t> pixels(numValues);
+	const auto render{ [&](SampleSequence sequence, uint32_t numSamples, uint32_t seed)
+		{
+			pRenderer->SetSampleSequence(sequence);
+			pRenderer->SetSamplesPerPixel(numSamples);
+			pRenderer->SetSampleSeed(seed);
+			pRenderer->Render(pScene.get());
+			pRenderer->ReadRect(0, 0, width, height, pixels.data());
+		} };
+
+	// 16 independent 64 sample renders
+	constexpr uint32_t numReferenceRenders{ 16 };
+	std::vector<float> reference(numValues);
+	for (uint32_t seed{ 0 }; seed < numReferenceRenders; ++seed)
+	{
+		render(SampleSequence::Random, 64, 1000 + seed);
+		for (size_t i{ 0 }; i < numValues; ++i)
+			reference[i] += static_cast<float>(pixels[i]) / numReferenceRenders;
+	}
+
+	// Averaged over a few seeds, a single render can be lucky
+	constexpr uint32_t numSeeds{ 4 };
+	const auto getError{ [&](SampleSequence sequence, uint32_t numSamples)
+		{
+			double squaredError{ 0.0 };
+			for (uint32_t seed{ 0 }; seed < numSeeds; ++seed)
+			{
+				render(sequence, numSamples, seed);
+				for (size_t i{ 0 }; i < numValues; ++i)
+					squaredError += Square(static_cast<float>(pixels[i]) - reference[i]);
+			}
+			return static_cast<float>(std::sqrt(squaredError / static_cast<double>(numValues * numSeeds)));
+		} };
+
+	std::cout << sceneName << " at " << width << 'x' << height << ", RMSE (0-255) against " << numReferenceRenders * 64 << " samples per pixel\n";
+	for (uint32_t numSamples{ 1 }; numSamples <= 64; numSamples *= 4)
+	{
+		const float randomError{ getError(SampleSequence::Random, numSamples) };
+		const float sobolError{ getError(SampleSequence::Sobol, numSamples) };
+		std::cout << numSamples << " spp: random " << randomError << " | sobol " << sobolError << " (" << randomError / sobolError << "x lower)\n";
+	}
+
+	return 0;
+}
+
+// Headless, one bounce of diffuse light traced at every pixel against the irradiance cache, a cold and a warm frame
+// RayTracer --irradiance [scene] [--size N]
+int RunIrradianceBenchmark(int argc, char* args[])
+{
+	const std::string sceneName{ GetSceneArgument(argc, args, "W4_Reference") };
+	const std::unique_ptr<Scene> pScene{ Benchmark::LoadScene(sceneName) };
+	if (!pScene) return 1;
+
+	// Small, the reference traces a full hemisphere at every pixel
+	const int width{ static_cast<int>(GetOption(argc, args, "--size", 160)) };
+	const int height{ width * 3 / 4 };
+	const size_t numValues{ static_cast<size_t>(width * height * 3) };
+
+	const auto pRenderer{ Benchmark::CreateRenderer(width, height) };
+
+	std::vector<uint8_t> reference(numValues);
+	std::vector<uint8_t> pixels(numValues);
+	const auto render{ [&](const char* label, std::vector<uint8_t>& result)
+		{
+			const float frameTime{ Benchmark::Measure([&]() { pRenderer->Render(pScene.get()); }) };
+			pRenderer->ReadRect(0, 0, width, height, result.data());
+
+			double squaredError{ 0.0 };
+			for (size_t i{ 0 }; i < numValues; ++i)
+				squaredError += Square(static_cast<float>(result[i]) - static_cast<float>(reference[i]));
+
+			std::cout << label << ": " << frameTime << "ms | " << pRenderer->GetNumIndirectRays() << " indirect rays | "
+				<< pRenderer->GetNumIrradianceRecords() << " records | RMSE (0-255) " << std::sqrt(squaredError / static_cast<double>(numValues)) << '\n';
+		} };
+
+	std::cout << sceneName << " at " << width << 'x' << height << '\n';
+
+	// Off -> hemisphere -> irradiance cache
+	pRenderer->CycleIndirectLighting();
+	render("Every pixel", reference);
+	pRenderer->CycleIndirectLighting();
+	render("Irradiance cache, cold", pixels);
+	render("Irradiance cache, warm", pixels);
+
+	// The records may not depend on which thread got to a part of the screen first
+	bool isSameImage{ true };
+	for (const uint32_t numThreads : { 1u, 16u })
+	{
+		const ConcurrencyLimit concurrencyLimit{ numThreads };
+		const auto pThreadRenderer{ Benchmark::CreateRenderer(width, height) };
+		pThreadRenderer->CycleIndirectLighting();
+		pThreadRenderer->CycleIndirectLighting();
+		pThreadRenderer->Render(pScene.get());
+
+		std::vector<uint8_t> result(numValues);
+		pThreadRenderer->ReadRect(0, 0, width, height, result.data());
+		const bool isSame{ result == pixels };
+		isSameImage &= isSame;
+		std::cout << "Irradiance cache, " << numThreads << (numThreads == 1 ? " thread: " : " threads: ") << pThreadRenderer->GetNumIrradianceRecords() << " records | "
+			<< (isSame ? "same image" : "IMAGES DIFFER") << '\n';
+	}
+
+	return isSameImage ? 0 : 1;
+}
+
+// Headless, the camera pans over a static scene, every frame is rendered with and without the visibility cache
+// RayTracer --visibility [scene] [--size N] [--frames N]
+int RunVisibilityBenchmark(int argc, char* args[])
+{
+	const std::string sceneName{ GetSceneArgument(argc, args, "W4_Reference") };
+	const std::unique_ptr<Scene> pScene{ Benchmark::LoadScene(sceneName) };
+	if (!pScene) return 1;
+
+	const int width{ static_cast<int>(GetOption(argc, args, "--size", 640)) };
+	const int height{ width * 3 / 4 };
+	const uint32_t numFrames{ std::max(GetOption(argc, args, "--frames", 10), 1u) };
+	const size_t numValues{ static_cast<size_t>(width * height * 3) };
+
+	// Every frame is traced completely, only the visibility cache may reuse anything
+	// Two renderers, switching the cache on and off in one would clear it every frame
+	const auto pTracingRenderer{ Benchmark::CreateRenderer(width, height) };
+	const auto pRenderer{ Benchmark::CreateRenderer(width, height) };
+	pRenderer->SetVisibilityCaching(true);
+
+	Camera& camera{ pScene->GetCamera() };
+	camera.CalculateCameraToWorld();
+	const Vector3 startOrigin{ camera.origin };
+	const Vector3 right{ camera.right };
+
+	std::vector<uint8_t> reference(numValues);
+	std::vector<uint8_t> pixels(numValues);
+	const auto render{ [&](Renderer* pFrameRenderer, uint32_t frame, std::vector<uint8_t>& result)
+		{
+			// A slow sideways pan, most of what the camera sees was already seen the frame before
+			camera.origin = startOrigin + right * (.05f * static_cast<float>(frame));
+
+			const float frameTime{ Benchmark::Measure([&]() { pFrameRenderer->Render(pScene.get()); }) };
+			pFrameRenderer->ReadRect(0, 0, width, height, result.data());
+			return frameTime;
+		} };
+
+	std::cout << sceneName << " at " << width << 'x' << height << ", " << numFrames << " frames\n";
+
+	uint64_t numLookups{ 0 };
+	uint64_t numHits{ 0 };
+	float cachedTime{ 0.f };
+	float tracedTime{ 0.f };
+	for (uint32_t frame{ 0 }; frame < numFrames; ++frame)
+	{
+		tracedTime += render(pTracingRenderer.get(), frame, reference);
+		cachedTime += render(pRenderer.get(), frame, pixels);
+
+		uint32_t numMismatchedPixels{ 0 };
+		for (size_t i{ 0 }; i < numValues; i += 3)
+		{
+			if (pixels[i] != reference[i] || pixels[i + 1] != reference[i + 1] || pixels[i + 2] != reference[i + 2]) ++numMismatchedPixels;
+		}
+
+		const uint32_t frameLookups{ pRenderer->GetNumVisibilityLookups() };
+		const uint32_t frameHits{ pRenderer->GetNumVisibilityHits() };
+		numLookups += frameLookups;
+		numHits += frameHits;
+
+		std::cout << "Frame " << frame << ": " << frameHits << " of " << frameLookups << " shadow rays from the cache ("
+			<< (frameLookups ? 100.f * static_cast<float>(frameHits) / static_cast<float>(frameLookups) : 0.f) << "%) | "
+			<< pRenderer->GetNumVisibilityCells() << " cells | " << numMismatchedPixels << " pixels differ\n";
+	}
+
+	std::cout << "Hit rate " << (numLookups ? 100.0 * static_cast<double>(numHits) / static_cast<double>(numLookups) : 0.0) << "% | " << numHits
+		<< " DoesHit calls saved | " << tracedTime / static_cast<float>(numFrames) << "ms/frame traced, " << cachedTime / static_cast<float>(numFrames) << "ms/frame cached\n";
+
+	return 0;
+}
+
+// Headless, primary rays against the whole scene and against the objects culled per tile
+// RayTracer --culling [scene] [--frames N]
+int RunCullingBenchmark(int argc, char* args[], uint32_t width, uint32_t height)
+{
+	const std::string sceneName{ GetSceneArgument(argc, args, "Resources/Scenes/spheres.scene") };
+	const std::unique_ptr<Scene> pScene{ Benchmark::LoadScene(sceneName) };
+	if (!pScene) return 1;
+
+	const uint32_t numFrames{ std::max(GetOption(argc, args, "--frames", 5), 1u) };
+	const size_t numValues{ static_cast<size_t>(width * height * 3) };
+
+	const auto pRenderer{ Benchmark::CreateRenderer(static_cast<int>(width), static_cast<int>(height)) };
+
+	std::vector<uint8_t> reference(numValues);
+	std::vector<uint8_t> pixels(numValues);
+	const auto render{ [&](bool isCulling, std::vector<uint8_t>& result)
+		{
+			pRenderer->SetFrustumCulling(isCulling);
+			pRenderer->Render(pScene.get());
+
+			const float frameTime{ Benchmark::MeasureMedian(numFrames, [&]() { pRenderer->Render(pScene.get()); }) };
+			pRenderer->ReadRect(0, 0, static_cast<int>(width), static_cast<int>(height), result.data());
+			return frameTime;
+		} };
+
+	const float fullTime{ render(false, reference) };
+	const float culledTime{ render(true, pixels) };
+
+	std::cout << sceneName << " at " << width << 'x' << height << ", median of " << numFrames << " frames\n"
+		<< "Whole scene: " << fullTime << "ms | " << pScene->GetNumObjects() << " objects per primary ray\n"
+		<< "Tile frustum culling: " << culledTime << "ms | " << pRenderer->GetAverageTileCandidates() << " objects per tile on average | "
+		<< (pixels == reference ? "same image" : "IMAGES DIFFER") << '\n';
+
+	return pixels == reference ? 0 : 1;
+}
+
+// Headless, builds BVHs over generated meshes with a growing number of threads
+// RayTracer --bvhbuild [--triangles N] [--runs N]
+int RunBVHBuildBenchmark(int argc, char* args[])
+{
+	const uint32_t numTriangles{ std::max(GetOption(argc, args, "--triangles", 1u << 21), 1u) };
+	const uint32_t numRuns{ std::max(GetOption(argc, args, "--runs", 3), 1u) };
+
+	// Evenly tessellated surface and a soup of differently sized triangles scattered through a box
+	TriangleMesh sphere{};
+	const int numRings{ std::max(static_cast<int>(std::sqrt(static_cast<float>(numTriangles) / 3.f)), 2) };
+	const int numSegments{ std::max(static_cast<int>(numTriangles) / (2 * numRings), 3) };
+	for (int ring{ 0 }; ring <= numRings; ++ring)
+	{
+		const float theta{ PI * static_cast<float>(ring) / static_cast<float>(numRings) };
+		for (int segment{ 0 }; segment <= numSegments; ++segment)
+		{
+			const float phi{ PI_2 * static_cast<float>(segment) / static_cast<float>(numSegments) };
+			sphere.positions.emplace_back(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+		}
+	}
+	for (int ring{ 0 }; ring < numRings; ++ring)
+	{
+		for (int segment{ 0 }; segment < numSegments; ++segment)
+		{
+			const int i0{ ring * (numSegments + 1) + segment };
+			sphere.indices.insert(sphere.indices.end(), { i0, i0 + 1, i0 + numSegments + 1, i0 + 1, i0 + numSegments + 2, i0 + numSegments + 1 });
+		}
+	}
+
+	TriangleMesh soup{};
+	std::mt19937 random{ 42 };
+	std::uniform_real_distribution<float> position{ -10.f, 10.f };
+	std::uniform_real_distribution<float> offset{ -1.f, 1.f };
+	std::exponential_distribution<float> size{ 8.f };
+	for (uint32_t i{ 0 }; i < numTriangles; ++i)
+	{
+		const Vector3 center{ position(random), position(random), position(random) };
+		const float triangleSize{ size(random) };
+		for (int v{ 0 }; v < 3; ++v)
+		{
+			soup.indices.push_back(static_cast<int>(soup.positions.size()));
+			soup.positions.push_back(center + Vector3{ offset(random), offset(random), offset(random) } * triangleSize);
+		}
+	}
+
+	// Triangles on top of each other, the heuristic can't separate any of them
+	TriangleMesh stacked{};
+	stacked.positions = { { 0.f, 0.f, 0.f }, { 1.f, 0.f, 0.f }, { 0.f, 1.f, 0.f } };
+	for (uint32_t i{ 0 }; i < std::max(numTriangles / 16, 1u); ++i)
+	{
+		stacked.indices.insert(stacked.indices.end(), { 0, 1, 2 });
+	}
+
+	std::cout << std::thread::hardware_concurrency() << " hardware threads, median of " << numRuns << " builds\n";
+
+	// Deepest leaf and largest leaf, both have to stay within what the traversal and the 4-wide layout can hold
+	const auto getShape{ [](const BVH& bvh)
+		{
+			std::pair<uint32_t, uint32_t> shape{};
+			std::vector<std::pair<uint32_t, uint32_t>> nodes{ { 0, 0 } };
+			while (!nodes.empty())
+			{
+				const auto [index, depth] { nodes.back() };
+				nodes.pop_back();
+
+				const BVHNode& node{ bvh.GetNodes()[index] };
+				if (node.triangleCount > 0)
+				{
+					shape.first = std::max(shape.first, depth);
+					shape.second = std::max(shape.second, node.triangleCount);
+					continue;
+				}
+				nodes.emplace_back(node.leftFirst, depth + 1);
+				nodes.emplace_back(node.leftFirst + 1, depth + 1);
+			}
+			return shape;
+		} };
+
+	bool isSameTree{ true };
+	const auto benchmark{ [&](const char* name, const TriangleMesh& mesh)
+		{
+			std::cout << name << ", " << mesh.indices.size() / 3 << " triangles\n";
+
+			BVH reference{};
+			float referenceTime{};
+			for (const uint32_t numThreads : { 1u, 2u, 4u, 8u, 16u })
+			{
+				const ConcurrencyLimit concurrencyLimit{ numThreads };
+
+				BVH bvh{};
+				const float buildTime{ Benchmark::MeasureMedian(numRuns, [&]() { bvh.Build(mesh.positions, mesh.indices, BVHLayout::Binary); }) };
+				if (numThreads == 1)
+				{
+					reference = bvh;
+					referenceTime = buildTime;
+				}
+				const bool isSame{ bvh.GetTriangleIndices() == reference.GetTriangleIndices() && bvh.GetNodes().size() == reference.GetNodes().size()
+					&& std::memcmp(bvh.GetNodes().data(), reference.GetNodes().data(), bvh.GetNodes().size() * sizeof(BVHNode)) == 0 };
+				const auto [depth, largestLeaf] { getShape(bvh) };
+				const bool isValid{ depth <= BVH::MaxDepth && largestLeaf <= BVH::MaxLeafSize };
+				isSameTree &= isSame && isValid;
+
+				std::cout << "  " << numThreads << (numThreads == 1 ? " thread: " : " threads: ") << buildTime << "ms | "
+					<< referenceTime / buildTime << "x | " << bvh.GetNodes().size() << " nodes | depth " << depth << " | leaves up to " << largestLeaf
+					<< (isSame ? "" : " | TREE DIFFERS") << (isValid ? "" : " | TOO DEEP OR LEAF TOO LARGE") << '\n';
+			}
+		} };
+
+	benchmark("Tessellated sphere", sphere);
+	benchmark("Triangle soup", soup);
+	benchmark("Stacked triangles", stacked);
+
+	return isSameTree ? 0 : 1;
+}
+
+// Headless, traces batches of random rays through a scene with the batch queries and one ray at a time
+// RayTracer --rayquery [scene] [--rays N] [--runs N]
+int RunRayQueryBenchmark(int argc, char* args[])
+{
+	const std::string sceneName{ GetSceneArgument(argc, args, "W4_Bunny") };
+	const std::unique_ptr<Scene> pScene{ Benchmark::LoadScene(sceneName) };
+	if (!pScene) return 1;
+
+	const uint32_t numRays{ std::max(GetOption(argc, args, "--rays", 1u << 20), 1u) };
+	const uint32_t numRuns{ std::max(GetOption(argc, args, "--runs", 3), 1u) };
+
+	pScene->BeginFrame();
+
+	// Rays start anywhere around the point the camera looks at, line of sight checks (any hit) end at most 8 units further
+	std::mt19937 random{ 42 };
+	std::uniform_real_distribution<float> offset{ -4.f, 4.f };
+	std::uniform_real_distribution<float> distance{ .1f, 8.f };
+	std::normal_distribution<float> gaussian{};
+	const Camera& camera{ pScene->GetCamera() };
+	const Vector3 center{ camera.origin + camera.forward * 8.f };
+	const auto randomPoint{ [&]() { return center + Vector3{ offset(random), offset(random), offset(random) }; } };
+	const auto randomDirection{ [&]() { return Vector3{ gaussian(random), gaussian(random), gaussian(random) }.Normalized(); } };
+
+	// Every ray on its own, or view cones: 64 rays from one point within 10 degrees of a random direction, like an agent looking around
+	constexpr uint32_t raysPerCone{ 64 };
+	const float coneSpread{ std::tan(10.f * TO_RADIANS) };
+	const auto generate{ [&](bool isCone, bool isLineOfSight)
+		{
+			std::vector<Ray> rays(numRays);
+			Vector3 origin{};
+			Vector3 axis{};
+			for (uint32_t i{ 0 }; i < numRays; ++i)
+			{
+				if (!isCone || i % raysPerCone == 0)
+				{
+					origin = randomPoint();
+					axis = randomDirection();
+				}
+
+				rays[i].origin = origin;
+				rays[i].direction = isCone ? (axis + randomDirection() * coneSpread * std::abs(gaussian(random)) * .5f).Normalized() : randomDirection();
+				if (isLineOfSight) rays[i].max = distance(random);
+				if (!isCone) origin = randomPoint();
+			}
+			return rays;
+		} };
+
+	// Alternates the two, so a machine that speeds up or slows down halfway affects both the same
+	const auto compare{ [numRays, numRuns](const char* name, const auto& single, const auto& batch)
+		{
+			std::vector<float> singleTimes{};
+			std::vector<float> batchTimes{};
+			for (uint32_t i{ 0 }; i < numRuns; ++i)
+			{
+				singleTimes.push_back(Benchmark::Measure(single));
+				batchTimes.push_back(Benchmark::Measure(batch));
+			}
+
+			const float singleTime{ Benchmark::GetMedian(std::move(singleTimes)) };
+			const float batchTime{ Benchmark::GetMedian(std::move(batchTimes)) };
+			std::cout << "  " << name << ": one ray at a time " << singleTime << "ms | batch " << batchTime << "ms | "
+				<< static_cast<float>(numRays) / (batchTime * 1000.f) << " Mrays/s | " << singleTime / batchTime << "x\n";
+		} };
+
+	std::cout << sceneName << ", " << numRays << " rays, " << std::thread::hardware_concurrency() << " hardware threads, median of " << numRuns << " runs\n";
+
+	// The single ray queries run on the same threads, the difference is the packets
+	uint32_t numMismatches{ 0 };
+	std::vector<HitRecord> singleHits(numRays);
+	std::vector<RayHit> batchHits(numRays);
+	std::vector<uint8_t> singleOccluded(numRays);
+	std::vector<uint8_t> batchOccluded(numRays);
+	for (const bool isCone : { false, true })
+	{
+		std::cout << (isCone ? "View cones\n" : "Random rays\n");
+
+		const std::vector<Ray> probes{ generate(isCone, false) };
+		compare("Closest hit", [&]()
+			{
+				concurrency::parallel_for(0u, numRays, [&](uint32_t i)
+					{
+						singleHits[i] = HitRecord{};
+						pScene->GetClosestHit(probes[i], singleHits[i]);
+					});
+			},
+			[&]() { pScene->GetClosestHits(probes, batchHits); });
+
+		for (uint32_t i{ 0 }; i < numRays; ++i)
+		{
+			const float singleT{ singleHits[i].didHit ? singleHits[i].t : FLT_MAX };
+			if (std::abs(singleT - batchHits[i].t) > 1e-4f * std::max(singleT, 1.f)) ++numMismatches;
+		}
+
+		const std::vector<Ray> lineOfSight{ generate(isCone, true) };
+		compare("Any hit", [&]()
+			{
+				concurrency::parallel_for(0u, numRays, [&](uint32_t i) { singleOccluded[i] = pScene->DoesHit(lineOfSight[i]); });
+			},
+			[&]() { pScene->DoesHit(lineOfSight, batchOccluded); });
+
+		for (uint32_t i{ 0 }; i < numRays; ++i)
+		{
+			if (singleOccluded[i] != batchOccluded[i]) ++numMismatches;
+		}
+	}
+
+	std::cout << (numMismatches == 0 ? "Same results" : "RESULTS DIFFER") << " | " << numMismatches << " mismatched rays\n";
+
+	return numMismatches == 0 ? 0 : 1;
+}
+
+// Headless, renders a scene with float meshes and a second copy of it with 16 bit positions and normals, the frames alternate between the two
+// RayTracer --compression [scene] [--frames N]
+int RunCompressionBenchmark(int argc, char* args[], uint32_t width, uint32_t height)
+{
+	const std::string sceneName{ GetSceneArgument(argc, args, "BVH_Dense") };
+	const std::unique_ptr<Scene> pScene{ Benchmark::LoadScene(sceneName) };
+	if (!pScene) return 1;
+
+	const std::unique_ptr<Scene> pCompressedScene{ Benchmark::LoadScene(sceneName) };
+	pCompressedScene->CompressMeshes();
+
+	const uint32_t numFrames{ std::max(GetOption(argc, args, "--frames", 5), 1u) };
+	const size_t numValues{ static_cast<size_t>(width * height * 3) };
+
+	const auto pRenderer{ Benchmark::CreateRenderer(static_cast<int>(width), static_cast<int>(height)) };
+
+	std::vector<uint8_t> reference(numValues);
+	std::vector<uint8_t> pixels(numValues);
+	pRenderer->Render(pScene.get());
+	pRenderer->ReadRect(0, 0, static_cast<int>(width), static_cast<int>(height), reference.data());
+	pRenderer->Render(pCompressedScene.get());
+	pRenderer->ReadRect(0, 0, static_cast<int>(width), static_cast<int>(height), pixels.data());
+
+	// Alternating, so both see the same noise from the rest of the machine
+	std::vector<float> frameTimes{};
+	std::vector<float> compressedFrameTimes{};
+	for (uint32_t frame{ 0 }; frame < numFrames; ++frame)
+	{
+		frameTimes.push_back(Benchmark::Measure([&]() { pRenderer->Render(pScene.get()); }));
+		compressedFrameTimes.push_back(Benchmark::Measure([&]() { pRenderer->Render(pCompressedScene.get()); }));
+	}
+	const float floatTime{ Benchmark::GetMedian(std::move(frameTimes)) };
+	const float compressedTime{ Benchmark::GetMedian(std::move(compressedFrameTimes)) };
+
+	// Quantized positions move the edges of triangles by a fraction of a pixel, only those pixels may change
+	int maxChannelError{};
+	uint32_t numChangedPixels{};
+	for (size_t i{ 0 }; i < numValues; i += 3)
+	{
+		int pixelError{};
+		for (size_t channel{ 0 }; channel < 3; ++channel)
+		{
+			pixelError = std::max(pixelError, std::abs(static_cast<int>(pixels[i + channel]) - static_cast<int>(reference[i + channel])));
+		}
+		maxChannelError = std::max(maxChannelError, pixelError);
+		if (pixelError > 2) ++numChangedPixels;
+	}
+
+	constexpr float toMB{ 1.f / (1024.f * 1024.f) };
+	std::cout << sceneName << " at " << width << 'x' << height << ", median of " << numFrames << " frames\n"
+		<< "Float meshes: " << floatTime << "ms | " << static_cast<float>(pScene->GetMeshMemoryUsage()) * toMB << "MB\n"
+		<< "Compressed meshes: " << compressedTime << "ms | " << static_cast<float>(pCompressedScene->GetMeshMemoryUsage()) * toMB << "MB\n"
+		<< "Largest channel difference " << maxChannelError << " | " << numChangedPixels << " pixels differ by more than 2\n";
+
+	return 0;
+}
+
+// Headless, renders a scene row by row and in Morton ordered tiles, with the binary and with the quantized BVH layout
+// Tiles are meant to keep the BVH nodes and triangles of neighbouring pixels in cache, this measures whether they beat rows on frame time
+// RayTracer --traversal [scene] [--frames N]
+int RunTraversalBenchmark(int argc, char* args[], uint32_t width, uint32_t height)
+{
+	const std::string sceneName{ GetSceneArgument(argc, args, "BVH_Dense") };
+	const std::unique_ptr<Scene> pScene{ Benchmark::LoadScene(sceneName) };
+	if (!pScene) return 1;
+
+	const uint32_t numFrames{ std::max(GetOption(argc, args, "--frames", 5), 1u) };
+	const size_t numValues{ static_cast<size_t>(width * height * 3) };
+
+	const auto pRenderer{ Benchmark::CreateRenderer(static_cast<int>(width), static_cast<int>(height)) };
+
+	std::vector<uint8_t> reference(numValues);
+	std::vector<uint8_t> pixels(numValues);
+	bool isSameImage{ true };
+	const auto measure{ [&](const char* layoutName)
+		{
+			pRenderer->SetScanlineTraversal(true);
+			pRenderer->Render(pScene.get());
+			pRenderer->ReadRect(0, 0, static_cast<int>(width), static_cast<int>(height), reference.data());
+			pRenderer->SetScanlineTraversal(false);
+			pRenderer->Render(pScene.get());
+			pRenderer->ReadRect(0, 0, static_cast<int>(width), static_cast<int>(height), pixels.data());
+			isSameImage = isSameImage && pixels == reference;
+
+			// Alternating, so both see the same noise from the rest of the machine
+			std::vector<float> scanlineFrameTimes{};
+			std::vector<float> mortonFrameTimes{};
+			for (uint32_t frame{ 0 }; frame < numFrames; ++frame)
+			{
+				pRenderer->SetScanlineTraversal(true);
+				scanlineFrameTimes.push_back(Benchmark::Measure([&]() { pRenderer->Render(pScene.get()); }));
+				pRenderer->SetScanlineTraversal(false);
+				mortonFrameTimes.push_back(Benchmark::Measure([&]() { pRenderer->Render(pScene.get()); }));
+			}
+			const float scanlineTime{ Benchmark::GetMedian(std::move(scanlineFrameTimes)) };
+			const float mortonTime{ Benchmark::GetMedian(std::move(mortonFrameTimes)) };
+
+			std::cout << layoutName << " BVH: scanline " << scanlineTime << "ms | Morton tiles " << mortonTime << "ms | "
+				<< scanlineTime / mortonTime << "x | " << (pixels == reference ? "same image" : "IMAGES DIFFER") << '\n';
+		} };
+
+	std::cout << sceneName << " at " << width << 'x' << height << ", median of " << numFrames << " frames\n";
+
+	// Scenes start out with the binary layout, the next one in the cycle is the quantized layout
+	measure("Binary");
+	pScene->CycleBVHLayout();
+	measure("Quantized");
+
+	return isSameImage ? 0 : 1;
+}
+
+// Headless, renders a scene with a growing number of threads, row by row and in tiles, writing pixels straight into the frame or through row and tile buffers,
+// and with pinned threads. Goes up to one thread per hardware thread, more only measures the OS switching between them
+// RayTracer --scaling [scene] [--threads N] [--frames N]
+int RunScalingBenchmark(int argc, char* args[], uint32_t width, uint32_t height)
+{
+	const std::string sceneName{ GetSceneArgument(argc, args, "W4_Reference") };
+	const std::unique_ptr<Scene> pScene{ Benchmark::LoadScene(sceneName) };
+	if (!pScene) return 1;
+
+	const uint32_t maxThreads{ std::max(GetOption(argc, args, "--threads", std::thread::hardware_concurrency()), 1u) };
+	const uint32_t numFrames{ std::max(GetOption(argc, args, "--frames", 5), 1u) };
+	const size_t numValues{ static_cast<size_t>(width * height * 3) };
+
+	std::vector<uint8_t> reference(numValues);
+	{
+		const auto pRenderer{ Benchmark::CreateRenderer(static_cast<int>(width), static_cast<int>(height)) };
+		pRenderer->Render(pScene.get());
+		pRenderer->ReadRect(0, 0, static_cast<int>(width), static_cast<int>(height), reference.data());
+	}
+
+	std::cout << sceneName << " at " << width << 'x' << height << ", median of " << numFrames << " frames, " << std::thread::hardware_concurrency() << " hardware threads\n";
+
+	bool isSameImage{ true };
+	std::vector<uint8_t> pixels(numValues);
+	const bool wasPinned{ IsThreadPinning() };
+	const auto benchmark{ [&](const char* name, bool isScanline, bool isTileBuffered, bool isPinned)
+		{
+			std::cout << name << '\n';
+			SetThreadPinning(isPinned);
+
+			// A new frame buffer, its rows are first touched by the threads of this mode
+			const auto pRenderer{ Benchmark::CreateRenderer(static_cast<int>(width), static_cast<int>(height)) };
+			pRenderer->SetScanlineTraversal(isScanline);
+			pRenderer->SetTileBuffers(isTileBuffered);
+
+			float singleThreadTime{};
+			for (uint32_t numThreads{ 1 }; numThreads <= maxThreads; numThreads *= 2)
+			{
+				const ConcurrencyLimit concurrencyLimit{ numThreads };
+
+				pRenderer->Render(pScene.get());
+				const float frameTime{ Benchmark::MeasureMedian(numFrames, [&]() { pRenderer->Render(pScene.get()); }) };
+				if (numThreads == 1) singleThreadTime = frameTime;
+
+				pRenderer->ReadRect(0, 0, static_cast<int>(width), static_cast<int>(height), pixels.data());
+				const bool isSame{ pixels == reference };
+				isSameImage &= isSame;
+
+				// Efficiency is the speedup over one thread divided by the number of threads, 100% is perfect scaling
+				const float speedup{ singleThreadTime / frameTime };
+				std::cout << "  " << numThreads << (numThreads == 1 ? " thread: " : " threads: ") << frameTime << "ms | speedup " << speedup
+					<< " | efficiency " << speedup / static_cast<float>(numThreads) * 100.f << '%' << (isSame ? "" : " | IMAGE DIFFERS") << '\n';
+			}
+		} };
+
+	// Neighbouring pixels of a scanline frame go to different threads, the only mode where threads write into the same cache lines
+	benchmark("Scanline, pixels written into the frame", true, false, false);
+	benchmark("Scanline, row buffers", true, true, false);
+	benchmark("Tiles, pixels written into the frame", false, false, false);
+	benchmark("Tiles, tile buffers", false, true, false);
+	benchmark("Tiles, tile buffers, pinned threads", false, true, true);
+	SetThreadPinning(wasPinned);
+
+	return isSameImage ? 0 : 1;
+}
+
+int main(int argc, char* args[])
+{
 	constexpr uint32_t width{ 640 };
 	constexpr uint32_t height{ 480 };
 
+	// RayTracer [mode] ... --pin, the worker threads of every mode stay on their own core (P toggles it in the window)
+	if (std::any_of(args + 1, args + argc, [](const char* arg) { return std::strcmp(arg, "--pin") == 0; }))
+		SetThreadPinning(true);
+
+	// RayTracer --worker <host>:<port>
+	if (argc > 2 && std::strcmp(args[1], "--worker") == 0)
+	{
+		const std::string address{ args[2] };
+		const size_t separator{ address.find_last_of(':') };
+		if (separator == std::string::npos) return 1;
+
+		return RenderWorker::Run(address.substr(0, separator), static_cast<uint16_t>(std::stoul(address.substr(separator + 1))));
+	}
+
+	if (argc > 1 && std::strcmp(args[1], "--coordinator") == 0)
+		return RunCoordinator(argc, args, width, height);
+
+	if (argc > 1 && std::strcmp(args[1], "--regression") == 0)
+		return RunRegression(argc, args, width, height);
+
+	if (argc > 1 && std::strcmp(args[1], "--raysort") == 0)
+		return RunRaySortBenchmark(argc, args, width, height);
+
+	if (argc > 1 && std::strcmp(args[1], "--sampling") == 0)
+		return RunSamplingBenchmark(argc, args);
+
+	if (argc > 1 && std::strcmp(args[1], "--irradiance") == 0)
+		return RunIrradianceBenchmark(argc, args);
+
+	if (argc > 1 && std::strcmp(args[1], "--visibility") == 0)
+		return RunVisibilityBenchmark(argc, args);
+
+	if (argc > 1 && std::strcmp(args[1], "--culling") == 0)
+		return RunCullingBenchmark(argc, args, width, height);
+
+	if (argc > 1 && std::strcmp(args[1], "--bvhbuild") == 0)
+		return RunBVHBuildBenchmark(argc, args);
+
+	if (argc > 1 && std::strcmp(args[1], "--rayquery") == 0)
+		return RunRayQueryBenchmark(argc, args);
+
+	if (argc > 1 && std::strcmp(args[1], "--compression") == 0)
+		return RunCompressionBenchmark(argc, args, width, height);
+
+	if (argc > 1 && std::strcmp(args[1], "--animation") == 0)
+		return RunAnimation(argc, args, width, height);
+
+	if (argc > 1 && std::strcmp(args[1], "--traversal") == 0)
+		return RunTraversalBenchmark(argc, args, width, height);
+
+	if (argc > 1 && std::strcmp(args[1], "--scaling") == 0)
+		return RunScalingBenchmark(argc, args, width, height);
+
+	//Create window + surfaces
+	SDL_Init(SDL_INIT_VIDEO);
+
 	SDL_Window* pWindow = SDL_CreateWindow(
 		"RayTracer - **Lucas Kinoo (2DAE15)**",
 		SDL_WINDOWPOS_UNDEFINED,
@@ -52,9 +906,21 @@ int main(int argc, char* args[])
 	//const auto pScene{ new Scene_W4_TestScene() };
 
 	//const auto pScene{ new Scene_W4_BunnyScene() };
-	const auto pScene{ new Scene_W4_ReferenceScene() };
+	//const auto pScene{ new Scene_BVH_DenseScene() };
+	//const auto pScene{ new Scene_W4_ReferenceScene() };
 
-	pScene->Initialize();
+	// RayTracer --scene <registered name or .scene file> [--compress]
+	Scene* pScene{ argc > 2 && std::strcmp(args[1], "--scene") == 0 ? Scene::Create(args[2]) : new Scene_W4_ReferenceScene() };
+	if (!pScene)
+	{
+		std::cout << "Unknown scene " << args[2] << '\n';
+		ShutDown(pWindow);
+		return 1;
+	}
+
+	pScene->InitializeFromSnapshot();
+	if (std::any_of(args + 1, args + argc, [](const char* arg) { return std::strcmp(arg, "--compress") == 0; }))
+		pScene->CompressMeshes();
 
 	//Start loop
 	pTimer->Start();
@@ -75,12 +941,36 @@ int main(int argc, char* args[])
 			case SDL_KEYUP:
 				if (e.key.keysym.scancode == SDL_SCANCODE_X)
 					takeScreenshot = true;
+				if (e.key.keysym.scancode == SDL_SCANCODE_G)
+					pRenderer->CycleIndirectLighting();
+				if (e.key.keysym.scancode == SDL_SCANCODE_V)
+					pRenderer->ToggleVisibilityCache();
+				if (e.key.keysym.scancode == SDL_SCANCODE_C)
+					pRenderer->ToggleFrustumCulling();
+				if (e.key.keysym.scancode == SDL_SCANCODE_P)
+					pRenderer->ToggleThreadPinning();
 				if (e.key.keysym.scancode == SDL_SCANCODE_F2)
 					pRenderer->ToggleShadows();
 				if (e.key.keysym.scancode == SDL_SCANCODE_F3)
 					pRenderer->CycleLightingMode();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F4)
+					pRenderer->CyclePixelTraversal();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F5)
+					pScene->CycleBVHLayout();
 				if (e.key.keysym.scancode == SDL_SCANCODE_F6)
 					pTimer->StartBenchmark();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F7)
+					pRenderer->ToggleFastMath();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F8)
+					pRenderer->ReportFastMathError(pScene);
+				if (e.key.keysym.scancode == SDL_SCANCODE_F9)
+					pRenderer->ToggleIncrementalRendering();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F10)
+					pRenderer->ToggleDirtyRegionOverlay();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F11)
+					pRenderer->ToggleRaySorting();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F12)
+					pRenderer->CycleSamplesPerPixel();
 				break;
 			default:
 				break;
@@ -99,16 +989,29 @@ int main(int argc, char* args[])
 		if (printTimer >= 1.f)
 		{
 			printTimer = .0f;
-			std::cout << "dFPS: " << pTimer->GetdFPS() << '\n';
+			std::cout << "dFPS: " << pTimer->GetdFPS() << " | primary rays/s: " << static_cast<float>(width * height) * pTimer->GetdFPS()
+				<< " | re-traced pixels: " << pRenderer->GetTracedPixelFraction() * 100.f << "%\n";
+
+			const uint32_t numVisibilityLookups{ pRenderer->GetNumVisibilityLookups() };
+			if (numVisibilityLookups > 0)
+			{
+				std::cout << "Visibility cache (last frame): " << 100.f * static_cast<float>(pRenderer->GetNumVisibilityHits()) / static_cast<float>(numVisibilityLookups)
+					<< "% hits | " << pRenderer->GetNumVisibilityHits() << " DoesHit calls saved | " << pRenderer->GetNumVisibilityCells() << " cells\n";
+			}
+
+			if (pScene->HasStreamedMeshes())
+			{
+				const StreamingStatistics& streaming{ pScene->GetStreamingStatistics() };
+				std::cout << "Streaming (last frame): " << streaming.numPageIns << " page-ins | " << static_cast<float>(streaming.pagedInBytes) / 1024.f << "KB paged in | "
+					<< streaming.numEvictions << " evictions | " << streaming.numResidentClusters << " clusters resident ("
+					<< static_cast<float>(streaming.residentBytes) / 1024.f << "KB)\n";
+			}
 		}
 
-		//Save screenshot after full render
+		//Save screenshot after full render, the BMP is written on the present thread
 		if (takeScreenshot)
 		{
-			if (!pRenderer->SaveBufferToImage())
-				std::cout << "Screenshot saved!\n";
-			else
-				std::cout << "Something went wrong. Screenshot not saved!\n";
+			pRenderer->RequestScreenshot();
 			takeScreenshot = false;
 		}
 	}